@@ -1,10 +1,49 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
 #include <memory>
 #include <span>
 
 namespace ui
 {
+	// counts latencies in fixed width buckets. The last bucket also collects every latency too large for the others
+	struct LatencyHistogram
+	{
+		// width of each bucket in seconds
+		static constexpr double bucket_width = 0.005;
+
+		std::array<uint32_t, 20> buckets{};
+
+		void record(double seconds) noexcept;
+
+		[[nodiscard]] uint64_t count() const noexcept;
+
+		// returns the upper bound of the bucket containing the given percentile (0.0 - 1.0) of recorded latencies
+		[[nodiscard]] double percentile(double p) const noexcept;
+	};
+
+	struct AudioStats
+	{
+		// sample rate and channel count the device was actually opened with
+		int frequency = 0;
+		int channels = 0;
+
+		// total number of calls to queue_audio and the number of samples they queued
+		uint64_t buffers_queued = 0;
+		uint64_t samples_queued = 0;
+
+		// number of times audio was queued after the device ran dry
+		uint64_t underruns = 0;
+
+		// samples waiting in the device queue and how long they will take to play
+		uint32_t queued_samples = 0;
+		double queued_latency = 0.0;
+
+		// the queued latency sampled every time audio is queued
+		LatencyHistogram latency;
+	};
+
 	class AudioDevice final
 	{
 	public:
@@ -16,6 +55,9 @@ namespace ui
 
 		void queue_audio(std::span<float> samples) noexcept;
 
+		// returns counters for the audio queued so far along with the current state of the device queue
+		[[nodiscard]] AudioStats stats() const noexcept;
+
 	private:
 		class AudioCore;
 		std::unique_ptr<AudioCore> core;
@@ -3,6 +3,7 @@
 #include <algorithm>
 #include <cmath>
 #include <numbers>
+#include <numeric>
 
 #include <SDL2/SDL_audio.h>
 
@@ -42,21 +43,86 @@ namespace ui
 			SDL_PauseAudioDevice(device, value);
 		}
 
-		void queue_audio(std::span<float> samples) const noexcept
+		void queue_audio(std::span<float> samples) noexcept
 		{
 			auto sample_size = size(samples) * sizeof(samples[0]);
 			CHECK(std::in_range<Uint32>(sample_size), "too many samples in buffer, truncating");
 
+			// anything still in the queue is latency the new samples will have to wait through
+			auto queued = queued_samples();
+			if (audio_stats.buffers_queued > 0 && queued == 0)
+				++audio_stats.underruns;
+
+			audio_stats.latency.record(to_seconds(queued));
+			++audio_stats.buffers_queued;
+			audio_stats.samples_queued += size(samples) / std::max(spec.channels, Uint8(1));
+
 			if (auto result = SDL_QueueAudio(device, data(samples), static_cast<Uint32>(sample_size));
 				result != 0)
 				LOG_ERROR("Problem queuing audio: {}", SDL_GetError());
 		}
 
+		AudioStats stats() const noexcept
+		{
+			auto result = audio_stats;
+			result.frequency = spec.freq;
+			result.channels = spec.channels;
+			result.queued_samples = queued_samples();
+			result.queued_latency = to_seconds(result.queued_samples);
+			return result;
+		}
+
 	private:
 		SDL_AudioSpec spec{};
 		SDL_AudioDeviceID device{};
+		AudioStats audio_stats;
+
+		// number of samples per channel waiting to be played
+		uint32_t queued_samples() const noexcept
+		{
+			auto frame_size = std::max(SDL_AUDIO_BITSIZE(spec.format) / 8 * spec.channels, 1);
+			return SDL_GetQueuedAudioSize(device) / Uint32(frame_size);
+		}
+
+		double to_seconds(uint32_t samples) const noexcept
+		{
+			if (spec.freq <= 0)
+				return 0.0;
+
+			return double(samples) / spec.freq;
+		}
 	};
 
+	void LatencyHistogram::record(double seconds) noexcept
+	{
+		auto bucket = std::min(size_t(std::max(seconds, 0.0) / bucket_width), buckets.size() - 1);
+		++buckets[bucket];
+	}
+
+	uint64_t LatencyHistogram::count() const noexcept
+	{
+		return std::accumulate(begin(buckets), end(buckets), uint64_t{0});
+	}
+
+	double LatencyHistogram::percentile(double p) const noexcept
+	{
+		auto total = count();
+		if (total == 0)
+			return 0.0;
+
+		auto target = uint64_t(std::ceil(std::clamp(p, 0.0, 1.0) * double(total)));
+		uint64_t running = 0;
+
+		for (size_t i = 0; i < buckets.size(); ++i)
+		{
+			running += buckets[i];
+			if (running >= target)
+				return double(i + 1) * bucket_width;
+		}
+
+		return double(buckets.size()) * bucket_width;
+	}
+
 	AudioDevice AudioDevice::create(int frequency, int channels, int sample_size) noexcept
 	{
 		CHECK(std::in_range<Uint8>(channels), "Too many channels, truncating");
@@ -96,6 +162,14 @@ namespace ui
 		core->queue_audio(samples);
 	}
 
+	AudioStats AudioDevice::stats() const noexcept
+	{
+		if (!core)
+			return {};
+
+		return core->stats();
+	}
+
 	AudioDevice::AudioDevice(std::unique_ptr<AudioCore> &&core) noexcept
 		: core(std::move(core))
 	{
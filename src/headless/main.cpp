@@ -0,0 +1,682 @@
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <expected>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <fmt/format.h>
+#include <fmt/ranges.h>
+#include <fmt/std.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+
+#include <nes.hpp>
+#include <nes_audio_capture.hpp>
+#include <nes_cartridge.hpp>
+#include <nes_debug_server.hpp>
+#include <nes_library.hpp>
+#include <nes_movie.hpp>
+#include <nes_state_hash.hpp>
+
+#include "../main/color_palette.hpp"
+
+namespace io
+{
+	using fmt::format;
+	using fmt::print;
+	using fmt::println;
+}
+
+constexpr int screen_width = 256;
+constexpr int screen_height = 240;
+
+struct Options
+{
+	std::string exe{};
+	std::filesystem::path rom_filename{};
+	std::optional<std::filesystem::path> movie_filename{};
+	std::optional<nesem::U64> frames{};
+	std::filesystem::path output_dir{"."};
+	std::optional<std::filesystem::path> palette_filename{};
+	std::optional<std::filesystem::path> debug_socket{};
+	std::optional<std::filesystem::path> library_filename{};
+	std::vector<std::filesystem::path> scan_dirs{};
+	nesem::NesLibraryQuery query{};
+	bool frame_hashes{};
+	bool screenshot{};
+	bool audio{};
+	bool timing{};
+	bool verbose{};
+	bool show_help{};
+};
+
+std::expected<Options, std::string> parse_command_line(std::span<char *> args)
+{
+	auto it = args.begin();
+	const auto end = args.end();
+
+	Options result;
+
+	auto next_arg = [&](std::string_view arg) -> std::expected<std::string_view, std::string> {
+		if (++it == end)
+			return std::unexpected(io::format("'{}' specified, but no argument given", arg));
+
+		return std::string_view{*it};
+	};
+
+	// skip the first argument (should be the program name)
+	while (++it != end)
+	{
+		auto arg = std::string_view{*it};
+
+		if (!arg.starts_with('-'))
+		{
+			if (result.rom_filename.empty())
+				result.rom_filename = arg;
+			else
+				return std::unexpected(io::format("rom '{}', but was already set to '{}'", arg, result.rom_filename));
+		}
+		else if (arg == "--help" || arg == "-h" || arg == "-?")
+		{
+			result.show_help = true;
+		}
+		else if (arg == "--frames" || arg == "-f")
+		{
+			auto value = next_arg(arg);
+			if (!value)
+				return std::unexpected(value.error());
+
+			nesem::U64 frames = 0;
+			auto [ptr, ec] = std::from_chars(value->data(), value->data() + value->size(), frames);
+			if (ec != std::errc{} || ptr != value->data() + value->size())
+				return std::unexpected(io::format("'{}' is not a frame count", *value));
+
+			result.frames = frames;
+		}
+		else if (arg == "--movie" || arg == "-m")
+		{
+			auto value = next_arg(arg);
+			if (!value)
+				return std::unexpected(value.error());
+
+			result.movie_filename = *value;
+		}
+		else if (arg == "--out" || arg == "-o")
+		{
+			auto value = next_arg(arg);
+			if (!value)
+				return std::unexpected(value.error());
+
+			result.output_dir = *value;
+		}
+		else if (arg == "--palette" || arg == "-p")
+		{
+			auto value = next_arg(arg);
+			if (!value)
+				return std::unexpected(value.error());
+
+			result.palette_filename = *value;
+		}
+		else if (arg == "--debug-socket")
+		{
+			auto value = next_arg(arg);
+			if (!value)
+				return std::unexpected(value.error());
+
+			result.debug_socket = *value;
+		}
+		else if (arg == "--library" || arg == "-l")
+		{
+			auto value = next_arg(arg);
+			if (!value)
+				return std::unexpected(value.error());
+
+			result.library_filename = *value;
+		}
+		else if (arg == "--scan")
+		{
+			auto value = next_arg(arg);
+			if (!value)
+				return std::unexpected(value.error());
+
+			result.scan_dirs.emplace_back(*value);
+		}
+		else if (arg == "--mapper" || arg == "--region")
+		{
+			auto value = next_arg(arg);
+			if (!value)
+				return std::unexpected(value.error());
+
+			int number = 0;
+			auto [ptr, ec] = std::from_chars(value->data(), value->data() + value->size(), number);
+			if (ec != std::errc{} || ptr != value->data() + value->size())
+				return std::unexpected(io::format("'{}' is not a number", *value));
+
+			(arg == "--mapper" ? result.query.mapper : result.query.region) = number;
+		}
+		else if (arg == "--title")
+		{
+			auto value = next_arg(arg);
+			if (!value)
+				return std::unexpected(value.error());
+
+			result.query.title = *value;
+		}
+		else if (arg == "--battery")
+		{
+			result.query.battery = true;
+		}
+		else if (arg == "--hashes")
+		{
+			result.frame_hashes = true;
+		}
+		else if (arg == "--screenshot")
+		{
+			result.screenshot = true;
+		}
+		else if (arg == "--audio")
+		{
+			result.audio = true;
+		}
+		else if (arg == "--timing")
+		{
+			result.timing = true;
+		}
+		else if (arg == "--verbose" || arg == "-v")
+		{
+			result.verbose = true;
+		}
+		else
+			return std::unexpected(io::format("unknown option '{}'", arg));
+	}
+
+	return result;
+}
+
+void print_help(std::string_view app)
+{
+	io::println("USAGE: {} [ops] <rom filename>", app);
+	io::println("       {} [ops] --library <file> [filters]", app);
+	io::println("       {} --library <file> --scan <dir>...", app);
+	io::println("Runs a rom without a display as fast as possible and prints a json report, also saved to the output directory");
+	io::println("With a library, runs every rom in it matching the filters in turn, reporting on each in a directory of its own");
+	io::println("and printing the reports as one json array");
+	io::println("OPTIONS:");
+	io::println("--help,-h,-?         - print this help");
+	io::println("--frames,-f  <count> - number of frames to run, default 600, or the length of the movie");
+	io::println("--movie,-m   <file>  - play back a movie recorded for the rom");
+	io::println("--out,-o     <dir>   - directory for the report, screenshot and audio, default current directory");
+	io::println("--palette,-p <file>  - .pal file used for the screenshot");
+	io::println("--debug-socket <path> - wait for a debugger on a unix socket at path and let it control the run");
+	io::println("--library,-l <file>  - pick the roms to run from a library made by --scan");
+	io::println("--scan       <dir>   - find the roms below dir, and any other dirs given, and save them as the library");
+	io::println("--mapper     <n>     - only run library roms using mapper n");
+	io::println("--region     <n>     - only run library roms for region n, 0 NTSC, 1 PAL, 2 multi, 3 Dendy");
+	io::println("--title      <text>  - only run library roms with text in their name");
+	io::println("--battery            - only run library roms with battery backed ram");
+	io::println("--hashes             - report the state and framebuffer hash of every frame");
+	io::println("--screenshot         - save the last frame as a .ppm image");
+	io::println("--audio              - save the audio as a .wav file");
+	io::println("--timing             - report how long the run took");
+	io::println("--verbose,-v         - log to stderr while running");
+}
+
+void print_error(std::string_view msg)
+{
+	io::println(stderr, "{}", msg);
+}
+
+// quote and escape text for a json string
+std::string json_string(std::string_view text)
+{
+	std::string result = "\"";
+
+	for (char c : text)
+	{
+		switch (c)
+		{
+		case '"':
+			result += "\\\"";
+			break;
+		case '\\':
+			result += "\\\\";
+			break;
+		case '\n':
+			result += "\\n";
+			break;
+		case '\r':
+			result += "\\r";
+			break;
+		case '\t':
+			result += "\\t";
+			break;
+		default:
+			if (static_cast<unsigned char>(c) < 0x20)
+				result += io::format("\\u{:04x}", static_cast<unsigned char>(c));
+			else
+				result += c;
+		}
+	}
+
+	result += '"';
+	return result;
+}
+
+std::string json_path(const std::filesystem::path &path)
+{
+	return json_string(path.generic_string());
+}
+
+struct FrameHash
+{
+	nesem::U64 state;
+	nesem::U64 framebuffer;
+};
+
+struct Report
+{
+	std::filesystem::path rom;
+	std::optional<std::filesystem::path> movie;
+	std::string sha1;
+	int mapper = -1;
+	std::vector<std::string> errors;
+
+	nesem::U64 frames = 0;
+	nesem::U64 state_hash = 0;
+	std::vector<FrameHash> frame_hashes;
+
+	std::optional<std::filesystem::path> screenshot;
+	std::optional<std::filesystem::path> audio;
+	nesem::U64 audio_samples = 0;
+
+	std::optional<double> wall_seconds;
+	double emulated_seconds = 0.0;
+};
+
+std::string to_json(const Report &report)
+{
+	std::string json = "{\n";
+
+	json += io::format("\t\"rom\": {},\n", json_path(report.rom));
+
+	if (report.movie)
+		json += io::format("\t\"movie\": {},\n", json_path(*report.movie));
+
+	json += io::format("\t\"sha1\": {},\n", json_string(report.sha1));
+	json += io::format("\t\"mapper\": {},\n", report.mapper);
+	json += io::format("\t\"success\": {},\n", report.errors.empty());
+
+	std::vector<std::string> errors;
+	for (const auto &error : report.errors)
+		errors.push_back(json_string(error));
+
+	json += io::format("\t\"errors\": [{}],\n", fmt::join(errors, ", "));
+	json += io::format("\t\"frames\": {},\n", report.frames);
+	json += io::format("\t\"state_hash\": \"{:016x}\"", report.state_hash);
+
+	if (!report.frame_hashes.empty())
+	{
+		json += ",\n\t\"frame_hashes\": [\n";
+
+		for (size_t i = 0; i < report.frame_hashes.size(); ++i)
+		{
+			const auto &hash = report.frame_hashes[i];
+			json += io::format("\t\t{{\"state\": \"{:016x}\", \"framebuffer\": \"{:016x}\"}}{}\n", hash.state, hash.framebuffer, i + 1 < report.frame_hashes.size() ? "," : "");
+		}
+
+		json += "\t]";
+	}
+
+	if (report.screenshot)
+		json += io::format(",\n\t\"screenshot\": {}", json_path(*report.screenshot));
+
+	if (report.audio)
+	{
+		json += io::format(",\n\t\"audio\": {}", json_path(*report.audio));
+		json += io::format(",\n\t\"audio_samples\": {}", report.audio_samples);
+	}
+
+	if (report.wall_seconds)
+	{
+		auto wall = *report.wall_seconds;
+		auto fps = wall > 0.0 ? static_cast<double>(report.frames) / wall : 0.0;
+		auto speed = wall > 0.0 ? report.emulated_seconds / wall : 0.0;
+
+		json += io::format(",\n\t\"timing\": {{\"wall_seconds\": {:.6f}, \"emulated_seconds\": {:.6f}, \"fps\": {:.2f}, \"speed\": {:.2f}}}", wall, report.emulated_seconds, fps, speed);
+	}
+
+	json += "\n}";
+	return json;
+}
+
+bool write_screenshot(const std::filesystem::path &filename, std::span<const nesem::U16> screen, const app::ColorPalette &palette)
+{
+	auto file = std::ofstream(filename, std::ios::binary | std::ios::trunc);
+	if (!file)
+		return false;
+
+	// binary ppm, about the simplest image format there is
+	file << io::format("P6\n{} {}\n255\n", screen_width, screen_height);
+
+	auto pixels = std::vector<char>();
+	pixels.reserve(screen.size() * 3);
+
+	for (auto color_index : screen)
+	{
+		auto color = palette.color_at_index(color_index);
+		pixels.push_back(static_cast<char>(color.r));
+		pixels.push_back(static_cast<char>(color.g));
+		pixels.push_back(static_cast<char>(color.b));
+	}
+
+	file.write(pixels.data(), static_cast<std::streamsize>(pixels.size()));
+	return file.good();
+}
+
+// run a rom and save its report to the output directory, leaving printing it to the caller
+Report run_rom(const Options &options)
+{
+	namespace fs = std::filesystem;
+	using namespace nesem;
+
+	Report report{.rom = options.rom_filename, .movie = options.movie_filename};
+
+	auto finish = [&] {
+		auto report_file = std::ofstream(options.output_dir / options.rom_filename.stem().concat(".json"), std::ios::trunc);
+		report_file << to_json(report) << '\n';
+
+		return report;
+	};
+
+	std::error_code ec;
+	fs::create_directories(options.output_dir, ec);
+	if (ec)
+	{
+		report.errors.push_back(io::format("could not create output directory: {}", ec.message()));
+		return finish();
+	}
+
+	auto palette = app::ColorPalette::default_palette();
+	if (options.palette_filename)
+	{
+		if (auto loaded = app::ColorPalette::from_file(*options.palette_filename))
+			palette = std::move(*loaded);
+		else
+			report.errors.push_back(io::format("could not load palette {}", *options.palette_filename));
+	}
+
+	std::optional<NesMoviePlayer> player;
+	if (options.movie_filename)
+	{
+		if (auto movie = NesMovie::load(*options.movie_filename))
+			player.emplace(std::move(*movie));
+		else
+			report.errors.push_back(io::format("could not load movie {}", *options.movie_filename));
+	}
+
+	if (player && options.debug_socket)
+		report.errors.push_back("a movie can't be played with a debugger attached");
+
+	if (!report.errors.empty())
+		return finish();
+
+	NesAudioCapture capture;
+	U32 sample_rate = 44100;
+
+	if (options.audio)
+	{
+		auto filename = options.output_dir / options.rom_filename.stem().concat(".wav");
+		capture = NesAudioCapture::create(filename, sample_rate, NesAudioFormat::wav_float);
+
+		if (capture)
+			report.audio = filename;
+		else
+			report.errors.push_back(io::format("could not create {}", filename));
+	}
+
+	auto screen = std::vector<U16>(screen_width * screen_height);
+
+	auto nes = std::make_unique<Nes>(NesSettings{
+		.error = [&](std::string_view message) { report.errors.emplace_back(message); },
+		.draw = [&](int x, int y, U8 color_index, util::Flags<NesColorEmphasis> emphasis) { screen[size_t(y * screen_width + x)] = app::to_color_index(color_index, emphasis); },
+		.audio = [&](float sample) { capture.push(sample); },
+		.sample_rate = sample_rate,
+		.player1 = std::make_unique<NesController>([&] { return player ? player->poll(0) : U8{0}; }),
+		.player2 = std::make_unique<NesController>([&] { return player ? player->poll(1) : U8{0}; }),
+	});
+
+	if (!nes->load_rom(options.rom_filename))
+	{
+		report.errors.push_back(io::format("could not load rom {}", options.rom_filename));
+		return finish();
+	}
+
+	report.sha1 = nes->cartridge()->rom().sha1;
+	report.mapper = mappers::rom_mapper(nes->cartridge()->rom());
+
+	if (player && !player->start(*nes))
+	{
+		report.errors.push_back(io::format("movie {} was not recorded with this rom", *options.movie_filename));
+		return finish();
+	}
+
+	nes->enable_audio(options.audio);
+
+	NesDebugServer debugger;
+	if (options.debug_socket)
+	{
+		debugger = NesDebugServer::create(*options.debug_socket, true);
+		if (!debugger)
+		{
+			report.errors.push_back(io::format("could not listen on {}", *options.debug_socket));
+			return finish();
+		}
+
+		spdlog::info("Waiting for a debugger on {}", *options.debug_socket);
+		while (!debugger.attached())
+			debugger.wait(std::chrono::milliseconds(100));
+	}
+
+	auto frame_limit = options.frames.value_or(player ? std::numeric_limits<U64>::max() : 600);
+	auto start_tick = nes->clock().current_tick();
+	auto start_time = std::chrono::steady_clock::now();
+
+	while (report.frames < frame_limit && report.errors.empty())
+	{
+		auto last_frame = report.frames + 1 == frame_limit || (player && player->current_frame() + 1 >= player->movie().frame_count());
+
+		// drawing is only needed for frames that are looked at
+		nes->enable_video(options.frame_hashes || (options.screenshot && last_frame));
+
+		if (player)
+		{
+			if (!player->run_frame())
+				break;
+		}
+		else if (debugger.attached())
+		{
+			// frames spent halted don't count towards the limit
+			if (!debugger.run_frame(*nes))
+			{
+				debugger.wait(std::chrono::milliseconds(16));
+				continue;
+			}
+		}
+		else
+			nes->step(NesClockStep::OneFrame);
+
+		++report.frames;
+
+		if (options.frame_hashes)
+			report.frame_hashes.push_back({.state = nes->state_hash(), .framebuffer = state_hash::hash_bytes(std::as_bytes(std::span(screen)))});
+	}
+
+	if (options.timing)
+		report.wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+
+	auto ticks = nes->clock().current_tick() - start_tick;
+	report.emulated_seconds = std::chrono::duration<double>(nes->clock().rate().frequency * ticks).count();
+	report.state_hash = nes->state_hash();
+
+	if (options.audio)
+	{
+		report.audio_samples = capture.sample_count();
+		capture.close();
+	}
+
+	if (options.screenshot)
+	{
+		auto filename = options.output_dir / options.rom_filename.stem().concat(".ppm");
+
+		if (write_screenshot(filename, screen, palette))
+			report.screenshot = filename;
+		else
+			report.errors.push_back(io::format("could not write {}", filename));
+	}
+
+	return finish();
+}
+
+int run(const Options &options)
+{
+	auto report = run_rom(options);
+	io::println("{}", to_json(report));
+
+	return report.errors.empty() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int scan(const Options &options)
+{
+	// the rom hash cache lives next to the library, so rescanning only hashes roms that changed
+	auto library = nesem::NesLibrary::scan({
+		.directories = options.scan_dirs,
+		.cache_dir = std::filesystem::absolute(*options.library_filename).parent_path(),
+	});
+
+	auto saved = library.save(*options.library_filename);
+	io::println("{{\n\t\"library\": {},\n\t\"success\": {},\n\t\"roms\": {}\n}}", json_path(*options.library_filename), saved, library.entries.size());
+
+	if (!saved)
+		print_error(io::format("could not write library {}", *options.library_filename));
+
+	return saved ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int run_library(const Options &options)
+{
+	auto library = nesem::NesLibrary::load(*options.library_filename);
+	if (!library)
+	{
+		print_error(io::format("could not load library {}", *options.library_filename));
+		return EXIT_FAILURE;
+	}
+
+	auto roms = library->find(options.query);
+	if (roms.empty())
+	{
+		print_error("No roms in the library match");
+		return EXIT_FAILURE;
+	}
+
+	auto result = EXIT_SUCCESS;
+	auto reports = std::vector<std::string>();
+
+	// roms in different directories can share a name, so each gets a directory of its own, named for the rom and
+	// its hash, with a number added for any copies of the same file
+	auto used_names = std::unordered_map<std::string, int>();
+
+	for (const auto *rom : roms)
+	{
+		auto name = io::format("{}-{}", rom->path.stem().string(), rom->sha1.substr(0, 12));
+		if (auto copies = ++used_names[name]; copies > 1)
+			name += io::format("-{}", copies);
+
+		auto rom_options = options;
+		rom_options.rom_filename = rom->path;
+		rom_options.output_dir = options.output_dir / name;
+
+		auto report = run_rom(rom_options);
+		if (!report.errors.empty())
+			result = EXIT_FAILURE;
+
+		reports.push_back(to_json(report));
+	}
+
+	// one json document for the whole run, an array of every rom's report
+	io::println("[\n{}\n]", fmt::join(reports, ",\n"));
+
+	return result;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc == 0)
+	{
+		// This "should" never happen. Technically possible, but windows and unix-likes always provide at least 1 argument
+		print_error("Commandline empty?!?!");
+		return EXIT_FAILURE;
+	}
+
+	auto exe = std::filesystem::path(argv[0]).filename().string();
+
+	auto options = parse_command_line({argv, argv + argc});
+
+	if (!options.has_value())
+	{
+		print_error(options.error());
+		print_help(exe);
+		return EXIT_FAILURE;
+	}
+
+	options->exe = exe;
+
+	if (options->show_help)
+	{
+		print_help(exe);
+		return EXIT_SUCCESS;
+	}
+
+	if (!options->scan_dirs.empty() && !options->library_filename)
+	{
+		print_error("--scan needs a --library to save to");
+		print_help(exe);
+		return EXIT_FAILURE;
+	}
+
+	if (options->library_filename && !options->rom_filename.empty())
+	{
+		print_error("Either name a rom or pick them from a library, not both");
+		print_help(exe);
+		return EXIT_FAILURE;
+	}
+
+	if (options->rom_filename.empty() && !options->library_filename)
+	{
+		print_error("No rom specified");
+		print_help(exe);
+		return EXIT_FAILURE;
+	}
+
+	// stdout is for the report, so anything logged goes to stderr, and only when asked for
+	auto logger = spdlog::stderr_color_mt("nesem-headless");
+	logger->set_level(options->verbose ? spdlog::level::info : spdlog::level::off);
+	spdlog::set_default_logger(std::move(logger));
+
+	if (!options->scan_dirs.empty())
+		return scan(*options);
+
+	if (options->library_filename)
+		return run_library(*options);
+
+	return run(*options);
+}
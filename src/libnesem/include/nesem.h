@@ -0,0 +1,116 @@
+#pragma once
+
+/*
+ * A small C interface to the emulator core, for embedding it in other processes through a shared library.
+ *
+ * An instance may be used from any thread, but only from one thread at a time. Pointers to the framebuffer, ram and
+ * audio ring point into the instance itself and stay valid until it is destroyed, but their contents only hold still
+ * between calls that run the emulator.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#	if defined(NESEM_BUILDING_LIBRARY)
+#		define NESEM_API __declspec(dllexport)
+#	else
+#		define NESEM_API __declspec(dllimport)
+#	endif
+#elif defined(__GNUC__)
+#	define NESEM_API __attribute__((visibility("default")))
+#else
+#	define NESEM_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* bumped whenever the interface changes in a way that breaks existing callers */
+#define NESEM_ABI_VERSION 1
+
+#define NESEM_SCREEN_WIDTH 256
+#define NESEM_SCREEN_HEIGHT 240
+#define NESEM_RAM_SIZE 2048
+
+/* controller buttons, combined into the mask passed to nesem_set_input */
+#define NESEM_BUTTON_A 0x01
+#define NESEM_BUTTON_B 0x02
+#define NESEM_BUTTON_SELECT 0x04
+#define NESEM_BUTTON_START 0x08
+#define NESEM_BUTTON_UP 0x10
+#define NESEM_BUTTON_DOWN 0x20
+#define NESEM_BUTTON_LEFT 0x40
+#define NESEM_BUTTON_RIGHT 0x80
+
+typedef struct nesem_instance nesem_instance;
+
+typedef struct nesem_settings
+{
+	/* audio sample rate in Hz, or 0 for 44100 */
+	uint32_t sample_rate;
+
+	/* samples the audio ring holds, rounded up to a power of two, or 0 for a second's worth */
+	uint32_t audio_ring_size;
+
+	/* nonzero to skip drawing and audio entirely, for runs that only look at ram */
+	int32_t disable_video;
+	int32_t disable_audio;
+
+	/* path to a nes20db.xml, or an index built from one by nes20db-index, to identify roms with, or NULL for the embedded copy */
+	const char *nes20db_filename;
+} nesem_settings;
+
+NESEM_API uint32_t nesem_abi_version(void);
+
+/* settings may be NULL for the defaults. Returns NULL if the instance can't be created */
+NESEM_API nesem_instance *nesem_create(const nesem_settings *settings);
+NESEM_API void nesem_destroy(nesem_instance *instance);
+
+/* load the contents of a .nes file, which is copied. Returns nonzero on success */
+NESEM_API int32_t nesem_load_rom(nesem_instance *instance, const void *data, size_t size);
+
+/* the message of the last error the emulator reported, or NULL if there was none since the rom was loaded */
+NESEM_API const char *nesem_last_error(const nesem_instance *instance);
+
+NESEM_API void nesem_reset(nesem_instance *instance);
+
+/* run whole frames. Returns the ppu's frame counter afterwards */
+NESEM_API uint64_t nesem_step_frames(nesem_instance *instance, uint32_t frames);
+
+/* the buttons held on controller port 0 or 1, a combination of NESEM_BUTTON_* */
+NESEM_API void nesem_set_input(nesem_instance *instance, int32_t port, uint8_t buttons);
+
+/* bytes needed for a save state of the loaded rom, or 0 if none is loaded */
+NESEM_API size_t nesem_state_size(const nesem_instance *instance);
+
+/* returns the bytes written, or 0 if size is too small or no rom is loaded */
+NESEM_API size_t nesem_save_state(const nesem_instance *instance, void *buffer, size_t size);
+
+/* returns nonzero on success, and leaves the instance alone on failure */
+NESEM_API int32_t nesem_load_state(nesem_instance *instance, const void *buffer, size_t size);
+
+/* a hash of the whole system state as of the last frame, see Nes::state_hash */
+NESEM_API uint64_t nesem_state_hash(const nesem_instance *instance);
+
+/*
+ * NESEM_SCREEN_WIDTH * NESEM_SCREEN_HEIGHT pixels, row by row. Each holds the ppu's color index in the low 6 bits and
+ * the color emphasis bits above them, for the host to map through a palette of its choice
+ */
+NESEM_API const uint16_t *nesem_framebuffer(const nesem_instance *instance);
+
+/* the NESEM_RAM_SIZE bytes of work ram */
+NESEM_API const uint8_t *nesem_ram(const nesem_instance *instance);
+
+/*
+ * Audio is written to a ring of *capacity samples, a power of two. Sample n of all those ever produced lives at
+ * ring[n & (*capacity - 1)], and nesem_audio_written returns how many have been produced so far. A reader that keeps
+ * its own count can take everything from its count up to that, as long as it doesn't fall more than a ring behind
+ */
+NESEM_API const float *nesem_audio_ring(const nesem_instance *instance, uint32_t *capacity);
+NESEM_API uint64_t nesem_audio_written(const nesem_instance *instance);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,193 @@
+#include "nesem.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <exception>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <nes.hpp>
+
+#include <util/logging.hpp>
+
+namespace
+{
+	using namespace nesem;
+
+	static_assert(NESEM_SCREEN_WIDTH == 256 && NESEM_SCREEN_HEIGHT == 240);
+	static_assert(NESEM_RAM_SIZE == 0x800);
+	static_assert(NESEM_BUTTON_A == U8(Buttons::A) && NESEM_BUTTON_RIGHT == U8(Buttons::Right));
+
+	constexpr size_t screen_size = NESEM_SCREEN_WIDTH * NESEM_SCREEN_HEIGHT;
+	constexpr U32 default_sample_rate = 44100;
+
+	U32 sample_rate(const nesem_settings &settings) noexcept
+	{
+		return settings.sample_rate > 0 ? settings.sample_rate : default_sample_rate;
+	}
+
+	// a second of audio unless asked for otherwise, rounded up to a power of two so positions wrap with a mask
+	size_t audio_ring_size(const nesem_settings &settings) noexcept
+	{
+		auto size = settings.audio_ring_size > 0 ? settings.audio_ring_size : sample_rate(settings);
+		return std::bit_ceil(std::max(size, U32{2}));
+	}
+}
+
+struct nesem_instance
+{
+	std::string last_error;
+	bool has_error = false;
+
+	std::vector<U16> screen = std::vector<U16>(screen_size);
+	std::array<U8, 2> input{};
+
+	std::vector<float> audio;
+	U64 audio_written = 0;
+
+	// declared last so its callbacks never see the buffers they write destroyed
+	Nes nes;
+
+	explicit nesem_instance(const nesem_settings &settings)
+		: audio(audio_ring_size(settings)),
+		  nes(NesSettings{
+			  .error = [this](std::string_view message) {
+				  last_error = message;
+				  has_error = true;
+			  },
+			  .draw = [this](int x, int y, U8 color_index, util::Flags<NesColorEmphasis> emphasis) {
+				  screen[size_t(y * NESEM_SCREEN_WIDTH + x)] = U16((color_index & 0x3F) | (emphasis.raw_value() << 6));
+			  },
+			  .audio = [this](float sample) { audio[audio_written++ & (audio.size() - 1)] = sample; },
+			  .sample_rate = sample_rate(settings),
+			  .player1 = std::make_unique<NesController>([this] { return input[0]; }),
+			  .player2 = std::make_unique<NesController>([this] { return input[1]; }),
+			  .nes20db_filename = settings.nes20db_filename ? settings.nes20db_filename : "",
+		  })
+	{
+		nes.enable_video(settings.disable_video == 0);
+		nes.enable_audio(settings.disable_audio == 0);
+	}
+};
+
+extern "C"
+{
+	uint32_t nesem_abi_version(void)
+	{
+		return NESEM_ABI_VERSION;
+	}
+
+	// nothing may throw across the boundary, so allocation failures turn into NULL here
+	nesem_instance *nesem_create(const nesem_settings *settings)
+	{
+		try
+		{
+			return new nesem_instance(settings ? *settings : nesem_settings{});
+		}
+		catch (const std::exception &e)
+		{
+			LOG_ERROR("Could not create an instance: {}", e.what());
+			return nullptr;
+		}
+	}
+
+	void nesem_destroy(nesem_instance *instance)
+	{
+		delete instance;
+	}
+
+	int32_t nesem_load_rom(nesem_instance *instance, const void *data, size_t size)
+	{
+		if (!instance || !data)
+			return 0;
+
+		instance->has_error = false;
+		return instance->nes.load_rom(std::span(static_cast<const U8 *>(data), size)) ? 1 : 0;
+	}
+
+	const char *nesem_last_error(const nesem_instance *instance)
+	{
+		if (!instance || !instance->has_error)
+			return nullptr;
+
+		return instance->last_error.c_str();
+	}
+
+	void nesem_reset(nesem_instance *instance)
+	{
+		if (instance)
+			instance->nes.reset();
+	}
+
+	uint64_t nesem_step_frames(nesem_instance *instance, uint32_t frames)
+	{
+		if (!instance)
+			return 0;
+
+		for (uint32_t i = 0; i < frames; ++i)
+			instance->nes.step(NesClockStep::OneFrame);
+
+		return instance->nes.ppu().current_frame();
+	}
+
+	void nesem_set_input(nesem_instance *instance, int32_t port, uint8_t buttons)
+	{
+		if (instance && (port == 0 || port == 1))
+			instance->input[size_t(port)] = buttons;
+	}
+
+	size_t nesem_state_size(const nesem_instance *instance)
+	{
+		return instance ? instance->nes.state_size() : 0;
+	}
+
+	size_t nesem_save_state(const nesem_instance *instance, void *buffer, size_t size)
+	{
+		if (!instance || !buffer)
+			return 0;
+
+		return instance->nes.save_state(std::span(static_cast<std::byte *>(buffer), size));
+	}
+
+	int32_t nesem_load_state(nesem_instance *instance, const void *buffer, size_t size)
+	{
+		if (!instance || !buffer)
+			return 0;
+
+		return instance->nes.load_state(std::span(static_cast<const std::byte *>(buffer), size)) ? 1 : 0;
+	}
+
+	uint64_t nesem_state_hash(const nesem_instance *instance)
+	{
+		return instance ? instance->nes.state_hash() : 0;
+	}
+
+	const uint16_t *nesem_framebuffer(const nesem_instance *instance)
+	{
+		return instance ? instance->screen.data() : nullptr;
+	}
+
+	const uint8_t *nesem_ram(const nesem_instance *instance)
+	{
+		return instance ? instance->nes.bus().work_ram().data() : nullptr;
+	}
+
+	const float *nesem_audio_ring(const nesem_instance *instance, uint32_t *capacity)
+	{
+		if (!instance)
+			return nullptr;
+
+		if (capacity)
+			*capacity = uint32_t(instance->audio.size());
+
+		return instance->audio.data();
+	}
+
+	uint64_t nesem_audio_written(const nesem_instance *instance)
+	{
+		return instance ? instance->audio_written : 0;
+	}
+}
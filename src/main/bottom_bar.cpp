@@ -5,6 +5,7 @@
 #include "text.hpp"
 
 #include <ui/app.hpp>
+#include <ui/audio_device.hpp>
 #include <ui/renderer.hpp>
 
 namespace app
@@ -14,7 +15,29 @@ namespace app
 	{
 	}
 
-	void BottomBar::update(bool in_break, const std::optional<std::string> &rom_name)
+	void BottomBar::update(bool is_break, const std::optional<std::string> &name)
+	{
+		in_break = is_break;
+		rom_name = name;
+
+		redraw();
+	}
+
+	void BottomBar::update_audio(const ui::AudioStats &stats, double write_latency, const ui::LatencyHistogram &write_latencies)
+	{
+		audio_info = fmt::format("Audio: {:5.1f} ms queued   p95: {:3.0f} ms   write to device: {:5.1f} ms   p95: {:3.0f} ms   underruns: {}",
+			stats.queued_latency * 1000.0, stats.latency.percentile(0.95) * 1000.0, write_latency * 1000.0, write_latencies.percentile(0.95) * 1000.0,
+			stats.underruns);
+
+		redraw();
+	}
+
+	void BottomBar::render(ui::Renderer &renderer)
+	{
+		renderer.blit(top_left(area), texture);
+	}
+
+	void BottomBar::redraw()
 	{
 		auto [canvas, lock] = texture.lock();
 
@@ -30,11 +53,12 @@ namespace app
 		if (in_break)
 			draw_string(canvas, {255, 255, 255}, "F5: resume   F8: step cpu   F9: step PPU cycle   F10: step scanline   F11: step frame", pos);
 		else
-			draw_string(canvas, {255, 255, 255}, "Move: WASD   A: '/'   B: '.'   Start: spacebar   Select: ','      Break key to pause emulation", pos);
-	}
+			draw_string(canvas, {255, 255, 255}, "Move: WASD   A: '/'   B: '.'   Start: spacebar   Select: ','   Backspace: rewind   Break key to pause emulation", pos);
 
-	void BottomBar::render(ui::Renderer &renderer)
-	{
-		renderer.blit(top_left(area), texture);
+		if (!audio_info.empty())
+		{
+			pos.y -= 12;
+			draw_string(canvas, {255, 255, 255}, audio_info, pos);
+		}
 	}
 }
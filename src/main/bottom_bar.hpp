@@ -10,6 +10,8 @@ namespace ui
 {
 	class App;
 	class Renderer;
+	struct AudioStats;
+	struct LatencyHistogram;
 }
 
 namespace app
@@ -21,10 +23,21 @@ namespace app
 		explicit BottomBar(ui::App &app, cm::Recti area);
 
 		void update(bool in_break, const std::optional<std::string> &rom_name);
+
+		// write_latency is the most recent time measured between an APU register write and the resulting sample reaching the audio device,
+		// write_latencies every one measured so far
+		void update_audio(const ui::AudioStats &stats, double write_latency, const ui::LatencyHistogram &write_latencies);
+
 		void render(ui::Renderer &renderer);
 
 	private:
 		ui::Texture texture;
 		cm::Recti area;
+
+		bool in_break = false;
+		std::optional<std::string> rom_name;
+		std::string audio_info;
+
+		void redraw();
 	};
 }
@@ -16,6 +16,10 @@ namespace app
 	constinit const auto key_last_rom = "last-rom"sv;
 	constinit const auto key_palette = "palette"sv;
 	constinit const auto nes20db_filename = "iNES2-DB-path"sv;
+	constinit const auto key_audio_sample_size = "audio-sample-size"sv;
+	constinit const auto key_rewind_buffer = "rewind-buffer-MiB"sv;
+	constinit const auto key_run_ahead_frames = "run-ahead-frames"sv;
+	constinit const auto key_run_ahead_thread = "run-ahead-thread"sv;
 
 	constinit const auto key_controller_1 = "controller-1"sv;
 	constinit const auto key_turbo_speed = "turbo-speed"sv;
@@ -48,6 +52,10 @@ namespace app
 				config.last_played_rom = table[key_last_rom].value<std::u8string>();
 				config.palette = table[key_palette].value<std::u8string>();
 				config.nes20db_filename = table[nes20db_filename].value<std::u8string>();
+				config.audio_sample_size = table[key_audio_sample_size].value_or(512);
+				config.rewind_buffer_mib = table[key_rewind_buffer].value_or(64);
+				config.run_ahead_frames = table[key_run_ahead_frames].value_or(0);
+				config.run_ahead_thread = table[key_run_ahead_thread].value_or(false);
 
 				auto controller_1 = table[key_controller_1];
 				config.controller_1.turbo_speed = controller_1[key_turbo_speed].value_or(16);
@@ -82,6 +90,11 @@ namespace app
 		if (config.nes20db_filename)
 			table.insert(nes20db_filename, config.nes20db_filename->u8string());
 
+		table.insert(key_audio_sample_size, config.audio_sample_size);
+		table.insert(key_rewind_buffer, config.rewind_buffer_mib);
+		table.insert(key_run_ahead_frames, config.run_ahead_frames);
+		table.insert(key_run_ahead_thread, config.run_ahead_thread);
+
 		table.insert("controller-1"sv,
 			toml::table{
 				{key_turbo_speed, config.controller_1.turbo_speed},
@@ -144,6 +157,29 @@ namespace app
 				else
 					LOG_WARN("iNES2 db not found at {}, ignoring", db_path);
 			}
+			else if (arg == "--audio-telemetry")
+			{
+				if (++it == end)
+					LOG_WARN("Ignoring argument --audio-telemetry, no argument given");
+				else
+					config.audio_telemetry = std::filesystem::path{*it};
+			}
+			else if (arg == "--shared-output")
+			{
+				if (++it == end)
+					LOG_WARN("Ignoring argument --shared-output, no argument given");
+				else
+					config.shared_output = std::string{*it};
+			}
+			else if (arg == "--shared-output-format")
+			{
+				if (++it == end)
+					LOG_WARN("Ignoring argument --shared-output-format, no argument given");
+				else if (auto format = std::string_view{*it}; format == "rgba" || format == "indexed")
+					config.shared_output_rgba = format == "rgba";
+				else
+					LOG_WARN("Ignoring unknown --shared-output-format {}, expected indexed or rgba", format);
+			}
 		}
 	}
 }
@@ -28,6 +28,26 @@ namespace app
 		std::optional<std::filesystem::path> palette;
 		std::optional<std::filesystem::path> nes20db_filename;
 		ControllerConfig controller_1;
+
+		// number of samples SDL buffers per callback. Smaller is lower latency, but more likely to underrun
+		int audio_sample_size = 512;
+
+		// memory set aside for rewinding, in MiB
+		int rewind_buffer_mib = 64;
+
+		// number of frames to run ahead of the real state to hide input latency, 0 to disable
+		int run_ahead_frames = 0;
+
+		// when running 1 frame ahead, emulate the frame ahead on a second instance on a worker thread
+		bool run_ahead_thread = false;
+
+		// if set, write per-frame audio telemetry as csv to this file. Only settable from the command line
+		std::optional<std::filesystem::path> audio_telemetry;
+
+		// if set, publish each frame and the audio to a shared memory segment of this name for other processes to
+		// read, with pixels as palette indexes or mapped to rgba. Only settable from the command line
+		std::optional<std::string> shared_output;
+		bool shared_output_rgba = false;
 	};
 
 	Config load_config_file(const std::filesystem::path &path) noexcept;
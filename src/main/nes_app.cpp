@@ -20,6 +20,8 @@ namespace app
 			  .error = std::bind_front(&NesApp::on_error, this),
 			  .draw = std::bind_front(&NesApp::on_nes_pixel, this),
 			  .frame_ready = std::bind_front(&NesApp::on_nes_frame_ready, this),
+			  .audio = std::bind_front(&NesApp::on_nes_audio_sample, this),
+			  .sample_rate = audio_frequency,
 			  .player1 = std::make_unique<nesem::NesController>(std::bind_front(&NesApp::read_controller, this)),
 			  .player2 = std::make_unique<nesem::NesInputDevice>(std::bind_front(&NesApp::read_zapper, this)),
 			  .nes20db_filename = config.nes20db_filename.value_or(std::filesystem::path{}),
@@ -63,6 +65,8 @@ namespace app
 			step_ppu_frame_key = ui::App::key_from_name("F11");
 
 			reset_key = ui::App::key_from_name("R");
+			rewind_key = ui::App::key_from_name("Backspace");
+			record_movie_key = ui::App::key_from_name("F7");
 		}
 
 		{ // setup screen areas
@@ -84,6 +88,49 @@ namespace app
 
 		turbo_frame_cycle = config.controller_1.turbo_speed;
 
+		rewind_buffer_mib = std::max(config.rewind_buffer_mib, 0);
+		rewind = nesem::NesRewind(size_t(rewind_buffer_mib) * 1024 * 1024);
+
+		{ // setup run ahead
+			run_ahead_frames = std::max(config.run_ahead_frames, 0);
+			run_ahead_thread = config.run_ahead_thread;
+			run_ahead.set_frames(run_ahead_frames);
+
+			if (run_ahead_thread && run_ahead_frames == 1)
+			{
+				// the second instance draws straight into our screen buffer from the worker thread, so it must never
+				// touch anything else. Errors are left to the main instance, which runs the same code a frame behind
+				run_ahead_worker = nesem::NesRunAheadThread(std::make_unique<nesem::Nes>(nesem::NesSettings{
+					.draw = std::bind_front(&NesApp::on_nes_pixel, this),
+					.player1 = std::make_unique<nesem::NesController>([this] { return ahead_controller.load(std::memory_order_relaxed); }),
+					.nes20db_filename = config.nes20db_filename.value_or(std::filesystem::path{}),
+					.user_data_dir = ui::App::get_user_data_path("nesem") / "run-ahead",
+				}));
+			}
+			else if (run_ahead_thread)
+				LOG_WARN("Running ahead on a worker thread only supports 1 frame ahead, running {} frames ahead on the main thread", run_ahead_frames);
+		}
+
+		{ // setup audio
+			audio_sample_size = config.audio_sample_size;
+			audio_device = ui::App::create_audio_device(audio_frequency, 1, audio_sample_size);
+
+			if (config.audio_telemetry)
+			{
+				audio_telemetry.open(*config.audio_telemetry, std::ios::trunc);
+				if (!audio_telemetry)
+					LOG_WARN("Could not open audio telemetry file {}", *config.audio_telemetry);
+				else
+					audio_telemetry << "frame,register_writes,samples_mixed,samples_queued,queued_samples,queued_latency_ms,underruns,write_latency_ms\n";
+			}
+		}
+
+		if (config.shared_output)
+		{
+			auto format = config.shared_output_rgba ? nesem::NesSharedPixelFormat::rgba : nesem::NesSharedPixelFormat::indexed;
+			shared_output = nesem::NesSharedOutput::create(*config.shared_output, format, audio_frequency);
+		}
+
 		nes_screen_texture = app.create_texture({256, 240});
 
 		if (config.last_played_rom)
@@ -91,6 +138,13 @@ namespace app
 
 		if (config.palette)
 			load_pal(*config.palette);
+		else
+			update_shared_palette();
+	}
+
+	NesApp::~NesApp()
+	{
+		stop_movie_recording();
 	}
 
 	Config NesApp::get_config() const noexcept
@@ -98,6 +152,10 @@ namespace app
 		Config config;
 
 		config.last_played_rom = rom_name;
+		config.audio_sample_size = audio_sample_size;
+		config.rewind_buffer_mib = rewind_buffer_mib;
+		config.run_ahead_frames = run_ahead_frames;
+		config.run_ahead_thread = run_ahead_thread;
 
 		config.controller_1.turbo_speed = turbo_frame_cycle;
 		config.controller_1.turbo_a = ui::App::name_from_key(button_turbo_a);
@@ -118,7 +176,7 @@ namespace app
 	{
 		auto path = std::filesystem::path(filename);
 
-		if (path.extension() == ".nes")
+		if (path.extension() == ".nes" || path.extension() == ".gz" || path.extension() == ".zip")
 			load_rom(path);
 		else if (path.extension() == ".pal")
 			load_pal(path);
@@ -131,7 +189,17 @@ namespace app
 
 	void NesApp::load_rom(const std::filesystem::path &filepath)
 	{
+		stop_movie_recording();
+
 		rom_loaded = nes.load_rom(filepath);
+		rewind.clear();
+
+		if (run_ahead_worker)
+		{
+			run_ahead_worker.wait();
+			if (rom_loaded && !run_ahead_worker.ahead().load_rom(filepath))
+				LOG_WARN("Could not load {} for running ahead", filepath);
+		}
 
 		if (!rom_loaded)
 		{
@@ -151,7 +219,10 @@ namespace app
 	{
 		auto new_colors = ColorPalette::from_file(filepath);
 		if (new_colors)
+		{
 			colors = std::move(*new_colors);
+			update_shared_palette();
+		}
 		else
 			LOG_WARN("Could not load color palette from '{}', keeping previous", filepath);
 	}
@@ -163,12 +234,39 @@ namespace app
 		system_break = enable;
 		step = nesem::NesClockStep::None;
 
+		if (audio_device)
+			audio_device.pause(system_break);
+
 		if (!system_break)
 			overlay.hide();
 
 		bottom_bar.update(system_break, rom_name);
 	}
 
+	void NesApp::start_movie_recording()
+	{
+		if (!rom_loaded || !movie_recorder.start(nes))
+			return;
+
+		LOG_INFO("Recording movie, rewind and run ahead are paused until recording stops");
+	}
+
+	void NesApp::stop_movie_recording()
+	{
+		if (!movie_recorder.recording())
+			return;
+
+		auto movie = movie_recorder.stop();
+		auto dir = ui::App::get_user_data_path("nesem") / "movies";
+
+		std::error_code ec;
+		std::filesystem::create_directories(dir, ec);
+
+		auto filename = dir / std::filesystem::path(rom_name.value_or("movie")).stem().concat(".nesm");
+		if (movie.save(filename))
+			LOG_INFO("Saved movie of {} frames to {}", movie.frame_count(), filename);
+	}
+
 	void NesApp::on_error(std::string_view message)
 	{
 		overlay.show({0, 0, 0, 127}, message);
@@ -311,8 +409,22 @@ namespace app
 		if (app.key_pressed(reset_key) && app.modifiers(ui::KeyMods::ctrl))
 		{
 			LOG_INFO("resetting NES...");
-			nes.reset();
+			movie_recorder.reset(nes);
 		}
+
+		if (app.key_pressed(rewind_key))
+			LOG_INFO("Rewinding, {:.1f}s of history in {:.1f} MiB ({:.1f}s per MiB)", rewind.seconds_of_history(), double(rewind.memory_used()) / (1024.0 * 1024.0), rewind.seconds_per_mib());
+
+		if (app.key_pressed(record_movie_key))
+		{
+			if (movie_recorder.recording())
+				stop_movie_recording();
+			else
+				start_movie_recording();
+		}
+
+		// rewinding would cut the recording short, so it waits until recording stops
+		rewinding = app.key_down(rewind_key) && !movie_recorder.recording();
 	}
 
 	void NesApp::update(double delta_time)
@@ -321,11 +433,39 @@ namespace app
 		{
 			using enum nesem::NesClockStep;
 
-			if (!system_break)
+			if (!system_break && rewinding)
 			{
-				nes.tick(delta_time);
+				// restore the newest frame in the history and run it again so the screen shows it
+				if (rewind.step_back(nes))
+					nes.step(OneFrame);
+
+				last_captured_frame = nes.ppu().current_frame();
 				side_bar.update(debug_mode, nes, current_palette, colors);
 			}
+			else if (!system_break)
+			{
+				if (run_ahead_frames > 0 && !movie_recorder.recording())
+					run_ahead_for(delta_time);
+				else
+					nes.tick(delta_time);
+
+				// capture between ticks rather than from the frame callback so we never save mid clock cycle
+				if (auto frame = nes.ppu().current_frame();
+					frame != last_captured_frame)
+				{
+					rewind.push(nes);
+					last_captured_frame = frame;
+				}
+
+				side_bar.update(debug_mode, nes, current_palette, colors);
+
+				// the worker has been drawing the frame ahead while we did the above, show it now that it is done
+				if (run_ahead_worker && run_ahead_frames > 0 && !movie_recorder.recording())
+				{
+					run_ahead_worker.wait();
+					on_nes_frame_ready();
+				}
+			}
 			else if (step != None)
 			{
 				nes.step(step);
@@ -337,6 +477,20 @@ namespace app
 		}
 	}
 
+	void NesApp::run_ahead_for(double delta_time) noexcept
+	{
+		// only whole frames can be run ahead, so run until we are just past real time and carry the difference over
+		run_ahead_time += delta_time;
+
+		while (run_ahead_time > 0.0)
+		{
+			if (run_ahead_worker)
+				run_ahead_time -= run_ahead_worker.run_frame(nes);
+			else
+				run_ahead_time -= run_ahead.run_frame(nes);
+		}
+	}
+
 	void NesApp::render()
 	{
 		auto renderer = app.renderer();
@@ -355,6 +509,9 @@ namespace app
 	void NesApp::on_nes_pixel(int x, int y, nesem::U8 color_index, util::Flags<nesem::NesColorEmphasis> emphasis) noexcept
 	{
 		nes_screen[y * nes_resolution.w + x] = to_color_index(color_index, emphasis);
+
+		if (shared_output)
+			shared_output.draw(x, y, color_index, emphasis);
 	}
 
 	void NesApp::on_nes_frame_ready() noexcept
@@ -363,6 +520,11 @@ namespace app
 		if (triggered_frame_counter > 0)
 			--triggered_frame_counter;
 
+		if (shared_output)
+			shared_output.frame_complete();
+
+		queue_audio();
+
 		// not that break is unlikely per se, but when we are running at full speed, we want this to be as fast as possible
 		if (system_break) [[unlikely]]
 			return;
@@ -370,6 +532,54 @@ namespace app
 		draw_screen();
 	}
 
+	void NesApp::on_nes_audio_sample(float sample) noexcept
+	{
+		audio_samples.push_back(sample);
+
+		if (shared_output)
+			shared_output.push(sample);
+	}
+
+	void NesApp::queue_audio() noexcept
+	{
+		// samples produced while stepping through a break or rewinding are just noise, drop them
+		if (!audio_device || system_break || rewinding)
+		{
+			audio_samples.clear();
+			return;
+		}
+
+		const auto &apu_stats = nes.apu().stats();
+		auto device_stats = audio_device.stats();
+
+		// a register write first affects the sample mixed right after it. That sample has to wait for everything mixed
+		// since and everything already queued at the device to play before it is heard
+		if (apu_stats.last_write_sample >= last_queued_sample && device_stats.frequency > 0)
+		{
+			auto pending = apu_stats.samples_mixed - apu_stats.last_write_sample + device_stats.queued_samples;
+			last_write_latency = double(pending) / device_stats.frequency;
+			write_latency.record(last_write_latency);
+		}
+
+		last_queued_sample = apu_stats.samples_mixed;
+
+		audio_device.queue_audio(audio_samples);
+		audio_samples.clear();
+
+		auto frame = nes.ppu().current_frame();
+
+		if (audio_telemetry)
+		{
+			device_stats = audio_device.stats();
+			audio_telemetry << fmt::format("{},{},{},{},{},{:.3f},{},{:.3f}\n", frame, apu_stats.register_writes, apu_stats.samples_mixed,
+				device_stats.samples_queued, device_stats.queued_samples, device_stats.queued_latency * 1000.0, device_stats.underruns, last_write_latency * 1000.0);
+		}
+
+		// twice a second is plenty to keep the numbers readable
+		if (frame % 30 == 0)
+			bottom_bar.update_audio(device_stats, last_write_latency, write_latency);
+	}
+
 	void NesApp::draw_screen()
 	{
 		auto [canvas, lock] = nes_screen_texture.lock();
@@ -380,6 +590,23 @@ namespace app
 			});
 	}
 
+	void NesApp::update_shared_palette() noexcept
+	{
+		if (!shared_output)
+			return;
+
+		// the shared frames index colors the way the core does, with the emphasis bits right above the color
+		auto palette = std::array<nesem::U32, nesem::NesSharedOutput::palette_size>{};
+		for (size_t i = 0; i < palette.size(); ++i)
+		{
+			auto emphasis = util::Flags(nesem::NesColorEmphasis(i >> 6));
+			auto color = colors.color_at_index(to_color_index(nesem::U8(i & 0x3F), emphasis));
+			palette[i] = nesem::NesSharedOutput::rgba(color.r, color.g, color.b);
+		}
+
+		shared_output.set_palette(palette);
+	}
+
 	nesem::U8 NesApp::read_controller()
 	{
 		using enum nesem::Buttons;
@@ -419,7 +646,10 @@ namespace app
 			result.clear(Left, Right);
 
 		controller_overlay.update(result);
-		return result.raw_value();
+
+		auto value = movie_recorder.poll(0, result.raw_value());
+		ahead_controller.store(value, std::memory_order_relaxed);
+		return value;
 	}
 
 	nesem::U8 NesApp::read_zapper()
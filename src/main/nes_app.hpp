@@ -1,12 +1,19 @@
 #pragma once
 
 #include <array>
+#include <atomic>
 #include <filesystem>
+#include <fstream>
 #include <optional>
 #include <string>
 #include <string_view>
+#include <vector>
 
 #include <nes.hpp>
+#include <nes_movie.hpp>
+#include <nes_rewind.hpp>
+#include <nes_run_ahead.hpp>
+#include <nes_shared_output.hpp>
 
 #include "bottom_bar.hpp"
 #include "color_palette.hpp"
@@ -16,6 +23,7 @@
 
 #include <cm/math.hpp>
 #include <ui/app.hpp>
+#include <ui/audio_device.hpp>
 #include <ui/clock.hpp>
 #include <ui/texture.hpp>
 #include <util/rng.hpp>
@@ -38,6 +46,7 @@ namespace app
 	{
 	public:
 		explicit NesApp(const Config &config);
+		~NesApp();
 
 		Config get_config() const noexcept;
 		bool tick();
@@ -47,18 +56,25 @@ namespace app
 		void load_rom(const std::filesystem::path &filepath);
 		void load_pal(const std::filesystem::path &filepath);
 		void trigger_break(bool enableapp);
+		void start_movie_recording();
+		void stop_movie_recording();
 
 		void on_error(std::string_view message);
 		void on_change_debug_mode(DebugMode mode);
 		void on_change_current_palette(nesem::U8 palette);
 		void on_nes_pixel(int x, int y, nesem::U8 color_index, util::Flags<nesem::NesColorEmphasis> emphasis) noexcept;
 		void on_nes_frame_ready() noexcept;
+		void on_nes_audio_sample(float sample) noexcept;
+
+		void queue_audio() noexcept;
 
 		void handle_input();
 		void update(double delta_time);
+		void run_ahead_for(double delta_time) noexcept;
 		void render();
 
 		void draw_screen();
+		void update_shared_palette() noexcept;
 
 		nesem::U8 read_controller();
 		nesem::U8 read_zapper();
@@ -113,6 +129,29 @@ namespace app
 		ui::Key palette_next_key;
 		ui::Key palette_prev_key;
 
+		// hold to step back in time one frame per frame
+		ui::Key rewind_key;
+		bool rewinding = false;
+		int rewind_buffer_mib = 64;
+		nesem::NesRewind rewind{0};
+		nesem::U64 last_captured_frame = 0;
+
+		// show frames from the future to hide input latency, see NesRunAhead
+		int run_ahead_frames = 0;
+		bool run_ahead_thread = false;
+		nesem::NesRunAhead run_ahead{0};
+		nesem::NesRunAheadThread run_ahead_worker;
+
+		// run ahead works in whole frames, this is how far ahead of real time we have run
+		double run_ahead_time = 0.0;
+
+		// the last controller state read for the main instance, replayed by the instance running ahead on the worker thread
+		std::atomic<nesem::U8> ahead_controller = 0;
+
+		// records controller input to a movie in the user data dir. Rewind and run ahead are paused while recording
+		ui::Key record_movie_key;
+		nesem::NesMovieRecorder movie_recorder;
+
 		bool rom_loaded = false;
 		std::optional<std::string> rom_name;
 
@@ -128,6 +167,21 @@ namespace app
 
 		ColorPalette colors = ColorPalette::default_palette();
 
+		// audio
+		static constexpr int audio_frequency = 44100;
+		int audio_sample_size = 512;
+		ui::AudioDevice audio_device;
+		std::vector<float> audio_samples;
+
+		// samples_mixed from the apu when we last queued audio
+		nesem::U64 last_queued_sample = 0;
+		double last_write_latency = 0.0;
+		ui::LatencyHistogram write_latency;
+		std::ofstream audio_telemetry;
+
+		// frames and audio published for other processes, if asked for
+		nesem::NesSharedOutput shared_output;
+
 		ui::Clock clock;
 	};
 }
@@ -1,13 +1,18 @@
 #pragma once
 
 #include <filesystem>
+#include <cstddef>
 #include <memory>
+#include <optional>
+#include <span>
 #include <string_view>
+#include <vector>
 
 #include <nes_apu.hpp>
 #include <nes_bus.hpp>
 #include <nes_clock.hpp>
 #include <nes_cpu.hpp>
+#include <nes_fork.hpp>
 #include <nes_input_device.hpp>
 #include <nes_ppu.hpp>
 #include <nes_rom_loader.hpp>
@@ -19,6 +24,8 @@ namespace nesem
 		ErrorFn error;
 		DrawFn draw;
 		FrameReadyFn frame_ready;
+		AudioSampleFn audio;
+		U32 sample_rate = 44100;
 		std::unique_ptr<NesInputDevice> player1 = make_null_input();
 		std::unique_ptr<NesInputDevice> player2 = make_null_input();
 		std::filesystem::path nes20db_filename;
@@ -40,8 +47,16 @@ namespace nesem
 		~Nes();
 
 		bool load_rom(const std::filesystem::path &filename) noexcept;
+
+		// load the contents of a .nes file already in memory. The data is copied, so it needn't outlive the call
+		bool load_rom(std::span<const U8> file_data) noexcept;
+
 		void unload_rom() noexcept;
 		void reset() noexcept;
+
+		// like reset, but also clears work ram and cpu registers as if the console was switched off and back on
+		void power_cycle() noexcept;
+
 		void error(std::string_view message) noexcept;
 
 		// run the system at full speed for a timeslice
@@ -55,6 +70,13 @@ namespace nesem
 
 		void screen_out(int x, int y, U8 color_index, util::Flags<NesColorEmphasis> emphasis) noexcept;
 		void frame_complete() noexcept;
+		void audio_out(float sample) noexcept;
+
+		// when disabled, the draw and frame_ready callbacks are skipped. Useful for frames that are emulated but never shown
+		void enable_video(bool enable) noexcept;
+
+		// when disabled, the audio callback is skipped
+		void enable_audio(bool enable) noexcept;
 
 		NesInputDevice &player1() noexcept;
 		NesInputDevice &player2() noexcept;
@@ -63,6 +85,31 @@ namespace nesem
 
 		[[nodiscard]] NesNvram open_prgnvram(std::string_view rom, size_t size) const noexcept;
 
+		// the number of bytes needed to save the state of the currently loaded rom, or 0 if no rom is loaded
+		[[nodiscard]] size_t state_size() const noexcept;
+
+		// save the full system state into buffer without allocating. Returns the number of bytes written, or 0 if
+		// no rom is loaded or the buffer is smaller than state_size()
+		size_t save_state(std::span<std::byte> buffer) const noexcept;
+
+		// restore a state saved with save_state. The state must come from the same rom and save state version.
+		// Returns false and leaves the system untouched if the state can't be loaded
+		bool load_state(std::span<const std::byte> buffer) noexcept;
+
+		// capture the current state as a fork that shares its memory pages with the last fork taken or restored
+		// here. Returns an empty fork if no rom is loaded
+		[[nodiscard]] NesFork fork() noexcept;
+
+		// continue from a fork of the same rom, which may have been taken from a different instance. Only pages that
+		// differ from the current memory are copied. Returns false and leaves the system untouched if the fork can't
+		// be restored
+		bool restore(const NesFork &fork) noexcept;
+
+		// a hash of the whole system state as of the end of the last step or tick that completed a frame, or the last
+		// load, restore or reset. Memory is hashed as it is written and the registers are only folded in once a frame,
+		// so this is free to call every frame. Systems with the same hash are all but certainly in the same state
+		[[nodiscard]] U64 state_hash() const noexcept;
+
 #if defined(__cpp_explicit_this_parameter)
 		auto &bus(this auto &self) noexcept
 		{
@@ -83,6 +130,11 @@ namespace nesem
 		{
 			return self.nes_apu;
 		}
+
+		auto &clock(this auto &self) noexcept
+		{
+			return self.nes_clock;
+		}
 #else
 		auto &bus() noexcept
 		{
@@ -123,12 +175,26 @@ namespace nesem
 		{
 			return nes_apu;
 		}
+
+		auto &clock() noexcept
+		{
+			return nes_clock;
+		}
+
+		[[nodiscard]] const auto &clock() const noexcept
+		{
+			return nes_clock;
+		}
 #endif
 
 	private:
 		ErrorFn on_error;
 		DrawFn draw;
 		FrameReadyFn frame_ready;
+		AudioSampleFn audio;
+		U32 sample_rate;
+		bool video_enabled = true;
+		bool audio_enabled = true;
 		std::unique_ptr<NesInputDevice> player1_input;
 		std::unique_ptr<NesInputDevice> player2_input;
 
@@ -141,5 +207,25 @@ namespace nesem
 
 		std::unique_ptr<NesCartridge> nes_cartridge;
 		std::filesystem::path user_data_dir;
+
+		// the save state size is fixed once a rom is loaded, so it is measured once up front
+		size_t save_state_size = 0;
+		size_t fork_size = 0;
+
+		// the pages of the last fork taken or restored. Memory pages that aren't dirty still hold exactly these
+		NesFork::PageTables fork_pages;
+
+		// everything but the memory that is hashed as it is written, serialized at the end of each frame to be hashed
+		std::vector<std::byte> hashed_registers;
+		U64 frame_hash = 0;
+		bool frame_hash_pending = false;
+
+		bool insert_rom(mappers::NesRomImage &&rom) noexcept;
+		void write_state(NesStateWriter &writer) const noexcept;
+		void write_fork(NesStateWriter &writer) const noexcept;
+		void write_registers(NesStateWriter &writer) const noexcept;
+		void read_registers(NesStateReader &reader) noexcept;
+		void update_state_hash() noexcept;
+		std::array<NesTrackedMemory, NesFork::memory_count> tracked_memory() noexcept;
 	};
 }
@@ -7,6 +7,8 @@
 namespace nesem
 {
 	class Nes;
+	class NesStateReader;
+	class NesStateWriter;
 
 	// represents data for one APU channel. Not all data is used by all channels, but the used bits
 	// are all in the same places for each channel type except for DMC, which is handled separately
@@ -72,6 +74,20 @@ namespace nesem
 		U8 length = 0;
 	};
 
+	// counters describing the mixer's output, used to measure latency of the audio path
+	struct NesApuStats
+	{
+		// total number of writes to the APU registers
+		U64 register_writes = 0;
+
+		// total number of samples produced by the mixer
+		U64 samples_mixed = 0;
+
+		// the value of samples_mixed when the last register write happened. The first sample that could
+		// reflect that write is the next one mixed
+		U64 last_write_sample = 0;
+	};
+
 	enum class ApuStepMode
 	{
 		four_step,
@@ -90,6 +106,14 @@ namespace nesem
 		U8 read(Addr addr) noexcept;
 		void write(Addr addr, U8 value) noexcept;
 
+		// set the rate the apu is clocked at and the rate the mixer should produce samples at
+		void set_output_rate(U64 apu_frequency, U32 sample_rate) noexcept;
+
+		[[nodiscard]] const NesApuStats &stats() const noexcept;
+
+		void save_state(NesStateWriter &writer) const noexcept;
+		void load_state(NesStateReader &reader) noexcept;
+
 	private:
 		Nes *nes;
 
@@ -114,8 +138,21 @@ namespace nesem
 
 		U64 frame_counter = 0;
 
+		// mixer state. Every apu cycle is mixed and averaged down to the output sample rate
+		U64 apu_frequency = 894886;
+		U64 sample_rate = 44100;
+		U64 sample_clock = 0;
+		float mix_accumulator = 0.0f;
+		U32 mix_count = 0;
+
+		NesApuStats apu_stats;
+
 	private:
 		void clock_quarter_frame();
 		void clock_half_frame();
+		void clock_timers() noexcept;
+		void clock_mixer() noexcept;
+
+		U8 pulse_1_output() const noexcept;
 	};
 }
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+#include <nes_types.hpp>
+
+namespace nesem
+{
+	enum class NesAudioFormat
+	{
+		// wav file with 32-bit float samples
+		wav_float,
+
+		// wav file with signed 16-bit samples
+		wav_pcm16,
+
+		// headerless little endian 32-bit float samples
+		raw_float,
+
+		// headerless little endian signed 16-bit samples
+		raw_pcm16,
+	};
+
+	// Captures the APU's mixed output to a file. Samples are collected into buffers on the emulation thread and
+	// handed to a background thread for conversion and writing, so pushing a sample never touches the file.
+	// Hook it up via the NesSettings audio callback:
+	//   .audio = [&capture](float sample) { capture.push(sample); }
+	class NesAudioCapture final
+	{
+	public:
+		static NesAudioCapture create(const std::filesystem::path &file_name, U32 sample_rate, NesAudioFormat format, size_t buffer_size = 4096) noexcept;
+
+		explicit NesAudioCapture() noexcept;
+		~NesAudioCapture();
+
+		NesAudioCapture(NesAudioCapture &&other) noexcept;
+		NesAudioCapture &operator=(NesAudioCapture &&other) noexcept;
+		NesAudioCapture(const NesAudioCapture &other) noexcept = delete;
+		NesAudioCapture &operator=(const NesAudioCapture &other) noexcept = delete;
+
+		explicit operator bool() const noexcept
+		{
+			return core != nullptr;
+		}
+
+		void push(float sample) noexcept
+		{
+			buffer.push_back(sample);
+
+			if (buffer.size() >= buffer_size) [[unlikely]]
+				submit();
+		}
+
+		// hand off any partially filled buffer to the writer
+		void flush() noexcept;
+
+		// flush, wait for the writer to finish and finalize the file. Called automatically on destruction
+		void close() noexcept;
+
+		// total samples pushed so far
+		[[nodiscard]] U64 sample_count() const noexcept;
+
+	private:
+		struct Core;
+		std::unique_ptr<Core> core;
+
+		// the buffer currently being filled, cached here so push doesn't need to go through the core
+		std::vector<float> buffer;
+		size_t buffer_size = 0;
+		U64 submitted = 0;
+
+		explicit NesAudioCapture(std::unique_ptr<Core> &&core, size_t buffer_size) noexcept;
+
+		void submit() noexcept;
+	};
+}
@@ -1,12 +1,16 @@
 #pragma once
 
 #include <array>
+#include <span>
 
+#include <nes_dirty_pages.hpp>
 #include <nes_types.hpp>
 
 namespace nesem
 {
 	class Nes;
+	class NesStateReader;
+	class NesStateWriter;
 	class NesCartridge;
 
 	class NesBus final
@@ -14,6 +18,8 @@ namespace nesem
 	public:
 		NesBus(Nes *nes) noexcept;
 
+		// clear work ram and the controller ports
+		void power_on() noexcept;
 		void clock() noexcept;
 
 		// just read addr without any additional handling, useful for visualizers, debuggers, etc
@@ -26,9 +32,26 @@ namespace nesem
 
 		U8 open_bus_read() const noexcept;
 
+		void save_state(NesStateWriter &writer) const noexcept;
+		void load_state(NesStateReader &reader) noexcept;
+
+		// everything but work ram, which forks share in pages instead
+		void save_registers(NesStateWriter &writer) const noexcept;
+		void load_registers(NesStateReader &reader) noexcept;
+
+		NesTrackedMemory tracked_ram() noexcept;
+
+		// the 2 KiB of work ram, for reading without going through the bus
+		[[nodiscard]] std::span<const U8> work_ram() const noexcept;
+
+		// hash of work ram, kept up to date on every write
+		[[nodiscard]] U64 memory_hash() const noexcept;
+
 	private:
 		Nes *nes = nullptr;
-		std::array<U8, 0x800> ram;
+		std::array<U8, 0x800> ram{};
+		NesDirtyPages ram_dirty;
+		NesMemoryHash ram_hash{NesHashedMemory::ram};
 		NesCartridge *cartridge = nullptr;
 
 		bool poll_input = false;
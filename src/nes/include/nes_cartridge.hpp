@@ -6,6 +6,7 @@
 #include <optional>
 #include <vector>
 
+#include <nes_dirty_pages.hpp>
 #include <nes_nvram.hpp>
 #include <nes_rom.hpp>
 #include <nes_types.hpp>
@@ -13,6 +14,8 @@
 namespace nesem
 {
 	class Nes;
+	class NesStateReader;
+	class NesStateWriter;
 
 	struct Bank
 	{
@@ -57,7 +60,7 @@ namespace nesem
 	class NesCartridge
 	{
 	public:
-		explicit NesCartridge(const Nes &nes, mappers::NesRom &&rom) noexcept;
+		explicit NesCartridge(const Nes &nes, mappers::NesRomImage &&rom) noexcept;
 
 		virtual ~NesCartridge() = default;
 
@@ -83,7 +86,25 @@ namespace nesem
 
 		virtual void signal_m2(bool rising) noexcept;
 
+		// saves cartridge memory and then lets the mapper save its registers
+		void save_state(NesStateWriter &writer) const noexcept;
+		void load_state(NesStateReader &reader) noexcept;
+
+		// everything but chr-ram, prg-ram and prg-nvram, which forks share in pages instead
+		void save_registers(NesStateWriter &writer) const noexcept;
+		void load_registers(NesStateReader &reader) noexcept;
+
+		// chr-ram, prg-ram and prg-nvram, in that order
+		std::array<NesTrackedMemory, 3> tracked_memory() noexcept;
+
+		// hash of chr-ram, prg-ram and prg-nvram, kept up to date on every write
+		[[nodiscard]] U64 memory_hash() const noexcept;
+
 	private:
+		// every mapper must save and restore all registers that are not derived from the rom
+		virtual void on_save_state(NesStateWriter &writer) const noexcept = 0;
+		virtual void on_load_state(NesStateReader &reader) noexcept = 0;
+
 		virtual U8 on_cpu_peek(Addr addr) const noexcept = 0;
 		virtual U8 on_cpu_read(Addr addr) noexcept;
 		virtual void on_cpu_write(Addr addr, U8 value) noexcept = 0;
@@ -120,7 +141,8 @@ namespace nesem
 		const Nes *nes = nullptr;
 
 	private:
-		mappers::NesRom nes_rom;
+		// shared with every other cartridge running the same rom
+		mappers::NesRomImage nes_rom;
 
 		std::vector<U8> chr_ram;
 		bool irq_signaled = false;
@@ -128,5 +150,15 @@ namespace nesem
 
 		std::vector<U8> prg_ram;
 		NesNvram prg_nvram;
+
+		NesDirtyPages chr_ram_dirty;
+		NesDirtyPages prg_ram_dirty;
+		NesDirtyPages prg_nvram_dirty;
+
+		NesMemoryHash chr_ram_hash{NesHashedMemory::chr_ram};
+		NesMemoryHash prg_ram_hash{NesHashedMemory::prg_ram};
+		NesMemoryHash prg_nvram_hash{NesHashedMemory::prg_nvram};
+
+		void rehash_memory() noexcept;
 	};
 }
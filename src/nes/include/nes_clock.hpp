@@ -7,6 +7,8 @@
 namespace nesem
 {
 	class Nes;
+	class NesStateReader;
+	class NesStateWriter;
 
 	// see: https://www.nesdev.org/wiki/Cycle_reference_chart
 	struct ClockRate
@@ -30,7 +32,7 @@ namespace nesem
 		constexpr U64 cpu_divisor = 12 / common_divisor;
 
 		// APU is clocked half as often as the cpu
-		constexpr U64 apu_divisor = (cpu_divisor * 2) / common_divisor;
+		constexpr U64 apu_divisor = (cpu_divisor * 2);
 
 		return {
 			.frequency = duration_cast<ClockRate::duration>(duration(1)),
@@ -76,6 +78,12 @@ namespace nesem
 		};
 	}
 
+	// the number of times per second the apu is clocked at the given clock rate
+	constexpr U64 apu_frequency(const ClockRate &clock_rate) noexcept
+	{
+		return std::chrono::seconds(1) / (clock_rate.frequency * clock_rate.apu_divisor);
+	}
+
 	enum class NesClockStep
 	{
 		None,
@@ -98,6 +106,15 @@ namespace nesem
 		// force stop the current tick/step. Used to preserve system state on an error
 		void stop() noexcept;
 
+		// number of master clock ticks since the rom was loaded
+		[[nodiscard]] U64 current_tick() const noexcept;
+
+		// the length of a master clock tick and how the components divide it
+		[[nodiscard]] const ClockRate &rate() const noexcept;
+
+		void save_state(NesStateWriter &writer) const noexcept;
+		void load_state(NesStateReader &reader) noexcept;
+
 	private:
 		Nes *nes;
 		ClockRate clock_rate;
@@ -1,10 +1,15 @@
 #pragma once
 
+#include <string>
+
 #include <nes_types.hpp>
 
 namespace nesem
 {
 	class Nes;
+	class NesBus;
+	class NesStateReader;
+	class NesStateWriter;
 
 	struct NesCpuState
 	{
@@ -16,6 +21,17 @@ namespace nesem
 		U8 Y;
 	};
 
+	// a single decoded instruction, see disassemble
+	struct NesInstruction
+	{
+		Addr addr;
+		int size; // in bytes, including the opcode
+		std::string text;
+	};
+
+	// decode the instruction at addr. Memory is only peeked at, so disassembling never disturbs the system
+	NesInstruction disassemble(const NesBus &bus, Addr addr) noexcept;
+
 	constexpr Addr cpu_nmi_lo = Addr{0xFFFA};
 	constexpr Addr cpu_nmi_hi = Addr{0xFFFB};
 	constexpr Addr cpu_reset_lo = Addr{0xFFFC};
@@ -31,6 +47,7 @@ namespace nesem
 		explicit NesCpu(Nes *nes) noexcept;
 
 		// signals
+		void power_on() noexcept;
 		void reset(Addr pc_addr = Addr{0}) noexcept;
 		void nmi() noexcept;
 		void dma(U8 page) noexcept;
@@ -41,6 +58,9 @@ namespace nesem
 		U64 current_cycle() const noexcept;
 		NesCpuState state() const noexcept;
 
+		void save_state(NesStateWriter &writer) const noexcept;
+		void load_state(NesStateReader &reader) noexcept;
+
 	private:
 		// helper functions
 
@@ -168,9 +188,9 @@ namespace nesem
 		Addr PC{0}; // program counter
 		U8 S = 0; // stack pointer, starts from the top of page 1 and grows downward
 		util::Flags<ProcessorStatus> P; // processor status
-		U8 A; // Accumulator
-		U8 X; // Index register X
-		U8 Y; // Index register Y
+		U8 A = 0; // Accumulator
+		U8 X = 0; // Index register X
+		U8 Y = 0; // Index register Y
 
 		// other state
 
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <memory>
+
+#include <nes_types.hpp>
+
+namespace nesem
+{
+	class Nes;
+
+	// The commands of the debug protocol. Every packet, either way, is a little endian U32 size counting everything
+	// after it, a command byte and the command's payload, all values little endian. Responses carry the command
+	// they answer with the top bit set, in the order the requests were sent.
+	enum class NesDebugCommand : U8
+	{
+		// U16 count, then count times U16 addr and U16 size. Answered with all the bytes read, in order. Memory is only
+		// peeked at, so reading never disturbs the system
+		read_cpu = 0x01,
+		read_ppu = 0x02,
+
+		// answered with the registers, see below
+		registers = 0x03,
+
+		// U16 addr of an instruction to halt before
+		add_breakpoint = 0x04,
+		remove_breakpoint = 0x05,
+		clear_breakpoints = 0x06,
+
+		// stop running, answered with the registers
+		halt = 0x07,
+		resume = 0x08,
+
+		// U8 NesClockStep and U32 count, run while halted and answered with the registers afterwards. A count of more
+		// than about a second's worth of steps, e.g. 60 frames, is refused with too_large
+		step = 0x09,
+
+		// sent unprompted when the system halts on a breakpoint: U16 addr, then the registers
+		stopped = 0x40,
+
+		// U8 command and U8 NesDebugError, sent instead of a response when a request fails
+		error = 0x7F,
+	};
+
+	// Registers are sent as U16 PC, U8 S, U8 P, U8 A, U8 X, U8 Y, U64 cpu cycle, U64 frame and U8 halted
+	enum class NesDebugError : U8
+	{
+		unknown_command = 1,
+		bad_request = 2,
+		no_rom = 3,
+		too_large = 4,
+	};
+
+	// A debug server on a Unix domain socket, for inspecting and stepping a system with no front end to do it in.
+	// One client at a time is served. A background thread does all the socket work and queues requests, and the
+	// emulation thread answers them when it calls run_frame, so a slow client never holds up the emulation and the
+	// emulation never waits on the client.
+	//
+	// Run it in place of stepping a frame while a client is attached, which costs nothing more than checking
+	// attached() once a frame when no one is:
+	//   if (!server.attached())
+	//       nes.step(NesClockStep::OneFrame);
+	//   else if (!server.run_frame(nes))
+	//       server.wait(std::chrono::milliseconds(16));
+	class NesDebugServer final
+	{
+	public:
+		// listen on a socket at path, replacing anything already there. With start_halted, each client starts out
+		// with the system halted so nothing runs before it has had a look. Only implemented for POSIX systems
+		static NesDebugServer create(const std::filesystem::path &path, bool start_halted = false) noexcept;
+
+		explicit NesDebugServer() noexcept;
+		~NesDebugServer();
+
+		NesDebugServer(NesDebugServer &&other) noexcept;
+		NesDebugServer &operator=(NesDebugServer &&other) noexcept;
+		NesDebugServer(const NesDebugServer &other) noexcept = delete;
+		NesDebugServer &operator=(const NesDebugServer &other) noexcept = delete;
+
+		explicit operator bool() const noexcept
+		{
+			return core != nullptr;
+		}
+
+		[[nodiscard]] bool attached() const noexcept;
+
+		// answer any waiting requests and, unless halted, run a frame, checking every instruction for breakpoints if
+		// any are set. Returns true if a whole frame was run
+		bool run_frame(Nes &nes) noexcept;
+
+		// block until a request comes in, a client attaches or detaches, or the timeout passes
+		void wait(std::chrono::milliseconds timeout) noexcept;
+
+	private:
+		struct Core;
+		std::unique_ptr<Core> core;
+
+		explicit NesDebugServer(std::unique_ptr<Core> &&core) noexcept;
+	};
+}
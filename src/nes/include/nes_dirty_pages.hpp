@@ -0,0 +1,66 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <span>
+#include <vector>
+
+#include <nes_state_hash.hpp>
+#include <nes_types.hpp>
+
+namespace nesem
+{
+	// Tracks which pages of a block of memory have been written to since the last clear(). Forks use this to only
+	// copy the pages that changed, see Nes::fork
+	class NesDirtyPages final
+	{
+	public:
+		static constexpr size_t page_size = 256;
+
+		// track memory_size bytes, starting with every page dirty
+		void resize(size_t memory_size) noexcept
+		{
+			pages = (memory_size + page_size - 1) / page_size;
+			bits.assign((pages + 63) / 64, 0);
+			mark_all();
+		}
+
+		void mark(size_t addr) noexcept
+		{
+			auto page = addr / page_size;
+			bits[page / 64] |= U64{1} << (page % 64);
+		}
+
+		void mark_all() noexcept
+		{
+			std::ranges::fill(bits, ~U64{0});
+		}
+
+		void clear() noexcept
+		{
+			std::ranges::fill(bits, U64{0});
+		}
+
+		[[nodiscard]] bool is_dirty(size_t page) const noexcept
+		{
+			return (bits[page / 64] & (U64{1} << (page % 64))) != 0;
+		}
+
+		[[nodiscard]] size_t page_count() const noexcept
+		{
+			return pages;
+		}
+
+	private:
+		std::vector<U64> bits;
+		size_t pages = 0;
+	};
+
+	// a block of memory paired with the pages of it that were written to and its hash
+	struct NesTrackedMemory
+	{
+		std::span<U8> memory;
+		NesDirtyPages *dirty = nullptr;
+		NesMemoryHash *hash = nullptr;
+	};
+}
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include <nes_pool.hpp>
+#include <nes_types.hpp>
+
+namespace nesem
+{
+	class Nes;
+
+	struct NesEnvSettings
+	{
+		std::filesystem::path rom;
+		std::filesystem::path nes20db_filename;
+
+		// also produce the screen as grayscale at half the resolution in each direction
+		bool grayscale = false;
+
+		bool audio = false;
+		U32 sample_rate = 44100;
+	};
+
+	struct NesEnvObservation
+	{
+		static constexpr int width = 256;
+		static constexpr int height = 240;
+		static constexpr int grayscale_width = width / 2;
+		static constexpr int grayscale_height = height / 2;
+
+		// width * height pixels, each holding the ppu's color index in the low 6 bits and its emphasis bits above them.
+		// Save states don't include the picture, so after a reset this still shows whatever was drawn last
+		std::span<const U16> screen;
+
+		// grayscale_width * grayscale_height luminance values, or empty if grayscale is off
+		std::span<const U8> grayscale;
+
+		// the 2 KiB of work ram, where games keep the score, lives, positions and such
+		std::span<const U8> ram;
+
+		// the samples produced during the step, or empty if audio is off
+		std::span<const float> audio;
+	};
+
+	struct NesEnvInfo
+	{
+		// the ppu's frame counter
+		U64 frame = 0;
+
+		// frames emulated by this step
+		U64 frames = 0;
+
+		U64 state_hash = 0;
+	};
+
+	// the views are into the environment's own buffers and stay valid until its next reset or step
+	struct NesEnvStep
+	{
+		NesEnvObservation observation;
+		NesEnvInfo info;
+	};
+
+	// halve the screen in each direction, averaging each 2x2 block of pixels' luminance. Uses SIMD where available
+	void downsample_grayscale(std::span<const U16> screen, std::span<U8> out) noexcept;
+
+	// A reinforcement learning environment in the style of gym. The buttons held for a step apply to player 1 for
+	// frameskip frames, and only the last of them is drawn, so skipped frames cost only the emulation. Observations
+	// are views of the framebuffer and ram, copied nowhere
+	class NesEnv final
+	{
+	public:
+		// loads the rom, returning an empty environment if it can't be
+		static NesEnv create(const NesEnvSettings &settings) noexcept;
+
+		explicit NesEnv() noexcept;
+		~NesEnv();
+
+		NesEnv(NesEnv &&other) noexcept;
+		NesEnv &operator=(NesEnv &&other) noexcept;
+		NesEnv(const NesEnv &other) noexcept = delete;
+		NesEnv &operator=(const NesEnv &other) noexcept = delete;
+
+		explicit operator bool() const noexcept
+		{
+			return core != nullptr;
+		}
+
+		// go back to the state right after the rom was loaded
+		NesEnvStep reset() noexcept;
+
+		// continue from a save state of the same rom. If it can't be loaded the environment is reset instead
+		NesEnvStep reset(std::span<const std::byte> state) noexcept;
+
+		// hold the buttons in action_mask, a combination of Buttons, for frameskip frames
+		NesEnvStep step(U8 action_mask, int frameskip = 1) noexcept;
+
+		[[nodiscard]] Nes &nes() noexcept;
+
+	private:
+		struct Core;
+		std::unique_ptr<Core> core;
+
+		explicit NesEnv(std::unique_ptr<Core> &&core) noexcept;
+	};
+
+	// Many environments stepped together on a NesPool, one step per instance per call
+	class NesVectorEnv final
+	{
+	public:
+		// threads is as for NesPoolSettings. Returns an empty environment if the rom can't be loaded
+		static NesVectorEnv create(const NesEnvSettings &settings, size_t instances, unsigned int threads = 0) noexcept;
+
+		explicit NesVectorEnv() noexcept;
+		~NesVectorEnv();
+
+		NesVectorEnv(NesVectorEnv &&other) noexcept;
+		NesVectorEnv &operator=(NesVectorEnv &&other) noexcept;
+		NesVectorEnv(const NesVectorEnv &other) noexcept = delete;
+		NesVectorEnv &operator=(const NesVectorEnv &other) noexcept = delete;
+
+		explicit operator bool() const noexcept
+		{
+			return core != nullptr;
+		}
+
+		[[nodiscard]] size_t size() const noexcept;
+
+		// reset every environment to the state right after the rom was loaded
+		std::span<const NesEnvStep> reset() noexcept;
+
+		// reset one environment from a save state, as NesEnv::reset(state)
+		const NesEnvStep &reset(size_t index, std::span<const std::byte> state) noexcept;
+
+		// step every environment in parallel, each with its own action from action_masks
+		std::span<const NesEnvStep> step(std::span<const U8> action_masks, int frameskip = 1) noexcept;
+
+		// throughput of the environments and how busy the pool kept the cores
+		[[nodiscard]] NesPoolMetrics metrics() const noexcept;
+
+		// only safe between calls
+		[[nodiscard]] Nes &nes(size_t index) noexcept;
+
+	private:
+		struct Core;
+		std::unique_ptr<Core> core;
+
+		explicit NesVectorEnv(std::unique_ptr<Core> &&core) noexcept;
+	};
+}
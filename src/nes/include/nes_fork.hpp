@@ -0,0 +1,47 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include <nes_dirty_pages.hpp>
+#include <nes_types.hpp>
+
+namespace nesem
+{
+	// A frozen copy of a running system, made with Nes::fork and continued with Nes::restore. The registers of every
+	// component and the ppu's small memories are copied outright, but work ram, chr-ram and prg-ram are held in
+	// immutable pages shared with the fork taken before it, so a fork only allocates the pages written to since then.
+	// Copying a fork shares everything, and the rom is never part of a fork at all, so thousands of forks cost little
+	// more than their registers.
+	class NesFork final
+	{
+	public:
+		using Page = std::array<U8, NesDirtyPages::page_size>;
+		using PageTable = std::vector<std::shared_ptr<const Page>>;
+
+		// work ram, chr-ram, prg-ram and prg-nvram
+		static constexpr size_t memory_count = 4;
+		using PageTables = std::array<PageTable, memory_count>;
+
+		explicit operator bool() const noexcept
+		{
+			return !registers.empty();
+		}
+
+		// the bytes allocated when this fork was taken, the registers plus any pages that were written since the
+		// previous fork
+		[[nodiscard]] size_t size() const noexcept
+		{
+			return registers.size() + new_pages * NesDirtyPages::page_size;
+		}
+
+	private:
+		friend class Nes;
+
+		std::vector<std::byte> registers;
+		PageTables pages;
+		size_t new_pages = 0;
+	};
+}
@@ -3,6 +3,7 @@
 #include <memory>
 #include <utility>
 
+#include <nes_state.hpp>
 #include <nes_types.hpp>
 
 namespace nesem
@@ -27,6 +28,16 @@ namespace nesem
 			return on_read();
 		}
 
+		void save_state(NesStateWriter &writer) const noexcept
+		{
+			writer.write(data);
+		}
+
+		void load_state(NesStateReader &reader) noexcept
+		{
+			reader.read(data);
+		}
+
 		NesInputDevice(const NesInputDevice &other) noexcept = delete;
 		NesInputDevice(NesInputDevice &&other) noexcept = delete;
 		NesInputDevice &operator=(const NesInputDevice &other) noexcept = delete;
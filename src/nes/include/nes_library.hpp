@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <nes_rom.hpp>
+#include <nes_types.hpp>
+
+namespace nesem
+{
+	// what the library knows about one rom file, from the nes20db if the rom is in it and its header otherwise
+	struct NesLibraryEntry
+	{
+		std::filesystem::path path;
+
+		// the nes20db doesn't name games, so this is the file's name without its extension
+		std::string title;
+		std::string sha1;
+
+		// the file's size and modification time when it was scanned
+		U64 file_size = 0;
+		int64_t modified = 0;
+
+		int mapper = 0;
+		int submapper = 0;
+		int region = 0;
+		mappers::MirroringMode mirroring = mappers::MirroringMode::horizontal;
+		bool battery = false;
+		bool in_db = false;
+
+		size_t prg_rom_size = 0;
+		size_t chr_rom_size = 0;
+		size_t prg_ram_size = 0;
+		size_t chr_ram_size = 0;
+	};
+
+	struct NesLibraryScanSettings
+	{
+		// searched for .nes files, and .gz and .zip archives of them, including every directory below them
+		std::vector<std::filesystem::path> directories;
+		std::filesystem::path nes20db_filename;
+
+		// where the rom hash cache lives, so rescanning only hashes files that changed. Empty to hash everything
+		std::filesystem::path cache_dir;
+
+		// threads hashing files, or 0 for one per core
+		unsigned int threads = 0;
+	};
+
+	// every condition set must match. title matches any part of an entry's title, ignoring case
+	struct NesLibraryQuery
+	{
+		std::optional<int> mapper;
+		std::optional<int> region;
+		std::optional<bool> battery;
+		std::optional<bool> in_db;
+		std::string title;
+	};
+
+	// An index of the roms in a set of directories, for picking roms without opening any of them. Scanning hashes
+	// files in parallel, each a chunk at a time, so it takes the same memory however large the files are and only
+	// holds a path and a few numbers per rom. Saved as fixed size records followed by their paths and titles
+	struct NesLibrary
+	{
+		// sorted by path
+		std::vector<NesLibraryEntry> entries;
+
+		[[nodiscard]] static NesLibrary scan(const NesLibraryScanSettings &settings) noexcept;
+
+		// entries matching the query, in the library's order
+		[[nodiscard]] std::vector<const NesLibraryEntry *> find(const NesLibraryQuery &query) const noexcept;
+
+		bool save(const std::filesystem::path &filename) const noexcept;
+		[[nodiscard]] static std::optional<NesLibrary> load(const std::filesystem::path &filename) noexcept;
+	};
+}
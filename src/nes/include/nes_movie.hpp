@@ -0,0 +1,127 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <nes_types.hpp>
+
+namespace nesem
+{
+	class Nes;
+
+	enum class NesMovieEventType : U8
+	{
+		reset,
+		power_cycle,
+	};
+
+	struct NesMovieEvent
+	{
+		// the master clock tick the event happened on, see NesClock::current_tick
+		U64 tick = 0;
+		NesMovieEventType type = NesMovieEventType::reset;
+	};
+
+	// A recording of everything fed into the system from outside: a save state to start from, the value each
+	// controller port returned for each frame, and any resets or power cycles. Replaying it gives exactly the same
+	// run, which makes for reproducible test and benchmark workloads.
+	struct NesMovie
+	{
+		// sha1 of the rom the movie was recorded with
+		std::string sha1;
+		std::vector<std::byte> start_state;
+
+		// one entry per frame, holding the value polled from each port during that frame
+		std::vector<std::array<U8, 2>> input;
+		std::vector<NesMovieEvent> events;
+
+		[[nodiscard]] size_t frame_count() const noexcept
+		{
+			return input.size();
+		}
+
+		bool save(const std::filesystem::path &filename) const noexcept;
+		[[nodiscard]] static std::optional<NesMovie> load(const std::filesystem::path &filename) noexcept;
+	};
+
+	// Records a movie while the system runs. Input devices should send their poll results through poll(), and
+	// resets and power cycles should go through the recorder so they land in the movie at the exact clock tick.
+	class NesMovieRecorder final
+	{
+	public:
+		// start recording from the current state of nes, which must have a rom loaded
+		bool start(const Nes &nes) noexcept;
+
+		// stop recording and hand over the movie
+		NesMovie stop() noexcept;
+
+		[[nodiscard]] bool recording() const noexcept;
+
+		// pass the live state of port 0 or 1 through the recorder. The first poll of each frame is recorded and
+		// returned for the rest of that frame, so a playback sees exactly what the game saw. Returns live unchanged
+		// when not recording
+		U8 poll(int port, U8 live) noexcept;
+
+		void reset(Nes &nes) noexcept;
+		void power_cycle(Nes &nes) noexcept;
+
+	private:
+		const Nes *nes = nullptr;
+		NesMovie movie;
+
+		// added to the ppu frame to get the movie frame. The ppu frame restarts on reset, the movie frame doesn't
+		U64 frame_offset = 0;
+
+		// one past the movie frame each port was last latched on
+		std::array<U64, 2> latched{};
+
+		[[nodiscard]] U64 current_frame() const noexcept;
+		void record(Nes &nes, NesMovieEventType type) noexcept;
+	};
+
+	// where a player is in its movie, so playback can continue from a save state taken at the same point
+	struct NesMoviePosition
+	{
+		// added to the ppu frame to get the movie frame
+		U64 frame_offset = 0;
+		size_t next_event = 0;
+	};
+
+	// Plays a movie back. Input devices should poll() the player instead of live input.
+	class NesMoviePlayer final
+	{
+	public:
+		explicit NesMoviePlayer(NesMovie movie) noexcept;
+
+		// load the movie's start state into nes. Fails if nes has a different rom loaded
+		bool start(Nes &nes) noexcept;
+
+		// continue playback on nes from a state saved at position, possibly by another instance playing the same
+		// movie. Fails if nes has a different rom loaded or the state can't be loaded
+		bool resume(Nes &nes, std::span<const std::byte> state, NesMoviePosition position) noexcept;
+
+		// run until the next frame completes, applying any events on the way. Returns false once the movie is over
+		bool run_frame() noexcept;
+
+		// the recorded value of port 0 or 1 for the current frame
+		[[nodiscard]] U8 poll(int port) const noexcept;
+
+		[[nodiscard]] bool finished() const noexcept;
+		[[nodiscard]] U64 current_frame() const noexcept;
+		[[nodiscard]] NesMoviePosition position() const noexcept;
+		[[nodiscard]] const NesMovie &movie() const noexcept;
+
+	private:
+		Nes *nes = nullptr;
+		NesMovie recording;
+		U64 frame_offset = 0;
+		size_t next_event = 0;
+
+		void step_frame() noexcept;
+	};
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <filesystem>
+#include <span>
+
+#include <nes_movie.hpp>
+#include <nes_types.hpp>
+
+namespace nesem
+{
+	struct NesRenderedFrame
+	{
+		static constexpr int width = 256;
+		static constexpr int height = 240;
+
+		// counting from the start of the movie
+		U64 frame = 0;
+
+		// width * height pixels, each holding the ppu's color index in the low 6 bits and its emphasis bits above them
+		std::span<const U16> pixels;
+
+		// the audio samples produced while the frame was drawn
+		std::span<const float> audio;
+	};
+
+	using NesRenderedFrameFn = CallbackFn<void(const NesRenderedFrame &frame)>;
+
+	struct NesMovieRenderSettings
+	{
+		// the rom the movie was recorded with
+		std::filesystem::path rom;
+		std::filesystem::path nes20db_filename;
+		U32 sample_rate = 44100;
+
+		// frames between keyframes, ten seconds at 60 fps. Each segment between keyframes is rendered on one thread
+		U64 keyframe_interval = 600;
+
+		// threads rendering segments, or 0 for one per core
+		unsigned int threads = 0;
+
+		// roughly how much memory segments rendered ahead of on_frame may take, each is about 75 MB at the default
+		// interval. Fewer segments are rendered at once to stay under it, but always at least one
+		size_t memory_limit = size_t{512} * 1024 * 1024;
+	};
+
+	struct NesMovieRenderResult
+	{
+		// frames handed to on_frame
+		U64 frames = 0;
+
+		// false if the rom couldn't be loaded, the movie wasn't recorded with it, or rendering failed part way, in
+		// which case frames only covers the start of the movie
+		bool success = false;
+	};
+
+	// Render every frame of a movie for exporting to video, using all cores. A quick pass with video and audio
+	// disabled saves a keyframe every keyframe_interval frames, and the segments starting at each keyframe are
+	// rendered in parallel as soon as their keyframe is ready. Finished segments are handed to on_frame in order on
+	// the calling thread, and rendering never gets more than threads + 1 segments ahead of it, nor more than fit in
+	// memory_limit, which bounds the memory used
+	NesMovieRenderResult render_movie(const NesMovie &movie, const NesMovieRenderSettings &settings, NesRenderedFrameFn on_frame) noexcept;
+}
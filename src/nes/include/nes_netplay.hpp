@@ -0,0 +1,150 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include <nes_types.hpp>
+
+namespace nesem
+{
+	class Nes;
+
+	// A non-blocking UDP socket that talks to a single peer. Only implemented for POSIX systems
+	class NesNetplaySocket final
+	{
+	public:
+		// bind to local_port on all interfaces, 0 picks any free port
+		static NesNetplaySocket create(U16 local_port) noexcept;
+
+		explicit NesNetplaySocket() noexcept;
+		~NesNetplaySocket();
+
+		NesNetplaySocket(NesNetplaySocket &&other) noexcept;
+		NesNetplaySocket &operator=(NesNetplaySocket &&other) noexcept;
+		NesNetplaySocket(const NesNetplaySocket &other) noexcept = delete;
+		NesNetplaySocket &operator=(const NesNetplaySocket &other) noexcept = delete;
+
+		explicit operator bool() const noexcept
+		{
+			return core != nullptr;
+		}
+
+		// set the peer all packets are sent to. Packets from anyone else are ignored
+		bool connect(std::string_view host, U16 port) noexcept;
+
+		[[nodiscard]] U16 local_port() const noexcept;
+
+		bool send(std::span<const std::byte> packet) noexcept;
+
+		// receive one waiting packet into buffer, returns its size or 0 if nothing is waiting
+		size_t receive(std::span<std::byte> buffer) noexcept;
+
+	private:
+		struct Core;
+		std::unique_ptr<Core> core;
+
+		explicit NesNetplaySocket(std::unique_ptr<Core> &&core) noexcept;
+	};
+
+	struct NesNetplayStats
+	{
+		U64 frames = 0;
+
+		// frames run_frame refused to run because the remote player fell too far behind
+		U64 stalls = 0;
+
+		U64 rollbacks = 0;
+		U64 frames_resimulated = 0;
+		int max_rollback_frames = 0;
+
+		// wall clock time spent restoring and re-simulating, in seconds
+		double rollback_time = 0.0;
+		double last_rollback_time = 0.0;
+		double max_rollback_time = 0.0;
+
+		// how many frames a rollback can re-run within one 60hz host frame, going by the rollbacks seen so far
+		[[nodiscard]] double frames_per_host_frame() const noexcept
+		{
+			if (rollback_time <= 0.0)
+				return 0.0;
+
+			return double(frames_resimulated) / rollback_time / 60.0;
+		}
+	};
+
+	// Two player rollback netplay. Each side runs its own Nes with the same rom from power on, and sends its local
+	// input for every frame to the other side. Remote input that hasn't arrived yet is predicted to be the same as the
+	// last input that did. When the real input turns out different, the session loads the state saved before that
+	// frame and quietly re-runs every frame since, all before the current frame is shown.
+	//
+	// The Nes input devices must poll() the session for both ports.
+	class NesNetplaySession final
+	{
+	public:
+		static constexpr int max_rollback_limit = 30;
+
+		// local_player is the port (0 or 1) local input is fed into. max_rollback is the furthest back a rollback may
+		// go, and so the furthest ahead of the remote player this side may run
+		NesNetplaySession(Nes &nes, NesNetplaySocket &&socket, int local_player, int max_rollback = 8) noexcept;
+
+		// exchange input with the remote player, roll back if a prediction was wrong, then run one frame with
+		// local_input. Returns false without running a frame if the remote player has fallen too far behind
+		bool run_frame(U8 local_input) noexcept;
+
+		// exchange input and roll back if needed without running a new frame, e.g. while waiting on the remote player
+		void sync() noexcept;
+
+		// the input for port 0 or 1 on the frame being run
+		[[nodiscard]] U8 poll(int port) const noexcept;
+
+		// the next frame to run
+		[[nodiscard]] U32 current_frame() const noexcept;
+
+		// every frame before this has confirmed input from the remote player
+		[[nodiscard]] U32 confirmed_frame() const noexcept;
+
+		[[nodiscard]] const NesNetplayStats &stats() const noexcept;
+
+	private:
+		static constexpr U32 ring_size = 128;
+
+		struct FrameInput
+		{
+			U32 frame = ~U32{0};
+			U8 local = 0;
+			U8 remote = 0;
+		};
+
+		Nes *nes;
+		NesNetplaySocket socket;
+		int local_player;
+		int max_rollback;
+
+		std::array<FrameInput, ring_size> inputs{};
+
+		// the state before each of the last max_rollback frames, one after another
+		std::vector<std::byte> snapshots;
+		size_t snapshot_size = 0;
+
+		U32 frame = 0;
+		U32 remote_frame = 0;
+
+		// the frame currently being run, which poll() answers for
+		U32 running_frame = 0;
+
+		NesNetplayStats session_stats;
+
+		FrameInput &input_for(U32 frame_number) noexcept;
+		std::span<std::byte> snapshot_for(U32 frame_number) noexcept;
+		U8 predict_remote(U32 frame_number) noexcept;
+
+		void send_input() noexcept;
+		U32 receive_input() noexcept;
+		void rollback(U32 from) noexcept;
+		void run_one(U32 frame_number) noexcept;
+	};
+}
@@ -31,6 +31,16 @@ namespace nesem
 			return data.size();
 		}
 
+		std::span<const U8> bytes() const noexcept
+		{
+			return data;
+		}
+
+		std::span<U8> bytes() noexcept
+		{
+			return data;
+		}
+
 #if defined(__cpp_explicit_this_parameter)
 		auto &&operator[](this auto &&self, size_t addr) noexcept
 		{
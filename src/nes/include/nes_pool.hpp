@@ -0,0 +1,138 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+#include <nes_types.hpp>
+
+namespace nesem
+{
+	class Nes;
+
+	// what an instance produced, written only by the thread running it
+	struct NesPoolOutput
+	{
+		static constexpr int width = 256;
+		static constexpr int height = 240;
+
+		// the last frame drawn, each pixel holding the ppu's color index in the low 6 bits and its emphasis bits above
+		std::vector<U16> screen = std::vector<U16>(width * height);
+
+		// the samples produced by the instance's last job
+		std::vector<float> audio;
+	};
+
+	struct NesInstanceMetrics
+	{
+		U64 jobs = 0;
+		U64 frames = 0;
+
+		// time spent running this instance's jobs
+		std::chrono::nanoseconds busy{0};
+
+		[[nodiscard]] double frames_per_second() const noexcept
+		{
+			auto seconds = std::chrono::duration<double>(busy).count();
+			return seconds > 0.0 ? double(frames) / seconds : 0.0;
+		}
+	};
+
+	struct NesPoolMetrics
+	{
+		std::vector<NesInstanceMetrics> instances;
+		unsigned int threads = 0;
+
+		// jobs a thread took from another thread's queue
+		U64 steals = 0;
+
+		// wall time since the pool was created or its metrics reset, and the time the threads spent running jobs
+		std::chrono::nanoseconds elapsed{0};
+		std::chrono::nanoseconds busy{0};
+
+		// the fraction of the threads' time spent running jobs, 1.0 when every core was kept busy
+		[[nodiscard]] double utilization() const noexcept
+		{
+			auto available = std::chrono::duration<double>(elapsed).count() * threads;
+			return available > 0.0 ? std::chrono::duration<double>(busy).count() / available : 0.0;
+		}
+	};
+
+	struct NesPoolSettings
+	{
+		size_t instances = 1;
+
+		// threads running jobs, or 0 for one per core
+		unsigned int threads = 0;
+
+		U32 sample_rate = 44100;
+		bool video = true;
+		bool audio = true;
+		std::filesystem::path nes20db_filename;
+	};
+
+	// a job for a single instance, returning the number of frames it emulated for the metrics
+	using NesPoolJob = CallbackFn<U64(Nes &nes)>;
+
+	// Owns a number of independent instances and runs jobs on them using every core. Jobs for the same instance run
+	// in the order they were submitted, one at a time, and jobs for different instances run in parallel. Each thread
+	// keeps its own queue of instances with work to do and steals from the others when it runs dry, so a few slow
+	// instances don't hold up the rest.
+	//
+	// Every instance draws into its own output and reads its own input, so instances share nothing mutable. An
+	// instance, its output and its input may only be touched from outside while the pool is idle, i.e. after wait()
+	class NesPool final
+	{
+	public:
+		static NesPool create(const NesPoolSettings &settings) noexcept;
+
+		explicit NesPool() noexcept;
+		~NesPool();
+
+		NesPool(NesPool &&other) noexcept;
+		NesPool &operator=(NesPool &&other) noexcept;
+		NesPool(const NesPool &other) noexcept = delete;
+		NesPool &operator=(const NesPool &other) noexcept = delete;
+
+		explicit operator bool() const noexcept
+		{
+			return core != nullptr;
+		}
+
+		[[nodiscard]] size_t size() const noexcept;
+
+		// load a rom into every instance in parallel and wait for them. Returns false if any instance failed
+		bool load_rom(const std::filesystem::path &filename) noexcept;
+
+		// queue a job for an instance
+		void submit(size_t index, NesPoolJob job) noexcept;
+
+		// queue running an instance for a number of frames
+		void run_frames(size_t index, U64 frames) noexcept;
+
+		// queue running every instance for a number of frames
+		void run_frames(U64 frames) noexcept;
+
+		// block until every queued job has finished
+		void wait() noexcept;
+
+		// only safe while the pool is idle
+		[[nodiscard]] Nes &instance(size_t index) noexcept;
+		[[nodiscard]] const NesPoolOutput &output(size_t index) const noexcept;
+
+		// set the buttons an instance reads from controller port 0 or 1. Only safe while the pool is idle, or from a job
+		// running on that instance
+		void set_input(size_t index, int port, U8 buttons) noexcept;
+
+		// safe to call at any time, though the numbers of running jobs only count once the job is done
+		[[nodiscard]] NesPoolMetrics metrics() const noexcept;
+		void reset_metrics() noexcept;
+
+	private:
+		struct Core;
+		std::unique_ptr<Core> core;
+
+		explicit NesPool(std::unique_ptr<Core> &&core) noexcept;
+	};
+}
@@ -2,11 +2,14 @@
 
 #include <array>
 
+#include <nes_state_hash.hpp>
 #include <nes_types.hpp>
 
 namespace nesem
 {
 	class Nes;
+	class NesStateReader;
+	class NesStateWriter;
 	class NesCartridge;
 
 	struct NesPatternTable
@@ -45,6 +48,18 @@ namespace nesem
 		void load_cartridge(NesCartridge *cartridge) noexcept;
 		bool clock() noexcept;
 
+		void save_state(NesStateWriter &writer) const noexcept;
+		void load_state(NesStateReader &reader) noexcept;
+
+		// the state is split in two so memory can be hashed and forked on its own
+		void save_memory(NesStateWriter &writer) const noexcept;
+		void load_memory(NesStateReader &reader) noexcept;
+		void save_registers(NesStateWriter &writer) const noexcept;
+		void load_registers(NesStateReader &reader) noexcept;
+
+		// hash of the nametables, palettes and oam, kept up to date on every write
+		[[nodiscard]] U64 memory_hash() const noexcept;
+
 		// PPU bus IO
 
 		U8 read(Addr addr) noexcept;
@@ -116,6 +131,12 @@ namespace nesem
 		std::array<U8, 32> palettes{};
 		std::array<U8, 256> oam{};
 
+		NesMemoryHash nametable_hash{NesHashedMemory::nametable};
+		NesMemoryHash palettes_hash{NesHashedMemory::palettes};
+		NesMemoryHash oam_hash{NesHashedMemory::oam};
+
+		void rehash_memory() noexcept;
+
 		// working buffer for evaluating sprites for the next scanline
 		std::array<U8, 8 * 4> evaluated_sprites{};
 
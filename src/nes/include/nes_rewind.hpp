@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <span>
+#include <vector>
+
+#include <nes_types.hpp>
+
+namespace nesem
+{
+	class Nes;
+
+	// Keeps a history of save states in a fixed memory budget so emulation can be stepped backwards a frame at a time.
+	// Every keyframe_interval frames a full state is stored, and the frames between are stored as the XOR of the state
+	// against the keyframe, run length encoded. Most of the state doesn't change from frame to frame, so the XOR is
+	// mostly zeros and compresses well. When the budget is full, the oldest keyframe and its deltas are dropped.
+	class NesRewind final
+	{
+	public:
+		explicit NesRewind(size_t budget_bytes, size_t keyframe_interval = 60) noexcept;
+
+		// capture the current state. Call once per frame
+		void push(const Nes &nes) noexcept;
+
+		// restore the most recently captured state and remove it from the history. Returns false if there is no history left
+		bool step_back(Nes &nes) noexcept;
+
+		void clear() noexcept;
+
+		[[nodiscard]] size_t frame_count() const noexcept;
+		[[nodiscard]] size_t memory_used() const noexcept;
+		[[nodiscard]] size_t budget() const noexcept;
+
+		// how many seconds of history the captured frames represent, given the system's frame rate
+		[[nodiscard]] double seconds_of_history(double frames_per_second = 60.0988) const noexcept;
+
+		// how many seconds of history fit in one MiB at the current average compressed frame size
+		[[nodiscard]] double seconds_per_mib(double frames_per_second = 60.0988) const noexcept;
+
+	private:
+		struct Entry
+		{
+			size_t offset;
+			size_t size;
+			bool keyframe;
+		};
+
+		std::vector<std::byte> storage;
+		std::deque<Entry> entries;
+		size_t write_pos = 0;
+		size_t used = 0;
+		size_t keyframe_interval;
+		size_t frames_since_keyframe = 0;
+
+		// scratch buffers sized to the state, allocated on first use so pushing doesn't allocate every frame
+		std::vector<std::byte> current;
+		std::vector<std::byte> keyframe;
+		std::vector<std::byte> encoded;
+
+		bool store(std::span<const std::byte> data, bool is_keyframe) noexcept;
+		void drop_oldest_group() noexcept;
+	};
+
+	namespace rewind
+	{
+		// encode the XOR of state and base as alternating runs of zero bytes and literal bytes. Returns the encoded size,
+		// or 0 if the encoding would not fit in out
+		size_t encode_delta(std::span<const std::byte> state, std::span<const std::byte> base, std::span<std::byte> out) noexcept;
+
+		// reverse of encode_delta, out must start as a copy of base. Returns false if the delta is malformed
+		bool decode_delta(std::span<const std::byte> delta, std::span<std::byte> out) noexcept;
+	}
+}
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <memory>
 #include <optional>
+#include <span>
 #include <string>
 #include <string_view>
 #include <vector>
@@ -213,14 +215,24 @@ namespace nesem::mappers
 
 	struct NesRom
 	{
-		std::vector<U8> prg_rom;
-		std::vector<U8> chr_rom;
+		// views of the rom's contents, which are never written to. Loaded from a file too large to copy, they point
+		// straight into a read only mapping of it, so every system running the same file shares the same pages
+		std::span<const U8> prg_rom;
+		std::span<const U8> chr_rom;
+
+		// keeps whatever prg_rom and chr_rom point into alive, shared by every copy of the rom
+		std::shared_ptr<const void> storage;
+
 		std::string sha1;
 
 		ines_1::RomData v1;
 		std::optional<ines_2::RomData> v2;
 	};
 
+	// A loaded rom, never changed once loaded. Every system running the same rom shares one image, so each only
+	// pays for its own ram and registers
+	using NesRomImage = std::shared_ptr<const NesRom>;
+
 	// utility function for mappers representing physically soldered nametable maps
 	// this handles one and four screen modes as selecting the first or last nametable
 	// roms that provide additional nametable memory need to provide custom handling
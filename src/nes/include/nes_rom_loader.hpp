@@ -1,8 +1,10 @@
 #pragma once
 
 #include <filesystem>
-#include <map>
+#include <memory>
 #include <optional>
+#include <span>
+#include <string>
 #include <string_view>
 #include <vector>
 
@@ -11,23 +13,66 @@
 
 namespace nesem
 {
+	class NesRomHashCache;
+
 	class NesRomLoader final
 	{
 	public:
-		static NesRomLoader create(const std::filesystem::path &nes20db_file);
+		// nes20db_file may be a nes20db.xml or a binary index made from one by the nes20db-index tool, which is mapped
+		// and used as is. Without one, or if it can't be loaded, the index embedded at build time is used.
+		// With a cache_dir, the sha1 and db entry of every rom file loaded are remembered there, so loading an
+		// unchanged file again skips hashing it
+		static NesRomLoader create(const std::filesystem::path &nes20db_file, const std::filesystem::path &cache_dir = {});
 
 		NesRomLoader() = default;
 		explicit NesRomLoader(std::vector<mappers::ines_2::RomData> &&roms);
 
-		std::optional<mappers::NesRom> load_rom(const std::filesystem::path &filename) noexcept;
+		// Roms are loaded once per process: while any system is still running a rom with the same contents, loading
+		// it again, from any loader on any thread, gives back the same image. Returns null if the rom can't be loaded
 
-		std::optional<mappers::ines_2::RomData> find_rom_data(std::string_view sha1);
+		// the file is mapped and its contents copied out, so it can be rebuilt while the rom is in use. A file over 4 MB
+		// stays mapped for as long as the rom is around instead, and mustn't be changed while in use. A .gz, or a .zip
+		// holding a .nes file, is inflated straight into memory
+		mappers::NesRomImage load_rom(const std::filesystem::path &filename) noexcept;
 
-	private:
-		void build_indexes();
+		// load a rom from the contents of a .nes file already in memory, which is copied so it needn't outlive the rom
+		mappers::NesRomImage load_rom(std::span<const U8> file_data) noexcept;
+
+		// Look a rom file up without loading it. Only the header is kept, the rest is hashed a chunk at a time, so the
+		// rom returned has no contents and memory use doesn't depend on the file's size, except for a .gz or .zip, which
+		// is inflated into memory while it's looked at. Safe to call from many threads
+		// at once. Hashes added to the hash cache, here or by load_rom, aren't saved until save_hash_cache is called or
+		// the last loader using the cache goes away
+		std::optional<mappers::NesRom> identify_rom(const std::filesystem::path &filename) noexcept;
+		void save_hash_cache() noexcept;
+
+		// only the matching entry is decoded, nothing else in the db is touched
+		std::optional<mappers::ines_2::RomData> find_rom_data(std::string_view sha1) const;
 
 	private:
-		std::vector<mappers::ines_2::RomData> roms;
-		std::map<std::string_view, size_t> rom_sha1_to_index;
+		struct Database;
+
+		// what a rom's contents were found to be, either by hashing them or from the hash cache
+		struct Identity
+		{
+			std::string sha1;
+			std::optional<mappers::ines_2::RomData> v2;
+		};
+
+		// immutable once loaded, so copies of a loader share it
+		std::shared_ptr<const Database> database;
+
+		std::shared_ptr<NesRomHashCache> hash_cache;
+
+		explicit NesRomLoader(std::shared_ptr<const Database> &&database) noexcept;
+
+		static NesRomLoader open_database(const std::filesystem::path &nes20db_file);
+
+		// file_data must live as long as storage does. Without storage, file_data is only borrowed and the rom's
+		// contents are copied out of it. Without identity, the contents are hashed and looked up in the db
+		mappers::NesRomImage load_rom(std::span<const U8> file_data, std::shared_ptr<const void> &&storage, std::optional<Identity> &&identity) noexcept;
+
+		// identifies the db roms are looked up in, for the hash cache
+		U64 db_fingerprint() const noexcept;
 	};
 }
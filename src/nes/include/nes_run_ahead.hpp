@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include <nes_types.hpp>
+
+namespace nesem
+{
+	class Nes;
+
+	// Hides input latency by showing frames from the near future. Each call to run_frame emulates one real frame
+	// with video disabled, saves the state, runs `frames` more frames with the same input, only drawing the last
+	// one, then restores the saved state. Games that take a few frames to react to input appear to react right
+	// away, at the cost of emulating frames + 1 frames per host frame.
+	class NesRunAhead final
+	{
+	public:
+		explicit NesRunAhead(int frames = 1) noexcept;
+
+		// advance nes one frame, drawing the frame `frames` ahead of it. With 0 frames, this is just nes.step(OneFrame).
+		// Returns the system time of the real frame
+		double run_frame(Nes &nes) noexcept;
+
+		[[nodiscard]] int frames() const noexcept;
+		void set_frames(int frames) noexcept;
+
+	private:
+		int ahead_frames;
+		std::vector<std::byte> state;
+	};
+
+	// Run ahead by a single frame using a second instance on a worker thread. The primary instance is never
+	// rewound, so its audio is never interrupted, and the ahead frame is emulated while the caller gets on with
+	// other work.
+	//
+	// ahead must have the same rom loaded as the primary instance and draws the presented frame through its own
+	// callbacks, which are called on the worker thread. Its input devices should report the same input as the
+	// primary instance's, and it should use its own user data dir so it doesn't share battery backed ram.
+	class NesRunAheadThread final
+	{
+	public:
+		explicit NesRunAheadThread() noexcept;
+		explicit NesRunAheadThread(std::unique_ptr<Nes> ahead) noexcept;
+		~NesRunAheadThread();
+
+		NesRunAheadThread(NesRunAheadThread &&other) noexcept;
+		NesRunAheadThread &operator=(NesRunAheadThread &&other) noexcept;
+		NesRunAheadThread(const NesRunAheadThread &other) noexcept = delete;
+		NesRunAheadThread &operator=(const NesRunAheadThread &other) noexcept = delete;
+
+		explicit operator bool() const noexcept
+		{
+			return core != nullptr;
+		}
+
+		// advance nes one frame with video disabled, then start the worker drawing the frame after it. Waits for the
+		// previous ahead frame to finish first. Returns the system time of the real frame
+		double run_frame(Nes &nes) noexcept;
+
+		// block until the ahead frame started by the last run_frame has been drawn
+		void wait() noexcept;
+
+		// the second instance. Only safe to use after wait(), e.g. to load the same rom as the primary instance
+		[[nodiscard]] Nes &ahead() noexcept;
+
+	private:
+		struct Core;
+		std::unique_ptr<Core> core;
+	};
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <span>
+#include <vector>
+
+#include <nes_movie.hpp>
+#include <nes_pool.hpp>
+#include <nes_types.hpp>
+
+namespace nesem
+{
+	// the button combinations tried at each step unless told otherwise, the ones that make sense in most games
+	std::vector<U8> default_search_actions() noexcept;
+
+	struct NesSearchSettings
+	{
+		std::filesystem::path rom;
+		std::filesystem::path nes20db_filename;
+
+		// a save state to search from, or empty to start right after the rom is loaded
+		std::vector<std::byte> start_state;
+
+		// the buttons held on player 1 for each choice, a combination of Buttons
+		std::vector<U8> actions = default_search_actions();
+
+		// frames each action is held for. Nothing is drawn or heard, so only the emulation costs anything
+		U64 frames_per_action = 8;
+
+		// actions in the longest sequence tried
+		size_t max_depth = 60;
+
+		// states kept to expand at each depth, the highest scoring ones first
+		size_t beam_width = 256;
+
+		// sequences reported, and the search ends at the first depth where this many have reached the goal
+		size_t best_count = 4;
+
+		// threads expanding states, or 0 for one per core
+		unsigned int threads = 0;
+	};
+
+	// Both are handed the 2 KiB of work ram after every frame and are called from many threads at once, so they must
+	// not change anything shared. A higher score is better
+	using NesSearchGoalFn = CallbackFn<bool(std::span<const U8> ram)>;
+	using NesSearchScoreFn = CallbackFn<double(std::span<const U8> ram)>;
+
+	struct NesSearchSolution
+	{
+		// one per step, the last of which may have been held for fewer frames if the goal was reached early
+		std::vector<U8> actions;
+		U64 frames = 0;
+		double score = 0.0;
+		bool reached_goal = false;
+
+		// plays the sequence back from the start state
+		NesMovie movie;
+	};
+
+	struct NesSearchStats
+	{
+		// states reached, and those thrown away because their ram matched a state already kept
+		U64 nodes = 0;
+		U64 duplicates = 0;
+
+		U64 frames = 0;
+		size_t depth = 0;
+
+		std::chrono::nanoseconds elapsed{0};
+		NesPoolMetrics pool;
+
+		[[nodiscard]] double frames_per_second() const noexcept
+		{
+			auto seconds = std::chrono::duration<double>(elapsed).count();
+			return seconds > 0.0 ? double(frames) / seconds : 0.0;
+		}
+	};
+
+	struct NesSearchResult
+	{
+		// sequences that reached the goal, shortest first. If none did, the highest scoring states found instead
+		std::vector<NesSearchSolution> best;
+		NesSearchStats stats;
+	};
+
+	// Search for inputs that take the system from the start state to one where goal holds, a breadth first search
+	// pruned to a beam of the best scoring states at each depth. Every state is a fork, so keeping thousands of them
+	// costs little, and each is expanded by restoring it on one of a pool of instances and running every action from
+	// there. States whose ram hashes the same as one already kept are dropped as duplicates, so sequences that end up
+	// in the same place are only explored once.
+	//
+	// Either function may be empty: without a goal the search runs to max_depth and reports the highest scores, and
+	// without a score states are kept in the order they were found. Results depend only on the settings, not on the
+	// number of threads. Returns no sequences if the rom or start state can't be loaded
+	NesSearchResult search_inputs(const NesSearchSettings &settings, NesSearchGoalFn goal, NesSearchScoreFn score) noexcept;
+}
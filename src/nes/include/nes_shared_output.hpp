@@ -0,0 +1,186 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string_view>
+
+#include <nes_types.hpp>
+
+namespace nesem
+{
+	enum class NesSharedPixelFormat : U32
+	{
+		// U16 per pixel, the ppu's color index in the low 6 bits and its emphasis bits above them
+		indexed = 1,
+
+		// 4 bytes per pixel in the order r, g, b, a, mapped through a palette given by the emulator
+		rgba = 2,
+	};
+
+	// The layout at the start of a shared output segment, followed by the frame buffers and the audio ring. Consumers
+	// may map the segment and read it directly using this, or use NesSharedOutputReader.
+	//
+	// Frames go round buffer_count buffers, each guarded by a seqlock: its sequence is odd while the frame is being
+	// drawn and 2 * (frame + 1) once it is done. To read the latest frame, load latest, then that buffer's sequence,
+	// copy the pixels and load the sequence again. If it was odd or changed, the copy is torn and should be retried.
+	// The emulator never waits on a reader, and a reader gets at least a whole frame to copy before the buffer it is
+	// reading is drawn over again.
+	//
+	// Audio is a ring of audio_capacity samples, a power of two. Sample n lives at n & (audio_capacity - 1) and
+	// audio_written counts the samples produced so far, so a reader more than a ring behind knows it lost samples.
+	struct NesSharedLayout
+	{
+		static constexpr U32 magic_value = 0x4D53454E; // "NESM"
+		static constexpr U32 version_value = 1;
+		static constexpr U32 buffer_count = 3;
+		static constexpr U32 width = 256;
+		static constexpr U32 height = 240;
+
+		U32 magic = magic_value;
+		U32 version = version_value;
+		NesSharedPixelFormat pixel_format = NesSharedPixelFormat::indexed;
+		U32 bytes_per_pixel = 0;
+		U32 sample_rate = 0;
+		U32 audio_capacity = 0;
+
+		// offsets from the start of the segment. Frame buffer i starts at frames_offset + i * frame_size
+		U64 frame_size = 0;
+		U64 frames_offset = 0;
+		U64 audio_offset = 0;
+
+		// frames finished so far. A reader that sees this go up by more than one since it last looked missed frames
+		alignas(64) std::atomic<U64> frame_count = 0;
+
+		// the buffer holding the most recently finished frame
+		std::atomic<U32> latest = 0;
+
+		alignas(64) std::array<std::atomic<U64>, buffer_count> sequence{};
+
+		alignas(64) std::atomic<U64> audio_written = 0;
+
+		static_assert(std::atomic<U64>::is_always_lock_free && std::atomic<U32>::is_always_lock_free, "shared atomics must not need a lock");
+	};
+
+	// Publishes the emulator's picture and sound in a named POSIX shared memory segment for other processes on the
+	// same machine, such as streaming or overlay tools. Pixels are written straight into the shared frame buffer as
+	// the ppu draws them, and samples straight into the shared ring, so nothing is copied after the fact.
+	// Hook it up via the NesSettings callbacks:
+	//   .draw = [&output](int x, int y, U8 color_index, auto emphasis) { output.draw(x, y, color_index, emphasis); },
+	//   .frame_ready = [&output] { output.frame_complete(); },
+	//   .audio = [&output](float sample) { output.push(sample); },
+	class NesSharedOutput final
+	{
+	public:
+		// pack a color into the byte order of rgba frames
+		static constexpr U32 rgba(U8 r, U8 g, U8 b, U8 a = 255) noexcept
+		{
+			return std::bit_cast<U32>(std::array{r, g, b, a});
+		}
+
+		// one color for each indexed pixel value, 64 colors for each combination of the emphasis bits
+		static constexpr size_t palette_size = 512;
+
+		// create the segment, replacing any left behind under the same name. Returns an empty output if shared memory
+		// isn't available on this platform or the segment couldn't be created
+		static NesSharedOutput create(std::string_view name, NesSharedPixelFormat format, U32 sample_rate, U32 audio_capacity = 65536) noexcept;
+
+		explicit NesSharedOutput() noexcept;
+		~NesSharedOutput();
+
+		NesSharedOutput(NesSharedOutput &&other) noexcept;
+		NesSharedOutput &operator=(NesSharedOutput &&other) noexcept;
+		NesSharedOutput(const NesSharedOutput &other) noexcept = delete;
+		NesSharedOutput &operator=(const NesSharedOutput &other) noexcept = delete;
+
+		explicit operator bool() const noexcept
+		{
+			return core != nullptr;
+		}
+
+		// the colors rgba frames are mapped through, defaulting to black
+		void set_palette(std::span<const U32, palette_size> colors) noexcept;
+
+		void draw(int x, int y, U8 color_index, util::Flags<NesColorEmphasis> emphasis) noexcept
+		{
+			if (!drawing) [[unlikely]]
+				begin_frame();
+
+			auto pixel = size_t(y * int(NesSharedLayout::width) + x);
+			auto value = U16((color_index & 0x3F) | (emphasis.raw_value() << 6));
+
+			if (rgba_pixels)
+				rgba_pixels[pixel] = palette[value];
+			else
+				indexed_pixels[pixel] = value;
+		}
+
+		// publish the frame drawn since the last call, if any
+		void frame_complete() noexcept;
+
+		void push(float sample) noexcept
+		{
+			audio[audio_written & audio_mask] = sample;
+			layout->audio_written.store(++audio_written, std::memory_order_release);
+		}
+
+	private:
+		struct Core;
+		std::unique_ptr<Core> core;
+
+		// cached here so drawing and pushing don't need to go through the core
+		NesSharedLayout *layout = nullptr;
+		U16 *indexed_pixels = nullptr;
+		U32 *rgba_pixels = nullptr;
+		const U32 *palette = nullptr;
+		float *audio = nullptr;
+		U64 audio_mask = 0;
+		U64 audio_written = 0;
+		U32 back_buffer = 0;
+		bool drawing = false;
+
+		explicit NesSharedOutput(std::unique_ptr<Core> &&core) noexcept;
+
+		void begin_frame() noexcept;
+	};
+
+	// Reads a segment published by NesSharedOutput, possibly from another process
+	class NesSharedOutputReader final
+	{
+	public:
+		// returns an empty reader if there is no such segment or it isn't one this version understands
+		static NesSharedOutputReader open(std::string_view name) noexcept;
+
+		explicit NesSharedOutputReader() noexcept;
+		~NesSharedOutputReader();
+
+		NesSharedOutputReader(NesSharedOutputReader &&other) noexcept;
+		NesSharedOutputReader &operator=(NesSharedOutputReader &&other) noexcept;
+		NesSharedOutputReader(const NesSharedOutputReader &other) noexcept = delete;
+		NesSharedOutputReader &operator=(const NesSharedOutputReader &other) noexcept = delete;
+
+		explicit operator bool() const noexcept
+		{
+			return core != nullptr;
+		}
+
+		[[nodiscard]] const NesSharedLayout &layout() const noexcept;
+
+		// copy the latest finished frame into pixels, which must hold layout().frame_size bytes. Returns the frame's
+		// number, counting from 0, or nothing if no frame has been finished yet or the copy kept getting torn
+		std::optional<U64> read_frame(std::span<std::byte> pixels) const noexcept;
+
+		// copy the samples from position onwards into samples, advancing position past them. A position that fell
+		// more than a ring behind skips ahead to the oldest sample still there. Returns the number of samples copied
+		size_t read_audio(U64 &position, std::span<float> samples) const noexcept;
+
+	private:
+		struct Core;
+		std::unique_ptr<Core> core;
+
+		explicit NesSharedOutputReader(std::unique_ptr<Core> &&core) noexcept;
+	};
+}
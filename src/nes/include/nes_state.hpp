@@ -0,0 +1,107 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <span>
+#include <type_traits>
+
+#include <nes_types.hpp>
+
+namespace nesem
+{
+	// bump whenever the layout of any component's state changes
+	constexpr U32 nes_state_version = 1;
+
+	// values are copied byte for byte, so anything with padding would leak whatever garbage is in it into the state
+	// and two identical systems could save different bytes. Write the members of such structs one at a time instead
+	template <typename T>
+	concept StateValue = std::is_trivially_copyable_v<T> && !std::is_pointer_v<T> && (std::has_unique_object_representations_v<T> || std::is_floating_point_v<T>);
+
+	// Writes component state into a caller provided buffer. Never allocates. Writing past the end of the buffer is
+	// dropped but still counted, so a writer over an empty buffer can be used to measure how big a state is
+	class NesStateWriter final
+	{
+	public:
+		explicit NesStateWriter(std::span<std::byte> buffer) noexcept
+			: buffer(buffer)
+		{
+		}
+
+		template <StateValue... Ts>
+		void write(const Ts &...values) noexcept
+		{
+			(write_bytes(std::as_bytes(std::span{&values, 1})), ...);
+		}
+
+		void write_bytes(std::span<const std::byte> bytes) noexcept
+		{
+			if (bytes.size() <= buffer.size() - std::min(position, buffer.size())) [[likely]]
+				std::memcpy(buffer.data() + position, bytes.data(), bytes.size());
+			else
+				overflow = true;
+
+			position += bytes.size();
+		}
+
+		// the number of bytes written, or that would have been written if the buffer was big enough
+		[[nodiscard]] size_t size() const noexcept
+		{
+			return position;
+		}
+
+		// true if everything written fit in the buffer
+		[[nodiscard]] bool ok() const noexcept
+		{
+			return !overflow;
+		}
+
+	private:
+		std::span<std::byte> buffer;
+		size_t position = 0;
+		bool overflow = false;
+	};
+
+	// Reads component state back out of a buffer written by NesStateWriter. Reading past the end of the buffer leaves
+	// values untouched and flags the reader as failed
+	class NesStateReader final
+	{
+	public:
+		explicit NesStateReader(std::span<const std::byte> buffer) noexcept
+			: buffer(buffer)
+		{
+		}
+
+		template <StateValue... Ts>
+		void read(Ts &...values) noexcept
+		{
+			(read_bytes(std::as_writable_bytes(std::span{&values, 1})), ...);
+		}
+
+		void read_bytes(std::span<std::byte> bytes) noexcept
+		{
+			if (bytes.size() <= remaining()) [[likely]]
+			{
+				std::memcpy(bytes.data(), buffer.data() + position, bytes.size());
+				position += bytes.size();
+			}
+			else
+				overflow = true;
+		}
+
+		[[nodiscard]] size_t remaining() const noexcept
+		{
+			return buffer.size() - position;
+		}
+
+		[[nodiscard]] bool ok() const noexcept
+		{
+			return !overflow;
+		}
+
+	private:
+		std::span<const std::byte> buffer;
+		size_t position = 0;
+		bool overflow = false;
+	};
+}
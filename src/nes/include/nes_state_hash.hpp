@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <span>
+
+#include <nes_types.hpp>
+
+namespace nesem
+{
+	namespace state_hash
+	{
+		// splitmix64's finalizer, cheap and every input bit affects every output bit
+		constexpr U64 mix(U64 value) noexcept
+		{
+			value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9;
+			value = (value ^ (value >> 27)) * 0x94D049BB133111EB;
+			return value ^ (value >> 31);
+		}
+
+		inline U64 hash_bytes(std::span<const std::byte> bytes, U64 seed = 0) noexcept
+		{
+			U64 hash = mix(seed ^ bytes.size());
+
+			while (bytes.size() >= sizeof(U64))
+			{
+				U64 word;
+				std::memcpy(&word, bytes.data(), sizeof(word));
+				hash = mix(hash ^ word);
+				bytes = bytes.subspan(sizeof(word));
+			}
+
+			U64 tail = 0;
+			if (!bytes.empty())
+				std::memcpy(&tail, bytes.data(), bytes.size());
+
+			return mix(hash ^ tail);
+		}
+	}
+
+	// the blocks of memory kept hashed, so identical contents in different blocks hash differently
+	enum class NesHashedMemory : U64
+	{
+		ram = 1,
+		nametable,
+		palettes,
+		oam,
+		chr_ram,
+		prg_ram,
+		prg_nvram,
+	};
+
+	// A hash of a block of memory that is kept up to date as it is written, so hashing the system every frame doesn't
+	// mean reading all of its memory every frame. Each byte contributes a mix of its address and value, and the
+	// contributions are XORed together, so a write only has to XOR out the old byte and XOR in the new one.
+	class NesMemoryHash final
+	{
+	public:
+		explicit NesMemoryHash(NesHashedMemory block) noexcept
+			: seed(state_hash::mix(U64(block)))
+		{
+		}
+
+		void update(size_t addr, U8 old_value, U8 new_value) noexcept
+		{
+			if (old_value != new_value)
+				hash ^= contribution(addr, old_value) ^ contribution(addr, new_value);
+		}
+
+		// start over from the current contents, after memory was changed without going through update()
+		void rehash(std::span<const U8> memory) noexcept
+		{
+			hash = 0;
+			add(memory);
+		}
+
+		// add memory starting at base_addr, for hashes that cover more than one block
+		void add(std::span<const U8> memory, size_t base_addr = 0) noexcept
+		{
+			for (size_t i = 0; i < memory.size(); ++i)
+				hash ^= contribution(base_addr + i, memory[i]);
+		}
+
+		[[nodiscard]] U64 value() const noexcept
+		{
+			return hash;
+		}
+
+	private:
+		U64 seed;
+		U64 hash = 0;
+
+		[[nodiscard]] U64 contribution(size_t addr, U8 value) const noexcept
+		{
+			return state_hash::mix(seed ^ ((U64{addr} << 8) | value));
+		}
+	};
+}
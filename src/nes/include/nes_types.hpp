@@ -100,6 +100,7 @@ namespace nesem
 
 	using DrawFn = CallbackFn<void(int x, int y, U8 color_index, util::Flags<NesColorEmphasis> emphasis)>;
 	using FrameReadyFn = CallbackFn<void()>;
+	using AudioSampleFn = CallbackFn<void(float sample)>;
 	using PollInputFn = CallbackFn<U8()>;
 	using ErrorFn = CallbackFn<void(std::string_view message)>;
 }
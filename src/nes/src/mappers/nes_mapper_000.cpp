@@ -1,10 +1,12 @@
 #include "nes_mapper_000.hpp"
 
+#include "nes_state.hpp"
+
 #include <util/logging.hpp>
 
 namespace nesem::mappers
 {
-	NesMapper000::NesMapper000(const Nes &nes, NesRom &&rom_data) noexcept
+	NesMapper000::NesMapper000(const Nes &nes, NesRomImage &&rom_data) noexcept
 		: NesCartridge(nes, std::move(rom_data))
 	{
 		reset();
@@ -119,4 +121,13 @@ namespace nesem::mappers
 
 		return false;
 	}
+
+	void NesMapper000::on_save_state([[maybe_unused]] NesStateWriter &writer) const noexcept
+	{
+		// NROM has no registers, everything is handled by NesCartridge
+	}
+
+	void NesMapper000::on_load_state([[maybe_unused]] NesStateReader &reader) noexcept
+	{
+	}
 }
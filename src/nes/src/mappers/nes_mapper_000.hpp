@@ -11,7 +11,7 @@ namespace nesem::mappers
 		REGISTER_MAPPER(0, NesMapper000);
 
 	public:
-		explicit NesMapper000(const Nes &nes, NesRom &&rom) noexcept;
+		explicit NesMapper000(const Nes &nes, NesRomImage &&rom) noexcept;
 
 	private:
 		void reset() noexcept override;
@@ -23,5 +23,8 @@ namespace nesem::mappers
 
 		void on_cpu_write(Addr addr, U8 value) noexcept override;
 		bool on_ppu_write(Addr &addr, U8 value) noexcept override;
+
+		void on_save_state(NesStateWriter &writer) const noexcept override;
+		void on_load_state(NesStateReader &reader) noexcept override;
 	};
 }
@@ -3,12 +3,13 @@
 #include <algorithm>
 
 #include "nes.hpp"
+#include "nes_state.hpp"
 
 #include <util/logging.hpp>
 
 namespace nesem::mappers
 {
-	NesMapper001::NesMapper001(const Nes &nes, NesRom &&rom_data) noexcept
+	NesMapper001::NesMapper001(const Nes &nes, NesRomImage &&rom_data) noexcept
 		: NesCartridge(nes, std::move(rom_data))
 	{
 		// the amount of chr data is a multiple of 8k
@@ -406,4 +407,14 @@ namespace nesem::mappers
 			return to_rom_addr(bank, bank_4k, addr);
 		}
 	}
+
+	void NesMapper001::on_save_state(NesStateWriter &writer) const noexcept
+	{
+		writer.write(prg_ram_mode, load_counter, load_shifter, last_write_cycle, control, chr_bank_0, chr_bank_1, prg_bank, chr_bank_mask);
+	}
+
+	void NesMapper001::on_load_state(NesStateReader &reader) noexcept
+	{
+		reader.read(prg_ram_mode, load_counter, load_shifter, last_write_cycle, control, chr_bank_0, chr_bank_1, prg_bank, chr_bank_mask);
+	}
 }
@@ -21,7 +21,7 @@ namespace nesem::mappers
 		};
 
 	public:
-		explicit NesMapper001(const Nes &nes, NesRom &&rom) noexcept;
+		explicit NesMapper001(const Nes &nes, NesRomImage &&rom) noexcept;
 
 	private:
 		void reset() noexcept override;
@@ -34,6 +34,9 @@ namespace nesem::mappers
 		void on_cpu_write(Addr addr, U8 value) noexcept override;
 		bool on_ppu_write(Addr &addr, U8 value) noexcept override;
 
+		void on_save_state(NesStateWriter &writer) const noexcept override;
+		void on_load_state(NesStateReader &reader) noexcept override;
+
 		MirroringMode mirroring() const noexcept override;
 		std::optional<U8> shift(U8 value) noexcept;
 
@@ -1,10 +1,12 @@
 #include "nes_mapper_002.hpp"
 
+#include "nes_state.hpp"
+
 #include <util/logging.hpp>
 
 namespace nesem::mappers
 {
-	NesMapper002::NesMapper002(const Nes &nes, NesRom &&rom_data) noexcept
+	NesMapper002::NesMapper002(const Nes &nes, NesRomImage &&rom_data) noexcept
 		: NesCartridge(nes, std::move(rom_data))
 	{
 		reset();
@@ -107,4 +109,14 @@ namespace nesem::mappers
 
 		return false;
 	}
+
+	void NesMapper002::on_save_state(NesStateWriter &writer) const noexcept
+	{
+		writer.write(bank_select);
+	}
+
+	void NesMapper002::on_load_state(NesStateReader &reader) noexcept
+	{
+		reader.read(bank_select);
+	}
 }
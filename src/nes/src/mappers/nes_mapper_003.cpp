@@ -1,10 +1,12 @@
 #include "nes_mapper_003.hpp"
 
+#include "nes_state.hpp"
+
 #include <util/logging.hpp>
 
 namespace nesem::mappers
 {
-	NesMapper003::NesMapper003(const Nes &nes, NesRom &&rom_data) noexcept
+	NesMapper003::NesMapper003(const Nes &nes, NesRomImage &&rom_data) noexcept
 		: NesCartridge(nes, std::move(rom_data))
 	{
 		reset();
@@ -112,4 +114,14 @@ namespace nesem::mappers
 
 		return false;
 	}
+
+	void NesMapper003::on_save_state(NesStateWriter &writer) const noexcept
+	{
+		writer.write(bank_select);
+	}
+
+	void NesMapper003::on_load_state(NesStateReader &reader) noexcept
+	{
+		reader.read(bank_select);
+	}
 }
@@ -3,6 +3,7 @@
 #include <utility>
 
 #include "nes.hpp"
+#include "nes_state.hpp"
 
 #include <util/logging.hpp>
 
@@ -45,7 +46,7 @@ namespace nesem::mappers
 		}
 	}
 
-	NesMapper004::NesMapper004(const Nes &nes, NesRom &&rom_data) noexcept
+	NesMapper004::NesMapper004(const Nes &nes, NesRomImage &&rom_data) noexcept
 		: NesCartridge(nes, std::move(rom_data)), variant(pick_variant(rom()))
 	{
 		reset();
@@ -450,4 +451,14 @@ namespace nesem::mappers
 
 		return false;
 	}
+
+	void NesMapper004::on_save_state(NesStateWriter &writer) const noexcept
+	{
+		writer.write(variant, bank_select, bank_map, mirror, prg_ram_protect, irq_latch, irq_reload, irq_counter, irq_enabled, a12, m2_state, m2_toggle_count);
+	}
+
+	void NesMapper004::on_load_state(NesStateReader &reader) noexcept
+	{
+		reader.read(variant, bank_select, bank_map, mirror, prg_ram_protect, irq_latch, irq_reload, irq_counter, irq_enabled, a12, m2_state, m2_toggle_count);
+	}
 }
@@ -22,7 +22,7 @@ namespace nesem::mappers
 		REGISTER_MAPPER(4, NesMapper004);
 
 	public:
-		explicit NesMapper004(const Nes &nes, NesRom &&rom) noexcept;
+		explicit NesMapper004(const Nes &nes, NesRomImage &&rom) noexcept;
 
 	private:
 		void reset() noexcept override;
@@ -43,6 +43,9 @@ namespace nesem::mappers
 		std::optional<U8> on_ppu_read(Addr &addr) noexcept override;
 		bool on_ppu_write(Addr &addr, U8 value) noexcept override;
 
+		void on_save_state(NesStateWriter &writer) const noexcept override;
+		void on_load_state(NesStateReader &reader) noexcept override;
+
 		U8 do_read_ram(size_t addr) const noexcept;
 		bool do_read_write(size_t addr, U8 value) noexcept;
 
@@ -1,10 +1,11 @@
 #include "nes_mapper_005.hpp"
 
 #include "../nes_ppu_register_bits.hpp"
+#include "nes_state.hpp"
 
 namespace nesem::mappers
 {
-	NesMapper005::NesMapper005(const Nes &nes, NesRom &&rom) noexcept
+	NesMapper005::NesMapper005(const Nes &nes, NesRomImage &&rom) noexcept
 		: NesCartridge(nes, std::move(rom))
 	{
 		reset();
@@ -266,4 +267,17 @@ namespace nesem::mappers
 		return false;
 	}
 
+	void NesMapper005::on_save_state(NesStateWriter &writer) const noexcept
+	{
+		writer.write(ppu_state, prg_mode, chr_mode, prg_ram_protect, internal_ram_mode, nametable_mapping, fill_mode_tile, fill_mode_color, nametable_fill);
+		writer.write(prg_banks, chr_banks, vertical_split_mode, vertical_split_scroll, vertical_split_bank);
+		writer.write(scanline_irq_compare, scanline_irq_enabled, current_scanline, mul_a, mul_b, mul_ans);
+	}
+
+	void NesMapper005::on_load_state(NesStateReader &reader) noexcept
+	{
+		reader.read(ppu_state, prg_mode, chr_mode, prg_ram_protect, internal_ram_mode, nametable_mapping, fill_mode_tile, fill_mode_color, nametable_fill);
+		reader.read(prg_banks, chr_banks, vertical_split_mode, vertical_split_scroll, vertical_split_bank);
+		reader.read(scanline_irq_compare, scanline_irq_enabled, current_scanline, mul_a, mul_b, mul_ans);
+	}
 }
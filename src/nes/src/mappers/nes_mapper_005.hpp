@@ -23,7 +23,7 @@ namespace nesem::mappers
 		REGISTER_MAPPER(5, NesMapper005);
 
 	public:
-		explicit NesMapper005(const Nes &nes, NesRom &&rom) noexcept;
+		explicit NesMapper005(const Nes &nes, NesRomImage &&rom) noexcept;
 
 	private:
 		void reset() noexcept override;
@@ -41,6 +41,9 @@ namespace nesem::mappers
 		std::optional<U8> on_ppu_read(Addr &addr) noexcept override;
 		bool on_ppu_write(Addr &addr, U8 value) noexcept override;
 
+		void on_save_state(NesStateWriter &writer) const noexcept override;
+		void on_load_state(NesStateReader &reader) noexcept override;
+
 	private:
 		util::Flags<PpuStateMirror> ppu_state;
 		U8 prg_mode = 0xFF;
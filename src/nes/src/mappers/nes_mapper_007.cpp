@@ -1,10 +1,12 @@
 #include "nes_mapper_007.hpp"
 
+#include "nes_state.hpp"
+
 #include <util/logging.hpp>
 
 namespace nesem::mappers
 {
-	NesMapper007::NesMapper007(const Nes &nes, NesRom &&rom_data) noexcept
+	NesMapper007::NesMapper007(const Nes &nes, NesRomImage &&rom_data) noexcept
 		: NesCartridge(nes, std::move(rom_data))
 	{
 		reset();
@@ -95,4 +97,14 @@ namespace nesem::mappers
 
 		return false;
 	}
+
+	void NesMapper007::on_save_state(NesStateWriter &writer) const noexcept
+	{
+		writer.write(num_banks, bank_select);
+	}
+
+	void NesMapper007::on_load_state(NesStateReader &reader) noexcept
+	{
+		reader.read(num_banks, bank_select);
+	}
 }
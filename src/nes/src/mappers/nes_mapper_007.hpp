@@ -11,7 +11,7 @@ namespace nesem::mappers
 		REGISTER_MAPPER(7, NesMapper007);
 
 	public:
-		explicit NesMapper007(const Nes &nes, NesRom &&rom) noexcept;
+		explicit NesMapper007(const Nes &nes, NesRomImage &&rom) noexcept;
 
 	private:
 		void reset() noexcept override;
@@ -26,6 +26,9 @@ namespace nesem::mappers
 		void on_cpu_write(Addr addr, U8 value) noexcept override;
 		bool on_ppu_write(Addr &addr, U8 value) noexcept override;
 
+		void on_save_state(NesStateWriter &writer) const noexcept override;
+		void on_load_state(NesStateReader &reader) noexcept override;
+
 	private:
 		U8 num_banks = 0;
 		U8 bank_select = 0;
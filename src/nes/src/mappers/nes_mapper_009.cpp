@@ -1,10 +1,12 @@
 #include "nes_mapper_009.hpp"
 
+#include "nes_state.hpp"
+
 #include <util/logging.hpp>
 
 namespace nesem::mappers
 {
-	NesMapper009::NesMapper009(const Nes &nes, NesRom &&rom_data) noexcept
+	NesMapper009::NesMapper009(const Nes &nes, NesRomImage &&rom_data) noexcept
 		: NesCartridge(nes, std::move(rom_data))
 	{
 		reset();
@@ -194,4 +196,14 @@ namespace nesem::mappers
 
 		return false;
 	}
+
+	void NesMapper009::on_save_state(NesStateWriter &writer) const noexcept
+	{
+		writer.write(prgrom_bank, chr_0_fd, chr_0_fe, chr_1_fd, chr_1_fe, mirror, chr_0, chr_1);
+	}
+
+	void NesMapper009::on_load_state(NesStateReader &reader) noexcept
+	{
+		reader.read(prgrom_bank, chr_0_fd, chr_0_fe, chr_1_fd, chr_1_fe, mirror, chr_0, chr_1);
+	}
 }
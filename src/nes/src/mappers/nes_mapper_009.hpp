@@ -11,7 +11,7 @@ namespace nesem::mappers
 		REGISTER_MAPPER(9, NesMapper009);
 
 	public:
-		explicit NesMapper009(const Nes &nes, NesRom &&rom) noexcept;
+		explicit NesMapper009(const Nes &nes, NesRomImage &&rom) noexcept;
 
 	private:
 		void reset() noexcept override;
@@ -28,6 +28,9 @@ namespace nesem::mappers
 		std::optional<U8> on_ppu_read(Addr &addr) noexcept override;
 		bool on_ppu_write(Addr &addr, U8 value) noexcept override;
 
+		void on_save_state(NesStateWriter &writer) const noexcept override;
+		void on_load_state(NesStateReader &reader) noexcept override;
+
 	private:
 		// registers
 		U8 prgrom_bank{}; // $A000-$AFFF
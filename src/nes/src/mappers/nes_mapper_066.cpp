@@ -1,10 +1,12 @@
 #include "nes_mapper_066.hpp"
 
+#include "nes_state.hpp"
+
 #include <util/logging.hpp>
 
 namespace nesem::mappers
 {
-	NesMapper066::NesMapper066(const Nes &nes, NesRom &&rom_data) noexcept
+	NesMapper066::NesMapper066(const Nes &nes, NesRomImage &&rom_data) noexcept
 		: NesCartridge(nes, std::move(rom_data))
 	{
 		reset();
@@ -72,4 +74,14 @@ namespace nesem::mappers
 
 		return false;
 	}
+
+	void NesMapper066::on_save_state(NesStateWriter &writer) const noexcept
+	{
+		writer.write(prg_bank_select, chr_bank_select);
+	}
+
+	void NesMapper066::on_load_state(NesStateReader &reader) noexcept
+	{
+		reader.read(prg_bank_select, chr_bank_select);
+	}
 }
@@ -11,7 +11,7 @@ namespace nesem::mappers
 		REGISTER_MAPPER(66, NesMapper066);
 
 	public:
-		explicit NesMapper066(const Nes &nes, NesRom &&rom) noexcept;
+		explicit NesMapper066(const Nes &nes, NesRomImage &&rom) noexcept;
 
 	private:
 		void reset() noexcept override;
@@ -24,6 +24,9 @@ namespace nesem::mappers
 		void on_cpu_write(Addr addr, U8 value) noexcept override;
 		bool on_ppu_write(Addr &addr, U8 value) noexcept override;
 
+		void on_save_state(NesStateWriter &writer) const noexcept override;
+		void on_load_state(NesStateReader &reader) noexcept override;
+
 		U8 prg_bank_select = 0;
 		U8 chr_bank_select = 0;
 	};
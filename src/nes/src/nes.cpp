@@ -1,15 +1,76 @@
 #include "nes.hpp"
 
+#include <algorithm>
+#include <array>
 #include <utility>
 
 #include <nes_cartridge.hpp>
 
 #include "nes_cartridge_loader.hpp"
+#include "nes_state.hpp"
+#include "nes_state_hash.hpp"
 
 #include <util/logging.hpp>
 
 namespace nesem
 {
+	namespace
+	{
+		constexpr std::array<char, 4> state_magic = {'N', 'E', 'S', 'S'};
+
+		struct NesStateHeader
+		{
+			std::array<char, 4> magic = state_magic;
+			U32 version = nes_state_version;
+
+			// total size of the state, including this header
+			U64 size = 0;
+
+			// sha1 of the rom the state was saved from
+			std::array<char, 40> sha1{};
+		};
+
+		std::array<char, 40> state_sha1(const NesCartridge &cartridge) noexcept
+		{
+			std::array<char, 40> result{};
+			const auto &sha1 = cartridge.rom().sha1;
+			std::copy_n(sha1.begin(), std::min(sha1.size(), result.size()), result.begin());
+			return result;
+		}
+
+		bool read_state_header(NesStateReader &reader, const NesCartridge &cartridge, size_t expected_size) noexcept
+		{
+			NesStateHeader header;
+			reader.read(header);
+
+			if (!reader.ok() || header.magic != state_magic)
+			{
+				LOG_WARN("Not a save state");
+				return false;
+			}
+
+			if (header.version != nes_state_version)
+			{
+				LOG_WARN("Save state version {} is not supported, expected version {}", header.version, nes_state_version);
+				return false;
+			}
+
+			if (header.sha1 != state_sha1(cartridge))
+			{
+				LOG_WARN("Save state is for a different rom");
+				return false;
+			}
+
+			if (header.size != expected_size)
+			{
+				LOG_WARN("Save state has wrong size {}, expected {}", header.size, expected_size);
+				return false;
+			}
+
+			return true;
+		}
+	}
+
 	constexpr ClockRate clock_for_region(int region) noexcept
 	{
 		switch (region)
@@ -44,6 +105,8 @@ namespace nesem
 		: on_error(std::move(settings.error)),
 		  draw(std::move(settings.draw)),
 		  frame_ready(std::move(settings.frame_ready)),
+		  audio(std::move(settings.audio)),
+		  sample_rate(settings.sample_rate),
 		  player1_input(std::move(settings.player1)),
 		  player2_input(std::move(settings.player2)),
 		  nes_bus(this),
@@ -51,7 +114,7 @@ namespace nesem
 		  nes_ppu(this),
 		  nes_apu(this),
 		  nes_clock(this),
-		  rom_loader(NesRomLoader::create(settings.nes20db_filename)),
+		  rom_loader(NesRomLoader::create(settings.nes20db_filename, settings.user_data_dir)),
 		  user_data_dir(std::move(settings.user_data_dir))
 	{
 	}
@@ -60,11 +123,20 @@ namespace nesem
 
 	bool Nes::load_rom(const std::filesystem::path &filename) noexcept
 	{
-		auto rom = rom_loader.load_rom(filename);
+		return insert_rom(rom_loader.load_rom(filename));
+	}
+
+	bool Nes::load_rom(std::span<const U8> file_data) noexcept
+	{
+		return insert_rom(rom_loader.load_rom(file_data));
+	}
+
+	bool Nes::insert_rom(mappers::NesRomImage &&rom) noexcept
+	{
 		if (!rom)
 			return false;
 
-		auto cart = load_cartridge(*this, std::move(*rom));
+		auto cart = load_cartridge(*this, std::move(rom));
 		if (!cart)
 			return false;
 
@@ -72,12 +144,28 @@ namespace nesem
 
 		nes_cartridge = std::move(cart);
 
-		nes_clock = NesClock{this, clock_for_region(rom_region(nes_cartridge->rom()))};
+		auto clock_rate = clock_for_region(rom_region(nes_cartridge->rom()));
+		nes_clock = NesClock{this, clock_rate};
+		nes_apu.set_output_rate(apu_frequency(clock_rate), sample_rate);
 		nes_bus.load_cartridge(nes_cartridge.get());
 		nes_ppu.load_cartridge(nes_cartridge.get());
 
 		reset();
 
+		auto measure = NesStateWriter({});
+		write_state(measure);
+		save_state_size = measure.size();
+
+		auto measure_fork = NesStateWriter({});
+		write_fork(measure_fork);
+		fork_size = measure_fork.size();
+		fork_pages = {};
+
+		auto measure_registers = NesStateWriter({});
+		write_registers(measure_registers);
+		hashed_registers.resize(measure_registers.size());
+		update_state_hash();
+
 		return true;
 	}
 
@@ -87,6 +175,11 @@ namespace nesem
 		nes_ppu.load_cartridge(nullptr);
 
 		nes_cartridge = nullptr;
+		save_state_size = 0;
+		fork_size = 0;
+		fork_pages = {};
+		hashed_registers.clear();
+		frame_hash = 0;
 	}
 
 	void Nes::reset() noexcept
@@ -97,6 +190,15 @@ namespace nesem
 		nes_cpu.reset();
 		nes_ppu.reset();
 		nes_apu.reset();
+
+		update_state_hash();
+	}
+
+	void Nes::power_cycle() noexcept
+	{
+		nes_bus.power_on();
+		nes_cpu.power_on();
+		reset();
 	}
 
 	void Nes::error(std::string_view message) noexcept
@@ -113,11 +215,18 @@ namespace nesem
 	{
 		auto dt = std::chrono::duration<double>(deltatime);
 		nes_clock.tick(duration_cast<ClockRate::duration>(dt));
+
+		if (frame_hash_pending)
+			update_state_hash();
 	}
 
 	double Nes::step(NesClockStep step) noexcept
 	{
 		std::chrono::duration<double> dt = nes_clock.step(step);
+
+		if (frame_hash_pending)
+			update_state_hash();
+
 		return dt.count();
 	}
 
@@ -133,16 +242,35 @@ namespace nesem
 
 	void Nes::screen_out(int x, int y, U8 color_index, util::Flags<NesColorEmphasis> emphasis) noexcept
 	{
-		if (draw) [[likely]]
+		if (draw && video_enabled) [[likely]]
 			draw(x, y, color_index, emphasis);
 	}
 
 	void Nes::frame_complete() noexcept
 	{
-		if (frame_ready) [[likely]]
+		// the rest of the system still has to finish this clock tick, so the hash waits for the step to end
+		frame_hash_pending = true;
+
+		if (frame_ready && video_enabled) [[likely]]
 			frame_ready();
 	}
 
+	void Nes::audio_out(float sample) noexcept
+	{
+		if (audio && audio_enabled)
+			audio(sample);
+	}
+
+	void Nes::enable_video(bool enable) noexcept
+	{
+		video_enabled = enable;
+	}
+
+	void Nes::enable_audio(bool enable) noexcept
+	{
+		audio_enabled = enable;
+	}
+
 	NesInputDevice &Nes::player1() noexcept
 	{
 		if (!player1_input)
@@ -164,6 +292,238 @@ namespace nesem
 		return nes_cartridge.get();
 	}
 
+	size_t Nes::state_size() const noexcept
+	{
+		return save_state_size;
+	}
+
+	size_t Nes::save_state(std::span<std::byte> buffer) const noexcept
+	{
+		if (!nes_cartridge || buffer.size() < save_state_size)
+			return 0;
+
+		auto writer = NesStateWriter(buffer);
+		write_state(writer);
+
+		if (!VERIFY(writer.ok() && writer.size() == save_state_size, "save state size changed after loading the rom"))
+			return 0;
+
+		return writer.size();
+	}
+
+	bool Nes::load_state(std::span<const std::byte> buffer) noexcept
+	{
+		if (!nes_cartridge)
+			return false;
+
+		auto reader = NesStateReader(buffer);
+
+		// validate everything before touching any state, so a bad state can't leave the system half loaded
+		if (!read_state_header(reader, *nes_cartridge, save_state_size))
+			return false;
+
+		if (buffer.size() < save_state_size)
+		{
+			LOG_WARN("Save state has wrong size {}, expected {}", buffer.size(), save_state_size);
+			return false;
+		}
+
+		nes_cpu.load_state(reader);
+		nes_bus.load_state(reader);
+		nes_ppu.load_state(reader);
+		nes_apu.load_state(reader);
+		nes_clock.load_state(reader);
+		player1_input->load_state(reader);
+		player2_input->load_state(reader);
+		nes_cartridge->load_state(reader);
+
+		update_state_hash();
+		return VERIFY(reader.ok(), "save state validated but failed to load");
+	}
+
+	U64 Nes::state_hash() const noexcept
+	{
+		return frame_hash;
+	}
+
+	NesFork Nes::fork() noexcept
+	{
+		if (!nes_cartridge)
+			return NesFork{};
+
+		NesFork result;
+		result.registers.resize(fork_size);
+
+		auto writer = NesStateWriter(result.registers);
+		write_fork(writer);
+
+		if (!VERIFY(writer.ok() && writer.size() == fork_size, "fork size changed after loading the rom"))
+			return NesFork{};
+
+		auto memory = tracked_memory();
+		for (size_t i = 0; i < memory.size(); ++i)
+		{
+			auto [bytes, dirty, hash] = memory[i];
+			const auto &base = fork_pages[i];
+			auto &pages = result.pages[i];
+
+			pages.resize(dirty->page_count());
+
+			for (size_t p = 0; p < pages.size(); ++p)
+			{
+				// untouched pages are still exactly what the last fork or restore left there
+				if (!dirty->is_dirty(p) && p < base.size())
+				{
+					pages[p] = base[p];
+					continue;
+				}
+
+				auto page = std::make_shared<NesFork::Page>();
+				auto source = bytes.subspan(p * NesDirtyPages::page_size);
+				std::copy_n(source.begin(), std::min(source.size(), page->size()), page->begin());
+
+				pages[p] = std::move(page);
+				++result.new_pages;
+			}
+
+			dirty->clear();
+		}
+
+		fork_pages = result.pages;
+		return result;
+	}
+
+	bool Nes::restore(const NesFork &fork) noexcept
+	{
+		if (!nes_cartridge || !fork)
+			return false;
+
+		auto reader = NesStateReader(fork.registers);
+		if (!read_state_header(reader, *nes_cartridge, fork_size))
+			return false;
+
+		auto memory = tracked_memory();
+		for (size_t i = 0; i < memory.size(); ++i)
+		{
+			if (fork.pages[i].size() != memory[i].dirty->page_count())
+			{
+				LOG_WARN("Fork memory doesn't match the loaded rom");
+				return false;
+			}
+		}
+
+		nes_ppu.load_memory(reader);
+		read_registers(reader);
+
+		for (size_t i = 0; i < memory.size(); ++i)
+		{
+			auto [bytes, dirty, hash] = memory[i];
+			const auto &base = fork_pages[i];
+			const auto &pages = fork.pages[i];
+
+			for (size_t p = 0; p < pages.size(); ++p)
+			{
+				// forks taken from the same line share pages, so most of them are already in place
+				if (!dirty->is_dirty(p) && p < base.size() && base[p] == pages[p])
+					continue;
+
+				auto target = bytes.subspan(p * NesDirtyPages::page_size);
+				auto count = std::min(target.size(), pages[p]->size());
+
+				for (size_t b = 0; b < count; ++b)
+					hash->update(p * NesDirtyPages::page_size + b, target[b], (*pages[p])[b]);
+
+				std::copy_n(pages[p]->begin(), count, target.begin());
+			}
+
+			dirty->clear();
+		}
+
+		fork_pages = fork.pages;
+
+		update_state_hash();
+		return VERIFY(reader.ok(), "fork validated but failed to load");
+	}
+
+	void Nes::write_state(NesStateWriter &writer) const noexcept
+	{
+		auto header = NesStateHeader{
+			.size = save_state_size,
+			.sha1 = state_sha1(*nes_cartridge),
+		};
+
+		writer.write(header);
+
+		nes_cpu.save_state(writer);
+		nes_bus.save_state(writer);
+		nes_ppu.save_state(writer);
+		nes_apu.save_state(writer);
+		nes_clock.save_state(writer);
+		player1_input->save_state(writer);
+		player2_input->save_state(writer);
+		nes_cartridge->save_state(writer);
+	}
+
+	void Nes::write_fork(NesStateWriter &writer) const noexcept
+	{
+		auto header = NesStateHeader{
+			.size = fork_size,
+			.sha1 = state_sha1(*nes_cartridge),
+		};
+
+		writer.write(header);
+
+		// the ppu's memory is small enough to copy outright
+		nes_ppu.save_memory(writer);
+		write_registers(writer);
+	}
+
+	void Nes::write_registers(NesStateWriter &writer) const noexcept
+	{
+		nes_cpu.save_state(writer);
+		nes_bus.save_registers(writer);
+		nes_ppu.save_registers(writer);
+		nes_apu.save_state(writer);
+		nes_clock.save_state(writer);
+		player1_input->save_state(writer);
+		player2_input->save_state(writer);
+		nes_cartridge->save_registers(writer);
+	}
+
+	void Nes::read_registers(NesStateReader &reader) noexcept
+	{
+		nes_cpu.load_state(reader);
+		nes_bus.load_registers(reader);
+		nes_ppu.load_registers(reader);
+		nes_apu.load_state(reader);
+		nes_clock.load_state(reader);
+		player1_input->load_state(reader);
+		player2_input->load_state(reader);
+		nes_cartridge->load_registers(reader);
+	}
+
+	void Nes::update_state_hash() noexcept
+	{
+		// nothing to hash until a rom is loaded and the registers are measured
+		if (!nes_cartridge || hashed_registers.empty())
+			return;
+
+		auto writer = NesStateWriter(hashed_registers);
+		write_registers(writer);
+
+		if (!VERIFY(writer.ok() && writer.size() == hashed_registers.size(), "register size changed after loading the rom"))
+			return;
+
+		frame_hash_pending = false;
+		frame_hash = state_hash::hash_bytes(hashed_registers) ^ nes_bus.memory_hash() ^ nes_ppu.memory_hash() ^ nes_cartridge->memory_hash();
+	}
+
+	std::array<NesTrackedMemory, NesFork::memory_count> Nes::tracked_memory() noexcept
+	{
+		auto [chr_ram, prg_ram, prg_nvram] = nes_cartridge->tracked_memory();
+		return {nes_bus.tracked_ram(), chr_ram, prg_ram, prg_nvram};
+	}
+
 	NesNvram Nes::open_prgnvram(std::string_view rom, size_t size) const noexcept
 	{
 		auto prgnvram_path = user_data_dir / "ram" / fmt::format("{}.prgnvram", rom);
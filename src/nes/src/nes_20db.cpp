@@ -0,0 +1,775 @@
+#include "nes_20db.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <concepts>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include <fmt/format.h>
+#include <fmt/std.h>
+#include <tinyxml2.h>
+
+#include <util/logging.hpp>
+
+#include "nes_state_hash.hpp"
+
+namespace nesem
+{
+	namespace
+	{
+		using namespace mappers::ines_2;
+		using namespace std::string_view_literals;
+
+		void log_error(const tinyxml2::XMLDocument &doc)
+		{
+			LOG_WARN("{} line {}: {}\n", doc.ErrorName(), doc.ErrorLineNum(), doc.ErrorStr());
+		}
+
+		template <std::integral T>
+		T read_int_attribute(const tinyxml2::XMLElement *element, const char *name)
+		{
+			if constexpr (std::same_as<int32_t, T>)
+				return element->IntAttribute(name);
+			if constexpr (std::same_as<int64_t, T>)
+				return element->Int64Attribute(name);
+			if constexpr (std::same_as<uint32_t, T>)
+				return element->UnsignedAttribute(name);
+			if constexpr (std::same_as<uint64_t, T>)
+				return element->Unsigned64Attribute(name);
+
+			std::unreachable();
+		}
+
+		PrgRom read_prgrom(const tinyxml2::XMLElement *element) noexcept
+		{
+			if (!element || element->Name() != "prgrom"sv)
+				return {};
+
+			return {
+				.size = read_int_attribute<size_t>(element, "size"),
+				.crc32 = element->Attribute("crc32"),
+				.sha1 = element->Attribute("sha1"),
+				.sum16 = element->Attribute("sum16"),
+			};
+		}
+
+		std::optional<ChrRom> read_chrrom(const tinyxml2::XMLElement *element) noexcept
+		{
+			if (!element || element->Name() != "chrrom"sv)
+				return {};
+
+			return ChrRom{
+				.size = read_int_attribute<size_t>(element, "size"),
+				.crc32 = element->Attribute("crc32"),
+				.sha1 = element->Attribute("sha1"),
+				.sum16 = element->Attribute("sum16"),
+			};
+		}
+
+		Rom read_rom(const tinyxml2::XMLElement *element) noexcept
+		{
+			if (!element || element->Name() != "rom"sv)
+				return {};
+
+			return {
+				.size = read_int_attribute<size_t>(element, "size"),
+				.crc32 = element->Attribute("crc32"),
+				.sha1 = element->Attribute("sha1"),
+			};
+		}
+
+		Pcb read_pcb(const tinyxml2::XMLElement *element) noexcept
+		{
+			if (!element || element->Name() != "pcb"sv)
+				return {};
+
+			constexpr auto mirroring = [](std::string_view m) {
+				using enum mappers::MirroringMode;
+				if (m == "H")
+					return horizontal;
+				if (m == "V")
+					return vertical;
+				if (m == "1")
+					return one_screen;
+				if (m == "4")
+					return four_screen;
+
+				LOG_CRITICAL("Unexpected mirroring mode {}", m);
+				return horizontal;
+			};
+
+			return {
+				.mapper = read_int_attribute<int>(element, "mapper"),
+				.submapper = read_int_attribute<int>(element, "submapper"),
+				.mirroring = mirroring(element->Attribute("mirroring")),
+				.battery = element->BoolAttribute("battery"),
+			};
+		}
+
+		Console read_console(const tinyxml2::XMLElement *element) noexcept
+		{
+			if (!element || element->Name() != "console"sv)
+				return {};
+
+			return {
+				.type = read_int_attribute<int>(element, "type"),
+				.region = read_int_attribute<int>(element, "region"),
+			};
+		}
+
+		Expansion read_expansion(const tinyxml2::XMLElement *element) noexcept
+		{
+			if (!element || element->Name() != "expansion"sv)
+				return {};
+
+			return Expansion{read_int_attribute<int>(element, "type")};
+		}
+
+		std::optional<ChrRam> read_chrram(const tinyxml2::XMLElement *element) noexcept
+		{
+			if (!element || element->Name() != "chrram"sv)
+				return {};
+
+			return ChrRam{read_int_attribute<size_t>(element, "size")};
+		}
+
+		std::optional<PrgNvram> read_prgnvram(const tinyxml2::XMLElement *element) noexcept
+		{
+			if (!element || element->Name() != "prgnvram"sv)
+				return {};
+
+			return PrgNvram{read_int_attribute<size_t>(element, "size")};
+		}
+
+		std::optional<PrgRam> read_prgram(const tinyxml2::XMLElement *element) noexcept
+		{
+			if (!element || element->Name() != "prgram"sv)
+				return {};
+
+			return PrgRam{read_int_attribute<size_t>(element, "size")};
+		}
+
+		std::optional<MiscRom> read_miscrom(const tinyxml2::XMLElement *element) noexcept
+		{
+			if (!element || element->Name() != "miscrom"sv)
+				return {};
+
+			return MiscRom{
+				.size = read_int_attribute<size_t>(element, "size"),
+				.crc32 = element->Attribute("crc32"),
+				.sha1 = element->Attribute("sha1"),
+				.number = read_int_attribute<int>(element, "number"),
+			};
+		}
+
+		std::optional<Vs> read_vs(const tinyxml2::XMLElement *element) noexcept
+		{
+			if (!element || element->Name() != "vs"sv)
+				return {};
+
+			return Vs{
+				.hardware = read_int_attribute<int>(element, "hardware"),
+				.ppu = read_int_attribute<int>(element, "ppu"),
+			};
+		}
+
+		std::optional<ChrNvram> read_chrnvram(const tinyxml2::XMLElement *element) noexcept
+		{
+			if (!element || element->Name() != "chrnvram"sv)
+				return {};
+
+			return ChrNvram{read_int_attribute<size_t>(element, "size")};
+		}
+
+		std::optional<Trainer> read_trainer(const tinyxml2::XMLElement *element) noexcept
+		{
+			if (!element || element->Name() != "trainer"sv)
+				return {};
+
+			return Trainer{
+				.size = read_int_attribute<size_t>(element, "size"),
+				.crc32 = std::string(element->Attribute("crc32")),
+				.sha1 = std::string(element->Attribute("sha1")),
+			};
+		}
+
+		std::vector<RomData> load_nes20db_xml(tinyxml2::XMLDocument &doc)
+		{
+			auto root = doc.FirstChildElement("nes20db");
+			if (doc.Error() || !root)
+			{
+				log_error(doc);
+				return {};
+			}
+
+			LOG_INFO("Loading nes20db.xml version {}", root->Attribute("date"));
+
+			auto game = root->FirstChildElement("game");
+			std::vector<RomData> roms;
+
+			while (!doc.Error() && game)
+			{
+				roms.emplace_back(
+					read_prgrom(game->FirstChildElement("prgrom")),
+					read_rom(game->FirstChildElement("rom")),
+					read_pcb(game->FirstChildElement("pcb")),
+					read_console(game->FirstChildElement("console")),
+					read_expansion(game->FirstChildElement("expansion")),
+					read_chrrom(game->FirstChildElement("chrrom")),
+					read_chrram(game->FirstChildElement("chrram")),
+					read_prgnvram(game->FirstChildElement("prgnvram")),
+					read_prgram(game->FirstChildElement("prgram")),
+					read_miscrom(game->FirstChildElement("miscrom")),
+					read_vs(game->FirstChildElement("vs")),
+					read_chrnvram(game->FirstChildElement("chrnvram")),
+					read_trainer(game->FirstChildElement("trainer")));
+
+				game = game->NextSiblingElement("game");
+			}
+
+			if (doc.Error())
+			{
+				log_error(doc);
+				return {};
+			}
+
+			return roms;
+		}
+
+		constexpr auto magic = std::array<U8, 4>{'N', '2', 'D', 'B'};
+		constexpr size_t header_size = 24;
+		constexpr size_t sha1_size = 20;
+		constexpr size_t key_size = sha1_size + sizeof(U32);
+
+		// set in the length of a text field when it is stored as the bytes of a hex string rather than its characters
+		constexpr U64 packed_hex = 1;
+
+		constexpr int hex_digit(char c) noexcept
+		{
+			if (c >= '0' && c <= '9')
+				return c - '0';
+			if (c >= 'A' && c <= 'F')
+				return c - 'A' + 10;
+
+			// only upper case, which is what nes20db and util::sha1 both use, so a packed string reads back the same
+			return -1;
+		}
+
+		// convert upper case hex to bytes, or nothing if it isn't
+		std::optional<std::vector<U8>> from_hex(std::string_view text) noexcept
+		{
+			if (text.size() % 2 != 0)
+				return std::nullopt;
+
+			std::vector<U8> bytes;
+			bytes.reserve(text.size() / 2);
+
+			for (size_t i = 0; i < text.size(); i += 2)
+			{
+				auto high = hex_digit(text[i]);
+				auto low = hex_digit(text[i + 1]);
+				if (high < 0 || low < 0)
+					return std::nullopt;
+
+				bytes.push_back(U8(high << 4 | low));
+			}
+
+			return bytes;
+		}
+
+		class Writer final
+		{
+		public:
+			explicit Writer(std::vector<U8> &bytes) noexcept
+				: bytes(bytes)
+			{
+			}
+
+			template <std::integral T>
+			void fixed(T value) noexcept
+			{
+				for (size_t i = 0; i < sizeof(T); ++i)
+					bytes.push_back(U8(std::make_unsigned_t<T>(value) >> (i * 8)));
+			}
+
+			// LEB128, most values in the db are small
+			void number(U64 value) noexcept
+			{
+				do
+				{
+					auto byte = U8(value & 0x7F);
+					value >>= 7;
+					bytes.push_back(value != 0 ? U8(byte | 0x80) : byte);
+				} while (value != 0);
+			}
+
+			// a length then the bytes, with the flag in the length's lowest bit saying whether they are the text's
+			// characters or a hex string packed two digits to a byte
+			void text(std::string_view value) noexcept
+			{
+				if (auto hex = from_hex(value))
+				{
+					number(U64{hex->size()} << 1 | packed_hex);
+					bytes.insert(bytes.end(), hex->begin(), hex->end());
+					return;
+				}
+
+				number(U64{value.size()} << 1);
+				bytes.insert(bytes.end(), value.begin(), value.end());
+			}
+
+		private:
+			std::vector<U8> &bytes;
+		};
+
+		// reads fields back out of a record. Reading past the end gives zeros and marks the record as bad
+		class Reader final
+		{
+		public:
+			explicit Reader(std::span<const U8> bytes) noexcept
+				: bytes(bytes)
+			{
+			}
+
+			[[nodiscard]] bool ok() const noexcept
+			{
+				return !overflow;
+			}
+
+			template <std::unsigned_integral T>
+			T fixed() noexcept
+			{
+				T value = 0;
+				for (size_t i = 0; i < sizeof(T); ++i)
+					value = T(value | T(byte()) << (i * 8));
+
+				return value;
+			}
+
+			U64 number() noexcept
+			{
+				U64 value = 0;
+				for (int shift = 0; shift < 64; shift += 7)
+				{
+					auto next = byte();
+					value |= U64(next & 0x7F) << shift;
+
+					if ((next & 0x80) == 0)
+						break;
+				}
+
+				return value;
+			}
+
+			int integer() noexcept
+			{
+				return int(U32(number()));
+			}
+
+			std::string text() noexcept
+			{
+				constexpr auto digits = "0123456789ABCDEF"sv;
+
+				auto length = number();
+				auto hex = (length & packed_hex) != 0;
+				length >>= 1;
+
+				// don't trust a length longer than what is left
+				if (length > bytes.size() - position)
+				{
+					overflow = true;
+					position = bytes.size();
+					return {};
+				}
+
+				std::string result;
+
+				if (hex)
+				{
+					result.reserve(length * 2);
+					for (U64 i = 0; i < length; ++i)
+					{
+						auto value = byte();
+						result += digits[value >> 4];
+						result += digits[value & 0x0F];
+					}
+				}
+				else
+				{
+					result.reserve(length);
+					for (U64 i = 0; i < length; ++i)
+						result += char(byte());
+				}
+
+				return result;
+			}
+
+		private:
+			std::span<const U8> bytes;
+			size_t position = 0;
+			bool overflow = false;
+
+			U8 byte() noexcept
+			{
+				if (position >= bytes.size())
+				{
+					overflow = true;
+					return 0;
+				}
+
+				return bytes[position++];
+			}
+		};
+
+		template <std::unsigned_integral T>
+		T read_fixed(std::span<const U8> bytes, size_t offset) noexcept
+		{
+			return Reader(bytes.subspan(offset, sizeof(T))).fixed<T>();
+		}
+
+		// the optional parts of an entry, as bits in the record saying which are present
+		enum class Present : U8
+		{
+			chrrom = 1 << 0,
+			chrram = 1 << 1,
+			prgnvram = 1 << 2,
+			prgram = 1 << 3,
+			miscrom = 1 << 4,
+			vs = 1 << 5,
+			chrnvram = 1 << 6,
+			trainer = 1 << 7,
+		};
+
+		void write_record(Writer &out, const RomData &rom) noexcept
+		{
+			out.number(rom.prgrom.size);
+			out.text(rom.prgrom.crc32);
+			out.text(rom.prgrom.sha1);
+			out.text(rom.prgrom.sum16);
+
+			out.number(rom.rom.size);
+			out.text(rom.rom.crc32);
+			out.text(rom.rom.sha1);
+
+			out.number(U32(rom.pcb.mapper));
+			out.number(U32(rom.pcb.submapper));
+			out.number(std::to_underlying(rom.pcb.mirroring));
+			out.number(rom.pcb.battery);
+
+			out.number(U32(rom.console.type));
+			out.number(U32(rom.console.region));
+			out.number(U32(std::to_underlying(rom.expansion)));
+
+			U8 present = 0;
+			auto mark = [&](const auto &part, Present bit) {
+				if (part)
+					present |= std::to_underlying(bit);
+			};
+
+			mark(rom.chrrom, Present::chrrom);
+			mark(rom.chrram, Present::chrram);
+			mark(rom.prgnvram, Present::prgnvram);
+			mark(rom.prgram, Present::prgram);
+			mark(rom.miscrom, Present::miscrom);
+			mark(rom.vs, Present::vs);
+			mark(rom.chrnvram, Present::chrnvram);
+			mark(rom.trainer, Present::trainer);
+			out.fixed(present);
+
+			if (rom.chrrom)
+			{
+				out.number(rom.chrrom->size);
+				out.text(rom.chrrom->crc32);
+				out.text(rom.chrrom->sha1);
+				out.text(rom.chrrom->sum16);
+			}
+
+			if (rom.chrram)
+				out.number(*rom.chrram);
+
+			if (rom.prgnvram)
+				out.number(*rom.prgnvram);
+
+			if (rom.prgram)
+				out.number(*rom.prgram);
+
+			if (rom.miscrom)
+			{
+				out.number(rom.miscrom->size);
+				out.text(rom.miscrom->crc32);
+				out.text(rom.miscrom->sha1);
+				out.number(U32(rom.miscrom->number));
+			}
+
+			if (rom.vs)
+			{
+				out.number(U32(rom.vs->hardware));
+				out.number(U32(rom.vs->ppu));
+			}
+
+			if (rom.chrnvram)
+				out.number(*rom.chrnvram);
+
+			if (rom.trainer)
+			{
+				out.number(rom.trainer->size);
+				out.text(rom.trainer->crc32);
+				out.text(rom.trainer->sha1);
+			}
+		}
+
+		RomData read_record(Reader &in) noexcept
+		{
+			RomData rom{};
+
+			rom.prgrom.size = in.number();
+			rom.prgrom.crc32 = in.text();
+			rom.prgrom.sha1 = in.text();
+			rom.prgrom.sum16 = in.text();
+
+			rom.rom.size = in.number();
+			rom.rom.crc32 = in.text();
+			rom.rom.sha1 = in.text();
+
+			rom.pcb.mapper = in.integer();
+			rom.pcb.submapper = in.integer();
+			rom.pcb.mirroring = mappers::MirroringMode(in.number());
+			rom.pcb.battery = in.number() != 0;
+
+			rom.console.type = in.integer();
+			rom.console.region = in.integer();
+			rom.expansion = Expansion(in.integer());
+
+			auto present = in.fixed<U8>();
+			auto has = [present](Present bit) { return (present & std::to_underlying(bit)) != 0; };
+
+			if (has(Present::chrrom))
+			{
+				auto &chrrom = rom.chrrom.emplace();
+				chrrom.size = in.number();
+				chrrom.crc32 = in.text();
+				chrrom.sha1 = in.text();
+				chrrom.sum16 = in.text();
+			}
+
+			if (has(Present::chrram))
+				rom.chrram = in.number();
+
+			if (has(Present::prgnvram))
+				rom.prgnvram = in.number();
+
+			if (has(Present::prgram))
+				rom.prgram = in.number();
+
+			if (has(Present::miscrom))
+			{
+				auto &miscrom = rom.miscrom.emplace();
+				miscrom.size = in.number();
+				miscrom.crc32 = in.text();
+				miscrom.sha1 = in.text();
+				miscrom.number = in.integer();
+			}
+
+			if (has(Present::vs))
+			{
+				auto hardware = in.integer();
+				rom.vs = Vs{.hardware = hardware, .ppu = in.integer()};
+			}
+
+			if (has(Present::chrnvram))
+				rom.chrnvram = in.number();
+
+			if (has(Present::trainer))
+			{
+				auto &trainer = rom.trainer.emplace();
+				trainer.size = in.number();
+				trainer.crc32 = in.text();
+				trainer.sha1 = in.text();
+			}
+
+			return rom;
+		}
+	}
+
+	std::vector<RomData> load_nes20db_xml(const std::filesystem::path &filename)
+	{
+		tinyxml2::XMLDocument doc;
+
+		LOG_INFO("Trying to load nes20db from '{}'", filename);
+		if (doc.LoadFile(filename.string().c_str()) != tinyxml2::XML_SUCCESS)
+		{
+			log_error(doc);
+			return {};
+		}
+
+		return load_nes20db_xml(doc);
+	}
+
+	std::vector<RomData> load_nes20db_xml(std::span<const U8> xml)
+	{
+		tinyxml2::XMLDocument doc;
+
+		if (doc.Parse(std::bit_cast<const char *>(xml.data()), xml.size()) != tinyxml2::XML_SUCCESS)
+		{
+			log_error(doc);
+			return {};
+		}
+
+		return load_nes20db_xml(doc);
+	}
+
+	std::vector<U8> build_nes20db_index(std::span<const RomData> roms)
+	{
+		struct Key
+		{
+			std::vector<U8> sha1;
+			size_t rom;
+		};
+
+		std::vector<Key> keys;
+		keys.reserve(roms.size());
+
+		for (size_t index = 0; index < roms.size(); ++index)
+		{
+			if (auto sha1 = from_hex(roms[index].rom.sha1); sha1 && sha1->size() == sha1_size)
+				keys.push_back({std::move(*sha1), index});
+		}
+
+		// stable, so the first of any duplicates is the one kept
+		std::ranges::stable_sort(keys, {}, &Key::sha1);
+		auto duplicates = std::ranges::unique(keys, {}, &Key::sha1);
+		keys.erase(duplicates.begin(), duplicates.end());
+
+		std::vector<U8> index;
+		auto out = Writer(index);
+
+		auto records_offset = header_size + keys.size() * key_size;
+
+		index.insert(index.end(), magic.begin(), magic.end());
+		out.fixed(Nes20dbIndex::version);
+		out.fixed(U32(keys.size()));
+		out.fixed(U32(records_offset));
+		out.fixed(U64(0));
+
+		// room for the keys, filled in as the records are written
+		index.resize(records_offset);
+
+		for (size_t i = 0; i < keys.size(); ++i)
+		{
+			auto key = std::span(index).subspan(header_size + i * key_size, key_size);
+			auto record = U32(index.size());
+
+			std::ranges::copy(keys[i].sha1, key.begin());
+			for (size_t b = 0; b < sizeof(U32); ++b)
+				key[sha1_size + b] = U8(record >> (b * 8));
+
+			write_record(out, roms[keys[i].rom]);
+		}
+
+		// filled in last, from everything after the header
+		auto digest = state_hash::hash_bytes(std::as_bytes(std::span(index).subspan(header_size)));
+		for (size_t b = 0; b < sizeof(U64); ++b)
+			index[16 + b] = U8(digest >> (b * 8));
+
+		return index;
+	}
+
+	std::vector<U8> encode_nes20db_entry(const RomData &rom)
+	{
+		std::vector<U8> record;
+		auto out = Writer(record);
+		write_record(out, rom);
+		return record;
+	}
+
+	std::optional<RomData> decode_nes20db_entry(std::span<const U8> record) noexcept
+	{
+		auto in = Reader(record);
+		auto rom = read_record(in);
+
+		if (!in.ok())
+			return std::nullopt;
+
+		return rom;
+	}
+
+	Nes20dbIndex::Nes20dbIndex(std::span<const U8> data, size_t count, U64 digest) noexcept
+		: data(data), count(count), digest(digest)
+	{
+	}
+
+	bool Nes20dbIndex::is_index(std::span<const U8> data) noexcept
+	{
+		return data.size() >= magic.size() && std::equal(magic.begin(), magic.end(), data.begin());
+	}
+
+	std::optional<Nes20dbIndex> Nes20dbIndex::open(std::span<const U8> data) noexcept
+	{
+		if (data.size() < header_size || !is_index(data))
+			return std::nullopt;
+
+		if (auto found = read_fixed<U32>(data, 4); found != version)
+		{
+			LOG_WARN("nes20db index is version {}, expected {}", found, version);
+			return std::nullopt;
+		}
+
+		auto count = size_t(read_fixed<U32>(data, 8));
+		auto records_offset = size_t(read_fixed<U32>(data, 12));
+
+		if (records_offset != header_size + count * key_size || records_offset > data.size())
+		{
+			LOG_WARN("nes20db index is corrupt");
+			return std::nullopt;
+		}
+
+		return Nes20dbIndex(data, count, read_fixed<U64>(data, 16));
+	}
+
+	std::optional<RomData> Nes20dbIndex::find(std::string_view sha1) const noexcept
+	{
+		auto key = from_hex(sha1);
+		if (!key || key->size() != sha1_size)
+			return std::nullopt;
+
+		auto key_at = [this](size_t i) { return data.subspan(header_size + i * key_size, key_size); };
+
+		// lower bound over the sorted keys
+		size_t first = 0;
+		size_t length = count;
+
+		while (length > 0)
+		{
+			auto half = length / 2;
+			if (std::memcmp(key_at(first + half).data(), key->data(), sha1_size) < 0)
+			{
+				first += half + 1;
+				length -= half + 1;
+			}
+			else
+				length = half;
+		}
+
+		if (first == count || std::memcmp(key_at(first).data(), key->data(), sha1_size) != 0)
+			return std::nullopt;
+
+		auto record = size_t(read_fixed<U32>(key_at(first), sha1_size));
+		if (record >= data.size())
+			return std::nullopt;
+
+		auto in = Reader(data.subspan(record));
+		auto rom = read_record(in);
+
+		if (!in.ok())
+		{
+			LOG_WARN("nes20db index entry for {} is corrupt", sha1);
+			return std::nullopt;
+		}
+
+		return rom;
+	}
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include <nes_rom.hpp>
+#include <nes_types.hpp>
+
+namespace nesem
+{
+	// parse a nes20db.xml, either from a file or already in memory. Returns nothing if it isn't valid nes20db xml
+	std::vector<mappers::ines_2::RomData> load_nes20db_xml(const std::filesystem::path &filename);
+	std::vector<mappers::ines_2::RomData> load_nes20db_xml(std::span<const U8> xml);
+
+	// Convert nes20db entries to the binary index searched by Nes20dbIndex, so it can be generated once at build time
+	// and used without parsing anything. Everything is little endian:
+	//   header: "N2DB", U32 version, U32 count, U32 offset of the records, U64 digest of everything after the header
+	//   keys:   count times the raw 20 byte rom sha1 and a U32 offset of its record, sorted by sha1
+	//   records: each entry's fields, packed, only decoded when looked up
+	// Entries whose rom sha1 isn't 40 hex digits can never be looked up, so they are left out. If more than one entry
+	// has the same sha1, the first is kept
+	std::vector<U8> build_nes20db_index(std::span<const mappers::ines_2::RomData> roms);
+
+	// a single entry packed the same way as the index's records, for storing elsewhere
+	std::vector<U8> encode_nes20db_entry(const mappers::ines_2::RomData &rom);
+	std::optional<mappers::ines_2::RomData> decode_nes20db_entry(std::span<const U8> record) noexcept;
+
+	// A read only view of a binary nes20db index, which must outlive it. Lookups are a binary search over the keys,
+	// so it can be used straight from an embedded array or a mapped file with nothing loaded up front
+	class Nes20dbIndex final
+	{
+	public:
+		static constexpr U32 version = 2;
+
+		// returns nothing if data isn't a binary index this version understands
+		static std::optional<Nes20dbIndex> open(std::span<const U8> data) noexcept;
+
+		// true if data starts like a binary index, to tell one apart from xml
+		static bool is_index(std::span<const U8> data) noexcept;
+
+		Nes20dbIndex() noexcept = default;
+
+		[[nodiscard]] size_t size() const noexcept
+		{
+			return count;
+		}
+
+		// a hash of the index's contents taken when it was built, to tell whether something remembered from a lookup
+		// came from this index. Changes whenever any entry does
+		[[nodiscard]] U64 fingerprint() const noexcept
+		{
+			return digest;
+		}
+
+		// look up a rom by the hex sha1 of its contents, as given by util::sha1
+		[[nodiscard]] std::optional<mappers::ines_2::RomData> find(std::string_view sha1) const noexcept;
+
+	private:
+		std::span<const U8> data;
+		size_t count = 0;
+		U64 digest = 0;
+
+		explicit Nes20dbIndex(std::span<const U8> data, size_t count, U64 digest) noexcept;
+	};
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <span>
+
+namespace nesem
+{
+	std::span<const unsigned char> nes20db_index();
+}
@@ -1,8 +0,0 @@
-#pragma once
-
-#include <vector>
-
-namespace nesem
-{
-	std::vector<unsigned char> nes20db_xml();
-}
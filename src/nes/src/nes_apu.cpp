@@ -1,6 +1,7 @@
 #include "nes_apu.hpp"
 
 #include "nes.hpp"
+#include "nes_state.hpp"
 
 #include <util/logging.hpp>
 
@@ -112,10 +113,18 @@ namespace nesem
 		status = ApuStatus::none;
 		frame_interrupt_requested = false;
 		dmc_interrupt_requested = false;
+
+		seq_pulse_1.length = 0;
+		sample_clock = 0;
+		mix_accumulator = 0.0f;
+		mix_count = 0;
 	}
 
 	void NesApu::clock() noexcept
 	{
+		clock_timers();
+		clock_mixer();
+
 		switch (frame_counter)
 		{
 		case 0:
@@ -192,6 +201,9 @@ namespace nesem
 
 	void NesApu::write(Addr addr, U8 value) noexcept
 	{
+		++apu_stats.register_writes;
+		apu_stats.last_write_sample = apu_stats.samples_mixed;
+
 		// first, check for writes to addresses the apu will handle directly, as well as invalid addresses
 		switch (to_integer(addr))
 		{
@@ -268,7 +280,10 @@ namespace nesem
 					// TODO: rename this? I think this flags restarting the sequencer, not whether it is in a running state....
 					seq_pulse_1.start = true;
 					seq_pulse_1.duty_pos = 0;
-					seq_pulse_1.length = length_table[channels[index].length()];
+
+					// the length counter is only loaded if the channel is enabled
+					if (status.is_set(ApuStatus::pulse_1))
+						seq_pulse_1.length = length_table[channels[index].length()];
 				}
 			}
 			return;
@@ -319,6 +334,89 @@ namespace nesem
 	void NesApu::clock_half_frame()
 	{
 		// clock length counters
+		if (seq_pulse_1.length > 0 && !channels[Pulse1].halt())
+			--seq_pulse_1.length;
+
 		// clock sweep units
 	}
+
+	void NesApu::set_output_rate(U64 apu_freq, U32 rate) noexcept
+	{
+		CHECK(apu_freq > 0, "apu frequency must be non-zero");
+		CHECK(rate > 0 && rate < apu_freq, "sample rate must be non-zero and less than the apu frequency");
+
+		apu_frequency = apu_freq;
+		sample_rate = rate;
+		sample_clock = 0;
+	}
+
+	const NesApuStats &NesApu::stats() const noexcept
+	{
+		return apu_stats;
+	}
+
+	void NesApu::save_state(NesStateWriter &writer) const noexcept
+	{
+		// mixer stats are instrumentation and not part of the emulated state, so they are not saved
+		writer.write(channels, status, step_mode, frame_interrupt_enabled, dmc_interrupt_enabled, frame_interrupt_requested, dmc_interrupt_requested, frame_counter);
+		writer.write(seq_pulse_1.start, seq_pulse_1.divider, seq_pulse_1.decay, seq_pulse_1.time, seq_pulse_1.duty_pos, seq_pulse_1.duty, seq_pulse_1.length);
+		writer.write(sample_clock, mix_accumulator, mix_count);
+	}
+
+	void NesApu::load_state(NesStateReader &reader) noexcept
+	{
+		reader.read(channels, status, step_mode, frame_interrupt_enabled, dmc_interrupt_enabled, frame_interrupt_requested, dmc_interrupt_requested, frame_counter);
+		reader.read(seq_pulse_1.start, seq_pulse_1.divider, seq_pulse_1.decay, seq_pulse_1.time, seq_pulse_1.duty_pos, seq_pulse_1.duty, seq_pulse_1.length);
+		reader.read(sample_clock, mix_accumulator, mix_count);
+	}
+
+	void NesApu::clock_timers() noexcept
+	{
+		// the pulse timers count down once per apu cycle. When the timer reaches 0, it is reloaded and the sequencer moves to the next step
+		if (seq_pulse_1.time == 0)
+		{
+			seq_pulse_1.time = channels[Pulse1].timer();
+			seq_pulse_1.duty_pos = (seq_pulse_1.duty_pos - 1) & 7;
+		}
+		else
+			--seq_pulse_1.time;
+	}
+
+	void NesApu::clock_mixer() noexcept
+	{
+		// see: https://www.nesdev.org/wiki/APU_Mixer
+		auto pulse = pulse_1_output();
+		auto pulse_out = pulse == 0 ? 0.0f : 95.88f / (8128.0f / float(pulse) + 100.0f);
+
+		mix_accumulator += pulse_out;
+		++mix_count;
+
+		// average every apu cycle that falls within an output sample. This acts as a crude low pass filter
+		sample_clock += sample_rate;
+		if (sample_clock >= apu_frequency)
+		{
+			sample_clock -= apu_frequency;
+
+			auto sample = mix_accumulator / float(mix_count);
+			mix_accumulator = 0.0f;
+			mix_count = 0;
+
+			++apu_stats.samples_mixed;
+			nes->audio_out(sample);
+		}
+	}
+
+	U8 NesApu::pulse_1_output() const noexcept
+	{
+		const auto &channel = channels[Pulse1];
+
+		// the channel is silenced when the length counter is 0 or the timer period is too low to produce an audible sound
+		if (seq_pulse_1.length == 0 || channel.timer() < 8)
+			return 0;
+
+		if (((duty_patterns[seq_pulse_1.duty] >> seq_pulse_1.duty_pos) & 1) == 0)
+			return 0;
+
+		return channel.use_constant_volume() ? channel.volume() : seq_pulse_1.decay;
+	}
 }
@@ -0,0 +1,272 @@
+#include "nes_audio_capture.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <span>
+#include <stop_token>
+#include <thread>
+
+#include <fmt/std.h>
+
+#include <util/logging.hpp>
+
+namespace
+{
+	using namespace nesem;
+
+	template <std::integral T>
+	void write_le(std::ofstream &file, T value) noexcept
+	{
+		if constexpr (std::endian::native == std::endian::big)
+			value = std::byteswap(value);
+
+		file.write(reinterpret_cast<const char *>(&value), sizeof(value));
+	}
+
+	bool is_wav(NesAudioFormat format) noexcept
+	{
+		return format == NesAudioFormat::wav_float || format == NesAudioFormat::wav_pcm16;
+	}
+
+	bool is_float(NesAudioFormat format) noexcept
+	{
+		return format == NesAudioFormat::wav_float || format == NesAudioFormat::raw_float;
+	}
+}
+
+namespace nesem
+{
+	struct NesAudioCapture::Core
+	{
+		std::ofstream file;
+		NesAudioFormat format;
+		U32 sample_rate;
+
+		// only touched by the writer thread until it is joined
+		U64 data_size = 0;
+		std::vector<std::int16_t> pcm16;
+
+		std::mutex mutex;
+		std::condition_variable_any ready;
+		std::deque<std::vector<float>> pending;
+		std::vector<std::vector<float>> recycled;
+
+		// declared last so the thread is stopped and joined before anything it uses is destroyed
+		std::jthread writer;
+
+		Core(std::ofstream &&file, NesAudioFormat format, U32 sample_rate) noexcept
+			: file(std::move(file)), format(format), sample_rate(sample_rate)
+		{
+			if (is_wav(format))
+				write_wav_header();
+
+			writer = std::jthread([this](std::stop_token stop) { write_loop(stop); });
+		}
+
+		// queue a full buffer for the writer and return an empty one to continue filling
+		std::vector<float> exchange(std::vector<float> &&full, size_t buffer_size) noexcept
+		{
+			std::vector<float> result;
+
+			{
+				auto lock = std::scoped_lock(mutex);
+
+				if (!full.empty())
+					pending.push_back(std::move(full));
+
+				if (!recycled.empty())
+				{
+					result = std::move(recycled.back());
+					recycled.pop_back();
+				}
+			}
+
+			ready.notify_one();
+
+			// if the writer is falling behind, grow the pool rather than dropping samples
+			result.reserve(buffer_size);
+			return result;
+		}
+
+		void finish() noexcept
+		{
+			writer.request_stop();
+
+			if (writer.joinable())
+				writer.join();
+
+			if (is_wav(format))
+			{
+				file.seekp(0);
+				write_wav_header();
+			}
+
+			file.close();
+		}
+
+	private:
+		void write_loop(std::stop_token stop) noexcept
+		{
+			while (true)
+			{
+				std::vector<float> work;
+
+				{
+					auto lock = std::unique_lock(mutex);
+
+					// after a stop is requested, keep going until everything pending is written
+					if (!ready.wait(lock, stop, [this] { return !pending.empty(); }))
+						break;
+
+					work = std::move(pending.front());
+					pending.pop_front();
+				}
+
+				write_samples(work);
+				work.clear();
+
+				auto lock = std::scoped_lock(mutex);
+				recycled.push_back(std::move(work));
+			}
+		}
+
+		void write_samples(std::span<const float> samples) noexcept
+		{
+			if (is_float(format))
+			{
+				for (auto sample : samples)
+					write_le(file, std::bit_cast<U32>(sample));
+
+				data_size += samples.size() * sizeof(float);
+			}
+			else
+			{
+				pcm16.resize(samples.size());
+				std::ranges::transform(samples, begin(pcm16), [](float sample) {
+					return static_cast<std::int16_t>(std::clamp(sample, -1.0f, 1.0f) * 32767.0f);
+				});
+
+				for (auto sample : pcm16)
+					write_le(file, sample);
+
+				data_size += samples.size() * sizeof(std::int16_t);
+			}
+
+			if (!file)
+				LOG_ERROR_ONCE("Error writing captured audio");
+		}
+
+		// see: http://soundfile.sapp.org/doc/WaveFormat/
+		void write_wav_header() noexcept
+		{
+			const U16 format_tag = is_float(format) ? 3 : 1;
+			const U16 channels = 1;
+			const U16 bits_per_sample = is_float(format) ? 32 : 16;
+			const U16 block_align = U16(channels * bits_per_sample / 8);
+			const U32 byte_rate = sample_rate * block_align;
+
+			// sizes are limited to 32-bits, so clamp rather than wrap around when the capture gets too long
+			const auto data_bytes = U32(std::min<U64>(data_size, 0xFFFF'FFFF - 36));
+
+			file.write("RIFF", 4);
+			write_le(file, 36 + data_bytes);
+			file.write("WAVE", 4);
+
+			file.write("fmt ", 4);
+			write_le(file, U32(16));
+			write_le(file, format_tag);
+			write_le(file, channels);
+			write_le(file, sample_rate);
+			write_le(file, byte_rate);
+			write_le(file, block_align);
+			write_le(file, bits_per_sample);
+
+			file.write("data", 4);
+			write_le(file, data_bytes);
+		}
+	};
+
+	NesAudioCapture NesAudioCapture::create(const std::filesystem::path &file_name, U32 sample_rate, NesAudioFormat format, size_t buffer_size) noexcept
+	{
+		CHECK(buffer_size > 0, "buffer_size must be non-zero");
+
+		auto file = std::ofstream(file_name, std::ios::binary | std::ios::trunc);
+		if (!file)
+		{
+			LOG_ERROR("Could not open '{}' for audio capture", file_name);
+			return NesAudioCapture();
+		}
+
+		LOG_INFO("Capturing audio to {}", file_name);
+		return NesAudioCapture(std::make_unique<Core>(std::move(file), format, sample_rate), std::max(buffer_size, size_t{1}));
+	}
+
+	NesAudioCapture::NesAudioCapture(std::unique_ptr<Core> &&core, size_t buffer_size) noexcept
+		: core(std::move(core)), buffer_size(buffer_size)
+	{
+		buffer.reserve(buffer_size);
+	}
+
+	void NesAudioCapture::flush() noexcept
+	{
+		if (!buffer.empty())
+			submit();
+	}
+
+	void NesAudioCapture::close() noexcept
+	{
+		if (!core)
+			return;
+
+		flush();
+		core->finish();
+		core = nullptr;
+	}
+
+	U64 NesAudioCapture::sample_count() const noexcept
+	{
+		return submitted + buffer.size();
+	}
+
+	void NesAudioCapture::submit() noexcept
+	{
+		if (!core) [[unlikely]]
+		{
+			// nothing to write to, just discard
+			submitted += buffer.size();
+			buffer.clear();
+			return;
+		}
+
+		submitted += buffer.size();
+		buffer = core->exchange(std::move(buffer), buffer_size);
+	}
+
+	NesAudioCapture::NesAudioCapture() noexcept = default;
+
+	NesAudioCapture::~NesAudioCapture()
+	{
+		close();
+	}
+
+	NesAudioCapture::NesAudioCapture(NesAudioCapture &&other) noexcept = default;
+
+	NesAudioCapture &NesAudioCapture::operator=(NesAudioCapture &&other) noexcept
+	{
+		if (this != &other)
+		{
+			close();
+
+			core = std::move(other.core);
+			buffer = std::move(other.buffer);
+			buffer_size = other.buffer_size;
+			submitted = other.submitted;
+		}
+
+		return *this;
+	}
+}
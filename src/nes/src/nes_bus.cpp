@@ -2,6 +2,7 @@
 
 #include "nes.hpp"
 #include "nes_cartridge.hpp"
+#include "nes_state.hpp"
 
 #include <util/logging.hpp>
 
@@ -11,6 +12,21 @@ namespace nesem
 		: nes(nes)
 	{
 		CHECK(nes != nullptr, "Nes should not be null!");
+
+		ram_dirty.resize(ram.size());
+		ram_hash.rehash(ram);
+	}
+
+	void NesBus::power_on() noexcept
+	{
+		ram.fill(0);
+		ram_dirty.mark_all();
+		ram_hash.rehash(ram);
+
+		poll_input = false;
+		controller1 = 0;
+		controller2 = 0;
+		last_read_value = 0;
 	}
 
 	void NesBus::clock() noexcept
@@ -142,7 +158,10 @@ namespace nesem
 		// thus, reads/writes to 0x0001 are observable at address 0x0801, 0x1001, 0x1801
 		if (addr < 0x2000)
 		{
-			ram[to_integer(addr & 0x7FF)] = value & 255;
+			auto index = to_integer(addr & 0x7FF);
+			ram_hash.update(index, ram[index], value);
+			ram_dirty.mark(index);
+			ram[index] = value;
 			return;
 		}
 
@@ -229,4 +248,44 @@ namespace nesem
 	{
 		return last_read_value;
 	}
+
+	void NesBus::save_state(NesStateWriter &writer) const noexcept
+	{
+		writer.write(ram);
+		save_registers(writer);
+	}
+
+	void NesBus::load_state(NesStateReader &reader) noexcept
+	{
+		reader.read(ram);
+		ram_dirty.mark_all();
+		ram_hash.rehash(ram);
+
+		load_registers(reader);
+	}
+
+	void NesBus::save_registers(NesStateWriter &writer) const noexcept
+	{
+		writer.write(poll_input, controller1, controller2, last_read_value);
+	}
+
+	void NesBus::load_registers(NesStateReader &reader) noexcept
+	{
+		reader.read(poll_input, controller1, controller2, last_read_value);
+	}
+
+	NesTrackedMemory NesBus::tracked_ram() noexcept
+	{
+		return {.memory = ram, .dirty = &ram_dirty, .hash = &ram_hash};
+	}
+
+	std::span<const U8> NesBus::work_ram() const noexcept
+	{
+		return ram;
+	}
+
+	U64 NesBus::memory_hash() const noexcept
+	{
+		return ram_hash.value();
+	}
 }
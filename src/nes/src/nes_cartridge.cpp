@@ -4,12 +4,13 @@
 
 #include "nes.hpp"
 #include "nes_cartridge_loader.hpp"
+#include "nes_state.hpp"
 
 #include <util/logging.hpp>
 
 namespace nesem
 {
-	NesCartridge::NesCartridge(const Nes &nes, mappers::NesRom &&rom_data) noexcept
+	NesCartridge::NesCartridge(const Nes &nes, mappers::NesRomImage &&rom_data) noexcept
 		: nes(&nes), nes_rom(std::move(rom_data))
 	{
 		if (rom_has_chrram(rom()))
@@ -38,13 +39,19 @@ namespace nesem
 				prg_ram.resize(size);
 		}
 
-		emulate_bus_conflicts = rom_has_bus_conflicts(nes_rom);
+		emulate_bus_conflicts = rom_has_bus_conflicts(rom());
+
+		chr_ram_dirty.resize(chr_ram.size());
+		prg_ram_dirty.resize(prg_ram.size());
+		prg_nvram_dirty.resize(prg_nvram.size());
+
+		rehash_memory();
 	}
 
 	mappers::MirroringMode NesCartridge::mirroring() const noexcept
 	{
 		// default implementation returns whatever the ROM tells us
-		return rom_mirroring_mode(nes_rom);
+		return rom_mirroring_mode(rom());
 	}
 
 	U8 NesCartridge::cpu_peek(Addr addr) const noexcept
@@ -104,7 +111,7 @@ namespace nesem
 
 	const mappers::NesRom &NesCartridge::rom() const noexcept
 	{
-		return nes_rom;
+		return *nes_rom;
 	}
 
 	bool NesCartridge::irq() const noexcept
@@ -114,10 +121,10 @@ namespace nesem
 
 	size_t NesCartridge::chr_size() const noexcept
 	{
-		if (rom_has_chrram(nes_rom))
+		if (rom_has_chrram(rom()))
 			return size(chr_ram);
 
-		return size(nes_rom.chr_rom);
+		return size(nes_rom->chr_rom);
 	}
 
 	void NesCartridge::signal_m2([[maybe_unused]] bool rising) noexcept
@@ -125,18 +132,80 @@ namespace nesem
 		// default, do nothing
 	}
 
+	void NesCartridge::save_state(NesStateWriter &writer) const noexcept
+	{
+		writer.write(irq_signaled, emulate_bus_conflicts);
+		writer.write_bytes(std::as_bytes(std::span(chr_ram)));
+		writer.write_bytes(std::as_bytes(std::span(prg_ram)));
+		writer.write_bytes(std::as_bytes(prg_nvram.bytes()));
+
+		on_save_state(writer);
+	}
+
+	void NesCartridge::load_state(NesStateReader &reader) noexcept
+	{
+		reader.read(irq_signaled, emulate_bus_conflicts);
+		reader.read_bytes(std::as_writable_bytes(std::span(chr_ram)));
+		reader.read_bytes(std::as_writable_bytes(std::span(prg_ram)));
+		reader.read_bytes(std::as_writable_bytes(prg_nvram.bytes()));
+
+		chr_ram_dirty.mark_all();
+		prg_ram_dirty.mark_all();
+		prg_nvram_dirty.mark_all();
+		rehash_memory();
+
+		on_load_state(reader);
+	}
+
+	void NesCartridge::save_registers(NesStateWriter &writer) const noexcept
+	{
+		writer.write(irq_signaled, emulate_bus_conflicts);
+		on_save_state(writer);
+	}
+
+	void NesCartridge::load_registers(NesStateReader &reader) noexcept
+	{
+		reader.read(irq_signaled, emulate_bus_conflicts);
+		on_load_state(reader);
+	}
+
+	std::array<NesTrackedMemory, 3> NesCartridge::tracked_memory() noexcept
+	{
+		return {
+			NesTrackedMemory{.memory = chr_ram, .dirty = &chr_ram_dirty, .hash = &chr_ram_hash},
+			NesTrackedMemory{.memory = prg_ram, .dirty = &prg_ram_dirty, .hash = &prg_ram_hash},
+			NesTrackedMemory{.memory = prg_nvram.bytes(), .dirty = &prg_nvram_dirty, .hash = &prg_nvram_hash},
+		};
+	}
+
+	U64 NesCartridge::memory_hash() const noexcept
+	{
+		return chr_ram_hash.value() ^ prg_ram_hash.value() ^ prg_nvram_hash.value();
+	}
+
+	void NesCartridge::rehash_memory() noexcept
+	{
+		chr_ram_hash.rehash(chr_ram);
+		prg_ram_hash.rehash(prg_ram);
+		prg_nvram_hash.rehash(prg_nvram.bytes());
+	}
+
 	U8 NesCartridge::chr_read(size_t addr) const noexcept
 	{
-		if (rom_has_chrram(nes_rom))
+		if (rom_has_chrram(rom()))
 			return chr_ram[addr];
 
-		return nes_rom.chr_rom[addr];
+		return nes_rom->chr_rom[addr];
 	}
 
 	bool NesCartridge::chr_write(size_t addr, U8 value) noexcept
 	{
-		if (rom_has_chrram(nes_rom))
+		if (rom_has_chrram(rom()))
+		{
+			chr_ram_hash.update(addr, chr_ram[addr], value);
+			chr_ram_dirty.mark(addr);
 			chr_ram[addr] = value;
+		}
 		else
 			LOG_ERROR("Write to CHR-ROM not allowed");
 
@@ -196,7 +265,7 @@ namespace nesem
 
 	U8 NesCartridge::prgram_read(size_t addr) const noexcept
 	{
-		if (prg_ram.size() < addr) [[unlikely]]
+		if (addr >= prg_ram.size()) [[unlikely]]
 		{
 			LOG_ERROR("PRGRAM read out of range! Read from {:X}, but size is {:X}", addr, prg_nvram.size());
 			return open_bus_read();
@@ -207,12 +276,14 @@ namespace nesem
 
 	bool NesCartridge::prgram_write(size_t addr, U8 value) noexcept
 	{
-		if (prg_ram.size() < addr) [[unlikely]]
+		if (addr >= prg_ram.size()) [[unlikely]]
 		{
 			LOG_ERROR("PRGRAM write out of range! Write to {:X}, but size is {:X}", addr, prg_nvram.size());
 			return false;
 		}
 
+		prg_ram_hash.update(addr, prg_ram[addr], value);
+		prg_ram_dirty.mark(addr);
 		prg_ram[addr] = value;
 		return true;
 	}
@@ -224,7 +295,7 @@ namespace nesem
 
 	U8 NesCartridge::prgnvram_read(size_t addr) const noexcept
 	{
-		if (prg_nvram.size() < addr) [[unlikely]]
+		if (addr >= prg_nvram.size()) [[unlikely]]
 		{
 			LOG_ERROR("PRGNVRAM read out of range! Read from {:X}, but size is {:X}", addr, prg_nvram.size());
 			return open_bus_read();
@@ -235,12 +306,14 @@ namespace nesem
 
 	bool NesCartridge::prgnvram_write(size_t addr, U8 value) noexcept
 	{
-		if (prg_nvram.size() < addr) [[unlikely]]
+		if (addr >= prg_nvram.size()) [[unlikely]]
 		{
 			LOG_ERROR("PRGNVRAM write out of range! Write to {:X}, but size is {:X}", addr, prg_nvram.size());
 			return false;
 		}
 
+		prg_nvram_hash.update(addr, prg_nvram[addr], value);
+		prg_nvram_dirty.mark(addr);
 		prg_nvram[addr] = value;
 		return true;
 	}
@@ -22,6 +22,8 @@
 
 namespace nesem::detail
 {
+	// Only written by register_cart during static initialization, before main runs. After that it is only read, so
+	// any number of instances can load roms from different threads without locking
 	auto &cart_registry()
 	{
 		static std::map<int, MakeCartFn> registry;
@@ -37,50 +39,50 @@ namespace nesem::detail
 
 namespace nesem
 {
-	std::unique_ptr<NesCartridge> load_cartridge(const Nes &nes, mappers::NesRom rom) noexcept
+	std::unique_ptr<NesCartridge> load_cartridge(const Nes &nes, mappers::NesRomImage rom) noexcept
 	{
-		if (rom.v2)
+		if (rom->v2)
 		{
 			LOG_INFO("iNES 2 info");
 
-			LOG_INFO("Console region: {0}, type: {1}", rom.v2->console.region, rom.v2->console.type);
-			LOG_INFO("Expansion device: {0}", expansion_device_name(rom.v2->expansion));
-			LOG_INFO("mapper: {0}, submapper: {1}", rom.v2->pcb.mapper, rom.v2->pcb.submapper);
-			LOG_INFO("has battery: {0}", rom.v2->pcb.battery);
+			LOG_INFO("Console region: {0}, type: {1}", rom->v2->console.region, rom->v2->console.type);
+			LOG_INFO("Expansion device: {0}", expansion_device_name(rom->v2->expansion));
+			LOG_INFO("mapper: {0}, submapper: {1}", rom->v2->pcb.mapper, rom->v2->pcb.submapper);
+			LOG_INFO("has battery: {0}", rom->v2->pcb.battery);
 
-			LOG_INFO("PRG ROM size: {0}K ({1:L})", rom.v2->prgrom.size / 1024, rom.v2->prgrom.size);
+			LOG_INFO("PRG ROM size: {0}K ({1:L})", rom->v2->prgrom.size / 1024, rom->v2->prgrom.size);
 
-			if (rom.v2->prgram)
-				LOG_INFO("PRG RAM size: {0}K ({1:L})", rom.v2->prgram.value() / 1024, rom.v2->prgram.value());
+			if (rom->v2->prgram)
+				LOG_INFO("PRG RAM size: {0}K ({1:L})", rom->v2->prgram.value() / 1024, rom->v2->prgram.value());
 
-			if (rom.v2->prgnvram)
-				LOG_INFO("PRG NVRAM size: {0}K ({1:L})", rom.v2->prgnvram.value() / 1024, rom.v2->prgnvram.value());
+			if (rom->v2->prgnvram)
+				LOG_INFO("PRG NVRAM size: {0}K ({1:L})", rom->v2->prgnvram.value() / 1024, rom->v2->prgnvram.value());
 
-			if (rom.v2->chrrom)
-				LOG_INFO("CHR ROM size: {0}K ({1:L})", rom.v2->chrrom->size / 1024, rom.v2->chrrom->size);
+			if (rom->v2->chrrom)
+				LOG_INFO("CHR ROM size: {0}K ({1:L})", rom->v2->chrrom->size / 1024, rom->v2->chrrom->size);
 
-			if (rom.v2->chrram)
-				LOG_INFO("CHR RAM size: {0}K ({1:L})", rom.v2->chrram.value() / 1024, rom.v2->chrram.value());
+			if (rom->v2->chrram)
+				LOG_INFO("CHR RAM size: {0}K ({1:L})", rom->v2->chrram.value() / 1024, rom->v2->chrram.value());
 
-			if (rom.v2->chrnvram)
-				LOG_INFO("CHR NVRAM size: {0}K ({1:L})", rom.v2->chrnvram.value() / 1024, rom.v2->chrnvram.value());
+			if (rom->v2->chrnvram)
+				LOG_INFO("CHR NVRAM size: {0}K ({1:L})", rom->v2->chrnvram.value() / 1024, rom->v2->chrnvram.value());
 		}
 		else
 		{
 			LOG_INFO("iNES 1 info");
-			LOG_INFO("mapper: {}", rom_mapper(rom));
-			LOG_INFO("PRG-ROM size: {0}K ({1:L})", size(rom.prg_rom) / 1024, size(rom.prg_rom));
-			LOG_INFO("CHR-ROM size: {0}K ({1:L})", size(rom.chr_rom) / 1024, size(rom.chr_rom));
+			LOG_INFO("mapper: {}", rom_mapper(*rom));
+			LOG_INFO("PRG-ROM size: {0}K ({1:L})", size(rom->prg_rom) / 1024, size(rom->prg_rom));
+			LOG_INFO("CHR-ROM size: {0}K ({1:L})", size(rom->chr_rom) / 1024, size(rom->chr_rom));
 		}
 
-		LOG_INFO("mirroring: {}", to_string(rom_mirroring_mode(rom)));
-		LOG_INFO("has bus conflicts: {}", rom_has_bus_conflicts(rom));
+		LOG_INFO("mirroring: {}", to_string(rom_mirroring_mode(*rom)));
+		LOG_INFO("has bus conflicts: {}", rom_has_bus_conflicts(*rom));
 
 		const auto &registry = detail::cart_registry();
-		if (auto it = registry.find(rom_mapper(rom));
+		if (auto it = registry.find(rom_mapper(*rom));
 			it == end(registry))
 		{
-			LOG_WARN("ROM uses unsupported mapper: {}", rom_mapper(rom));
+			LOG_WARN("ROM uses unsupported mapper: {}", rom_mapper(*rom));
 			return {};
 		}
 		else
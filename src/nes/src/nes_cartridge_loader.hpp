@@ -4,6 +4,8 @@
 #include <memory>
 #include <version>
 
+#include <nes_rom.hpp>
+
 #include <util/preprocessor.hpp>
 
 namespace nesem
@@ -11,16 +13,11 @@ namespace nesem
 	class Nes;
 	class NesCartridge;
 
-	namespace mappers
-	{
-		struct NesRom;
-	}
-
-	std::unique_ptr<NesCartridge> load_cartridge(const Nes &nes, mappers::NesRom rom) noexcept;
+	std::unique_ptr<NesCartridge> load_cartridge(const Nes &nes, mappers::NesRomImage rom) noexcept;
 
 	namespace detail
 	{
-		using MakeCartFn = std::function<std::unique_ptr<NesCartridge>(const Nes &nes, mappers::NesRom &&rom)>;
+		using MakeCartFn = std::function<std::unique_ptr<NesCartridge>(const Nes &nes, mappers::NesRomImage &&rom)>;
 
 #if defined(__cpp_lib_move_only_function)
 		using ConstructFn = std::move_only_function<MakeCartFn()>;
@@ -33,7 +30,7 @@ namespace nesem
 		template <typename T>
 		auto construct_helper()
 		{
-			return [](const Nes &nes, mappers::NesRom &&rom) {
+			return [](const Nes &nes, mappers::NesRomImage &&rom) {
 				return std::make_unique<T>(nes, std::move(rom));
 			};
 		}
@@ -1,6 +1,7 @@
 #include "nes_clock.hpp"
 
 #include "nes.hpp"
+#include "nes_state.hpp"
 
 #include <util/logging.hpp>
 
@@ -88,4 +89,25 @@ namespace nesem
 	{
 		force_stop = true;
 	}
+
+	U64 NesClock::current_tick() const noexcept
+	{
+		return tickcount;
+	}
+
+	const ClockRate &NesClock::rate() const noexcept
+	{
+		return clock_rate;
+	}
+
+	void NesClock::save_state(NesStateWriter &writer) const noexcept
+	{
+		// the clock rate is determined by the loaded rom, so only the position needs saving
+		writer.write(tickcount, accumulator);
+	}
+
+	void NesClock::load_state(NesStateReader &reader) noexcept
+	{
+		reader.read(tickcount, accumulator);
+	}
 }
@@ -9,6 +9,7 @@
 
 #include "nes.hpp"
 #include "nes_cpu_ops.hpp"
+#include "nes_state.hpp"
 
 #include <util/logging.hpp>
 
@@ -99,14 +100,17 @@ namespace nesem
 	constexpr int nmi_sequence = -2;
 	constexpr int irq_sequence = -3;
 
-	std::string decompile(U8 instruction, NesBus &bus, Addr pc) noexcept
+	NesInstruction disassemble(const NesBus &bus, Addr addr) noexcept
 	{
+		U8 instruction = bus.peek(addr);
+		Addr pc = addr + 1;
+
 		std::string_view name = CpuOps::ops[instruction].name;
 
 		switch (instruction)
 		{
 		default:
-			return fmt::format("Unknown: {:02X}", instruction);
+			return {.addr = addr, .size = 1, .text = fmt::format("Unknown: {:02X}", instruction)};
 
 		// Implied 0 - "INS"
 		case 0x00:
@@ -134,14 +138,14 @@ namespace nesem
 		case 0x8A:
 		case 0x9A:
 		case 0x98:
-			return std::string(name);
+			return {.addr = addr, .size = 1, .text = std::string(name)};
 
 		// Accumulator 0 - "INS A"
 		case 0x0A:
 		case 0x4A:
 		case 0x2A:
 		case 0x6A:
-			return fmt::format("{} A", name);
+			return {.addr = addr, .size = 1, .text = fmt::format("{} A", name)};
 
 		// Relative 1 - "INS *+/-num <$addr>" (normally, you jump to a label, but we'll calculate the absolute address)
 		case 0x90:
@@ -155,7 +159,7 @@ namespace nesem
 		{
 			// relative address is signed
 			int value = int8_t(bus.peek(pc));
-			return fmt::format("{} *{:+} <${}>", name, value, pc + value + 1);
+			return {.addr = addr, .size = 2, .text = fmt::format("{} *{:+} <${}>", name, value, pc + value + 1)};
 		}
 
 		// Immediate 1 - "INS #dec <$hex>"
@@ -172,7 +176,7 @@ namespace nesem
 		case 0xE9:
 		{
 			int value = bus.peek(pc);
-			return fmt::format("{0} #{1} <${1:02X}>", name, value);
+			return {.addr = addr, .size = 2, .text = fmt::format("{0} #{1} <${1:02X}>", name, value)};
 		}
 
 		// Zero Page 1 - "INS $hex"
@@ -199,7 +203,7 @@ namespace nesem
 		case 0x84:
 		{
 			int value = bus.peek(pc);
-			return fmt::format("{} ${:02X}", name, value);
+			return {.addr = addr, .size = 2, .text = fmt::format("{} ${:02X}", name, value)};
 		}
 
 		// Zero Page,X 1 - "INS $hex,X"
@@ -221,7 +225,7 @@ namespace nesem
 		case 0x94:
 		{
 			int value = bus.peek(pc);
-			return fmt::format("{} ${:02X},X", name, value);
+			return {.addr = addr, .size = 2, .text = fmt::format("{} ${:02X},X", name, value)};
 		}
 
 		// Zero Page,Y 1 - "INS $hex,Y"
@@ -229,7 +233,7 @@ namespace nesem
 		case 0x96:
 		{
 			int value = bus.peek(pc);
-			return fmt::format("{} ${:02X},Y", name, value);
+			return {.addr = addr, .size = 2, .text = fmt::format("{} ${:02X},Y", name, value)};
 		}
 
 		// Absolute 2 - "INS $addr"
@@ -259,7 +263,7 @@ namespace nesem
 		{
 			int lo = bus.peek(pc);
 			int hi = bus.peek(pc + 1);
-			return fmt::format("{} ${:04X}", name, hi << 8 | lo);
+			return {.addr = addr, .size = 3, .text = fmt::format("{} ${:04X}", name, hi << 8 | lo)};
 		}
 
 		// Absolute,X 2 - "INS $addr,X"
@@ -281,7 +285,7 @@ namespace nesem
 		{
 			int lo = bus.peek(pc);
 			int hi = bus.peek(pc + 1);
-			return fmt::format("{} ${:04X},X", name, hi << 8 | lo);
+			return {.addr = addr, .size = 3, .text = fmt::format("{} ${:04X},X", name, hi << 8 | lo)};
 		}
 
 		// Absolute,Y 2 - "INS $addr,Y"
@@ -297,7 +301,7 @@ namespace nesem
 		{
 			int lo = bus.peek(pc);
 			int hi = bus.peek(pc + 1);
-			return fmt::format("{} ${:04X},Y", name, hi << 8 | lo);
+			return {.addr = addr, .size = 3, .text = fmt::format("{} ${:04X},Y", name, hi << 8 | lo)};
 		}
 
 		// Indirect 2 - "INS ($addr)"
@@ -305,7 +309,7 @@ namespace nesem
 		{
 			int lo = bus.peek(pc);
 			int hi = bus.peek(pc + 1);
-			return fmt::format("{} (${:04X})", name, hi << 8 | lo);
+			return {.addr = addr, .size = 3, .text = fmt::format("{} (${:04X})", name, hi << 8 | lo)};
 		}
 
 		// (Indirect,X) 1 - "INS ($zp,X)"
@@ -319,7 +323,7 @@ namespace nesem
 		case 0x81:
 		{
 			int value = bus.peek(pc);
-			return fmt::format("{} (${:02X},X)", name, value);
+			return {.addr = addr, .size = 2, .text = fmt::format("{} (${:02X},X)", name, value)};
 		}
 
 		// (Indirect),Y 1 - INS ($zp),Y
@@ -333,7 +337,7 @@ namespace nesem
 		case 0x91:
 		{
 			int value = bus.peek(pc);
-			return fmt::format("{} (${:02X}),Y", name, value);
+			return {.addr = addr, .size = 2, .text = fmt::format("{} (${:02X}),Y", name, value)};
 		}
 		}
 	}
@@ -582,6 +586,8 @@ namespace nesem
 	}
 
 	// TODO: Keep this? Give it a "better" home? The static logger is a bit hacky...
+	// It is safe with several instances on several threads, as the static is initialized once and the sink is the
+	// thread safe _mt variant, but their lines end up interleaved in the same file. Trace one instance at a time
 	void NesCpu::log_instruction() noexcept
 	{
 #if !defined(__EMSCRIPTEN__)
@@ -614,6 +620,18 @@ namespace nesem
 	}
 
 	// signals
+	void NesCpu::power_on() noexcept
+	{
+		// reset leaves the registers alone, only power on clears them
+		A = 0;
+		X = 0;
+		Y = 0;
+		in_dma = false;
+		dma_step = -1;
+
+		reset();
+	}
+
 	void NesCpu::reset(Addr addr) noexcept
 	{
 		PC = addr;
@@ -771,7 +789,7 @@ namespace nesem
 			}
 
 			instruction = readPC();
-			LOG_TRACE("{:>5}: [{}] {:<35} A:{:02X} X:{:02X} Y:{:02X} P:{:02X} SP:{:02X}", cycles, PC - 1, decompile(U8(instruction), nes->bus(), PC), A, X, Y, U8(P), S);
+			LOG_TRACE("{:>5}: [{}] {:<35} A:{:02X} X:{:02X} Y:{:02X} P:{:02X} SP:{:02X}", cycles, PC - 1, disassemble(nes->bus(), PC - 1).text, A, X, Y, U8(P), S);
 			log_instruction();
 		}
 		else
@@ -799,6 +817,16 @@ namespace nesem
 		};
 	}
 
+	void NesCpu::save_state(NesStateWriter &writer) const noexcept
+	{
+		writer.write(PC, S, P, A, X, Y, cycles, instruction, step, scratch, effective_addr, nmi_requested, in_dma, dma_page, dma_step);
+	}
+
+	void NesCpu::load_state(NesStateReader &reader) noexcept
+	{
+		reader.read(PC, S, P, A, X, Y, cycles, instruction, step, scratch, effective_addr, nmi_requested, in_dma, dma_page, dma_step);
+	}
+
 	void NesCpu::push(U8 value) noexcept
 	{
 		nes->bus().write(cpu_stack_page | S, value, NesBusOp::ready);
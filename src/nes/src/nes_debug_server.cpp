@@ -0,0 +1,735 @@
+#include "nes_debug_server.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <bitset>
+#include <cerrno>
+#include <concepts>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <span>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__)
+#	include <fcntl.h>
+#	include <poll.h>
+#	include <sys/socket.h>
+#	include <sys/un.h>
+#	include <unistd.h>
+#	define NESEM_HAS_SOCKETS 1
+#endif
+
+#include <fmt/std.h>
+
+#include "nes.hpp"
+
+#include <util/logging.hpp>
+
+namespace
+{
+	using namespace nesem;
+
+	// bigger requests than this are never valid, so a client sending one is dropped rather than buffered
+	constexpr size_t max_request_size = 64 * 1024;
+
+	// the most bytes one read request may ask for
+	constexpr size_t max_read_size = 1024 * 1024;
+
+	constexpr U8 response_bit = 0x80;
+
+	// builds a packet, filling in its size once done
+	class Packet final
+	{
+	public:
+		explicit Packet(U8 command) noexcept
+		{
+			bytes.resize(sizeof(U32));
+			put(command);
+		}
+
+		template <std::integral T>
+		void put(T value) noexcept
+		{
+			if constexpr (std::endian::native == std::endian::big)
+				value = std::byteswap(value);
+
+			auto raw = std::bit_cast<std::array<std::byte, sizeof(T)>>(value);
+			bytes.insert(bytes.end(), raw.begin(), raw.end());
+		}
+
+		[[nodiscard]] std::vector<std::byte> finish() && noexcept
+		{
+			auto size = U32(bytes.size() - sizeof(U32));
+			if constexpr (std::endian::native == std::endian::big)
+				size = std::byteswap(size);
+
+			std::memcpy(bytes.data(), &size, sizeof(size));
+			return std::move(bytes);
+		}
+
+	private:
+		std::vector<std::byte> bytes;
+	};
+
+	// reads the payload of a request. Reading past the end gives zeros and marks the request as bad
+	class Payload final
+	{
+	public:
+		explicit Payload(std::span<const std::byte> bytes) noexcept
+			: bytes(bytes)
+		{
+		}
+
+		template <std::integral T>
+		T get() noexcept
+		{
+			T value{};
+
+			if (bytes.size() - position < sizeof(T))
+			{
+				overflow = true;
+				return value;
+			}
+
+			std::memcpy(&value, bytes.data() + position, sizeof(T));
+			position += sizeof(T);
+
+			if constexpr (std::endian::native == std::endian::big)
+				value = std::byteswap(value);
+
+			return value;
+		}
+
+		// true if everything read was there and nothing was left over
+		[[nodiscard]] bool ok() const noexcept
+		{
+			return !overflow && position == bytes.size();
+		}
+
+	private:
+		std::span<const std::byte> bytes;
+		size_t position = 0;
+		bool overflow = false;
+	};
+
+	std::vector<std::byte> error_packet(NesDebugCommand command, NesDebugError code) noexcept
+	{
+		auto packet = Packet(U8(NesDebugCommand::error));
+		packet.put(U8(command));
+		packet.put(U8(code));
+		return std::move(packet).finish();
+	}
+
+	void put_registers(Packet &packet, const Nes &nes, bool halted) noexcept
+	{
+		auto state = nes.cpu().state();
+
+		packet.put(to_integer(state.PC));
+		packet.put(state.S);
+		packet.put(state.P.raw_value());
+		packet.put(state.A);
+		packet.put(state.X);
+		packet.put(state.Y);
+		packet.put(nes.cpu().current_cycle());
+		packet.put(nes.ppu().current_frame());
+		packet.put(U8(halted));
+	}
+
+	bool is_step(U8 step) noexcept
+	{
+		return step > U8(NesClockStep::None) && step <= U8(NesClockStep::OneFrame);
+	}
+
+	// the most steps of a kind one request may ask for, about a second of NTSC emulation, so a single request can't
+	// stall the emulation thread for long
+	U32 max_steps(NesClockStep step) noexcept
+	{
+		constexpr U32 frames = 60;
+		constexpr U32 scanlines = 262 * frames;
+		constexpr U32 ppu_cycles = 341 * scanlines;
+
+		switch (step)
+		{
+		case NesClockStep::None:
+			return 0;
+		case NesClockStep::OneClockCycle:
+		case NesClockStep::OnePpuCycle:
+			return ppu_cycles;
+		case NesClockStep::OnePpuScanline:
+			return scanlines;
+		case NesClockStep::OneCpuCycle:
+			return ppu_cycles / 3;
+		case NesClockStep::OneCpuInstruction:
+			// every instruction takes at least 2 cycles
+			return ppu_cycles / 6;
+		case NesClockStep::OneFrame:
+			return frames;
+		}
+
+		return 0;
+	}
+
+	// a request as received, or a marker that a client attached or detached
+	struct Request
+	{
+		U64 session = 0;
+		bool attach = false;
+		bool detach = false;
+		std::vector<std::byte> bytes;
+	};
+
+	struct Response
+	{
+		U64 session = 0;
+		std::vector<std::byte> bytes;
+	};
+}
+
+namespace nesem
+{
+	struct NesDebugServer::Core
+	{
+		std::filesystem::path path;
+		bool start_halted = false;
+
+		std::mutex mutex;
+		std::condition_variable changed;
+		std::deque<Request> inbox;
+		std::deque<Response> outbox;
+
+		std::atomic<bool> client_attached = false;
+		std::atomic<bool> has_requests = false;
+
+		// only touched on the emulation thread
+		U64 session = 0;
+		bool halted = false;
+		std::bitset<0x10000> breakpoints;
+		size_t breakpoint_count = 0;
+
+#if defined(NESEM_HAS_SOCKETS)
+		int listen_fd = -1;
+		std::array<int, 2> wake_fds{-1, -1};
+
+		// declared last so the thread is stopped and joined before anything it uses is destroyed
+		std::jthread io;
+
+		Core(const std::filesystem::path &path, bool start_halted, int listen_fd, std::array<int, 2> wake_fds) noexcept
+			: path(path), start_halted(start_halted), listen_fd(listen_fd), wake_fds(wake_fds)
+		{
+			io = std::jthread([this](std::stop_token stop) { io_loop(stop); });
+		}
+
+		~Core()
+		{
+			io.request_stop();
+			wake();
+			io.join();
+
+			::close(listen_fd);
+			::close(wake_fds[0]);
+			::close(wake_fds[1]);
+
+			std::error_code ec;
+			std::filesystem::remove(path, ec);
+		}
+
+		Core(const Core &other) = delete;
+		Core &operator=(const Core &other) = delete;
+
+		// poke the io thread out of poll
+		void wake() noexcept
+		{
+			auto byte = char{0};
+			[[maybe_unused]] auto written = ::write(wake_fds[1], &byte, 1);
+		}
+
+		void io_loop(std::stop_token stop) noexcept
+		{
+			int client = -1;
+			U64 client_session = 0;
+			std::vector<std::byte> received;
+			std::array<std::byte, 4096> chunk;
+
+			auto detach = [&] {
+				::close(client);
+				client = -1;
+				received.clear();
+
+				{
+					auto lock = std::scoped_lock(mutex);
+					client_attached = false;
+					inbox.clear();
+					outbox.clear();
+
+					// so the system doesn't stay halted, or stop at breakpoints, with nobody left to resume it
+					inbox.push_back({.session = client_session, .detach = true});
+					has_requests = true;
+				}
+
+				changed.notify_all();
+				LOG_INFO("Debug client detached");
+			};
+
+			while (!stop.stop_requested())
+			{
+				auto fds = std::array{
+					pollfd{.fd = client >= 0 ? client : listen_fd, .events = POLLIN, .revents = 0},
+					pollfd{.fd = wake_fds[0], .events = POLLIN, .revents = 0},
+				};
+
+				if (::poll(fds.data(), fds.size(), -1) < 0)
+				{
+					if (errno == EINTR)
+						continue;
+
+					LOG_ERROR("Debug server stopped: {}", std::strerror(errno));
+					break;
+				}
+
+				if (fds[1].revents & POLLIN)
+				{
+					std::array<char, 64> drain;
+					while (::read(wake_fds[0], drain.data(), drain.size()) > 0)
+						;
+				}
+
+				if (client < 0 && (fds[0].revents & POLLIN))
+				{
+					client = ::accept(listen_fd, nullptr, nullptr);
+					if (client >= 0)
+					{
+						{
+							auto lock = std::scoped_lock(mutex);
+							inbox.push_back({.session = ++client_session, .attach = true});
+							client_attached = true;
+							has_requests = true;
+						}
+
+						changed.notify_all();
+						LOG_INFO("Debug client attached");
+					}
+				}
+				else if (client >= 0 && (fds[0].revents & (POLLIN | POLLHUP | POLLERR)))
+				{
+					auto count = ::recv(client, chunk.data(), chunk.size(), 0);
+					if (count <= 0)
+					{
+						detach();
+						continue;
+					}
+
+					received.insert(received.end(), chunk.begin(), chunk.begin() + count);
+
+					if (!take_requests(received, client_session))
+					{
+						LOG_WARN("Debug client sent a request larger than {} bytes", max_request_size);
+						detach();
+						continue;
+					}
+				}
+
+				if (client >= 0 && !send_responses(client, client_session))
+					detach();
+			}
+
+			if (client >= 0)
+				::close(client);
+		}
+
+		// move every complete request out of received into the inbox. Returns false if the client sent garbage
+		bool take_requests(std::vector<std::byte> &received, U64 client_session) noexcept
+		{
+			size_t position = 0;
+			bool any = false;
+
+			while (received.size() - position >= sizeof(U32))
+			{
+				U32 size = 0;
+				std::memcpy(&size, received.data() + position, sizeof(size));
+				if constexpr (std::endian::native == std::endian::big)
+					size = std::byteswap(size);
+
+				if (size == 0 || size > max_request_size)
+					return false;
+
+				if (received.size() - position - sizeof(U32) < size)
+					break;
+
+				auto start = received.begin() + ptrdiff_t(position + sizeof(U32));
+
+				{
+					// set while holding mutex, so a waiter can't check it just before and then miss the notify
+					auto lock = std::scoped_lock(mutex);
+					inbox.push_back({.session = client_session, .bytes = std::vector<std::byte>(start, start + size)});
+					has_requests = true;
+				}
+
+				position += sizeof(U32) + size;
+				any = true;
+			}
+
+			received.erase(received.begin(), received.begin() + ptrdiff_t(position));
+
+			if (any)
+				changed.notify_all();
+
+			return true;
+		}
+
+		// a slow client only ever blocks this thread
+		bool send_responses(int client, U64 client_session) noexcept
+		{
+			std::deque<Response> responses;
+
+			{
+				auto lock = std::scoped_lock(mutex);
+				responses.swap(outbox);
+			}
+
+			for (const auto &response : responses)
+			{
+				if (response.session != client_session)
+					continue;
+
+				auto bytes = std::span(response.bytes);
+				while (!bytes.empty())
+				{
+					auto sent = ::send(client, bytes.data(), bytes.size(), MSG_NOSIGNAL);
+					if (sent < 0 && errno == EINTR)
+						continue;
+
+					if (sent <= 0)
+						return false;
+
+					bytes = bytes.subspan(size_t(sent));
+				}
+			}
+
+			return true;
+		}
+#else
+		void wake() noexcept
+		{
+		}
+#endif
+
+		void send(std::vector<Response> &&responses) noexcept
+		{
+			if (responses.empty())
+				return;
+
+			{
+				auto lock = std::scoped_lock(mutex);
+				for (auto &response : responses)
+					outbox.push_back(std::move(response));
+			}
+
+			wake();
+		}
+
+		// answer everything received since last time
+		void service(Nes &nes) noexcept
+		{
+			if (!has_requests.load(std::memory_order_acquire))
+				return;
+
+			std::deque<Request> requests;
+
+			{
+				auto lock = std::scoped_lock(mutex);
+				requests.swap(inbox);
+				has_requests = false;
+			}
+
+			std::vector<Response> responses;
+
+			for (const auto &request : requests)
+			{
+				if (request.attach)
+				{
+					session = request.session;
+					halted = start_halted;
+					breakpoints.reset();
+					breakpoint_count = 0;
+					continue;
+				}
+
+				if (request.detach)
+				{
+					if (request.session == session)
+					{
+						halted = false;
+						breakpoints.reset();
+						breakpoint_count = 0;
+					}
+
+					continue;
+				}
+
+				responses.push_back({.session = request.session, .bytes = handle(nes, request.bytes)});
+			}
+
+			send(std::move(responses));
+		}
+
+		std::vector<std::byte> handle(Nes &nes, std::span<const std::byte> request) noexcept
+		{
+			using enum NesDebugCommand;
+
+			auto command = NesDebugCommand(request.front());
+			auto payload = Payload(request.subspan(1));
+			auto response = Packet(U8(U8(command) | response_bit));
+
+			switch (command)
+			{
+			case read_cpu:
+			case read_ppu:
+			{
+				struct Range
+				{
+					U16 addr;
+					U16 size;
+				};
+
+				auto ranges = std::vector<Range>(payload.get<U16>());
+				size_t total = 0;
+
+				for (auto &range : ranges)
+				{
+					range.addr = payload.get<U16>();
+					range.size = payload.get<U16>();
+					total += range.size;
+				}
+
+				if (!payload.ok())
+					return error_packet(command, NesDebugError::bad_request);
+
+				if (total > max_read_size)
+					return error_packet(command, NesDebugError::too_large);
+
+				for (const auto &range : ranges)
+				{
+					for (U16 i = 0; i < range.size; ++i)
+					{
+						auto addr = Addr(U16(range.addr + i));
+						response.put(command == read_cpu ? nes.bus().peek(addr) : nes.ppu().peek(addr));
+					}
+				}
+
+				break;
+			}
+
+			case registers:
+				if (!payload.ok())
+					return error_packet(command, NesDebugError::bad_request);
+
+				put_registers(response, nes, halted);
+				break;
+
+			case add_breakpoint:
+			case remove_breakpoint:
+			{
+				auto addr = payload.get<U16>();
+				if (!payload.ok())
+					return error_packet(command, NesDebugError::bad_request);
+
+				bool set = command == add_breakpoint;
+				if (breakpoints[addr] != set)
+				{
+					breakpoints[addr] = set;
+					breakpoint_count = set ? breakpoint_count + 1 : breakpoint_count - 1;
+				}
+
+				break;
+			}
+
+			case clear_breakpoints:
+				if (!payload.ok())
+					return error_packet(command, NesDebugError::bad_request);
+
+				breakpoints.reset();
+				breakpoint_count = 0;
+				break;
+
+			case halt:
+				if (!payload.ok())
+					return error_packet(command, NesDebugError::bad_request);
+
+				halted = true;
+				put_registers(response, nes, halted);
+				break;
+
+			case resume:
+				if (!payload.ok())
+					return error_packet(command, NesDebugError::bad_request);
+
+				halted = false;
+				break;
+
+			case step:
+			{
+				auto kind = payload.get<U8>();
+				auto count = payload.get<U32>();
+
+				if (!payload.ok() || !is_step(kind))
+					return error_packet(command, NesDebugError::bad_request);
+
+				if (count > max_steps(NesClockStep(kind)))
+					return error_packet(command, NesDebugError::too_large);
+
+				if (!nes.cartridge())
+					return error_packet(command, NesDebugError::no_rom);
+
+				// stepping only makes sense from a standstill, and leaves the system there
+				halted = true;
+				for (U32 i = 0; i < count; ++i)
+					nes.step(NesClockStep(kind));
+
+				put_registers(response, nes, halted);
+				break;
+			}
+
+			default:
+				return error_packet(command, NesDebugError::unknown_command);
+			}
+
+			return std::move(response).finish();
+		}
+
+		// run until the frame ends or the next instruction has a breakpoint on it. Returns true if the frame ended
+		bool run_to_breakpoint(Nes &nes) noexcept
+		{
+			auto frame = nes.ppu().current_frame();
+
+			while (nes.ppu().current_frame() == frame)
+			{
+				nes.step(NesClockStep::OneCpuInstruction);
+
+				auto pc = nes.cpu().state().PC;
+				if (breakpoints[to_integer(pc)])
+				{
+					halted = true;
+
+					auto event = Packet(U8(NesDebugCommand::stopped));
+					event.put(to_integer(pc));
+					put_registers(event, nes, halted);
+
+					auto responses = std::vector<Response>();
+					responses.push_back({.session = session, .bytes = std::move(event).finish()});
+					send(std::move(responses));
+
+					return false;
+				}
+			}
+
+			return true;
+		}
+	};
+
+	NesDebugServer NesDebugServer::create(const std::filesystem::path &path, bool start_halted) noexcept
+	{
+#if defined(NESEM_HAS_SOCKETS)
+		auto address = sockaddr_un{.sun_family = AF_UNIX, .sun_path = {}};
+
+		auto native = path.native();
+		if (native.empty() || native.size() >= sizeof(address.sun_path))
+		{
+			LOG_WARN("Debug socket path {} must be between 1 and {} characters", path, sizeof(address.sun_path) - 1);
+			return NesDebugServer();
+		}
+
+		std::ranges::copy(native, address.sun_path);
+
+		// a socket left behind by a server that didn't shut down cleanly would make bind fail
+		std::error_code ec;
+		if (std::filesystem::is_socket(path, ec))
+			std::filesystem::remove(path, ec);
+
+		int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (fd < 0)
+		{
+			LOG_WARN("Could not create debug socket: {}", std::strerror(errno));
+			return NesDebugServer();
+		}
+
+		if (::bind(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0 || ::listen(fd, 1) != 0)
+		{
+			LOG_WARN("Could not listen on debug socket {}: {}", path, std::strerror(errno));
+			::close(fd);
+			return NesDebugServer();
+		}
+
+		std::array<int, 2> wake_fds{-1, -1};
+		if (::pipe(wake_fds.data()) != 0)
+		{
+			LOG_WARN("Could not create debug server pipe: {}", std::strerror(errno));
+			::close(fd);
+			return NesDebugServer();
+		}
+
+		// the emulation thread must never block poking the io thread, however far behind it is
+		for (auto wake_fd : wake_fds)
+			::fcntl(wake_fd, F_SETFL, ::fcntl(wake_fd, F_GETFL) | O_NONBLOCK);
+
+		LOG_INFO("Debug server listening on {}", path);
+		return NesDebugServer(std::make_unique<Core>(path, start_halted, fd, wake_fds));
+#else
+		LOG_WARN("Debug server on {} not started, it is only supported on POSIX systems", path);
+		return NesDebugServer();
+#endif
+	}
+
+	NesDebugServer::NesDebugServer() noexcept = default;
+
+	NesDebugServer::NesDebugServer(std::unique_ptr<Core> &&core) noexcept
+		: core(std::move(core))
+	{
+	}
+
+	NesDebugServer::~NesDebugServer() = default;
+	NesDebugServer::NesDebugServer(NesDebugServer &&other) noexcept = default;
+	NesDebugServer &NesDebugServer::operator=(NesDebugServer &&other) noexcept = default;
+
+	bool NesDebugServer::attached() const noexcept
+	{
+		return core && core->client_attached.load(std::memory_order_relaxed);
+	}
+
+	bool NesDebugServer::run_frame(Nes &nes) noexcept
+	{
+		if (!core)
+		{
+			nes.step(NesClockStep::OneFrame);
+			return true;
+		}
+
+		core->service(nes);
+
+		if (core->halted)
+			return false;
+
+		if (core->breakpoint_count == 0)
+		{
+			nes.step(NesClockStep::OneFrame);
+			return true;
+		}
+
+		return core->run_to_breakpoint(nes);
+	}
+
+	void NesDebugServer::wait(std::chrono::milliseconds timeout) noexcept
+	{
+		if (!core)
+			return;
+
+		auto attached = core->client_attached.load();
+		auto lock = std::unique_lock(core->mutex);
+		core->changed.wait_for(lock, timeout, [&] { return core->has_requests.load() || core->client_attached.load() != attached; });
+	}
+}
@@ -0,0 +1,361 @@
+#include "nes_env.hpp"
+
+#include <algorithm>
+#include <array>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	define NESEM_HAS_SSE2 1
+#	include <emmintrin.h>
+#endif
+
+#include <fmt/std.h>
+
+#include "nes.hpp"
+
+#include <util/logging.hpp>
+
+namespace
+{
+	using namespace nesem;
+
+	constexpr size_t screen_size = NesEnvObservation::width * NesEnvObservation::height;
+	constexpr size_t grayscale_size = NesEnvObservation::grayscale_width * NesEnvObservation::grayscale_height;
+
+	// the luminance of each color in the app's default palette. Emphasis only tints the picture slightly, so it is
+	// ignored
+	constexpr std::array<U8, 64> luma{
+		// clang-format off
+		77,  27,  24,  27,  31,  29,  26,  27,  28,  30,  33,  32,  31,  0, 0, 0,
+		156, 68,  69,  70,  71,  71,  68,  71,  74,  75,  73,  73,  71,  0, 0, 0,
+		255, 145, 138, 140, 148, 149, 149, 150, 151, 152, 152, 151, 151, 55, 0, 0,
+		255, 207, 204, 205, 208, 208, 209, 209, 209, 208, 209, 209, 209, 165, 0, 0,
+		// clang-format on
+	};
+
+	// average each 2x2 block of two rows of luminance, rounding up like the SIMD averages do at each step
+	void downsample_rows(std::span<const U8> top, std::span<const U8> bottom, std::span<U8> out) noexcept
+	{
+		size_t x = 0;
+
+#if defined(NESEM_HAS_SSE2)
+		auto low_bytes = _mm_set1_epi16(0x00FF);
+
+		for (; x + 32 <= top.size(); x += 32)
+		{
+			auto vertical0 = _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(&top[x])), _mm_loadu_si128(reinterpret_cast<const __m128i *>(&bottom[x])));
+			auto vertical1 = _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(&top[x + 16])), _mm_loadu_si128(reinterpret_cast<const __m128i *>(&bottom[x + 16])));
+
+			// even pixels in the low byte of each 16 bit lane, odd ones in the high byte
+			auto horizontal0 = _mm_avg_epu16(_mm_and_si128(vertical0, low_bytes), _mm_srli_epi16(vertical0, 8));
+			auto horizontal1 = _mm_avg_epu16(_mm_and_si128(vertical1, low_bytes), _mm_srli_epi16(vertical1, 8));
+
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(&out[x / 2]), _mm_packus_epi16(horizontal0, horizontal1));
+		}
+#endif
+
+		constexpr auto average = [](unsigned int a, unsigned int b) { return (a + b + 1) >> 1; };
+
+		for (; x + 1 < top.size(); x += 2)
+			out[x / 2] = U8(average(average(top[x], bottom[x]), average(top[x + 1], bottom[x + 1])));
+	}
+
+	// run a step's frames, drawing only the last
+	U64 run_frames(Nes &nes, int frameskip) noexcept
+	{
+		auto frames = U64(std::max(frameskip, 1));
+
+		nes.enable_video(false);
+		for (U64 i = 1; i < frames; ++i)
+			nes.step(NesClockStep::OneFrame);
+
+		nes.enable_video(true);
+		nes.step(NesClockStep::OneFrame);
+
+		return frames;
+	}
+
+	NesEnvStep make_step(const Nes &nes, std::span<const U16> screen, std::span<U8> grayscale, std::span<const float> audio, U64 frames) noexcept
+	{
+		if (!grayscale.empty())
+			downsample_grayscale(screen, grayscale);
+
+		return NesEnvStep{
+			.observation{
+				.screen = screen,
+				.grayscale = grayscale,
+				.ram = nes.bus().work_ram(),
+				.audio = audio,
+			},
+			.info{
+				.frame = nes.ppu().current_frame(),
+				.frames = frames,
+				.state_hash = nes.state_hash(),
+			},
+		};
+	}
+
+	std::vector<std::byte> save_initial_state(const Nes &nes) noexcept
+	{
+		auto state = std::vector<std::byte>(nes.state_size());
+
+		if (state.empty() || nes.save_state(state) == 0)
+			return {};
+
+		return state;
+	}
+}
+
+namespace nesem
+{
+	void downsample_grayscale(std::span<const U16> screen, std::span<U8> out) noexcept
+	{
+		CHECK(screen.size() == screen_size, "screen is the wrong size");
+		CHECK(out.size() == grayscale_size, "grayscale buffer is the wrong size");
+
+		constexpr size_t width = NesEnvObservation::width;
+
+		// the luminance of a pair of rows at a time, which is then averaged down to a single row
+		std::array<U8, width> top;
+		std::array<U8, width> bottom;
+
+		for (size_t y = 0; y < NesEnvObservation::grayscale_height; ++y)
+		{
+			auto top_row = screen.subspan(y * 2 * width, width);
+			auto bottom_row = screen.subspan((y * 2 + 1) * width, width);
+
+			for (size_t x = 0; x < width; ++x)
+			{
+				top[x] = luma[top_row[x] & 0x3F];
+				bottom[x] = luma[bottom_row[x] & 0x3F];
+			}
+
+			downsample_rows(top, bottom, out.subspan(y * NesEnvObservation::grayscale_width, NesEnvObservation::grayscale_width));
+		}
+	}
+
+	struct NesEnv::Core
+	{
+		std::vector<U16> screen = std::vector<U16>(screen_size);
+		std::vector<U8> grayscale;
+		std::vector<float> audio;
+		std::vector<std::byte> initial_state;
+		U8 buttons = 0;
+
+		// declared last so its callbacks never see the buffers they write destroyed
+		Nes nes;
+
+		explicit Core(const NesEnvSettings &settings) noexcept
+			: grayscale(settings.grayscale ? grayscale_size : 0),
+			  nes(NesSettings{
+				  .error = [](std::string_view message) { LOG_WARN("Error in environment: {}", message); },
+				  .draw = [this](int x, int y, U8 color_index, util::Flags<NesColorEmphasis> emphasis) {
+					  screen[size_t(y * NesEnvObservation::width + x)] = U16((color_index & 0x3F) | (emphasis.raw_value() << 6));
+				  },
+				  .audio = [this](float sample) { audio.push_back(sample); },
+				  .sample_rate = settings.sample_rate,
+				  .player1 = std::make_unique<NesController>([this] { return buttons; }),
+				  .nes20db_filename = settings.nes20db_filename,
+			  })
+		{
+			nes.enable_audio(settings.audio);
+		}
+	};
+
+	NesEnv::NesEnv() noexcept = default;
+
+	NesEnv::NesEnv(std::unique_ptr<Core> &&core) noexcept
+		: core(std::move(core))
+	{
+	}
+
+	NesEnv::~NesEnv() = default;
+	NesEnv::NesEnv(NesEnv &&other) noexcept = default;
+	NesEnv &NesEnv::operator=(NesEnv &&other) noexcept = default;
+
+	NesEnv NesEnv::create(const NesEnvSettings &settings) noexcept
+	{
+		auto core = std::make_unique<Core>(settings);
+
+		if (!core->nes.load_rom(settings.rom))
+		{
+			LOG_WARN("Could not load {} for the environment", settings.rom);
+			return NesEnv();
+		}
+
+		core->initial_state = save_initial_state(core->nes);
+		if (core->initial_state.empty())
+		{
+			LOG_WARN("Could not save the initial state of {}", settings.rom);
+			return NesEnv();
+		}
+
+		return NesEnv(std::move(core));
+	}
+
+	NesEnvStep NesEnv::reset() noexcept
+	{
+		CHECK(core != nullptr, "resetting an empty environment");
+
+		core->nes.load_state(core->initial_state);
+		return make_step(core->nes, core->screen, core->grayscale, {}, 0);
+	}
+
+	NesEnvStep NesEnv::reset(std::span<const std::byte> state) noexcept
+	{
+		CHECK(core != nullptr, "resetting an empty environment");
+
+		if (!core->nes.load_state(state))
+		{
+			LOG_WARN("Could not load the environment's state, resetting instead");
+			return reset();
+		}
+
+		return make_step(core->nes, core->screen, core->grayscale, {}, 0);
+	}
+
+	NesEnvStep NesEnv::step(U8 action_mask, int frameskip) noexcept
+	{
+		CHECK(core != nullptr, "stepping an empty environment");
+
+		core->buttons = action_mask;
+		core->audio.clear();
+		auto frames = run_frames(core->nes, frameskip);
+
+		return make_step(core->nes, core->screen, core->grayscale, core->audio, frames);
+	}
+
+	Nes &NesEnv::nes() noexcept
+	{
+		CHECK(core != nullptr, "no system in an empty environment");
+		return core->nes;
+	}
+
+	struct NesVectorEnv::Core
+	{
+		NesPool pool;
+		std::vector<std::byte> initial_state;
+
+		// one per environment, each only written by the job stepping it
+		std::vector<std::vector<U8>> grayscale;
+		std::vector<NesEnvStep> results;
+
+		// run a job on every environment and wait for them all to finish
+		template <typename Fn>
+		std::span<const NesEnvStep> run_all(Fn &&fn) noexcept
+		{
+			for (size_t i = 0; i < pool.size(); ++i)
+				pool.submit(i, [this, i, &fn](Nes &nes) { return fn(i, nes); });
+
+			pool.wait();
+			return results;
+		}
+
+		U64 finish(size_t index, const Nes &nes, U64 frames) noexcept
+		{
+			const auto &output = pool.output(index);
+			results[index] = make_step(nes, output.screen, grayscale[index], output.audio, frames);
+			return frames;
+		}
+	};
+
+	NesVectorEnv::NesVectorEnv() noexcept = default;
+
+	NesVectorEnv::NesVectorEnv(std::unique_ptr<Core> &&core) noexcept
+		: core(std::move(core))
+	{
+	}
+
+	NesVectorEnv::~NesVectorEnv() = default;
+	NesVectorEnv::NesVectorEnv(NesVectorEnv &&other) noexcept = default;
+	NesVectorEnv &NesVectorEnv::operator=(NesVectorEnv &&other) noexcept = default;
+
+	NesVectorEnv NesVectorEnv::create(const NesEnvSettings &settings, size_t instances, unsigned int threads) noexcept
+	{
+		auto pool = NesPool::create({
+			.instances = instances,
+			.threads = threads,
+			.sample_rate = settings.sample_rate,
+			.audio = settings.audio,
+			.nes20db_filename = settings.nes20db_filename,
+		});
+
+		if (!pool || !pool.load_rom(settings.rom))
+		{
+			LOG_WARN("Could not load {} for the environments", settings.rom);
+			return NesVectorEnv();
+		}
+
+		auto core = std::make_unique<Core>();
+		core->initial_state = save_initial_state(pool.instance(0));
+		if (core->initial_state.empty())
+		{
+			LOG_WARN("Could not save the initial state of {}", settings.rom);
+			return NesVectorEnv();
+		}
+
+		core->grayscale.resize(instances, std::vector<U8>(settings.grayscale ? grayscale_size : 0));
+		core->results.resize(instances);
+		core->pool = std::move(pool);
+
+		// loading the rom isn't part of the environments' throughput
+		core->pool.reset_metrics();
+
+		return NesVectorEnv(std::move(core));
+	}
+
+	size_t NesVectorEnv::size() const noexcept
+	{
+		return core ? core->results.size() : 0;
+	}
+
+	std::span<const NesEnvStep> NesVectorEnv::reset() noexcept
+	{
+		CHECK(core != nullptr, "resetting an empty environment");
+
+		return core->run_all([this](size_t i, Nes &nes) {
+			nes.load_state(core->initial_state);
+			return core->finish(i, nes, 0);
+		});
+	}
+
+	const NesEnvStep &NesVectorEnv::reset(size_t index, std::span<const std::byte> state) noexcept
+	{
+		CHECK(core != nullptr, "resetting an empty environment");
+		CHECK(index < size(), "environment index out of range");
+
+		core->pool.submit(index, [this, index, state](Nes &nes) {
+			if (!nes.load_state(state))
+			{
+				LOG_WARN("Could not load the state of environment {}, resetting instead", index);
+				nes.load_state(core->initial_state);
+			}
+
+			return core->finish(index, nes, 0);
+		});
+
+		core->pool.wait();
+		return core->results[index];
+	}
+
+	std::span<const NesEnvStep> NesVectorEnv::step(std::span<const U8> action_masks, int frameskip) noexcept
+	{
+		CHECK(core != nullptr, "stepping an empty environment");
+		CHECK(action_masks.size() == size(), "need one action per environment");
+
+		for (size_t i = 0; i < size(); ++i)
+			core->pool.set_input(i, 0, i < action_masks.size() ? action_masks[i] : 0);
+
+		return core->run_all([this, frameskip](size_t i, Nes &nes) { return core->finish(i, nes, run_frames(nes, frameskip)); });
+	}
+
+	NesPoolMetrics NesVectorEnv::metrics() const noexcept
+	{
+		return core ? core->pool.metrics() : NesPoolMetrics{};
+	}
+
+	Nes &NesVectorEnv::nes(size_t index) noexcept
+	{
+		CHECK(core != nullptr, "no systems in an empty environment");
+		return core->pool.instance(index);
+	}
+}
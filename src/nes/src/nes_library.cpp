@@ -0,0 +1,397 @@
+#include "nes_library.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <fstream>
+#include <random>
+#include <thread>
+#include <utility>
+
+#include <fmt/std.h>
+
+#include "nes_rom_loader.hpp"
+#include "nes_state.hpp"
+
+#include <util/logging.hpp>
+
+namespace
+{
+	using namespace nesem;
+
+	constexpr std::array<char, 4> library_magic = {'N', 'L', 'I', 'B'};
+	constexpr U32 library_version = 1;
+
+	struct LibraryHeader
+	{
+		std::array<char, 4> magic = library_magic;
+		U32 version = library_version;
+		U32 count = 0;
+	};
+
+	// one per entry, all of them first so they can be skimmed without touching the text, which follows them
+	struct LibraryRecord
+	{
+		U64 file_size = 0;
+		int64_t modified = 0;
+		std::array<char, 40> sha1{};
+
+		U32 prg_rom_size = 0;
+		U32 chr_rom_size = 0;
+		U32 prg_ram_size = 0;
+		U32 chr_ram_size = 0;
+
+		U32 path_size = 0;
+		U32 title_size = 0;
+
+		U32 mapper = 0;
+		U8 submapper = 0;
+		U8 region = 0;
+		mappers::MirroringMode mirroring = mappers::MirroringMode::horizontal;
+		U8 flags = 0;
+	};
+
+	constexpr U8 flag_battery = 0x01;
+	constexpr U8 flag_in_db = 0x02;
+
+	std::string path_text(const std::filesystem::path &path)
+	{
+		auto text = path.generic_u8string();
+		return std::string(text.begin(), text.end());
+	}
+
+	std::string lowercase(std::string_view text)
+	{
+		auto result = std::string(text);
+		std::ranges::transform(result, result.begin(), [](char c) { return char(std::tolower(static_cast<unsigned char>(c))); });
+		return result;
+	}
+
+	// the files the rom loader can load, archives included
+	bool is_rom_file(const std::filesystem::path &path)
+	{
+		auto extension = lowercase(path_text(path.extension()));
+		return extension == ".nes" || extension == ".gz" || extension == ".zip";
+	}
+
+	std::vector<std::filesystem::path> find_rom_files(const std::vector<std::filesystem::path> &directories) noexcept
+	{
+		std::vector<std::filesystem::path> files;
+
+		for (const auto &directory : directories)
+		{
+			std::error_code ec;
+			auto it = std::filesystem::recursive_directory_iterator(directory, std::filesystem::directory_options::skip_permission_denied, ec);
+
+			if (ec)
+			{
+				LOG_WARN("Could not scan {}, reason: {}", directory, ec.message());
+				continue;
+			}
+
+			for (; it != std::filesystem::recursive_directory_iterator(); it.increment(ec))
+			{
+				if (ec)
+				{
+					LOG_WARN("Stopped scanning {} early, reason: {}", directory, ec.message());
+					break;
+				}
+
+				if (it->is_regular_file(ec) && is_rom_file(it->path()))
+					files.push_back(it->path());
+			}
+		}
+
+		std::ranges::sort(files);
+		files.erase(std::unique(files.begin(), files.end()), files.end());
+		return files;
+	}
+
+	// the file's name without its extension, or both extensions for an archive named like game.nes.gz
+	std::string title_of(const std::filesystem::path &path)
+	{
+		auto name = path.stem();
+		if (lowercase(path_text(name.extension())) == ".nes")
+			name = name.stem();
+
+		return path_text(name);
+	}
+
+	NesLibraryEntry make_entry(const std::filesystem::path &path, const mappers::NesRom &rom) noexcept
+	{
+		auto entry = NesLibraryEntry{
+			.path = path,
+			.title = title_of(path),
+			.sha1 = rom.sha1,
+			.mapper = mappers::rom_mapper(rom),
+			.submapper = rom.v2 ? rom.v2->pcb.submapper : 0,
+			.region = mappers::rom_region(rom),
+			.mirroring = mappers::rom_mirroring_mode(rom),
+			.battery = rom.v2 ? rom.v2->pcb.battery : rom.v1.has_battery,
+			.in_db = rom.v2.has_value(),
+			.prg_rom_size = size_t(mappers::rom_prgrom_banks(rom, bank_1k)) * bank_1k,
+			.chr_rom_size = size_t(mappers::rom_chrrom_banks(rom, bank_1k)) * bank_1k,
+			.prg_ram_size = mappers::rom_prgram_size(rom),
+			.chr_ram_size = mappers::rom_chrram_size(rom),
+		};
+
+		std::error_code ec;
+		entry.file_size = std::filesystem::file_size(path, ec);
+		entry.modified = std::filesystem::last_write_time(path, ec).time_since_epoch().count();
+
+		return entry;
+	}
+
+	void write_library(NesStateWriter &writer, const NesLibrary &library) noexcept
+	{
+		writer.write(LibraryHeader{.count = U32(library.entries.size())});
+
+		auto paths = std::vector<std::string>();
+		paths.reserve(library.entries.size());
+
+		for (const auto &entry : library.entries)
+		{
+			const auto &path = paths.emplace_back(path_text(entry.path));
+
+			auto record = LibraryRecord{
+				.file_size = entry.file_size,
+				.modified = entry.modified,
+				.prg_rom_size = U32(entry.prg_rom_size),
+				.chr_rom_size = U32(entry.chr_rom_size),
+				.prg_ram_size = U32(entry.prg_ram_size),
+				.chr_ram_size = U32(entry.chr_ram_size),
+				.path_size = U32(path.size()),
+				.title_size = U32(entry.title.size()),
+				.mapper = U32(entry.mapper),
+				.submapper = U8(entry.submapper),
+				.region = U8(entry.region),
+				.mirroring = entry.mirroring,
+				.flags = U8((entry.battery ? flag_battery : 0) | (entry.in_db ? flag_in_db : 0)),
+			};
+
+			std::copy_n(entry.sha1.begin(), std::min(entry.sha1.size(), record.sha1.size()), record.sha1.begin());
+			writer.write(record);
+		}
+
+		for (size_t i = 0; i < library.entries.size(); ++i)
+		{
+			writer.write_bytes(std::as_bytes(std::span(paths[i])));
+			writer.write_bytes(std::as_bytes(std::span(library.entries[i].title)));
+		}
+	}
+}
+
+namespace nesem
+{
+	NesLibrary NesLibrary::scan(const NesLibraryScanSettings &settings) noexcept
+	{
+		auto files = find_rom_files(settings.directories);
+		LOG_INFO("Found {} rom files to scan", files.size());
+
+		auto loader = NesRomLoader::create(settings.nes20db_filename, settings.cache_dir);
+
+		// each thread takes the next file until there are none left, so a few slow files don't hold up the rest
+		auto roms = std::vector<std::optional<NesLibraryEntry>>(files.size());
+		auto next = std::atomic<size_t>(0);
+
+		auto thread_count = settings.threads > 0 ? settings.threads : std::max(std::thread::hardware_concurrency(), 1u);
+		thread_count = static_cast<unsigned int>(std::clamp<size_t>(files.size(), 1, thread_count));
+
+		{
+			auto threads = std::vector<std::jthread>();
+			threads.reserve(thread_count);
+
+			for (unsigned int i = 0; i < thread_count; ++i)
+			{
+				threads.emplace_back([&] {
+					for (auto index = next++; index < files.size(); index = next++)
+					{
+						if (auto rom = loader.identify_rom(files[index]))
+							roms[index] = make_entry(files[index], *rom);
+					}
+				});
+			}
+		}
+
+		loader.save_hash_cache();
+
+		auto library = NesLibrary();
+		library.entries.reserve(files.size());
+
+		for (auto &rom : roms)
+		{
+			if (rom)
+				library.entries.push_back(std::move(*rom));
+		}
+
+		LOG_INFO("Scanned {} roms, skipped {} files that aren't", library.entries.size(), files.size() - library.entries.size());
+		return library;
+	}
+
+	std::vector<const NesLibraryEntry *> NesLibrary::find(const NesLibraryQuery &query) const noexcept
+	{
+		auto title = lowercase(query.title);
+
+		auto matches = [&](const NesLibraryEntry &entry) {
+			return (!query.mapper || entry.mapper == *query.mapper) &&
+				(!query.region || entry.region == *query.region) &&
+				(!query.battery || entry.battery == *query.battery) &&
+				(!query.in_db || entry.in_db == *query.in_db) &&
+				(title.empty() || lowercase(entry.title).contains(title));
+		};
+
+		std::vector<const NesLibraryEntry *> result;
+
+		for (const auto &entry : entries)
+		{
+			if (matches(entry))
+				result.push_back(&entry);
+		}
+
+		return result;
+	}
+
+	bool NesLibrary::save(const std::filesystem::path &filename) const noexcept
+	{
+		auto measure = NesStateWriter({});
+		write_library(measure, *this);
+
+		auto data = std::vector<std::byte>(measure.size());
+		auto writer = NesStateWriter(data);
+		write_library(writer, *this);
+
+		// written next to the library and renamed over it, so a failed save leaves the old library as it was
+		auto temp_filename = filename;
+		temp_filename += fmt::format(".{:08x}{:08x}.tmp", std::random_device{}(), std::random_device{}());
+
+		std::error_code ec;
+
+		{
+			auto file = std::ofstream(temp_filename, std::ios::binary | std::ios::trunc);
+			if (!file)
+			{
+				LOG_WARN("Could not open library file {} for writing", temp_filename);
+				return false;
+			}
+
+			file.write(reinterpret_cast<const char *>(data.data()), std::streamsize(data.size()));
+
+			if (!file)
+			{
+				LOG_WARN("Error writing library file {}", temp_filename);
+				file.close();
+				std::filesystem::remove(temp_filename, ec);
+				return false;
+			}
+		}
+
+		std::filesystem::rename(temp_filename, filename, ec);
+		if (ec)
+		{
+			LOG_WARN("Could not replace library file {}: {}", filename, ec.message());
+			std::filesystem::remove(temp_filename, ec);
+			return false;
+		}
+
+		return true;
+	}
+
+	std::optional<NesLibrary> NesLibrary::load(const std::filesystem::path &filename) noexcept
+	{
+		std::error_code ec;
+		auto size = std::filesystem::file_size(filename, ec);
+		if (ec)
+		{
+			LOG_WARN("Could not open library file {}, reason: {}", filename, ec.message());
+			return std::nullopt;
+		}
+
+		auto data = std::vector<std::byte>(size);
+
+		auto file = std::ifstream(filename, std::ios::binary);
+		if (!file || !file.read(reinterpret_cast<char *>(data.data()), std::streamsize(data.size())))
+		{
+			LOG_WARN("Could not read library file {}", filename);
+			return std::nullopt;
+		}
+
+		auto reader = NesStateReader(data);
+
+		LibraryHeader header;
+		reader.read(header);
+
+		if (!reader.ok() || header.magic != library_magic)
+		{
+			LOG_WARN("{} is not a library file", filename);
+			return std::nullopt;
+		}
+
+		if (header.version != library_version)
+		{
+			LOG_WARN("Library version {} is not supported, expected version {}", header.version, library_version);
+			return std::nullopt;
+		}
+
+		// check the count against what is actually there before allocating anything based on it
+		if (size_t(header.count) * sizeof(LibraryRecord) > reader.remaining())
+		{
+			LOG_WARN("Library file {} is truncated", filename);
+			return std::nullopt;
+		}
+
+		auto records = std::vector<LibraryRecord>(header.count);
+		for (auto &record : records)
+			reader.read(record);
+
+		NesLibrary library;
+		library.entries.reserve(records.size());
+
+		for (const auto &record : records)
+		{
+			if (size_t(record.path_size) + record.title_size > reader.remaining())
+			{
+				LOG_WARN("Library file {} is truncated", filename);
+				return std::nullopt;
+			}
+
+			if (std::to_underlying(record.mirroring) > std::to_underlying(mappers::MirroringMode::four_screen))
+			{
+				LOG_WARN("Library file {} is corrupt, mirroring mode {} is not one there is", filename, std::to_underlying(record.mirroring));
+				return std::nullopt;
+			}
+
+			auto path = std::u8string(record.path_size, u8'\0');
+			reader.read_bytes(std::as_writable_bytes(std::span(path)));
+
+			auto title = std::string(record.title_size, '\0');
+			reader.read_bytes(std::as_writable_bytes(std::span(title)));
+
+			library.entries.push_back(NesLibraryEntry{
+				.path = std::filesystem::path(path),
+				.title = std::move(title),
+				.sha1 = std::string(record.sha1.begin(), record.sha1.end()),
+				.file_size = record.file_size,
+				.modified = record.modified,
+				.mapper = int(record.mapper),
+				.submapper = record.submapper,
+				.region = record.region,
+				.mirroring = record.mirroring,
+				.battery = (record.flags & flag_battery) != 0,
+				.in_db = (record.flags & flag_in_db) != 0,
+				.prg_rom_size = record.prg_rom_size,
+				.chr_rom_size = record.chr_rom_size,
+				.prg_ram_size = record.prg_ram_size,
+				.chr_ram_size = record.chr_ram_size,
+			});
+		}
+
+		if (!reader.ok())
+		{
+			LOG_WARN("Library file {} is truncated", filename);
+			return std::nullopt;
+		}
+
+		return library;
+	}
+}
@@ -0,0 +1,403 @@
+#include "nes_movie.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+
+#include <fmt/std.h>
+
+#include "nes.hpp"
+#include "nes_cartridge.hpp"
+#include "nes_state.hpp"
+
+#include <util/logging.hpp>
+
+namespace
+{
+	using namespace nesem;
+
+	constexpr std::array<char, 4> movie_magic = {'N', 'E', 'S', 'M'};
+	constexpr U32 movie_version = 1;
+
+	// no region has more master clock ticks in a frame than PAL's 341 * 312 ppu cycles at 5 ticks each
+	constexpr U64 max_frame_ticks = 341 * 312 * 5;
+
+	struct NesMovieHeader
+	{
+		std::array<char, 4> magic = movie_magic;
+		U32 version = movie_version;
+		std::array<char, 40> sha1{};
+		U32 state_size = 0;
+		U32 frame_count = 0;
+		U32 event_count = 0;
+		U32 run_count = 0;
+	};
+
+	// input rarely changes from frame to frame, so it is stored as runs of identical frames
+	struct InputRun
+	{
+		U16 length = 0;
+		std::array<U8, 2> input{};
+	};
+
+	std::vector<InputRun> encode_runs(const std::vector<std::array<U8, 2>> &input) noexcept
+	{
+		std::vector<InputRun> runs;
+
+		for (const auto &frame : input)
+		{
+			if (runs.empty() || runs.back().input != frame || runs.back().length == std::numeric_limits<U16>::max())
+				runs.push_back({.input = frame});
+
+			++runs.back().length;
+		}
+
+		return runs;
+	}
+
+	void write_movie(NesStateWriter &writer, const NesMovie &movie, const std::vector<InputRun> &runs) noexcept
+	{
+		auto header = NesMovieHeader{
+			.state_size = U32(movie.start_state.size()),
+			.frame_count = U32(movie.input.size()),
+			.event_count = U32(movie.events.size()),
+			.run_count = U32(runs.size()),
+		};
+
+		std::copy_n(movie.sha1.begin(), std::min(movie.sha1.size(), header.sha1.size()), header.sha1.begin());
+
+		writer.write(header);
+		writer.write_bytes(movie.start_state);
+
+		for (const auto &event : movie.events)
+			writer.write(event.tick, event.type);
+
+		for (const auto &run : runs)
+			writer.write(run.length, run.input);
+	}
+
+	// the ppu signals a finished frame at the start of vblank, leaving it just past that point
+	bool at_frame_end(const Nes &nes) noexcept
+	{
+		return nes.ppu().current_scanline() == 241 && nes.ppu().current_cycle() == 2;
+	}
+
+	void apply_event(Nes &nes, NesMovieEventType type) noexcept
+	{
+		switch (type)
+		{
+		case NesMovieEventType::reset:
+			nes.reset();
+			break;
+
+		case NesMovieEventType::power_cycle:
+			nes.power_cycle();
+			break;
+		}
+	}
+}
+
+namespace nesem
+{
+	bool NesMovie::save(const std::filesystem::path &filename) const noexcept
+	{
+		auto runs = encode_runs(input);
+
+		auto measure = NesStateWriter({});
+		write_movie(measure, *this, runs);
+
+		auto data = std::vector<std::byte>(measure.size());
+		auto writer = NesStateWriter(data);
+		write_movie(writer, *this, runs);
+
+		auto file = std::ofstream(filename, std::ios::binary | std::ios::trunc);
+		if (!file)
+		{
+			LOG_WARN("Could not open movie file {} for writing", filename);
+			return false;
+		}
+
+		file.write(reinterpret_cast<const char *>(data.data()), std::streamsize(data.size()));
+
+		if (!file)
+		{
+			LOG_WARN("Error writing movie file {}", filename);
+			return false;
+		}
+
+		return true;
+	}
+
+	std::optional<NesMovie> NesMovie::load(const std::filesystem::path &filename) noexcept
+	{
+		std::error_code ec;
+		auto size = std::filesystem::file_size(filename, ec);
+		if (ec)
+		{
+			LOG_WARN("Could not open movie file {}, reason: {}", filename, ec.message());
+			return std::nullopt;
+		}
+
+		auto data = std::vector<std::byte>(size);
+
+		auto file = std::ifstream(filename, std::ios::binary);
+		if (!file || !file.read(reinterpret_cast<char *>(data.data()), std::streamsize(data.size())))
+		{
+			LOG_WARN("Could not read movie file {}", filename);
+			return std::nullopt;
+		}
+
+		auto reader = NesStateReader(data);
+
+		NesMovieHeader header;
+		reader.read(header);
+
+		if (!reader.ok() || header.magic != movie_magic)
+		{
+			LOG_WARN("{} is not a movie file", filename);
+			return std::nullopt;
+		}
+
+		if (header.version != movie_version)
+		{
+			LOG_WARN("Movie version {} is not supported, expected version {}", header.version, movie_version);
+			return std::nullopt;
+		}
+
+		NesMovie movie;
+		movie.sha1.assign(header.sha1.begin(), header.sha1.end());
+
+		// check the sizes against what is actually there before allocating anything based on them
+		if (header.state_size > reader.remaining())
+		{
+			LOG_WARN("Movie file {} is truncated", filename);
+			return std::nullopt;
+		}
+
+		movie.start_state.resize(header.state_size);
+		reader.read_bytes(movie.start_state);
+
+		movie.events.reserve(std::min<size_t>(header.event_count, reader.remaining()));
+		for (U32 i = 0; i < header.event_count && reader.ok(); ++i)
+		{
+			auto &event = movie.events.emplace_back();
+			reader.read(event.tick, event.type);
+		}
+
+		for (U32 i = 0; i < header.run_count && reader.ok(); ++i)
+		{
+			InputRun run;
+			reader.read(run.length, run.input);
+
+			if (reader.ok())
+				movie.input.insert(movie.input.end(), run.length, run.input);
+		}
+
+		if (!reader.ok() || movie.input.size() != header.frame_count)
+		{
+			LOG_WARN("Movie file {} is truncated", filename);
+			return std::nullopt;
+		}
+
+		return movie;
+	}
+
+	bool NesMovieRecorder::start(const Nes &system) noexcept
+	{
+		auto *cartridge = system.cartridge();
+		if (!cartridge)
+		{
+			LOG_WARN("Cannot record a movie without a rom loaded");
+			return false;
+		}
+
+		movie = NesMovie{.sha1 = cartridge->rom().sha1};
+		movie.start_state.resize(system.state_size());
+
+		if (system.save_state(movie.start_state) == 0)
+		{
+			LOG_WARN("Could not save the starting state for the movie");
+			return false;
+		}
+
+		nes = &system;
+		frame_offset = 0 - system.ppu().current_frame();
+		latched = {};
+
+		return true;
+	}
+
+	NesMovie NesMovieRecorder::stop() noexcept
+	{
+		nes = nullptr;
+		return std::move(movie);
+	}
+
+	bool NesMovieRecorder::recording() const noexcept
+	{
+		return nes != nullptr;
+	}
+
+	U8 NesMovieRecorder::poll(int port, U8 live) noexcept
+	{
+		if (!nes || port < 0 || port > 1)
+			return live;
+
+		auto frame = current_frame();
+
+		// frames where the game never polled are left as 0
+		if (frame >= movie.input.size())
+			movie.input.resize(frame + 1);
+
+		if (latched[port] != frame + 1)
+		{
+			movie.input[frame][port] = live;
+			latched[port] = frame + 1;
+		}
+
+		return movie.input[frame][port];
+	}
+
+	void NesMovieRecorder::reset(Nes &system) noexcept
+	{
+		record(system, NesMovieEventType::reset);
+	}
+
+	void NesMovieRecorder::power_cycle(Nes &system) noexcept
+	{
+		record(system, NesMovieEventType::power_cycle);
+	}
+
+	U64 NesMovieRecorder::current_frame() const noexcept
+	{
+		return frame_offset + nes->ppu().current_frame();
+	}
+
+	void NesMovieRecorder::record(Nes &system, NesMovieEventType type) noexcept
+	{
+		if (!nes)
+		{
+			apply_event(system, type);
+			return;
+		}
+
+		CHECK(nes == &system, "recording a different system");
+
+		auto frame = current_frame();
+		movie.events.push_back({.tick = system.clock().current_tick(), .type = type});
+		apply_event(system, type);
+
+		// the ppu starts over at frame 0, which is the next movie frame
+		frame_offset = frame + 1;
+	}
+
+	NesMoviePlayer::NesMoviePlayer(NesMovie movie) noexcept
+		: recording(std::move(movie))
+	{
+	}
+
+	bool NesMoviePlayer::start(Nes &system) noexcept
+	{
+		if (!resume(system, recording.start_state, {}))
+			return false;
+
+		frame_offset = 0 - system.ppu().current_frame();
+		return true;
+	}
+
+	bool NesMoviePlayer::resume(Nes &system, std::span<const std::byte> state, NesMoviePosition position) noexcept
+	{
+		auto *cartridge = system.cartridge();
+		if (!cartridge || cartridge->rom().sha1 != recording.sha1)
+		{
+			LOG_WARN("Movie was recorded with rom {}, which isn't loaded", recording.sha1);
+			return false;
+		}
+
+		if (!system.load_state(state))
+			return false;
+
+		nes = &system;
+		frame_offset = position.frame_offset;
+		next_event = position.next_event;
+
+		return true;
+	}
+
+	bool NesMoviePlayer::run_frame() noexcept
+	{
+		if (finished())
+			return false;
+
+		step_frame();
+		return true;
+	}
+
+	U8 NesMoviePlayer::poll(int port) const noexcept
+	{
+		if (!nes || port < 0 || port > 1)
+			return 0;
+
+		auto frame = current_frame();
+		if (frame >= recording.input.size())
+			return 0;
+
+		return recording.input[frame][port];
+	}
+
+	bool NesMoviePlayer::finished() const noexcept
+	{
+		return !nes || current_frame() >= recording.input.size();
+	}
+
+	U64 NesMoviePlayer::current_frame() const noexcept
+	{
+		return frame_offset + nes->ppu().current_frame();
+	}
+
+	NesMoviePosition NesMoviePlayer::position() const noexcept
+	{
+		return {.frame_offset = frame_offset, .next_event = next_event};
+	}
+
+	const NesMovie &NesMoviePlayer::movie() const noexcept
+	{
+		return recording;
+	}
+
+	void NesMoviePlayer::step_frame() noexcept
+	{
+		using enum NesClockStep;
+
+		while (next_event < recording.events.size())
+		{
+			const auto &event = recording.events[next_event];
+			auto now = nes->clock().current_tick();
+
+			if (event.tick <= now)
+			{
+				auto frame = current_frame();
+				apply_event(*nes, event.type);
+				frame_offset = frame + 1;
+				++next_event;
+				continue;
+			}
+
+			// too far off to land in this frame
+			if (event.tick - now > max_frame_ticks)
+				break;
+
+			// events land between arbitrary clock ticks, so walk up to it a tick at a time, watching for the frame to end
+			while (nes->clock().current_tick() < event.tick)
+			{
+				auto ppu_tick = nes->ppu().current_tick();
+				nes->step(OneClockCycle);
+
+				if (nes->ppu().current_tick() != ppu_tick && at_frame_end(*nes))
+					return;
+			}
+		}
+
+		nes->step(OneFrame);
+	}
+}
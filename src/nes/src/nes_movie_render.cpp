@@ -0,0 +1,325 @@
+#include "nes_movie_render.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+#include <fmt/std.h>
+
+#include "nes.hpp"
+
+#include <util/logging.hpp>
+
+namespace
+{
+	using namespace nesem;
+
+	constexpr size_t frame_size = NesRenderedFrame::width * NesRenderedFrame::height;
+
+	// what a rendered segment holds on to, counting audio at PAL's 50 frames a second as it has more samples a frame
+	U64 segment_bytes(U64 interval, U32 sample_rate) noexcept
+	{
+		auto frame_bytes = frame_size * sizeof(U16) + (sample_rate / 50 + 1) * sizeof(float) + sizeof(size_t);
+		return interval * frame_bytes;
+	}
+
+	// the frames from one keyframe to the next, rendered by a single worker
+	struct Segment
+	{
+		// the keyframe, including the picture on screen when it was taken
+		std::vector<std::byte> state;
+		NesMoviePosition position;
+		std::vector<U16> screen;
+
+		// filled in by the worker
+		std::vector<U16> pixels;
+		std::vector<float> audio;
+
+		// one past each frame's last sample in audio
+		std::vector<size_t> audio_ends;
+		bool done = false;
+	};
+
+	// a system playing the movie, drawing into its own screen
+	struct Instance
+	{
+		NesMoviePlayer player;
+		std::vector<U16> screen = std::vector<U16>(frame_size);
+		std::vector<float> *audio = nullptr;
+		Nes nes;
+
+		Instance(const NesMovie &movie, const NesMovieRenderSettings &settings) noexcept
+			: player(movie),
+			  nes(NesSettings{
+				  .error = [](std::string_view message) { LOG_WARN("Error while rendering movie: {}", message); },
+				  .draw = [this](int x, int y, U8 color_index, util::Flags<NesColorEmphasis> emphasis) {
+					  screen[size_t(y * NesRenderedFrame::width + x)] = U16((color_index & 0x3F) | (emphasis.raw_value() << 6));
+				  },
+				  .audio = [this](float sample) {
+					  if (audio)
+						  audio->push_back(sample);
+				  },
+				  .sample_rate = settings.sample_rate,
+				  .player1 = std::make_unique<NesController>([this] { return player.poll(0); }),
+				  .player2 = std::make_unique<NesController>([this] { return player.poll(1); }),
+				  .nes20db_filename = settings.nes20db_filename,
+			  })
+		{
+		}
+
+		// play the frames of segment, stopping early if the movie ends
+		bool render(Segment &segment, U64 frame_count) noexcept
+		{
+			if (!player.resume(nes, segment.state, segment.position))
+				return false;
+
+			// a frame cut short by a reset leaves some of the previous picture on screen, so start from the same one
+			screen = segment.screen;
+			audio = &segment.audio;
+
+			segment.pixels.reserve(frame_count * frame_size);
+			segment.audio_ends.reserve(frame_count);
+
+			for (U64 i = 0; i < frame_count && player.run_frame(); ++i)
+			{
+				segment.pixels.insert(segment.pixels.end(), screen.begin(), screen.end());
+				segment.audio_ends.push_back(segment.audio.size());
+			}
+
+			audio = nullptr;
+			segment.state = {};
+
+			return true;
+		}
+	};
+
+	// hands segments out to the workers as their keyframes come in, and back to the caller in order once done
+	struct Schedule
+	{
+		std::mutex mutex;
+		std::condition_variable_any changed;
+
+		std::vector<std::unique_ptr<Segment>> segments;
+		bool all_keyframes = false;
+		bool failed = false;
+
+		size_t next_segment = 0;
+		size_t emitted = 0;
+		size_t max_ahead = 1;
+
+		void add(std::unique_ptr<Segment> segment) noexcept
+		{
+			{
+				auto lock = std::scoped_lock(mutex);
+				segments.push_back(std::move(segment));
+			}
+
+			changed.notify_all();
+		}
+
+		void finish_keyframes() noexcept
+		{
+			{
+				auto lock = std::scoped_lock(mutex);
+				all_keyframes = true;
+			}
+
+			changed.notify_all();
+		}
+
+		// give up on the whole movie, waking everyone waiting on a segment
+		void fail() noexcept
+		{
+			{
+				auto lock = std::scoped_lock(mutex);
+				failed = true;
+			}
+
+			changed.notify_all();
+		}
+
+		// the next segment to render, or nullptr once there are none left
+		Segment *take(std::stop_token stop) noexcept
+		{
+			auto lock = std::unique_lock(mutex);
+
+			auto ready = changed.wait(lock, stop, [this] {
+				return failed ||
+					(next_segment < segments.size() && next_segment < emitted + max_ahead) ||
+					(all_keyframes && next_segment == segments.size());
+			});
+
+			if (!ready || failed || next_segment == segments.size())
+				return nullptr;
+
+			return segments[next_segment++].get();
+		}
+
+		void finish(Segment &segment, bool success) noexcept
+		{
+			{
+				auto lock = std::scoped_lock(mutex);
+				segment.done = true;
+				failed = failed || !success;
+			}
+
+			changed.notify_all();
+		}
+
+		// wait for the segment at index to be rendered, or nullptr if there is no such segment
+		std::unique_ptr<Segment> collect(size_t index) noexcept
+		{
+			std::unique_ptr<Segment> segment;
+
+			{
+				auto lock = std::unique_lock(mutex);
+
+				changed.wait(lock, [&] {
+					return failed ||
+						(index < segments.size() && segments[index]->done) ||
+						(all_keyframes && index >= segments.size());
+				});
+
+				if (failed || index >= segments.size())
+					return nullptr;
+
+				segment = std::move(segments[index]);
+				emitted = index + 1;
+			}
+
+			changed.notify_all();
+			return segment;
+		}
+	};
+
+	// play through the movie with video and audio off, saving a keyframe every interval frames. Only the frame before
+	// each keyframe is drawn, for the picture the segment starts with
+	void save_keyframes(Instance &instance, Schedule &schedule, U64 interval, std::stop_token stop) noexcept
+	{
+		auto &nes = instance.nes;
+		nes.enable_audio(false);
+
+		while (!stop.stop_requested() && !instance.player.finished())
+		{
+			auto segment = std::make_unique<Segment>();
+			segment->state.resize(nes.state_size());
+			segment->position = instance.player.position();
+			segment->screen = instance.screen;
+
+			if (nes.save_state(segment->state) == 0)
+			{
+				schedule.fail();
+				return;
+			}
+
+			schedule.add(std::move(segment));
+
+			for (U64 i = 0; i < interval; ++i)
+			{
+				nes.enable_video(i + 1 == interval);
+
+				if (!instance.player.run_frame())
+					break;
+			}
+		}
+
+		schedule.finish_keyframes();
+	}
+
+	void render_segments(const NesMovie &movie, const NesMovieRenderSettings &settings, Schedule &schedule, U64 interval, std::stop_token stop) noexcept
+	{
+		auto instance = std::make_unique<Instance>(movie, settings);
+
+		if (!instance->nes.load_rom(settings.rom))
+		{
+			schedule.fail();
+			return;
+		}
+
+		while (auto *segment = schedule.take(stop))
+			schedule.finish(*segment, instance->render(*segment, interval));
+	}
+}
+
+namespace nesem
+{
+	NesMovieRenderResult render_movie(const NesMovie &movie, const NesMovieRenderSettings &settings, NesRenderedFrameFn on_frame) noexcept
+	{
+		auto start_time = std::chrono::steady_clock::now();
+
+		auto keyframer = std::make_unique<Instance>(movie, settings);
+		if (!keyframer->nes.load_rom(settings.rom) || !keyframer->player.start(keyframer->nes))
+		{
+			LOG_WARN("Could not play movie on {}", settings.rom);
+			return {};
+		}
+
+		auto interval = std::max(settings.keyframe_interval, U64{1});
+		auto thread_count = settings.threads > 0 ? settings.threads : std::max(std::thread::hardware_concurrency(), 1u);
+
+		Schedule schedule;
+		schedule.max_ahead = std::clamp<U64>(settings.memory_limit / segment_bytes(interval, settings.sample_rate), 1, thread_count + 1);
+
+		// more workers than segments allowed ahead would only sit idle holding a system each
+		thread_count = std::min(thread_count, static_cast<unsigned int>(schedule.max_ahead));
+
+		// declared after the schedule so they are stopped and joined before it goes away
+		auto threads = std::vector<std::jthread>();
+		threads.reserve(thread_count + 1);
+
+		threads.emplace_back([&](std::stop_token stop) { save_keyframes(*keyframer, schedule, interval, stop); });
+
+		for (unsigned int i = 0; i < thread_count; ++i)
+			threads.emplace_back([&](std::stop_token stop) { render_segments(movie, settings, schedule, interval, stop); });
+
+		U64 frames = 0;
+		size_t segment_count = 0;
+
+		while (auto segment = schedule.collect(segment_count))
+		{
+			size_t audio_start = 0;
+
+			for (size_t i = 0; i < segment->audio_ends.size(); ++i)
+			{
+				auto audio_end = segment->audio_ends[i];
+
+				on_frame(NesRenderedFrame{
+					.frame = frames++,
+					.pixels = std::span(segment->pixels).subspan(i * frame_size, frame_size),
+					.audio = std::span(segment->audio).subspan(audio_start, audio_end - audio_start),
+				});
+
+				audio_start = audio_end;
+			}
+
+			++segment_count;
+		}
+
+		for (auto &thread : threads)
+			thread.request_stop();
+
+		// a worker can still be failing until it has been joined
+		threads.clear();
+
+		auto failed = [&] {
+			auto lock = std::scoped_lock(schedule.mutex);
+			return schedule.failed;
+		}();
+
+		if (failed)
+		{
+			LOG_WARN("Rendering movie on {} failed after {} frames", settings.rom, frames);
+			return {.frames = frames, .success = false};
+		}
+
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+		LOG_INFO("Rendered {} frames in {} segments on {} threads in {:.2f}s", frames, segment_count, thread_count, elapsed.count());
+
+		return {.frames = frames, .success = true};
+	}
+}
@@ -0,0 +1,386 @@
+#include "nes_netplay.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <string>
+
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__)
+#	include <arpa/inet.h>
+#	include <fcntl.h>
+#	include <netdb.h>
+#	include <netinet/in.h>
+#	include <sys/socket.h>
+#	include <unistd.h>
+#	define NESEM_HAS_SOCKETS 1
+#endif
+
+#include "nes.hpp"
+#include "nes_state.hpp"
+
+#include <util/logging.hpp>
+
+namespace
+{
+	using namespace nesem;
+
+	constexpr std::array<char, 2> packet_magic = {'N', 'P'};
+
+	// every packet carries the input of this many recent frames, so a lost packet is covered by the next one
+	constexpr U8 max_packet_inputs = 2 * NesNetplaySession::max_rollback_limit + 2;
+
+	constexpr size_t max_packet_size = sizeof(packet_magic) + sizeof(U8) + sizeof(U32) + max_packet_inputs;
+}
+
+namespace nesem
+{
+#if defined(NESEM_HAS_SOCKETS)
+	struct NesNetplaySocket::Core
+	{
+		int fd = -1;
+		sockaddr_in peer{};
+		bool has_peer = false;
+
+		explicit Core(int fd) noexcept
+			: fd(fd)
+		{
+		}
+
+		~Core()
+		{
+			::close(fd);
+		}
+
+		Core(const Core &other) = delete;
+		Core &operator=(const Core &other) = delete;
+	};
+
+	NesNetplaySocket NesNetplaySocket::create(U16 local_port) noexcept
+	{
+		int fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+		if (fd < 0)
+		{
+			LOG_WARN("Could not create netplay socket: {}", std::strerror(errno));
+			return NesNetplaySocket{};
+		}
+
+		auto core = std::make_unique<Core>(fd);
+
+		sockaddr_in address{};
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_ANY);
+		address.sin_port = htons(local_port);
+
+		if (::bind(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0)
+		{
+			LOG_WARN("Could not bind netplay socket to port {}: {}", local_port, std::strerror(errno));
+			return NesNetplaySocket{};
+		}
+
+		if (::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK) != 0)
+		{
+			LOG_WARN("Could not make netplay socket non-blocking: {}", std::strerror(errno));
+			return NesNetplaySocket{};
+		}
+
+		return NesNetplaySocket(std::move(core));
+	}
+
+	bool NesNetplaySocket::connect(std::string_view host, U16 port) noexcept
+	{
+		if (!core)
+			return false;
+
+		addrinfo hints{};
+		hints.ai_family = AF_INET;
+		hints.ai_socktype = SOCK_DGRAM;
+
+		addrinfo *result = nullptr;
+		if (auto error = ::getaddrinfo(std::string(host).c_str(), nullptr, &hints, &result); error != 0 || !result)
+		{
+			LOG_WARN("Could not resolve netplay peer {}: {}", host, ::gai_strerror(error));
+			return false;
+		}
+
+		core->peer = *reinterpret_cast<const sockaddr_in *>(result->ai_addr);
+		core->peer.sin_port = htons(port);
+		core->has_peer = true;
+
+		::freeaddrinfo(result);
+		return true;
+	}
+
+	U16 NesNetplaySocket::local_port() const noexcept
+	{
+		if (!core)
+			return 0;
+
+		sockaddr_in address{};
+		socklen_t length = sizeof(address);
+		if (::getsockname(core->fd, reinterpret_cast<sockaddr *>(&address), &length) != 0)
+			return 0;
+
+		return ntohs(address.sin_port);
+	}
+
+	bool NesNetplaySocket::send(std::span<const std::byte> packet) noexcept
+	{
+		if (!core || !core->has_peer)
+			return false;
+
+		auto sent = ::sendto(core->fd, packet.data(), packet.size(), 0, reinterpret_cast<const sockaddr *>(&core->peer), sizeof(core->peer));
+
+		// a full send buffer just drops the packet, same as the network might
+		return sent == std::ssize(packet);
+	}
+
+	size_t NesNetplaySocket::receive(std::span<std::byte> buffer) noexcept
+	{
+		if (!core)
+			return 0;
+
+		while (true)
+		{
+			sockaddr_in from{};
+			socklen_t length = sizeof(from);
+
+			auto size = ::recvfrom(core->fd, buffer.data(), buffer.size(), 0, reinterpret_cast<sockaddr *>(&from), &length);
+			if (size < 0)
+				return 0;
+
+			if (core->has_peer && from.sin_addr.s_addr == core->peer.sin_addr.s_addr && from.sin_port == core->peer.sin_port)
+				return size_t(size);
+		}
+	}
+#else
+	struct NesNetplaySocket::Core
+	{
+	};
+
+	NesNetplaySocket NesNetplaySocket::create(U16) noexcept
+	{
+		LOG_WARN("Netplay is not supported on this platform");
+		return NesNetplaySocket{};
+	}
+
+	bool NesNetplaySocket::connect(std::string_view, U16) noexcept
+	{
+		return false;
+	}
+
+	U16 NesNetplaySocket::local_port() const noexcept
+	{
+		return 0;
+	}
+
+	bool NesNetplaySocket::send(std::span<const std::byte>) noexcept
+	{
+		return false;
+	}
+
+	size_t NesNetplaySocket::receive(std::span<std::byte>) noexcept
+	{
+		return 0;
+	}
+#endif
+
+	NesNetplaySocket::NesNetplaySocket() noexcept = default;
+	NesNetplaySocket::~NesNetplaySocket() = default;
+	NesNetplaySocket::NesNetplaySocket(NesNetplaySocket &&other) noexcept = default;
+	NesNetplaySocket &NesNetplaySocket::operator=(NesNetplaySocket &&other) noexcept = default;
+
+	NesNetplaySocket::NesNetplaySocket(std::unique_ptr<Core> &&core) noexcept
+		: core(std::move(core))
+	{
+	}
+
+	NesNetplaySession::NesNetplaySession(Nes &nes, NesNetplaySocket &&socket, int local_player, int max_rollback) noexcept
+		: nes(&nes),
+		  socket(std::move(socket)),
+		  local_player(std::clamp(local_player, 0, 1)),
+		  max_rollback(std::clamp(max_rollback, 1, max_rollback_limit)),
+		  snapshot_size(nes.state_size())
+	{
+		CHECK(snapshot_size > 0, "netplay needs a rom loaded");
+		snapshots.resize(snapshot_size * size_t(this->max_rollback));
+	}
+
+	void NesNetplaySession::sync() noexcept
+	{
+		if (auto from = receive_input(); from < frame)
+			rollback(from);
+
+		send_input();
+	}
+
+	bool NesNetplaySession::run_frame(U8 local_input) noexcept
+	{
+		if (auto from = receive_input(); from < frame)
+			rollback(from);
+
+		// running further would overwrite the snapshot of the oldest frame still waiting on remote input
+		if (frame >= remote_frame + U32(max_rollback))
+		{
+			++session_stats.stalls;
+			send_input();
+			return false;
+		}
+
+		input_for(frame).local = local_input;
+		run_one(frame);
+		++frame;
+		++session_stats.frames;
+
+		send_input();
+		return true;
+	}
+
+	U8 NesNetplaySession::poll(int port) const noexcept
+	{
+		const auto &input = inputs[running_frame % ring_size];
+		return port == local_player ? input.local : input.remote;
+	}
+
+	U32 NesNetplaySession::current_frame() const noexcept
+	{
+		return frame;
+	}
+
+	U32 NesNetplaySession::confirmed_frame() const noexcept
+	{
+		return std::min(frame, remote_frame);
+	}
+
+	const NesNetplayStats &NesNetplaySession::stats() const noexcept
+	{
+		return session_stats;
+	}
+
+	NesNetplaySession::FrameInput &NesNetplaySession::input_for(U32 frame_number) noexcept
+	{
+		auto &input = inputs[frame_number % ring_size];
+		if (input.frame != frame_number)
+			input = FrameInput{.frame = frame_number};
+
+		return input;
+	}
+
+	std::span<std::byte> NesNetplaySession::snapshot_for(U32 frame_number) noexcept
+	{
+		auto index = frame_number % U32(max_rollback);
+		return std::span(snapshots).subspan(index * snapshot_size, snapshot_size);
+	}
+
+	U8 NesNetplaySession::predict_remote(U32 frame_number) noexcept
+	{
+		if (frame_number < remote_frame)
+			return input_for(frame_number).remote;
+
+		// players tend to hold buttons down, so the last input we know about is the best guess
+		if (remote_frame > 0)
+			return input_for(remote_frame - 1).remote;
+
+		return 0;
+	}
+
+	void NesNetplaySession::send_input() noexcept
+	{
+		auto count = std::min(frame, U32(2 * max_rollback + 2));
+		auto first = frame - count;
+
+		std::array<std::byte, max_packet_size> packet;
+		auto writer = NesStateWriter(packet);
+		writer.write(packet_magic, U8(count), first);
+
+		for (auto f = first; f < frame; ++f)
+			writer.write(input_for(f).local);
+
+		if (VERIFY(writer.ok(), "netplay packet overflow"))
+			socket.send(std::span(packet).first(writer.size()));
+	}
+
+	U32 NesNetplaySession::receive_input() noexcept
+	{
+		auto rollback_from = frame;
+
+		std::array<std::byte, max_packet_size> packet;
+		while (auto size = socket.receive(packet))
+		{
+			auto reader = NesStateReader(std::span(packet).first(size));
+
+			std::array<char, 2> magic{};
+			U8 count = 0;
+			U32 first = 0;
+			reader.read(magic, count, first);
+
+			if (!reader.ok() || magic != packet_magic || count > max_packet_inputs)
+				continue;
+
+			for (U32 i = 0; i < count; ++i)
+			{
+				U8 value = 0;
+				reader.read(value);
+
+				// only take input in order so confirmed frames never have gaps. Anything lost is resent with the next packet
+				auto input_frame = first + i;
+				if (!reader.ok())
+					break;
+
+				if (input_frame != remote_frame || input_frame >= frame + ring_size / 2)
+					continue;
+
+				auto &input = input_for(input_frame);
+				if (input_frame < frame && input.remote != value)
+					rollback_from = std::min(rollback_from, input_frame);
+
+				input.remote = value;
+				++remote_frame;
+			}
+		}
+
+		return rollback_from;
+	}
+
+	void NesNetplaySession::rollback(U32 from) noexcept
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		if (!nes->load_state(snapshot_for(from)))
+		{
+			LOG_ERROR("Could not restore netplay snapshot for frame {}, players may be out of sync", from);
+			return;
+		}
+
+		// these frames were already seen and heard, only their outcome changes
+		nes->enable_video(false);
+		nes->enable_audio(false);
+
+		for (auto f = from; f < frame; ++f)
+			run_one(f);
+
+		nes->enable_video(true);
+		nes->enable_audio(true);
+
+		auto frames = int(frame - from);
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+		++session_stats.rollbacks;
+		session_stats.frames_resimulated += U64(frames);
+		session_stats.max_rollback_frames = std::max(session_stats.max_rollback_frames, frames);
+		session_stats.rollback_time += elapsed.count();
+		session_stats.last_rollback_time = elapsed.count();
+		session_stats.max_rollback_time = std::max(session_stats.max_rollback_time, elapsed.count());
+	}
+
+	void NesNetplaySession::run_one(U32 frame_number) noexcept
+	{
+		auto &input = input_for(frame_number);
+		input.remote = predict_remote(frame_number);
+
+		nes->save_state(snapshot_for(frame_number));
+
+		running_frame = frame_number;
+		nes->step(NesClockStep::OneFrame);
+	}
+}
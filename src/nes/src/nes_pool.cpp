@@ -0,0 +1,415 @@
+#include "nes_pool.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <thread>
+#include <utility>
+
+#include <fmt/std.h>
+
+#include "nes.hpp"
+
+#include <util/logging.hpp>
+
+namespace
+{
+	using namespace nesem;
+
+	using Clock = std::chrono::steady_clock;
+
+	// an instance and everything it reads and writes
+	struct Slot
+	{
+		NesPoolOutput output;
+		std::array<U8, 2> input{};
+
+		// jobs waiting to run, and whether the slot is already in some thread's queue or being run by one. A slot is
+		// only ever queued once so its jobs never run concurrently
+		std::mutex mutex;
+		std::deque<NesPoolJob> jobs;
+		bool scheduled = false;
+
+		std::atomic<U64> jobs_done = 0;
+		std::atomic<U64> frames = 0;
+		std::atomic<U64> busy_ns = 0;
+
+		std::unique_ptr<Nes> nes;
+
+		Slot(size_t index, const NesPoolSettings &settings) noexcept
+			: nes(std::make_unique<Nes>(NesSettings{
+				  .error = [index](std::string_view message) { LOG_WARN("Error in pool instance {}: {}", index, message); },
+				  .draw = [this](int x, int y, U8 color_index, util::Flags<NesColorEmphasis> emphasis) {
+					  output.screen[size_t(y * NesPoolOutput::width + x)] = U16((color_index & 0x3F) | (emphasis.raw_value() << 6));
+				  },
+				  .audio = [this](float sample) { output.audio.push_back(sample); },
+				  .sample_rate = settings.sample_rate,
+				  .player1 = std::make_unique<NesController>([this] { return input[0]; }),
+				  .player2 = std::make_unique<NesController>([this] { return input[1]; }),
+				  .nes20db_filename = settings.nes20db_filename,
+			  }))
+		{
+			nes->enable_video(settings.video);
+			nes->enable_audio(settings.audio);
+		}
+	};
+
+	// the slots a thread has been handed. The owner takes from the back, thieves from the front
+	struct WorkQueue
+	{
+		std::mutex mutex;
+		std::deque<size_t> slots;
+
+		void push(size_t index) noexcept
+		{
+			auto lock = std::scoped_lock(mutex);
+			slots.push_back(index);
+		}
+
+		std::optional<size_t> pop() noexcept
+		{
+			auto lock = std::scoped_lock(mutex);
+			if (slots.empty())
+				return std::nullopt;
+
+			auto index = slots.back();
+			slots.pop_back();
+			return index;
+		}
+
+		std::optional<size_t> steal() noexcept
+		{
+			auto lock = std::scoped_lock(mutex);
+			if (slots.empty())
+				return std::nullopt;
+
+			auto index = slots.front();
+			slots.pop_front();
+			return index;
+		}
+	};
+}
+
+namespace nesem
+{
+	struct NesPool::Core
+	{
+		std::vector<std::unique_ptr<Slot>> slots;
+		std::vector<std::unique_ptr<WorkQueue>> queues;
+
+		std::mutex mutex;
+
+		// signaled when a slot is queued, and when the last job finishes
+		std::condition_variable_any work_ready;
+		std::condition_variable_any idle;
+
+		// slots sitting in some queue that no thread has taken yet, and jobs submitted but not yet finished
+		size_t ready = 0;
+		size_t pending = 0;
+
+		std::atomic<size_t> next_queue = 0;
+		std::atomic<U64> steals = 0;
+		std::atomic<Clock::rep> start_time = Clock::now().time_since_epoch().count();
+
+		// declared last so the threads are stopped and joined before anything they use is destroyed
+		std::vector<std::jthread> threads;
+
+		Core(const NesPoolSettings &settings, unsigned int thread_count) noexcept
+		{
+			slots.reserve(settings.instances);
+			for (size_t i = 0; i < settings.instances; ++i)
+				slots.push_back(std::make_unique<Slot>(i, settings));
+
+			queues.reserve(thread_count);
+			for (unsigned int i = 0; i < thread_count; ++i)
+				queues.push_back(std::make_unique<WorkQueue>());
+
+			threads.reserve(thread_count);
+			for (unsigned int i = 0; i < thread_count; ++i)
+				threads.emplace_back([this, i](std::stop_token stop) { run_loop(i, stop); });
+		}
+
+		void submit(size_t index, NesPoolJob &&job) noexcept
+		{
+			// counted before the job is visible to the threads, so it can't finish before it was counted
+			{
+				auto lock = std::scoped_lock(mutex);
+				++pending;
+			}
+
+			auto &slot = *slots[index];
+			bool schedule = false;
+
+			{
+				auto lock = std::scoped_lock(slot.mutex);
+				slot.jobs.push_back(std::move(job));
+				schedule = !std::exchange(slot.scheduled, true);
+			}
+
+			if (schedule)
+			{
+				// queued and counted together, so the thread that takes the slot can't uncount it before it's counted
+				{
+					auto lock = std::scoped_lock(mutex);
+					queues[next_queue.fetch_add(1, std::memory_order_relaxed) % queues.size()]->push(index);
+					++ready;
+				}
+
+				work_ready.notify_one();
+			}
+		}
+
+		void wait() noexcept
+		{
+			auto lock = std::unique_lock(mutex);
+			idle.wait(lock, [this] { return pending == 0; });
+		}
+
+	private:
+		void run_loop(size_t id, std::stop_token stop) noexcept
+		{
+			while (!stop.stop_requested())
+			{
+				// the queues come first, so a busy thread goes straight from one slot to the next
+				if (auto index = take(id))
+				{
+					{
+						auto lock = std::scoped_lock(mutex);
+						--ready;
+					}
+
+					run_slot(*slots[*index]);
+					continue;
+				}
+
+				auto lock = std::unique_lock(mutex);
+
+				// a slot still counted when every queue looked empty has just been taken by another thread, which is
+				// about to uncount it, so step aside for it rather than spinning
+				if (ready > 0)
+				{
+					lock.unlock();
+					std::this_thread::yield();
+					continue;
+				}
+
+				// nothing queued anywhere, so park until something is
+				if (!work_ready.wait(lock, stop, [this] { return ready > 0; }))
+					break;
+			}
+		}
+
+		std::optional<size_t> take(size_t id) noexcept
+		{
+			if (auto index = queues[id]->pop())
+				return index;
+
+			for (size_t i = 1; i < queues.size(); ++i)
+			{
+				if (auto index = queues[(id + i) % queues.size()]->steal())
+				{
+					steals.fetch_add(1, std::memory_order_relaxed);
+					return index;
+				}
+			}
+
+			return std::nullopt;
+		}
+
+		// run the slot's jobs until it has none left
+		void run_slot(Slot &slot) noexcept
+		{
+			while (true)
+			{
+				NesPoolJob job;
+
+				{
+					auto lock = std::scoped_lock(slot.mutex);
+					if (slot.jobs.empty())
+					{
+						slot.scheduled = false;
+						return;
+					}
+
+					job = std::move(slot.jobs.front());
+					slot.jobs.pop_front();
+				}
+
+				slot.output.audio.clear();
+
+				auto start = Clock::now();
+				auto frames = job(*slot.nes);
+				auto busy = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start);
+
+				slot.jobs_done.fetch_add(1, std::memory_order_relaxed);
+				slot.frames.fetch_add(frames, std::memory_order_relaxed);
+				slot.busy_ns.fetch_add(U64(busy.count()), std::memory_order_relaxed);
+
+				bool done = false;
+
+				{
+					auto lock = std::scoped_lock(mutex);
+					done = --pending == 0;
+				}
+
+				if (done)
+					idle.notify_all();
+			}
+		}
+	};
+
+	NesPool::NesPool() noexcept = default;
+
+	NesPool::NesPool(std::unique_ptr<Core> &&core) noexcept
+		: core(std::move(core))
+	{
+	}
+
+	NesPool::~NesPool() = default;
+	NesPool::NesPool(NesPool &&other) noexcept = default;
+	NesPool &NesPool::operator=(NesPool &&other) noexcept = default;
+
+	NesPool NesPool::create(const NesPoolSettings &settings) noexcept
+	{
+		if (settings.instances == 0)
+		{
+			LOG_WARN("A pool needs at least one instance");
+			return NesPool();
+		}
+
+		auto thread_count = settings.threads > 0 ? settings.threads : std::max(std::thread::hardware_concurrency(), 1u);
+
+		// more threads than instances would never have anything to do
+		thread_count = unsigned(std::min(size_t{thread_count}, settings.instances));
+
+		return NesPool(std::make_unique<Core>(settings, thread_count));
+	}
+
+	size_t NesPool::size() const noexcept
+	{
+		return core ? core->slots.size() : 0;
+	}
+
+	bool NesPool::load_rom(const std::filesystem::path &filename) noexcept
+	{
+		if (!core)
+			return false;
+
+		// one element per instance, so no two threads write the same one
+		auto loaded = std::vector<U8>(core->slots.size());
+
+		for (size_t i = 0; i < core->slots.size(); ++i)
+		{
+			core->submit(i, [&, i](Nes &nes) {
+				loaded[i] = nes.load_rom(filename);
+				return U64{0};
+			});
+		}
+
+		core->wait();
+
+		auto failed = std::ranges::count(loaded, 0);
+		if (failed > 0)
+			LOG_WARN("{} of {} pool instances failed to load {}", failed, loaded.size(), filename);
+
+		return failed == 0;
+	}
+
+	void NesPool::submit(size_t index, NesPoolJob job) noexcept
+	{
+		CHECK(core != nullptr, "submitting to an empty pool");
+		CHECK(index < core->slots.size(), "instance index out of range");
+
+		core->submit(index, std::move(job));
+	}
+
+	void NesPool::run_frames(size_t index, U64 frames) noexcept
+	{
+		submit(index, [frames](Nes &nes) {
+			for (U64 i = 0; i < frames; ++i)
+				nes.step(NesClockStep::OneFrame);
+
+			return frames;
+		});
+	}
+
+	void NesPool::run_frames(U64 frames) noexcept
+	{
+		for (size_t i = 0; i < size(); ++i)
+			run_frames(i, frames);
+	}
+
+	void NesPool::wait() noexcept
+	{
+		if (core)
+			core->wait();
+	}
+
+	Nes &NesPool::instance(size_t index) noexcept
+	{
+		CHECK(core != nullptr, "no instances in an empty pool");
+		return *core->slots[index]->nes;
+	}
+
+	const NesPoolOutput &NesPool::output(size_t index) const noexcept
+	{
+		CHECK(core != nullptr, "no instances in an empty pool");
+		return core->slots[index]->output;
+	}
+
+	void NesPool::set_input(size_t index, int port, U8 buttons) noexcept
+	{
+		CHECK(core != nullptr, "no instances in an empty pool");
+		CHECK(port == 0 || port == 1, "controller port out of range");
+
+		core->slots[index]->input[size_t(port)] = buttons;
+	}
+
+	NesPoolMetrics NesPool::metrics() const noexcept
+	{
+		if (!core)
+			return {};
+
+		auto result = NesPoolMetrics{
+			.threads = unsigned(core->threads.size()),
+			.steals = core->steals.load(std::memory_order_relaxed),
+			.elapsed = Clock::now() - Clock::time_point(Clock::duration(core->start_time.load(std::memory_order_relaxed))),
+		};
+
+		result.instances.reserve(core->slots.size());
+
+		for (const auto &slot : core->slots)
+		{
+			auto &instance = result.instances.emplace_back(NesInstanceMetrics{
+				.jobs = slot->jobs_done.load(std::memory_order_relaxed),
+				.frames = slot->frames.load(std::memory_order_relaxed),
+				.busy = std::chrono::nanoseconds(slot->busy_ns.load(std::memory_order_relaxed)),
+			});
+
+			result.busy += instance.busy;
+		}
+
+		return result;
+	}
+
+	void NesPool::reset_metrics() noexcept
+	{
+		if (!core)
+			return;
+
+		for (auto &slot : core->slots)
+		{
+			slot->jobs_done.store(0, std::memory_order_relaxed);
+			slot->frames.store(0, std::memory_order_relaxed);
+			slot->busy_ns.store(0, std::memory_order_relaxed);
+		}
+
+		core->steals.store(0, std::memory_order_relaxed);
+		core->start_time.store(Clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+	}
+}
@@ -4,6 +4,7 @@
 
 #include "nes.hpp"
 #include "nes_ppu_register_bits.hpp"
+#include "nes_state.hpp"
 
 #include <util/logging.hpp>
 
@@ -96,6 +97,7 @@ namespace nesem
 
 		reset();
 		palettes.fill(0);
+		rehash_memory();
 	}
 
 	void NesPpu::reset() noexcept
@@ -122,6 +124,63 @@ namespace nesem
 		this->cartridge = cart;
 	}
 
+	void NesPpu::save_state(NesStateWriter &writer) const noexcept
+	{
+		// memory first, then registers and rendering state
+		save_memory(writer);
+		save_registers(writer);
+	}
+
+	void NesPpu::load_state(NesStateReader &reader) noexcept
+	{
+		load_memory(reader);
+		load_registers(reader);
+	}
+
+	void NesPpu::save_memory(NesStateWriter &writer) const noexcept
+	{
+		writer.write(nametable, palettes, oam);
+	}
+
+	void NesPpu::load_memory(NesStateReader &reader) noexcept
+	{
+		reader.read(nametable, palettes, oam);
+		rehash_memory();
+	}
+
+	void NesPpu::save_registers(NesStateWriter &writer) const noexcept
+	{
+		writer.write(evaluated_sprites, evaluated_sprite_addr, active_sprites);
+		writer.write(sprite_0_addr, evaluated_sprite_count, sprite_evaluation_step, oam_clear, latch);
+		writer.write(reg.ppuctrl, reg.ppumask, reg.ppustatus, reg.oamaddr, reg.addr_latch, reg.tram_addr, reg.vram_addr, reg.fine_x, reg.ppudata);
+		writer.write(tick, frame, cycle, scanline);
+		writer.write(next_tile_id, next_pattern_lo, next_pattern_hi, next_attribute);
+		writer.write(pattern_shifter_lo, pattern_shifter_hi, attribute_lo, attribute_hi);
+	}
+
+	void NesPpu::load_registers(NesStateReader &reader) noexcept
+	{
+		reader.read(evaluated_sprites, evaluated_sprite_addr, active_sprites);
+		reader.read(sprite_0_addr, evaluated_sprite_count, sprite_evaluation_step, oam_clear, latch);
+		reader.read(reg.ppuctrl, reg.ppumask, reg.ppustatus, reg.oamaddr, reg.addr_latch, reg.tram_addr, reg.vram_addr, reg.fine_x, reg.ppudata);
+		reader.read(tick, frame, cycle, scanline);
+		reader.read(next_tile_id, next_pattern_lo, next_pattern_hi, next_attribute);
+		reader.read(pattern_shifter_lo, pattern_shifter_hi, attribute_lo, attribute_hi);
+	}
+
+	U64 NesPpu::memory_hash() const noexcept
+	{
+		return nametable_hash.value() ^ palettes_hash.value() ^ oam_hash.value();
+	}
+
+	void NesPpu::rehash_memory() noexcept
+	{
+		nametable_hash.rehash(nametable[0]);
+		nametable_hash.add(nametable[1], nametable[0].size());
+		palettes_hash.rehash(palettes);
+		oam_hash.rehash(oam);
+	}
+
 	U64 NesPpu::current_tick() const noexcept
 	{
 		return tick;
@@ -994,7 +1053,11 @@ namespace nesem
 			// $2C00-$2FFF Nametable 3
 			// always treat nametables as vertically mirrored and let the cartridge remap addr as needed
 			// TODO: This may not work for some mappers... but we'll figure it out when we get there
-			nametable[to_integer((effective_addr >> vram_nametable_shift) & 1)][to_integer(effective_addr & 0x03FF)] = value;
+			auto table = to_integer((effective_addr >> vram_nametable_shift) & 1);
+			auto index = to_integer(effective_addr & 0x03FF);
+
+			nametable_hash.update(table * nametable[0].size() + index, nametable[table][index], value);
+			nametable[table][index] = value;
 			return;
 		}
 
@@ -1020,6 +1083,7 @@ namespace nesem
 				break;
 			}
 
+			palettes_hash.update(to_integer(effective_addr), palettes[to_integer(effective_addr)], value);
 			palettes[to_integer(effective_addr)] = value;
 			return;
 		}
@@ -1087,7 +1151,10 @@ namespace nesem
 
 	void NesPpu::oamdata(U8 value) noexcept
 	{
-		oam[to_integer(reg.oamaddr++ & 0xFF)] = value;
+		auto index = to_integer(reg.oamaddr++ & 0xFF);
+
+		oam_hash.update(index, oam[index], value);
+		oam[index] = value;
 	}
 
 	U8 NesPpu::ppuscroll() noexcept
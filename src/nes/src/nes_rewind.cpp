@@ -0,0 +1,277 @@
+#include "nes_rewind.hpp"
+
+#include <algorithm>
+
+#include "nes.hpp"
+
+#include <util/logging.hpp>
+
+namespace
+{
+	// LEB128 style variable length integers keep the common short runs to a single byte
+	bool put_varint(std::span<std::byte> out, size_t &pos, size_t value) noexcept
+	{
+		do
+		{
+			if (pos >= out.size())
+				return false;
+
+			auto byte = value & 0x7F;
+			value >>= 7;
+
+			if (value != 0)
+				byte |= 0x80;
+
+			out[pos++] = std::byte(byte);
+		} while (value != 0);
+
+		return true;
+	}
+
+	bool get_varint(std::span<const std::byte> in, size_t &pos, size_t &value) noexcept
+	{
+		value = 0;
+
+		for (size_t shift = 0; shift < sizeof(size_t) * 8; shift += 7)
+		{
+			if (pos >= in.size())
+				return false;
+
+			auto byte = std::to_integer<size_t>(in[pos++]);
+			value |= (byte & 0x7F) << shift;
+
+			if ((byte & 0x80) == 0)
+				return true;
+		}
+
+		return false;
+	}
+}
+
+namespace nesem
+{
+	namespace rewind
+	{
+		size_t encode_delta(std::span<const std::byte> state, std::span<const std::byte> base, std::span<std::byte> out) noexcept
+		{
+			CHECK(state.size() == base.size(), "state and base must be the same size");
+
+			size_t i = 0;
+			size_t pos = 0;
+			const auto size = std::min(state.size(), base.size());
+
+			while (i < size)
+			{
+				auto zero_start = i;
+				while (i < size && state[i] == base[i])
+					++i;
+
+				auto literal_start = i;
+				while (i < size && state[i] != base[i])
+					++i;
+
+				auto literal_count = i - literal_start;
+
+				if (!put_varint(out, pos, literal_start - zero_start) || !put_varint(out, pos, literal_count) || out.size() - pos < literal_count)
+					return 0;
+
+				for (auto j = literal_start; j < i; ++j)
+					out[pos++] = state[j] ^ base[j];
+			}
+
+			return pos;
+		}
+
+		bool decode_delta(std::span<const std::byte> delta, std::span<std::byte> out) noexcept
+		{
+			size_t pos = 0;
+			size_t i = 0;
+
+			while (pos < delta.size())
+			{
+				size_t zero_count = 0;
+				size_t literal_count = 0;
+
+				if (!get_varint(delta, pos, zero_count) || !get_varint(delta, pos, literal_count))
+					return false;
+
+				i += zero_count;
+
+				if (i > out.size() || out.size() - i < literal_count || delta.size() - pos < literal_count)
+					return false;
+
+				for (size_t j = 0; j < literal_count; ++j)
+					out[i++] ^= delta[pos++];
+			}
+
+			return true;
+		}
+	}
+
+	NesRewind::NesRewind(size_t budget_bytes, size_t keyframe_interval) noexcept
+		: storage(budget_bytes), keyframe_interval(std::max(keyframe_interval, size_t{1}))
+	{
+	}
+
+	void NesRewind::push(const Nes &nes) noexcept
+	{
+		auto size = nes.state_size();
+		if (size == 0)
+			return;
+
+		// a different rom was loaded, the old history is useless
+		if (current.size() != size)
+		{
+			clear();
+			current.resize(size);
+			keyframe.resize(size);
+			encoded.resize(size);
+		}
+
+		if (nes.save_state(current) == 0)
+			return;
+
+		if (!entries.empty() && frames_since_keyframe < keyframe_interval)
+		{
+			// if the delta is no smaller than the state, it's better off as a keyframe anyway
+			if (auto encoded_size = rewind::encode_delta(current, keyframe, encoded);
+				encoded_size > 0 && store(std::span(encoded).first(encoded_size), false))
+			{
+				++frames_since_keyframe;
+				return;
+			}
+		}
+
+		if (store(current, true))
+		{
+			std::ranges::copy(current, begin(keyframe));
+			frames_since_keyframe = 1;
+		}
+	}
+
+	bool NesRewind::step_back(Nes &nes) noexcept
+	{
+		if (entries.empty())
+			return false;
+
+		auto entry = entries.back();
+		auto data = std::span(storage).subspan(entry.offset, entry.size);
+		bool loaded = false;
+
+		if (entry.keyframe)
+			loaded = nes.load_state(data);
+		else
+		{
+			// entries are only evicted a whole group at a time, so the keyframe for this delta must still be here
+			auto key = std::ranges::find_if(entries.rbegin(), entries.rend(), &Entry::keyframe);
+			CHECK(key != entries.rend(), "delta without a keyframe");
+
+			if (key != entries.rend())
+			{
+				std::ranges::copy(std::span(storage).subspan(key->offset, key->size), begin(current));
+				loaded = rewind::decode_delta(data, current) && nes.load_state(current);
+			}
+		}
+
+		// the newest entry is always the last thing written, so its space can be reused right away
+		entries.pop_back();
+		used -= entry.size;
+		write_pos = entries.empty() ? 0 : entry.offset;
+
+		if (entry.keyframe)
+		{
+			// new deltas need to be encoded against whatever keyframe is now the newest
+			auto key = std::ranges::find_if(entries.rbegin(), entries.rend(), &Entry::keyframe);
+			if (key != entries.rend())
+			{
+				std::ranges::copy(std::span(storage).subspan(key->offset, key->size), begin(keyframe));
+				frames_since_keyframe = size_t(std::distance(entries.rbegin(), key)) + 1;
+			}
+			else
+				frames_since_keyframe = 0;
+		}
+		else
+			--frames_since_keyframe;
+
+		if (!loaded)
+			LOG_WARN("Failed to restore rewind state");
+
+		return loaded;
+	}
+
+	void NesRewind::clear() noexcept
+	{
+		entries.clear();
+		write_pos = 0;
+		used = 0;
+		frames_since_keyframe = 0;
+	}
+
+	size_t NesRewind::frame_count() const noexcept
+	{
+		return entries.size();
+	}
+
+	size_t NesRewind::memory_used() const noexcept
+	{
+		return used;
+	}
+
+	size_t NesRewind::budget() const noexcept
+	{
+		return storage.size();
+	}
+
+	double NesRewind::seconds_of_history(double frames_per_second) const noexcept
+	{
+		return double(entries.size()) / frames_per_second;
+	}
+
+	double NesRewind::seconds_per_mib(double frames_per_second) const noexcept
+	{
+		if (used == 0)
+			return 0.0;
+
+		auto bytes_per_frame = double(used) / double(entries.size());
+		return (1024.0 * 1024.0 / bytes_per_frame) / frames_per_second;
+	}
+
+	bool NesRewind::store(std::span<const std::byte> data, bool is_keyframe) noexcept
+	{
+		if (data.size() > storage.size())
+		{
+			LOG_WARN_ONCE("Rewind budget of {} bytes is too small to hold a {} byte state", storage.size(), data.size());
+			return false;
+		}
+
+		// storage is used as a ring buffer, records are never split across the end
+		if (storage.size() - write_pos < data.size())
+			write_pos = 0;
+
+		auto end = write_pos + data.size();
+
+		// live records run from the oldest entry up to write_pos, so anything in the way must be the oldest history
+		while (!entries.empty() && entries.front().offset < end && entries.front().offset + entries.front().size > write_pos)
+			drop_oldest_group();
+
+		// if we had to drop the keyframe this delta depends on, the delta is useless
+		if (!is_keyframe && entries.empty())
+			return false;
+
+		std::ranges::copy(data, begin(storage) + std::ptrdiff_t(write_pos));
+		entries.push_back({.offset = write_pos, .size = data.size(), .keyframe = is_keyframe});
+		used += data.size();
+		write_pos = end;
+
+		return true;
+	}
+
+	void NesRewind::drop_oldest_group() noexcept
+	{
+		do
+		{
+			used -= entries.front().size;
+			entries.pop_front();
+		} while (!entries.empty() && !entries.front().keyframe);
+	}
+}
@@ -0,0 +1,339 @@
+#include "nes_rom_archive.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <string_view>
+#include <vector>
+
+#include <cryptopp/cryptlib.h>
+#include <cryptopp/filters.h>
+#include <cryptopp/gzip.h>
+#include <cryptopp/simple.h>
+#include <cryptopp/zinflate.h>
+
+#include "nes_sha1.hpp"
+
+#include <util/logging.hpp>
+
+namespace
+{
+	using namespace nesem;
+
+	constexpr size_t header_size = 16;
+
+	// far beyond any real cartridge, so a damaged archive can't ask for any amount of memory
+	constexpr size_t max_rom_size = 64 * 1024 * 1024;
+
+	constexpr U32 zip_local_signature = 0x04034B50;
+	constexpr U32 zip_central_signature = 0x02014B50;
+	constexpr U32 zip_end_signature = 0x06054B50;
+
+	constexpr size_t zip_local_size = 30;
+	constexpr size_t zip_central_size = 46;
+	constexpr size_t zip_end_size = 22;
+
+	enum class Compression
+	{
+		stored,
+		deflate,
+		gzip,
+	};
+
+	struct alignas(64) CacheLine
+	{
+		std::array<U8, 64> bytes;
+	};
+
+	U16 read_u16(std::span<const U8> data, size_t offset) noexcept
+	{
+		return U16(data[offset] | data[offset + 1] << 8);
+	}
+
+	U32 read_u32(std::span<const U8> data, size_t offset) noexcept
+	{
+		return U32(read_u16(data, offset) | read_u16(data, offset + 2) << 16);
+	}
+
+	// Takes the inflated file as it comes out of the inflator, copying it into place and hashing everything after
+	// the header while it's still in the cache
+	class RomSink final : public CryptoPP::Bufferless<CryptoPP::Sink>
+	{
+	public:
+		RomSink(std::span<U8> output, bool hash) noexcept
+			: output(output), hash(hash)
+		{
+		}
+
+		size_t Put2(const CryptoPP::byte *data, size_t length, int, bool) override
+		{
+			if (length > output.size() - written)
+			{
+				overflowed = true;
+				length = output.size() - written;
+			}
+
+			std::copy_n(data, length, output.begin() + std::ptrdiff_t(written));
+
+			if (auto begin = std::max(written, header_size); hash && written + length > begin)
+				sha.update(output.subspan(begin, written + length - begin));
+
+			written += length;
+			return 0;
+		}
+
+		// true if exactly as much as expected turned up
+		[[nodiscard]] bool complete() const noexcept
+		{
+			return !overflowed && written == output.size();
+		}
+
+		std::string sha1() noexcept
+		{
+			return hash ? sha.finish() : std::string();
+		}
+
+	private:
+		std::span<U8> output;
+		bool hash = false;
+		nesem::util::Sha1 sha;
+
+		size_t written = 0;
+		bool overflowed = false;
+	};
+
+	std::optional<InflatedRom> inflate(std::span<const U8> compressed, Compression compression, size_t file_size, bool hash) noexcept
+	{
+		if (file_size < header_size || file_size > max_rom_size)
+		{
+			LOG_WARN("Archive holds a file of {:L} bytes, which can't be a rom", file_size);
+			return std::nullopt;
+		}
+
+		// the header goes at the end of the first cache line, so everything after it starts on the next
+		auto lines = std::make_shared<std::vector<CacheLine>>(1 + (file_size - header_size + sizeof(CacheLine) - 1) / sizeof(CacheLine));
+		auto file = std::span(reinterpret_cast<U8 *>(lines->data()) + sizeof(CacheLine) - header_size, file_size);
+
+		auto sink = RomSink(file, hash);
+
+		try
+		{
+			switch (compression)
+			{
+			case Compression::stored:
+				sink.Put(compressed.data(), compressed.size());
+				break;
+
+			case Compression::deflate:
+			{
+				auto inflator = CryptoPP::Inflator(new CryptoPP::Redirector(sink));
+				inflator.Put(compressed.data(), compressed.size());
+				inflator.MessageEnd();
+				break;
+			}
+
+			case Compression::gzip:
+			{
+				auto inflator = CryptoPP::Gunzip(new CryptoPP::Redirector(sink));
+				inflator.Put(compressed.data(), compressed.size());
+				inflator.MessageEnd();
+				break;
+			}
+			}
+		}
+		catch (const CryptoPP::Exception &e)
+		{
+			LOG_WARN("Could not inflate rom, reason: {}", e.what());
+			return std::nullopt;
+		}
+
+		if (!sink.complete())
+		{
+			LOG_WARN("Inflated rom isn't the size the archive says it is");
+			return std::nullopt;
+		}
+
+		return InflatedRom{
+			.file_data = file,
+			.storage = std::move(lines),
+			.sha1 = sink.sha1(),
+		};
+	}
+
+	bool is_gzip(std::span<const U8> data) noexcept
+	{
+		return data.size() >= 2 && data[0] == 0x1F && data[1] == 0x8B;
+	}
+
+	bool is_zip(std::span<const U8> data) noexcept
+	{
+		return data.size() >= 4 && (read_u32(data, 0) == zip_local_signature || read_u32(data, 0) == zip_end_signature);
+	}
+
+	std::optional<InflatedRom> inflate_gzip(std::span<const U8> archive, bool hash) noexcept
+	{
+		// smallest possible gzip file: 10 byte header and 8 byte trailer, the last 4 of which are the inflated size
+		if (archive.size() < 18)
+		{
+			LOG_WARN("gzip file is truncated");
+			return std::nullopt;
+		}
+
+		return inflate(archive, Compression::gzip, read_u32(archive, archive.size() - 4), hash);
+	}
+
+	bool is_nes_name(std::string_view name) noexcept
+	{
+		constexpr auto extension = std::string_view(".nes");
+
+		return name.size() >= extension.size() && std::ranges::equal(name.substr(name.size() - extension.size()), extension, [](char a, char b) {
+			return std::tolower(static_cast<unsigned char>(a)) == b;
+		});
+	}
+
+	std::optional<InflatedRom> inflate_zip(std::span<const U8> archive, bool hash) noexcept
+	{
+		if (archive.size() < zip_end_size)
+		{
+			LOG_WARN("zip file is truncated");
+			return std::nullopt;
+		}
+
+		// the end of central directory record is at the very end, unless the archive has a comment after it
+		auto end = archive.size() - zip_end_size;
+		auto lowest = end - std::min<size_t>(end, 0xFFFF);
+
+		while (read_u32(archive, end) != zip_end_signature)
+		{
+			if (end == lowest)
+			{
+				LOG_WARN("zip file has no central directory");
+				return std::nullopt;
+			}
+
+			--end;
+		}
+
+		struct Found
+		{
+			size_t local = 0;
+			size_t compressed = 0;
+			size_t size = 0;
+			U16 flags = 0;
+			U16 method = 0;
+		};
+
+		std::optional<Found> rom;
+		std::optional<Found> only_file;
+		size_t files = 0;
+
+		auto count = read_u16(archive, end + 10);
+		size_t offset = read_u32(archive, end + 16);
+
+		for (U16 i = 0; i < count && !rom; ++i)
+		{
+			if (offset + zip_central_size > archive.size() || read_u32(archive, offset) != zip_central_signature)
+			{
+				LOG_WARN("zip file's central directory is damaged");
+				return std::nullopt;
+			}
+
+			auto name_size = read_u16(archive, offset + 28);
+			if (offset + zip_central_size + name_size > archive.size())
+			{
+				LOG_WARN("zip file's central directory is damaged");
+				return std::nullopt;
+			}
+
+			auto name = std::string_view(reinterpret_cast<const char *>(archive.data() + offset + zip_central_size), name_size);
+
+			auto entry = Found{
+				.local = read_u32(archive, offset + 42),
+				.compressed = read_u32(archive, offset + 20),
+				.size = read_u32(archive, offset + 24),
+				.flags = read_u16(archive, offset + 8),
+				.method = read_u16(archive, offset + 10),
+			};
+
+			if (!name.ends_with('/'))
+			{
+				++files;
+				only_file = entry;
+
+				if (is_nes_name(name))
+					rom = entry;
+			}
+
+			offset += zip_central_size + name_size + read_u16(archive, offset + 30) + read_u16(archive, offset + 32);
+		}
+
+		if (!rom && files == 1)
+			rom = only_file;
+
+		if (!rom)
+		{
+			LOG_WARN("zip file has no .nes file in it");
+			return std::nullopt;
+		}
+
+		if (rom->flags & 0x0001)
+		{
+			LOG_WARN("Rom in zip file is encrypted");
+			return std::nullopt;
+		}
+
+		if (rom->local + zip_local_size > archive.size() || read_u32(archive, rom->local) != zip_local_signature)
+		{
+			LOG_WARN("zip file is damaged");
+			return std::nullopt;
+		}
+
+		auto data = rom->local + zip_local_size + read_u16(archive, rom->local + 26) + read_u16(archive, rom->local + 28);
+		if (data > archive.size() || rom->compressed > archive.size() - data)
+		{
+			LOG_WARN("zip file is truncated");
+			return std::nullopt;
+		}
+
+		auto compressed = archive.subspan(data, rom->compressed);
+
+		switch (rom->method)
+		{
+		case 0:
+			if (rom->compressed != rom->size)
+			{
+				LOG_WARN("zip file is damaged");
+				return std::nullopt;
+			}
+
+			return inflate(compressed, Compression::stored, rom->size, hash);
+
+		case 8:
+			return inflate(compressed, Compression::deflate, rom->size, hash);
+
+		default:
+			LOG_WARN("Rom in zip file uses compression method {}, only stored and deflate are supported", rom->method);
+			return std::nullopt;
+		}
+	}
+}
+
+namespace nesem
+{
+	bool is_rom_archive(std::span<const U8> data) noexcept
+	{
+		return is_gzip(data) || is_zip(data);
+	}
+
+	std::optional<InflatedRom> inflate_rom(std::span<const U8> archive, bool hash) noexcept
+	{
+		if (is_gzip(archive))
+			return inflate_gzip(archive, hash);
+
+		if (is_zip(archive))
+			return inflate_zip(archive, hash);
+
+		LOG_WARN("Not a gzip or zip file");
+		return std::nullopt;
+	}
+}
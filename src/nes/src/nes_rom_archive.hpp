@@ -0,0 +1,30 @@
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+
+#include <nes_types.hpp>
+
+namespace nesem
+{
+	// true if data starts like a gzip file or a zip archive
+	bool is_rom_archive(std::span<const U8> data) noexcept;
+
+	// a .nes file taken out of an archive, laid out just as if it had been read from disk
+	struct InflatedRom
+	{
+		// the whole file, header and all, which lives in storage. Everything after the header starts on a cache line
+		std::span<const U8> file_data;
+		std::shared_ptr<const void> storage;
+
+		// sha1 of everything after the header, as util::sha1 would give. Empty unless asked for
+		std::string sha1;
+	};
+
+	// Inflate the rom in a .gz, or the first .nes file in a .zip, or its only file if none is named .nes. The rom is
+	// inflated straight into its final place and hashed on the way, so each byte is only touched once. Only stored
+	// and deflated zip entries are understood, not zip64 or encryption. Returns nothing if there's no rom to be had
+	std::optional<InflatedRom> inflate_rom(std::span<const U8> archive, bool hash) noexcept;
+}
@@ -0,0 +1,260 @@
+#include "nes_rom_hash_cache.hpp"
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <iterator>
+#include <random>
+
+#include <fmt/std.h>
+
+#include "nes_20db.hpp"
+#include "nes_state.hpp"
+
+#include <util/logging.hpp>
+
+namespace
+{
+	using namespace nesem;
+
+	constexpr std::array<char, 4> cache_magic = {'N', 'R', 'H', 'C'};
+	// 2: keyed on the nes20db index's content digest, records with length prefixed text
+	constexpr U32 cache_version = 2;
+
+	struct CacheHeader
+	{
+		std::array<char, 4> magic = cache_magic;
+		U32 version = cache_version;
+		U32 count = 0;
+	};
+
+	// followed by the path and the packed db entry
+	struct EntryHeader
+	{
+		U64 size = 0;
+		int64_t modified = 0;
+		U64 db = 0;
+		std::array<char, 40> sha1{};
+		U32 path_size = 0;
+		U32 record_size = 0;
+	};
+
+	std::string path_key(const std::filesystem::path &path)
+	{
+		auto text = path.generic_u8string();
+		return std::string(text.begin(), text.end());
+	}
+}
+
+namespace nesem
+{
+	std::shared_ptr<NesRomHashCache> NesRomHashCache::open(const std::filesystem::path &filename) noexcept
+	{
+		if (filename.empty())
+			return nullptr;
+
+		static std::mutex mutex;
+		static std::unordered_map<std::string, std::weak_ptr<NesRomHashCache>> caches;
+
+		auto lock = std::scoped_lock(mutex);
+
+		auto &cache = caches[path_key(filename)];
+		if (auto existing = cache.lock())
+			return existing;
+
+		auto created = std::make_shared<NesRomHashCache>(filename);
+		cache = created;
+		return created;
+	}
+
+	std::optional<NesRomHashCache::FileStamp> NesRomHashCache::stamp(const std::filesystem::path &rom_filename) noexcept
+	{
+		std::error_code ec;
+
+		auto path = std::filesystem::canonical(rom_filename, ec);
+		if (ec)
+			return std::nullopt;
+
+		auto size = std::filesystem::file_size(path, ec);
+		if (ec)
+			return std::nullopt;
+
+		auto modified = std::filesystem::last_write_time(path, ec);
+		if (ec)
+			return std::nullopt;
+
+		return FileStamp{
+			.path = std::move(path),
+			.size = size,
+			.modified = modified.time_since_epoch().count(),
+		};
+	}
+
+	NesRomHashCache::NesRomHashCache(const std::filesystem::path &filename) noexcept
+		: filename(filename)
+	{
+		load();
+	}
+
+	NesRomHashCache::~NesRomHashCache()
+	{
+		save();
+	}
+
+	std::optional<NesRomHashCache::Entry> NesRomHashCache::find(const FileStamp &rom, U64 db) const noexcept
+	{
+		auto lock = std::scoped_lock(mutex);
+
+		auto it = entries.find(path_key(rom.path));
+		if (it == entries.end() || it->second.size != rom.size || it->second.modified != rom.modified)
+			return std::nullopt;
+
+		const auto &cached = it->second;
+		auto entry = Entry{.sha1 = cached.sha1};
+
+		if (cached.db == db)
+		{
+			entry.resolved = true;
+
+			if (!cached.record.empty())
+			{
+				entry.v2 = decode_nes20db_entry(cached.record);
+				entry.resolved = entry.v2.has_value();
+			}
+		}
+
+		return entry;
+	}
+
+	void NesRomHashCache::add(const FileStamp &rom, U64 db, const std::string &sha1, const std::optional<mappers::ines_2::RomData> &v2) noexcept
+	{
+		auto lock = std::scoped_lock(mutex);
+
+		entries[path_key(rom.path)] = Cached{
+			.size = rom.size,
+			.modified = rom.modified,
+			.db = db,
+			.sha1 = sha1,
+			.record = v2 ? encode_nes20db_entry(*v2) : std::vector<U8>{},
+		};
+
+		changed = true;
+	}
+
+	void NesRomHashCache::load() noexcept
+	{
+		auto file = std::ifstream(filename, std::ios::binary);
+		if (!file)
+			return;
+
+		auto data = std::vector<std::byte>();
+		std::transform(std::istreambuf_iterator<char>(file), {}, std::back_inserter(data), [](char c) { return std::byte(c); });
+
+		auto reader = NesStateReader(data);
+
+		CacheHeader header;
+		reader.read(header);
+
+		if (!reader.ok() || header.magic != cache_magic || header.version != cache_version)
+		{
+			LOG_WARN("Ignoring rom hash cache {}, it isn't one this version understands", filename);
+			return;
+		}
+
+		for (U32 i = 0; i < header.count; ++i)
+		{
+			EntryHeader entry;
+			reader.read(entry);
+
+			if (!reader.ok() || size_t(entry.path_size) + entry.record_size > reader.remaining())
+				break;
+
+			auto path = std::string(entry.path_size, '\0');
+			reader.read_bytes(std::as_writable_bytes(std::span(path)));
+
+			auto record = std::vector<U8>(entry.record_size);
+			reader.read_bytes(std::as_writable_bytes(std::span(record)));
+
+			entries[std::move(path)] = Cached{
+				.size = entry.size,
+				.modified = entry.modified,
+				.db = entry.db,
+				.sha1 = std::string(entry.sha1.begin(), entry.sha1.end()),
+				.record = std::move(record),
+			};
+		}
+
+		if (!reader.ok() || entries.size() != header.count)
+			LOG_WARN("Rom hash cache {} is damaged, only {} of {} entries read", filename, entries.size(), header.count);
+		else
+			LOG_INFO("Loaded {} rom hashes from {}", entries.size(), filename);
+	}
+
+	void NesRomHashCache::save() noexcept
+	{
+		auto lock = std::scoped_lock(mutex);
+
+		if (!changed)
+			return;
+
+		auto write = [this](NesStateWriter &writer) {
+			writer.write(CacheHeader{.count = U32(entries.size())});
+
+			for (const auto &[path, cached] : entries)
+			{
+				auto entry = EntryHeader{
+					.size = cached.size,
+					.modified = cached.modified,
+					.db = cached.db,
+					.path_size = U32(path.size()),
+					.record_size = U32(cached.record.size()),
+				};
+
+				std::copy_n(cached.sha1.begin(), std::min(cached.sha1.size(), entry.sha1.size()), entry.sha1.begin());
+
+				writer.write(entry);
+				writer.write_bytes(std::as_bytes(std::span(path)));
+				writer.write_bytes(std::as_bytes(std::span(cached.record)));
+			}
+		};
+
+		auto measure = NesStateWriter({});
+		write(measure);
+
+		auto data = std::vector<std::byte>(measure.size());
+		auto writer = NesStateWriter(data);
+		write(writer);
+
+		std::error_code ec;
+		std::filesystem::create_directories(filename.parent_path(), ec);
+
+		// next to the cache so the rename stays on one filesystem, with a name of its own so other processes saving the
+		// same cache at the same time don't write into each other's file
+		auto temp_filename = filename;
+		temp_filename += fmt::format(".{:08x}{:08x}.tmp", std::random_device{}(), std::random_device{}());
+
+		{
+			auto file = std::ofstream(temp_filename, std::ios::binary | std::ios::trunc);
+			file.write(reinterpret_cast<const char *>(data.data()), std::streamsize(data.size()));
+
+			if (!file)
+			{
+				LOG_WARN("Could not write rom hash cache {}", temp_filename);
+				file.close();
+				std::filesystem::remove(temp_filename, ec);
+				return;
+			}
+		}
+
+		// replacing the file in one go means readers only ever see the old cache or the new one
+		std::filesystem::rename(temp_filename, filename, ec);
+		if (ec)
+		{
+			LOG_WARN("Could not replace rom hash cache {}: {}", filename, ec.message());
+			std::filesystem::remove(temp_filename, ec);
+			return;
+		}
+
+		changed = false;
+	}
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <nes_rom.hpp>
+#include <nes_types.hpp>
+
+namespace nesem
+{
+	// Remembers the sha1 and db entry of rom files already loaded, so loading one again doesn't need to hash it. Kept
+	// in a small file, keyed by the rom's canonical path, and trusted only while the rom's size and modification time
+	// are what they were when it was hashed. Db entries are only reused while the db has the same content digest it
+	// had when they were looked up. Saving writes a temporary file that then replaces the cache, so a crash part way
+	// through never leaves a damaged cache behind. Anything not yet saved is saved when the last user lets go of it
+	class NesRomHashCache final
+	{
+	public:
+		struct Entry
+		{
+			std::string sha1;
+
+			// true if the db entry was looked up in the db the cache was asked about, in which case v2 is what it
+			// found, or nothing if the rom isn't in it. Otherwise the rom needs looking up again
+			bool resolved = false;
+			std::optional<mappers::ines_2::RomData> v2;
+		};
+
+		// the file's modification time and size, as looked at by find and add
+		struct FileStamp
+		{
+			std::filesystem::path path;
+			U64 size = 0;
+			int64_t modified = 0;
+		};
+
+		// everything using the same cache file in a process shares one cache. Returns null if filename is empty
+		static std::shared_ptr<NesRomHashCache> open(const std::filesystem::path &filename) noexcept;
+
+		// the rom's canonical path, size and modification time, or nothing if it can't be looked at
+		static std::optional<FileStamp> stamp(const std::filesystem::path &rom_filename) noexcept;
+
+		explicit NesRomHashCache(const std::filesystem::path &filename) noexcept;
+		~NesRomHashCache();
+
+		NesRomHashCache(const NesRomHashCache &) = delete;
+		NesRomHashCache &operator=(const NesRomHashCache &) = delete;
+
+		// db identifies the db the caller would look the rom up in, see Nes20dbIndex::fingerprint
+		std::optional<Entry> find(const FileStamp &rom, U64 db) const noexcept;
+
+		// only remembered in memory until saved
+		void add(const FileStamp &rom, U64 db, const std::string &sha1, const std::optional<mappers::ines_2::RomData> &v2) noexcept;
+
+		// write the cache out if anything was added since it was loaded or last saved
+		void save() noexcept;
+
+	private:
+		struct Cached
+		{
+			U64 size = 0;
+			int64_t modified = 0;
+			U64 db = 0;
+			std::string sha1;
+
+			// the packed db entry, empty if the rom isn't in the db
+			std::vector<U8> record;
+		};
+
+		std::filesystem::path filename;
+
+		mutable std::mutex mutex;
+		std::unordered_map<std::string, Cached> entries;
+		bool changed = false;
+
+		void load() noexcept;
+	};
+}
@@ -4,14 +4,20 @@
 #include <array>
 #include <bit>
 #include <concepts>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
 #include <utility>
 
 #include <fmt/format.h>
 #include <fmt/std.h>
 #include <mio/mmap.hpp>
-#include <tinyxml2.h>
 
-#include "nes_20db_xml.hpp"
+#include "nes_20db.hpp"
+#include "nes_20db_index_data.hpp"
+#include "nes_rom_archive.hpp"
+#include "nes_rom_hash_cache.hpp"
 #include "nes_sha1.hpp"
 
 #include <util/logging.hpp>
@@ -20,256 +26,93 @@ namespace nesem
 {
 	namespace
 	{
-		using namespace mappers::ines_2;
-		using namespace std::string_view_literals;
-
-		void log_error(const tinyxml2::XMLDocument &doc)
-		{
-			LOG_WARN("{} line {}: {}\n", doc.ErrorName(), doc.ErrorLineNum(), doc.ErrorStr());
-		}
-
-		template <std::integral T>
-		T read_int_attribute(const tinyxml2::XMLElement *element, const char *name)
-		{
-			if constexpr (std::same_as<int32_t, T>)
-				return element->IntAttribute(name);
-			if constexpr (std::same_as<int64_t, T>)
-				return element->Int64Attribute(name);
-			if constexpr (std::same_as<uint32_t, T>)
-				return element->UnsignedAttribute(name);
-			if constexpr (std::same_as<uint64_t, T>)
-				return element->Unsigned64Attribute(name);
-
-			std::unreachable();
-		}
-
-		PrgRom read_prgrom(const tinyxml2::XMLElement *element) noexcept
-		{
-			if (!element || element->Name() != "prgrom"sv)
-				return {};
-
-			return {
-				.size = read_int_attribute<size_t>(element, "size"),
-				.crc32 = element->Attribute("crc32"),
-				.sha1 = element->Attribute("sha1"),
-				.sum16 = element->Attribute("sum16"),
-			};
-		}
-
-		std::optional<ChrRom> read_chrrom(const tinyxml2::XMLElement *element) noexcept
-		{
-			if (!element || element->Name() != "chrrom"sv)
-				return {};
-
-			return ChrRom{
-				.size = read_int_attribute<size_t>(element, "size"),
-				.crc32 = element->Attribute("crc32"),
-				.sha1 = element->Attribute("sha1"),
-				.sum16 = element->Attribute("sum16"),
-			};
-		}
-
-		Rom read_rom(const tinyxml2::XMLElement *element) noexcept
-		{
-			if (!element || element->Name() != "rom"sv)
-				return {};
-
-			return {
-				.size = read_int_attribute<size_t>(element, "size"),
-				.crc32 = element->Attribute("crc32"),
-				.sha1 = element->Attribute("sha1"),
-			};
-		}
-
-		Pcb read_pcb(const tinyxml2::XMLElement *element) noexcept
-		{
-			if (!element || element->Name() != "pcb"sv)
-				return {};
-
-			constexpr auto mirroring = [](std::string_view m) {
-				using enum mappers::MirroringMode;
-				if (m == "H")
-					return horizontal;
-				if (m == "V")
-					return vertical;
-				if (m == "1")
-					return one_screen;
-				if (m == "4")
-					return four_screen;
-
-				LOG_CRITICAL("Unexpected mirroring mode {}", m);
-				return horizontal;
-			};
-
-			return {
-				.mapper = read_int_attribute<int>(element, "mapper"),
-				.submapper = read_int_attribute<int>(element, "submapper"),
-				.mirroring = mirroring(element->Attribute("mirroring")),
-				.battery = element->BoolAttribute("battery"),
-			};
-		}
-
-		Console read_console(const tinyxml2::XMLElement *element) noexcept
+		// roms up to this size are copied out of their file rather than left mapped, which covers every licensed game
+		constexpr size_t max_mapped_copy_size = 4 * 1024 * 1024;
+
+		// Every rom image still in use, by the sha1 of its contents and its header. Only weak references are held, so
+		// an image goes away with the last cartridge using it. The header is part of the key so that a rom reloaded
+		// after fixing its header isn't handed the image made from the old one. Whichever loader loads a rom first
+		// decides what the db says about it
+		class RomImages final
 		{
-			if (!element || element->Name() != "console"sv)
-				return {};
-
-			return {
-				.type = read_int_attribute<int>(element, "type"),
-				.region = read_int_attribute<int>(element, "region"),
-			};
-		}
-
-		Expansion read_expansion(const tinyxml2::XMLElement *element) noexcept
-		{
-			if (!element || element->Name() != "expansion"sv)
-				return {};
-
-			return Expansion{read_int_attribute<int>(element, "type")};
-		}
-
-		std::optional<ChrRam> read_chrram(const tinyxml2::XMLElement *element) noexcept
-		{
-			if (!element || element->Name() != "chrram"sv)
-				return {};
+		public:
+			static std::string key(const std::string &sha1, std::span<const U8> header) noexcept
+			{
+				auto result = sha1;
+				result.append(header.begin(), header.end());
+				return result;
+			}
 
-			return ChrRam{read_int_attribute<size_t>(element, "size")};
-		}
+			mappers::NesRomImage find(const std::string &key) noexcept
+			{
+				auto lock = std::scoped_lock(mutex);
 
-		std::optional<PrgNvram> read_prgnvram(const tinyxml2::XMLElement *element) noexcept
-		{
-			if (!element || element->Name() != "prgnvram"sv)
-				return {};
+				if (auto it = images.find(key); it != images.end())
+					return it->second.lock();
 
-			return PrgNvram{read_int_attribute<size_t>(element, "size")};
-		}
+				return nullptr;
+			}
 
-		std::optional<PrgRam> read_prgram(const tinyxml2::XMLElement *element) noexcept
-		{
-			if (!element || element->Name() != "prgram"sv)
-				return {};
+			// add an image, unless another thread got there first, in which case that one is used instead
+			mappers::NesRomImage add(const std::string &key, mappers::NesRom &&rom) noexcept
+			{
+				auto lock = std::scoped_lock(mutex);
 
-			return PrgRam{read_int_attribute<size_t>(element, "size")};
-		}
+				if (auto it = images.find(key); it != images.end())
+				{
+					if (auto image = it->second.lock())
+						return image;
+				}
 
-		std::optional<MiscRom> read_miscrom(const tinyxml2::XMLElement *element) noexcept
-		{
-			if (!element || element->Name() != "miscrom"sv)
-				return {};
-
-			return MiscRom{
-				.size = read_int_attribute<size_t>(element, "size"),
-				.crc32 = element->Attribute("crc32"),
-				.sha1 = element->Attribute("sha1"),
-				.number = read_int_attribute<int>(element, "number"),
-			};
-		}
+				// drop the entries of images that have gone away, rather than letting them pile up
+				std::erase_if(images, [](const auto &image) { return image.second.expired(); });
 
-		std::optional<Vs> read_vs(const tinyxml2::XMLElement *element) noexcept
-		{
-			if (!element || element->Name() != "vs"sv)
-				return {};
+				auto image = std::make_shared<const mappers::NesRom>(std::move(rom));
+				images[key] = image;
+				return image;
+			}
 
-			return Vs{
-				.hardware = read_int_attribute<int>(element, "hardware"),
-				.ppu = read_int_attribute<int>(element, "ppu"),
-			};
-		}
+		private:
+			std::mutex mutex;
+			std::unordered_map<std::string, std::weak_ptr<const mappers::NesRom>> images;
+		};
 
-		std::optional<ChrNvram> read_chrnvram(const tinyxml2::XMLElement *element) noexcept
+		RomImages &rom_images()
 		{
-			if (!element || element->Name() != "chrnvram"sv)
-				return {};
-
-			return ChrNvram{read_int_attribute<size_t>(element, "size")};
+			static RomImages images;
+			return images;
 		}
 
-		std::optional<Trainer> read_trainer(const tinyxml2::XMLElement *element) noexcept
+		// a copy of a rom's contents, prg-rom and chr-rom each starting on a cache line of their own
+		struct alignas(64) CacheLine
 		{
-			if (!element || element->Name() != "trainer"sv)
-				return {};
-
-			return Trainer{
-				.size = read_int_attribute<size_t>(element, "size"),
-				.crc32 = std::string(element->Attribute("crc32")),
-				.sha1 = std::string(element->Attribute("sha1")),
-			};
-		}
+			std::array<U8, 64> bytes;
+		};
 
-		std::vector<RomData> load_nes20db_xml(tinyxml2::XMLDocument &doc)
+		void copy_contents(mappers::NesRom &rom) noexcept
 		{
-			auto root = doc.FirstChildElement("nes20db");
-			if (doc.Error() || !root)
-			{
-				log_error(doc);
-				return {};
-			}
-
-			LOG_INFO("Loading nes20db.xml version {}", root->Attribute("date"));
+			auto lines = [](size_t size) { return (size + sizeof(CacheLine) - 1) / sizeof(CacheLine); };
 
-			auto game = root->FirstChildElement("game");
-			std::vector<RomData> roms;
+			auto copy = std::make_shared<std::vector<CacheLine>>(lines(rom.prg_rom.size()) + lines(rom.chr_rom.size()));
+			auto bytes = reinterpret_cast<U8 *>(copy->data());
 
-			while (!doc.Error() && game)
-			{
-				roms.emplace_back(
-					read_prgrom(game->FirstChildElement("prgrom")),
-					read_rom(game->FirstChildElement("rom")),
-					read_pcb(game->FirstChildElement("pcb")),
-					read_console(game->FirstChildElement("console")),
-					read_expansion(game->FirstChildElement("expansion")),
-					read_chrrom(game->FirstChildElement("chrrom")),
-					read_chrram(game->FirstChildElement("chrram")),
-					read_prgnvram(game->FirstChildElement("prgnvram")),
-					read_prgram(game->FirstChildElement("prgram")),
-					read_miscrom(game->FirstChildElement("miscrom")),
-					read_vs(game->FirstChildElement("vs")),
-					read_chrnvram(game->FirstChildElement("chrnvram")),
-					read_trainer(game->FirstChildElement("trainer")));
-
-				game = game->NextSiblingElement("game");
-			}
+			auto prg_rom = std::span(bytes, rom.prg_rom.size());
+			auto chr_rom = std::span(bytes + lines(rom.prg_rom.size()) * sizeof(CacheLine), rom.chr_rom.size());
 
-			if (doc.Error())
-			{
-				log_error(doc);
-				return {};
-			}
+			std::ranges::copy(rom.prg_rom, prg_rom.begin());
+			std::ranges::copy(rom.chr_rom, chr_rom.begin());
 
-			return roms;
+			rom.prg_rom = prg_rom;
+			rom.chr_rom = chr_rom;
+			rom.storage = std::move(copy);
 		}
 
-		std::vector<mappers::ines_2::RomData> load_nes20db_xml(const std::filesystem::path &db_file)
+		bool is_ines(std::span<const U8> header) noexcept
 		{
-			tinyxml2::XMLDocument doc;
-
-			// initialize error to something other than success so if we skip loading a file, we can detect that we haven't succeeded in loading the file
-			// using the count of errors as it isn't a real error condition so we should never get it naturally
-			auto err = tinyxml2::XML_ERROR_COUNT;
+			// iNES rom files start with "NES" followed by the DOS "EOF" character (0x1A, more correctly, the ASCII/ANSI SUB character)
+			constexpr auto magic = std::array<U8, 4>{'N', 'E', 'S', '\x1A'};
 
-			if (!db_file.empty())
-			{
-				LOG_INFO("Trying to load nes20db from '{}'", db_file);
-				err = doc.LoadFile(db_file.string().c_str());
-				if (err != tinyxml2::XML_SUCCESS)
-					log_error(doc);
-			}
-
-			// fallback to embedded version
-			if (err != tinyxml2::XML_SUCCESS)
-			{
-				LOG_INFO("Trying to load embedded nes20db");
-				auto data = nes20db_xml();
-				err = doc.Parse(std::bit_cast<char *>(data.data()), data.size());
-			}
-
-			if (err != tinyxml2::XML_SUCCESS)
-			{
-				log_error(doc);
-				return {};
-			}
-
-			return load_nes20db_xml(doc);
+			return header.size() >= 16 && std::ranges::equal(header.first(4), magic);
 		}
 
 		mappers::ines_1::RomData read_ines_1_data(std::span<const U8> header)
@@ -305,64 +148,179 @@ namespace nesem
 		}
 	}
 
-	NesRomLoader NesRomLoader::create(const std::filesystem::path &nes20db_file)
+	// where the index lives: the embedded copy, a mapped index file or one built from xml at runtime
+	struct NesRomLoader::Database
+	{
+		mio::ummap_source file;
+		std::vector<U8> built;
+		Nes20dbIndex index;
+	};
+
+	NesRomLoader NesRomLoader::create(const std::filesystem::path &nes20db_file, const std::filesystem::path &cache_dir)
 	{
-		return NesRomLoader{load_nes20db_xml(nes20db_file)};
+		auto loader = open_database(nes20db_file);
+
+		if (!cache_dir.empty())
+			loader.hash_cache = NesRomHashCache::open(cache_dir / "rom_hashes.bin");
+
+		return loader;
+	}
+
+	NesRomLoader NesRomLoader::open_database(const std::filesystem::path &nes20db_file)
+	{
+		auto database = std::make_shared<Database>();
+
+		if (!nes20db_file.empty())
+		{
+			std::error_code ec;
+			database->file.map(nes20db_file.string(), ec);
+
+			if (ec)
+				LOG_WARN("Could not open nes20db '{}', reason: {}", nes20db_file, ec.message());
+			else if (auto file = std::span(database->file.data(), database->file.size()); Nes20dbIndex::is_index(file))
+			{
+				// a prebuilt index is used straight from the mapping
+				if (auto index = Nes20dbIndex::open(file))
+				{
+					LOG_INFO("Using nes20db index '{}' with {} entries", nes20db_file, index->size());
+					database->index = *index;
+					return NesRomLoader(std::move(database));
+				}
+			}
+			else if (auto roms = load_nes20db_xml(file); !roms.empty())
+			{
+				database->file.unmap();
+				return NesRomLoader(std::move(roms));
+			}
+		}
+
+		database->file.unmap();
+
+		// the embedded index is generated from data/nes20db.xml at build time, so there is nothing to parse
+		if (auto index = Nes20dbIndex::open(nes20db_index()))
+		{
+			LOG_INFO("Using embedded nes20db index with {} entries", index->size());
+			database->index = *index;
+			return NesRomLoader(std::move(database));
+		}
+
+		LOG_WARN("No nes20db available, roms will be identified by their headers alone");
+		return NesRomLoader();
 	}
 
 	NesRomLoader::NesRomLoader(std::vector<mappers::ines_2::RomData> &&roms)
-		: roms(std::move(roms))
 	{
-		build_indexes();
+		LOG_INFO("Building iNES20 DB index");
+
+		auto built = std::make_shared<Database>();
+		built->built = build_nes20db_index(roms);
+		built->index = Nes20dbIndex::open(built->built).value_or(Nes20dbIndex());
+
+		database = std::move(built);
 		LOG_INFO("iNES20 DB ready");
 	}
 
-	void NesRomLoader::build_indexes()
+	NesRomLoader::NesRomLoader(std::shared_ptr<const Database> &&database) noexcept
+		: database(std::move(database))
 	{
-		LOG_INFO("Building iNES20 DB indexes");
-		for (size_t index = 0; index < size(roms); ++index)
-			rom_sha1_to_index.try_emplace(roms[index].rom.sha1, index);
 	}
 
-	std::optional<mappers::NesRom> NesRomLoader::load_rom(const std::filesystem::path &filename) noexcept
+	mappers::NesRomImage NesRomLoader::load_rom(const std::filesystem::path &filename) noexcept
 	{
 		using namespace std::string_view_literals;
 
 		LOG_INFO("Loading {}", filename);
 
-		mio::ummap_source file;
+		auto stamp = hash_cache ? NesRomHashCache::stamp(filename) : std::nullopt;
+		auto cached = stamp ? hash_cache->find(*stamp, db_fingerprint()) : std::nullopt;
+
+		auto file = std::make_shared<mio::ummap_source>();
 		std::error_code ec;
-		file.map(filename.string(), ec);
+		file->map(filename.string(), ec);
 
 		if (ec)
 		{
 			LOG_WARN("Could not open file '{}', reason: {}", filename, ec.message());
-			return std::nullopt;
+			return nullptr;
 		}
 
+		auto file_data = std::span<const U8>(file->data(), file->size());
+		auto storage = std::shared_ptr<const void>(file);
+		std::optional<std::string> sha1;
+
+		// an archive is inflated into memory of its own, hashed on the way unless the hash cache already knows it
+		if (is_rom_archive(file_data))
+		{
+			auto inflated = inflate_rom(file_data, !cached);
+			if (!inflated)
+			{
+				LOG_WARN("Could not get a rom out of '{}'", filename);
+				return nullptr;
+			}
+
+			file_data = inflated->file_data;
+			storage = std::move(inflated->storage);
+
+			if (!inflated->sha1.empty())
+				sha1 = std::move(inflated->sha1);
+		}
+		else if (file_data.size() <= max_mapped_copy_size)
+		{
+			// reads through a mapping see the file as it is now, so rebuilding a rom while it runs would change it
+			// under the system, or crash it if the file got shorter. Copied out, only the rare huge rom is left mapped
+			storage.reset();
+		}
+
+		std::optional<Identity> identity;
+		if (cached && cached->resolved)
+			identity = Identity{.sha1 = std::move(cached->sha1), .v2 = std::move(cached->v2)};
+		else if (sha1 || (stamp && file_data.size() >= 16))
+		{
+			// either never hashed, or hashed when a different db was in use, so only the lookup is repeated
+			if (!sha1)
+				sha1 = cached ? std::move(cached->sha1) : util::sha1(file_data.subspan(16));
+
+			identity = Identity{.sha1 = *sha1, .v2 = find_rom_data(*sha1)};
+
+			if (stamp)
+				hash_cache->add(*stamp, db_fingerprint(), identity->sha1, identity->v2);
+		}
+
+		return load_rom(file_data, std::move(storage), std::move(identity));
+	}
+
+	mappers::NesRomImage NesRomLoader::load_rom(std::span<const U8> file_data) noexcept
+	{
+		return load_rom(file_data, nullptr, std::nullopt);
+	}
+
+	mappers::NesRomImage NesRomLoader::load_rom(std::span<const U8> file_data, std::shared_ptr<const void> &&storage, std::optional<Identity> &&identity) noexcept
+	{
 		// bail early if we don't even have enough space for the ines header
-		if (file.size() < 16)
+		if (file_data.size() < 16)
 		{
-			LOG_WARN("File '{}' too small");
-			return std::nullopt;
+			LOG_WARN("ROM too small, only {} bytes", file_data.size());
+			return nullptr;
 		}
 
-		auto file_data = std::span(file.data(), file.size());
+		if (!is_ines(file_data))
+		{
+			LOG_WARN("Invalid iNES Rom");
+			return nullptr;
+		}
 
-		// iNES rom files start with "NES" followed by the DOS "EOF" character (0x1A, more correctly, the ASCII/ANSI SUB character)
-		constexpr auto magic = std::array<U8, 4>{'N', 'E', 'S', '\x1A'};
+		auto sha1 = identity ? std::move(identity->sha1) : util::sha1(file_data.subspan(16));
+		auto image_key = RomImages::key(sha1, file_data.subspan(0, 16));
 
-		// if (!std::ranges::equal(file_data.subspan(0, 4), magic))
-		auto start_span = file_data.subspan(0, 4);
-		if (!std::equal(begin(start_span), end(start_span), begin(magic)))
+		// a file already hashed by the hash cache and still in use only has its header read
+		if (auto image = rom_images().find(image_key))
 		{
-			LOG_WARN("Invalid iNES Rom, file: '{}'", filename);
-			return std::nullopt;
+			LOG_INFO("ROM already loaded, sharing it");
+			return image;
 		}
 
 		auto ines_1 = read_ines_1_data(file_data.subspan(0, 16));
-		auto sha1 = util::sha1(file_data.subspan(16));
-		auto ines_2 = find_rom_data(sha1);
+		auto ines_2 = identity ? std::move(identity->v2) : find_rom_data(sha1);
 
 		LOG_INFO("ROM file iNES version: {}", ines_1.version);
 
@@ -372,15 +330,20 @@ namespace nesem
 
 		size_t expected_rom_size = 16 + prg_rom_size + chr_rom_size + trainer_size;
 
-		if (expected_rom_size != file.size())
-			LOG_WARN("ROM reports size {:L} but size is {:L}", expected_rom_size, file.size());
+		if (expected_rom_size != file_data.size())
+			LOG_WARN("ROM reports size {:L} but size is {:L}", expected_rom_size, file_data.size());
 
-		auto prg_rom_start = file.begin() + 16 + trainer_size;
-		auto chr_rom_start = prg_rom_start + prg_rom_size;
+		// the data may come from anywhere, so don't trust the header enough to read past the end of it
+		if (expected_rom_size > file_data.size())
+		{
+			LOG_WARN("ROM is truncated");
+			return nullptr;
+		}
 
 		auto result = mappers::NesRom{
-			.prg_rom = std::vector<U8>(prg_rom_start, prg_rom_start + prg_rom_size),
-			.chr_rom = std::vector<U8>(chr_rom_start, chr_rom_start + chr_rom_size),
+			.prg_rom = file_data.subspan(16 + trainer_size, prg_rom_size),
+			.chr_rom = file_data.subspan(16 + trainer_size + prg_rom_size, chr_rom_size),
+			.storage = std::move(storage),
 			.sha1 = sha1,
 			.v1 = ines_1,
 			.v2 = ines_2,
@@ -389,13 +352,100 @@ namespace nesem
 		if (trainer_size > 0)
 			LOG_WARN("ROM has INST-ROM data, but we are ignoring it");
 
-		return result;
+		if (!result.storage)
+			copy_contents(result);
+
+		return rom_images().add(image_key, std::move(result));
 	}
 
-	std::optional<mappers::ines_2::RomData> NesRomLoader::find_rom_data(std::string_view sha1)
+	std::optional<mappers::NesRom> NesRomLoader::identify_rom(const std::filesystem::path &filename) noexcept
 	{
-		if (auto it = rom_sha1_to_index.find(sha1); it != end(rom_sha1_to_index))
-			return roms[it->second];
+		auto file = std::ifstream(filename, std::ios::binary);
+		auto header = std::array<U8, 16>{};
+
+		if (!file.read(reinterpret_cast<char *>(header.data()), std::streamsize(header.size())))
+		{
+			LOG_WARN("{} is not an iNES rom", filename);
+			return std::nullopt;
+		}
+
+		auto stamp = hash_cache ? NesRomHashCache::stamp(filename) : std::nullopt;
+		auto cached = stamp ? hash_cache->find(*stamp, db_fingerprint()) : std::nullopt;
+
+		// an archive's header can only be seen by inflating it, which hashes it too unless the hash cache knows it
+		std::optional<std::string> inflated_sha1;
+		if (is_rom_archive(header))
+		{
+			auto archive = mio::ummap_source();
+			std::error_code ec;
+			archive.map(filename.string(), ec);
+
+			auto inflated = ec ? std::nullopt : inflate_rom(std::span<const U8>(archive.data(), archive.size()), !cached);
+			if (!inflated || inflated->file_data.size() < header.size())
+			{
+				LOG_WARN("Could not get a rom out of '{}'", filename);
+				return std::nullopt;
+			}
+
+			std::ranges::copy(inflated->file_data.first(header.size()), header.begin());
+
+			if (!inflated->sha1.empty())
+				inflated_sha1 = std::move(inflated->sha1);
+		}
+
+		if (!is_ines(header))
+		{
+			LOG_WARN("{} is not an iNES rom", filename);
+			return std::nullopt;
+		}
+
+		auto rom = mappers::NesRom{.v1 = read_ines_1_data(header)};
+
+		if (cached && cached->resolved)
+		{
+			rom.sha1 = std::move(cached->sha1);
+			rom.v2 = std::move(cached->v2);
+			return rom;
+		}
+
+		if (cached)
+			rom.sha1 = std::move(cached->sha1);
+		else if (inflated_sha1)
+			rom.sha1 = std::move(*inflated_sha1);
+		else if (auto sha1 = util::sha1(file))
+			rom.sha1 = std::move(*sha1);
+		else
+		{
+			LOG_WARN("Could not read {}", filename);
+			return std::nullopt;
+		}
+
+		rom.v2 = find_rom_data(rom.sha1);
+
+		if (stamp)
+			hash_cache->add(*stamp, db_fingerprint(), rom.sha1, rom.v2);
+
+		return rom;
+	}
+
+	void NesRomLoader::save_hash_cache() noexcept
+	{
+		if (hash_cache)
+			hash_cache->save();
+	}
+
+	U64 NesRomLoader::db_fingerprint() const noexcept
+	{
+		return database ? database->index.fingerprint() : 0;
+	}
+
+	std::optional<mappers::ines_2::RomData> NesRomLoader::find_rom_data(std::string_view sha1) const
+	{
+		if (database)
+		{
+			if (auto rom = database->index.find(sha1))
+				return rom;
+		}
 
 		LOG_WARN("ROM not found in DB");
 		return {};
@@ -0,0 +1,171 @@
+#include "nes_run_ahead.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+
+#include "nes.hpp"
+
+#include <util/logging.hpp>
+
+namespace nesem
+{
+	NesRunAhead::NesRunAhead(int frames) noexcept
+		: ahead_frames(std::max(frames, 0))
+	{
+	}
+
+	double NesRunAhead::run_frame(Nes &nes) noexcept
+	{
+		using enum NesClockStep;
+
+		if (ahead_frames == 0 || nes.state_size() == 0)
+			return nes.step(OneFrame);
+
+		state.resize(nes.state_size());
+
+		// the real frame, heard but not seen
+		nes.enable_video(false);
+		auto time = nes.step(OneFrame);
+
+		if (nes.save_state(state) == 0)
+		{
+			nes.enable_video(true);
+			return time;
+		}
+
+		// the future, seen but not heard. Only the last frame is drawn
+		nes.enable_audio(false);
+		for (int i = 1; i < ahead_frames; ++i)
+			nes.step(OneFrame);
+
+		nes.enable_video(true);
+		nes.step(OneFrame);
+		nes.enable_audio(true);
+
+		nes.load_state(state);
+
+		return time;
+	}
+
+	int NesRunAhead::frames() const noexcept
+	{
+		return ahead_frames;
+	}
+
+	void NesRunAhead::set_frames(int frames) noexcept
+	{
+		ahead_frames = std::max(frames, 0);
+	}
+
+	struct NesRunAheadThread::Core
+	{
+		std::unique_ptr<Nes> ahead;
+
+		std::mutex mutex;
+		std::condition_variable_any ready;
+
+		// the state to run ahead from, owned by the worker while busy is set
+		std::vector<std::byte> state;
+		bool busy = false;
+
+		// declared last so the thread is stopped and joined before anything it uses is destroyed
+		std::jthread worker;
+
+		explicit Core(std::unique_ptr<Nes> &&ahead) noexcept
+			: ahead(std::move(ahead))
+		{
+			this->ahead->enable_audio(false);
+			worker = std::jthread([this](std::stop_token stop) { run_loop(stop); });
+		}
+
+		void post() noexcept
+		{
+			{
+				auto lock = std::scoped_lock(mutex);
+				busy = true;
+			}
+
+			ready.notify_all();
+		}
+
+		void wait() noexcept
+		{
+			auto lock = std::unique_lock(mutex);
+			ready.wait(lock, [this] { return !busy; });
+		}
+
+	private:
+		void run_loop(std::stop_token stop) noexcept
+		{
+			while (true)
+			{
+				{
+					auto lock = std::unique_lock(mutex);
+					if (!ready.wait(lock, stop, [this] { return busy; }))
+						break;
+				}
+
+				if (ahead->load_state(state))
+					ahead->step(NesClockStep::OneFrame);
+
+				{
+					auto lock = std::scoped_lock(mutex);
+					busy = false;
+				}
+
+				ready.notify_all();
+			}
+		}
+	};
+
+	NesRunAheadThread::NesRunAheadThread() noexcept = default;
+
+	NesRunAheadThread::NesRunAheadThread(std::unique_ptr<Nes> ahead) noexcept
+	{
+		if (!ahead)
+		{
+			LOG_WARN("No instance to run ahead with");
+			return;
+		}
+
+		core = std::make_unique<Core>(std::move(ahead));
+	}
+
+	NesRunAheadThread::~NesRunAheadThread() = default;
+	NesRunAheadThread::NesRunAheadThread(NesRunAheadThread &&other) noexcept = default;
+	NesRunAheadThread &NesRunAheadThread::operator=(NesRunAheadThread &&other) noexcept = default;
+
+	double NesRunAheadThread::run_frame(Nes &nes) noexcept
+	{
+		if (!core)
+			return nes.step(NesClockStep::OneFrame);
+
+		core->wait();
+
+		nes.enable_video(false);
+		auto time = nes.step(NesClockStep::OneFrame);
+		nes.enable_video(true);
+
+		core->state.resize(nes.state_size());
+
+		if (nes.save_state(core->state) != 0)
+			core->post();
+
+		return time;
+	}
+
+	void NesRunAheadThread::wait() noexcept
+	{
+		if (core)
+			core->wait();
+	}
+
+	Nes &NesRunAheadThread::ahead() noexcept
+	{
+		CHECK(core != nullptr, "no instance to run ahead with");
+		return *core->ahead;
+	}
+}
@@ -0,0 +1,295 @@
+#include "nes_search.hpp"
+
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <ranges>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+
+#include <fmt/std.h>
+
+#include "nes.hpp"
+#include "nes_cartridge.hpp"
+#include "nes_fork.hpp"
+#include "nes_state_hash.hpp"
+
+#include <util/logging.hpp>
+
+namespace
+{
+	using namespace nesem;
+
+	using Clock = std::chrono::steady_clock;
+
+	constexpr size_t no_parent = ~size_t{0};
+
+	// a step of some sequence, kept for every distinct state reached so the sequence can be walked back to the start
+	struct Step
+	{
+		size_t parent = no_parent;
+		U8 action = 0;
+
+		// how long the action was held, and the frames from the start to the end of this step
+		U64 frames = 0;
+		U64 length = 0;
+	};
+
+	// a state still to be expanded
+	struct Node
+	{
+		size_t step = 0;
+		NesFork fork;
+		double score = 0.0;
+	};
+
+	// a sequence that ended somewhere worth reporting
+	struct Leaf
+	{
+		size_t step = 0;
+		U64 frames = 0;
+		double score = 0.0;
+	};
+
+	// what running one action from a node led to, written only by the job expanding that node
+	struct Outcome
+	{
+		bool ran = false;
+		bool reached_goal = false;
+		U64 frames = 0;
+		U64 ram_hash = 0;
+		double score = 0.0;
+
+		// only taken if the goal wasn't reached, as nothing continues from there
+		NesFork fork;
+	};
+
+	U64 hash_ram(std::span<const U8> ram) noexcept
+	{
+		return state_hash::hash_bytes(std::as_bytes(ram));
+	}
+
+	NesSearchSolution make_solution(const std::vector<Step> &steps, const Leaf &leaf, bool reached_goal, const NesMovie &start) noexcept
+	{
+		auto result = NesSearchSolution{
+			.frames = leaf.frames,
+			.score = leaf.score,
+			.reached_goal = reached_goal,
+			.movie = start,
+		};
+
+		auto path = std::vector<size_t>();
+		for (auto index = leaf.step; steps[index].parent != no_parent; index = steps[index].parent)
+			path.push_back(index);
+
+		result.movie.input.reserve(leaf.frames);
+
+		for (auto index : path | std::views::reverse)
+		{
+			const auto &step = steps[index];
+			result.actions.push_back(step.action);
+			result.movie.input.insert(result.movie.input.end(), step.frames, std::array<U8, 2>{step.action, 0});
+		}
+
+		return result;
+	}
+}
+
+namespace nesem
+{
+	std::vector<U8> default_search_actions() noexcept
+	{
+		using enum Buttons;
+
+		auto combine = [](auto... buttons) { return U8((U8(buttons) | ...)); };
+
+		return {
+			combine(None),
+			combine(A),
+			combine(B),
+			combine(Left),
+			combine(Right),
+			combine(Up),
+			combine(Down),
+			combine(Left, A),
+			combine(Left, B),
+			combine(Right, A),
+			combine(Right, B),
+			combine(Right, A, B),
+		};
+	}
+
+	NesSearchResult search_inputs(const NesSearchSettings &settings, NesSearchGoalFn goal, NesSearchScoreFn score) noexcept
+	{
+		auto start_time = Clock::now();
+		auto result = NesSearchResult{};
+
+		if (settings.actions.empty())
+		{
+			LOG_WARN("Nothing to search without any actions");
+			return result;
+		}
+
+		auto thread_count = settings.threads > 0 ? settings.threads : std::max(std::thread::hardware_concurrency(), 1u);
+		auto frames_per_action = std::max(settings.frames_per_action, U64{1});
+
+		// an instance per thread, as every node is restored from a fork anyway
+		auto pool = NesPool::create(NesPoolSettings{
+			.instances = thread_count,
+			.threads = thread_count,
+			.video = false,
+			.audio = false,
+			.nes20db_filename = settings.nes20db_filename,
+		});
+
+		if (!pool.load_rom(settings.rom))
+		{
+			LOG_WARN("Could not load {} to search", settings.rom);
+			return result;
+		}
+
+		auto &first = pool.instance(0);
+		if (!settings.start_state.empty() && !first.load_state(settings.start_state))
+		{
+			LOG_WARN("Could not load the state to search from");
+			return result;
+		}
+
+		// every sequence found plays back from here
+		auto start = NesMovie{.sha1 = first.cartridge()->rom().sha1};
+		start.start_state.resize(first.state_size());
+		first.save_state(start.start_state);
+
+		auto steps = std::vector<Step>{Step{}};
+		auto seen = std::unordered_set<U64>{hash_ram(first.bus().work_ram())};
+		auto root_score = score ? score(first.bus().work_ram()) : 0.0;
+
+		if (goal && goal(first.bus().work_ram()))
+		{
+			result.best.push_back(make_solution(steps, Leaf{.score = root_score}, true, start));
+			return result;
+		}
+
+		auto frontier = std::vector<Node>{Node{.fork = first.fork(), .score = root_score}};
+		auto goals = std::vector<Leaf>();
+		auto top = std::vector<Leaf>();
+
+		pool.reset_metrics();
+
+		for (size_t depth = 1; depth <= settings.max_depth && !frontier.empty() && goals.size() < settings.best_count; ++depth)
+		{
+			auto outcomes = std::vector<std::vector<Outcome>>(frontier.size(), std::vector<Outcome>(settings.actions.size()));
+
+			for (size_t i = 0; i < frontier.size(); ++i)
+			{
+				auto index = i % pool.size();
+
+				pool.submit(index, [&, i, index](Nes &nes) {
+					U64 frames = 0;
+
+					for (size_t a = 0; a < settings.actions.size(); ++a)
+					{
+						auto &outcome = outcomes[i][a];
+						if (!nes.restore(frontier[i].fork))
+							continue;
+
+						pool.set_input(index, 0, settings.actions[a]);
+
+						while (outcome.frames < frames_per_action && !outcome.reached_goal)
+						{
+							nes.step(NesClockStep::OneFrame);
+							++outcome.frames;
+							outcome.reached_goal = goal && goal(nes.bus().work_ram());
+						}
+
+						auto ram = nes.bus().work_ram();
+						outcome.ran = true;
+						outcome.ram_hash = hash_ram(ram);
+						outcome.score = score ? score(ram) : 0.0;
+
+						if (!outcome.reached_goal)
+							outcome.fork = nes.fork();
+
+						frames += outcome.frames;
+					}
+
+					return frames;
+				});
+			}
+
+			pool.wait();
+
+			// gathered in the order the jobs were submitted, so which duplicate survives never depends on timing
+			auto next = std::vector<Node>();
+
+			for (size_t i = 0; i < frontier.size(); ++i)
+			{
+				for (size_t a = 0; a < settings.actions.size(); ++a)
+				{
+					auto &outcome = outcomes[i][a];
+					if (!outcome.ran)
+						continue;
+
+					++result.stats.nodes;
+
+					if (!seen.insert(outcome.ram_hash).second)
+					{
+						++result.stats.duplicates;
+						continue;
+					}
+
+					auto length = steps[frontier[i].step].length + outcome.frames;
+					steps.push_back(Step{.parent = frontier[i].step, .action = settings.actions[a], .frames = outcome.frames, .length = length});
+
+					if (outcome.reached_goal)
+						goals.push_back(Leaf{.step = steps.size() - 1, .frames = steps.back().length, .score = outcome.score});
+					else
+						next.push_back(Node{.step = steps.size() - 1, .fork = std::move(outcome.fork), .score = outcome.score});
+				}
+			}
+
+			std::ranges::stable_sort(next, std::ranges::greater{}, &Node::score);
+			if (next.size() > settings.beam_width)
+				next.erase(next.begin() + ptrdiff_t(settings.beam_width), next.end());
+
+			// the beam keeps the highest scores, so the best of all states expanded so far are always among it and the last top
+			for (const auto &node : next)
+				top.push_back(Leaf{.step = node.step, .frames = steps[node.step].length, .score = node.score});
+
+			std::ranges::stable_sort(top, std::ranges::greater{}, &Leaf::score);
+			if (top.size() > settings.best_count)
+				top.erase(top.begin() + ptrdiff_t(settings.best_count), top.end());
+
+			frontier = std::move(next);
+			result.stats.depth = depth;
+		}
+
+		if (!goals.empty())
+		{
+			std::ranges::stable_sort(goals, [](const Leaf &a, const Leaf &b) {
+				return a.frames != b.frames ? a.frames < b.frames : a.score > b.score;
+			});
+
+			for (size_t i = 0; i < std::min(goals.size(), settings.best_count); ++i)
+				result.best.push_back(make_solution(steps, goals[i], true, start));
+		}
+		else
+		{
+			for (const auto &leaf : top)
+				result.best.push_back(make_solution(steps, leaf, false, start));
+		}
+
+		result.stats.pool = pool.metrics();
+		for (const auto &instance : result.stats.pool.instances)
+			result.stats.frames += instance.frames;
+
+		result.stats.elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start_time);
+
+		LOG_INFO("Searched {} states ({} duplicates) to depth {} in {:.2f}s, {:.0f} fps, {} reached the goal",
+			result.stats.nodes, result.stats.duplicates, result.stats.depth, std::chrono::duration<double>(result.stats.elapsed).count(),
+			result.stats.frames_per_second(), goals.size());
+
+		return result;
+	}
+}
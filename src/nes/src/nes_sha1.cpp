@@ -15,12 +15,9 @@
 
 namespace nesem::util
 {
-	std::string sha1_impl(std::ranges::contiguous_range auto... bytes) noexcept
+	std::string sha1_final(CryptoPP::SHA1 &sha) noexcept
 	{
 		std::array<CryptoPP::byte, CryptoPP::SHA1::DIGESTSIZE> digest{};
-
-		CryptoPP::SHA1 sha;
-		(sha.Update(data(bytes), size(bytes)), ...);
 		sha.Final(data(digest));
 
 		std::string output;
@@ -32,6 +29,13 @@ namespace nesem::util
 		return output;
 	}
 
+	std::string sha1_impl(std::ranges::contiguous_range auto... bytes) noexcept
+	{
+		CryptoPP::SHA1 sha;
+		(sha.Update(data(bytes), size(bytes)), ...);
+		return sha1_final(sha);
+	}
+
 	std::string sha1(std::span<const U8> data) noexcept
 	{
 		return sha1_impl(data);
@@ -41,4 +45,44 @@ namespace nesem::util
 	{
 		return sha1_impl(prgrom, chrrom);
 	}
+
+	std::optional<std::string> sha1(std::istream &stream) noexcept
+	{
+		constexpr size_t chunk_size = 64 * 1024;
+
+		auto chunk = std::array<U8, chunk_size>{};
+		auto sha = Sha1();
+
+		while (stream.read(reinterpret_cast<char *>(data(chunk)), std::streamsize(size(chunk))) || stream.gcount() > 0)
+			sha.update(std::span(chunk).first(size_t(stream.gcount())));
+
+		if (stream.bad())
+			return std::nullopt;
+
+		return sha.finish();
+	}
+
+	struct Sha1::Core
+	{
+		CryptoPP::SHA1 sha;
+	};
+
+	Sha1::Sha1() noexcept
+		: core(std::make_unique<Core>())
+	{
+	}
+
+	Sha1::~Sha1() = default;
+	Sha1::Sha1(Sha1 &&other) noexcept = default;
+	Sha1 &Sha1::operator=(Sha1 &&other) noexcept = default;
+
+	void Sha1::update(std::span<const U8> data) noexcept
+	{
+		core->sha.Update(data.data(), data.size());
+	}
+
+	std::string Sha1::finish() noexcept
+	{
+		return sha1_final(core->sha);
+	}
 }
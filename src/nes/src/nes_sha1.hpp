@@ -1,5 +1,8 @@
 #pragma once
 
+#include <istream>
+#include <memory>
+#include <optional>
 #include <span>
 #include <string>
 
@@ -9,4 +12,30 @@ namespace nesem::util
 {
 	std::string sha1(std::span<const U8> data) noexcept;
 	std::string sha1(std::span<const U8> prgrom, std::span<const U8> chrrom) noexcept;
+
+	// hash the rest of a stream a chunk at a time, so a file of any size takes the same memory. Returns nothing if
+	// reading fails before the end
+	std::optional<std::string> sha1(std::istream &stream) noexcept;
+
+	// for data that turns up a piece at a time, gives the same hash as hashing all of it at once
+	class Sha1 final
+	{
+	public:
+		Sha1() noexcept;
+		~Sha1();
+
+		Sha1(Sha1 &&other) noexcept;
+		Sha1 &operator=(Sha1 &&other) noexcept;
+		Sha1(const Sha1 &other) noexcept = delete;
+		Sha1 &operator=(const Sha1 &other) noexcept = delete;
+
+		void update(std::span<const U8> data) noexcept;
+
+		// the hash of everything so far, after which it starts again from nothing
+		std::string finish() noexcept;
+
+	private:
+		struct Core;
+		std::unique_ptr<Core> core;
+	};
 }
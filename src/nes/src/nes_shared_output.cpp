@@ -0,0 +1,400 @@
+#include "nes_shared_output.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <bit>
+#include <new>
+#include <string>
+#include <utility>
+
+#include <util/logging.hpp>
+
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(__EMSCRIPTEN__)
+#	define NESEM_SHARED_MEMORY 1
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#else
+#	define NESEM_SHARED_MEMORY 0
+#endif
+
+namespace
+{
+	using namespace nesem;
+
+	constexpr size_t align_up(size_t value, size_t alignment) noexcept
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	size_t bytes_per_pixel(NesSharedPixelFormat format) noexcept
+	{
+		return format == NesSharedPixelFormat::rgba ? sizeof(U32) : sizeof(U16);
+	}
+
+	// posix wants a single leading slash and no others
+	std::string segment_name(std::string_view name) noexcept
+	{
+		auto result = std::string(name.starts_with('/') ? "" : "/");
+		result += name;
+		std::ranges::replace(result.begin() + 1, result.end(), '/', '_');
+		return result;
+	}
+
+	// a mapping of a named shared memory segment, unlinked on destruction if this side created it
+	class SharedMemory final
+	{
+	public:
+		SharedMemory(const SharedMemory &other) = delete;
+		SharedMemory &operator=(const SharedMemory &other) = delete;
+
+		SharedMemory(std::string name, void *memory, size_t size, bool owner) noexcept
+			: name(std::move(name)), memory(memory), size(size), owner(owner)
+		{
+		}
+
+		~SharedMemory()
+		{
+#if NESEM_SHARED_MEMORY
+			munmap(memory, size);
+
+			if (owner)
+				shm_unlink(name.c_str());
+#endif
+		}
+
+		[[nodiscard]] std::byte *data() const noexcept
+		{
+			return static_cast<std::byte *>(memory);
+		}
+
+		[[nodiscard]] size_t bytes() const noexcept
+		{
+			return size;
+		}
+
+		static std::unique_ptr<SharedMemory> create(const std::string &name, size_t size) noexcept
+		{
+#if NESEM_SHARED_MEMORY
+			// anything left behind by a process that didn't clean up would have the wrong size and readers attached
+			shm_unlink(name.c_str());
+
+			int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+			if (fd < 0)
+			{
+				LOG_WARN("Could not create shared memory {}, reason: {}", name, std::strerror(errno));
+				return nullptr;
+			}
+
+			void *memory = MAP_FAILED;
+			if (ftruncate(fd, off_t(size)) == 0)
+				memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+			auto error = errno;
+			close(fd);
+
+			if (memory == MAP_FAILED)
+			{
+				LOG_WARN("Could not map shared memory {}, reason: {}", name, std::strerror(error));
+				shm_unlink(name.c_str());
+				return nullptr;
+			}
+
+			return std::make_unique<SharedMemory>(name, memory, size, true);
+#else
+			LOG_WARN("Shared memory {} of {} bytes not created, shared memory isn't supported on this platform", name, size);
+			return nullptr;
+#endif
+		}
+
+		static std::unique_ptr<SharedMemory> open(const std::string &name) noexcept
+		{
+#if NESEM_SHARED_MEMORY
+			int fd = shm_open(name.c_str(), O_RDONLY, 0);
+			if (fd < 0)
+			{
+				LOG_WARN("Could not open shared memory {}, reason: {}", name, std::strerror(errno));
+				return nullptr;
+			}
+
+			struct stat info{};
+			void *memory = MAP_FAILED;
+
+			if (fstat(fd, &info) == 0 && info.st_size > 0)
+				memory = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+
+			close(fd);
+
+			if (memory == MAP_FAILED)
+			{
+				LOG_WARN("Could not map shared memory {}", name);
+				return nullptr;
+			}
+
+			return std::make_unique<SharedMemory>(name, memory, size_t(info.st_size), false);
+#else
+			LOG_WARN("Shared memory {} not opened, shared memory isn't supported on this platform", name);
+			return nullptr;
+#endif
+		}
+
+	private:
+		std::string name;
+		void *memory;
+		size_t size;
+		bool owner;
+	};
+}
+
+namespace nesem
+{
+	struct NesSharedOutput::Core
+	{
+		std::unique_ptr<SharedMemory> memory;
+		std::array<U32, palette_size> palette{};
+	};
+
+	NesSharedOutput NesSharedOutput::create(std::string_view name, NesSharedPixelFormat format, U32 sample_rate, U32 audio_capacity) noexcept
+	{
+		audio_capacity = std::bit_ceil(std::max(audio_capacity, U32{2}));
+
+		auto frame_size = size_t{NesSharedLayout::width} * NesSharedLayout::height * bytes_per_pixel(format);
+		auto frames_offset = align_up(sizeof(NesSharedLayout), 64);
+		auto audio_offset = align_up(frames_offset + NesSharedLayout::buffer_count * frame_size, 64);
+		auto size = audio_offset + audio_capacity * sizeof(float);
+
+		auto memory = SharedMemory::create(segment_name(name), size);
+		if (!memory)
+			return NesSharedOutput();
+
+		auto *layout = new (memory->data()) NesSharedLayout{
+			.pixel_format = format,
+			.bytes_per_pixel = U32(bytes_per_pixel(format)),
+			.sample_rate = sample_rate,
+			.audio_capacity = audio_capacity,
+			.frame_size = frame_size,
+			.frames_offset = frames_offset,
+			.audio_offset = audio_offset,
+		};
+
+		auto result = NesSharedOutput(std::make_unique<Core>(Core{.memory = std::move(memory)}));
+		result.layout = layout;
+		result.palette = result.core->palette.data();
+		result.audio = std::bit_cast<float *>(result.core->memory->data() + audio_offset);
+		result.audio_mask = audio_capacity - 1;
+
+		LOG_INFO("Publishing output to shared memory {}, {} bytes", segment_name(name), size);
+		return result;
+	}
+
+	NesSharedOutput::NesSharedOutput() noexcept = default;
+
+	NesSharedOutput::NesSharedOutput(std::unique_ptr<Core> &&core) noexcept
+		: core(std::move(core))
+	{
+	}
+
+	NesSharedOutput::~NesSharedOutput() = default;
+
+	NesSharedOutput::NesSharedOutput(NesSharedOutput &&other) noexcept
+		: core(std::move(other.core)),
+		  layout(std::exchange(other.layout, nullptr)),
+		  indexed_pixels(std::exchange(other.indexed_pixels, nullptr)),
+		  rgba_pixels(std::exchange(other.rgba_pixels, nullptr)),
+		  palette(std::exchange(other.palette, nullptr)),
+		  audio(std::exchange(other.audio, nullptr)),
+		  audio_mask(std::exchange(other.audio_mask, 0)),
+		  audio_written(std::exchange(other.audio_written, 0)),
+		  back_buffer(std::exchange(other.back_buffer, 0)),
+		  drawing(std::exchange(other.drawing, false))
+	{
+	}
+
+	NesSharedOutput &NesSharedOutput::operator=(NesSharedOutput &&other) noexcept
+	{
+		if (this != &other)
+		{
+			core = std::move(other.core);
+			layout = std::exchange(other.layout, nullptr);
+			indexed_pixels = std::exchange(other.indexed_pixels, nullptr);
+			rgba_pixels = std::exchange(other.rgba_pixels, nullptr);
+			palette = std::exchange(other.palette, nullptr);
+			audio = std::exchange(other.audio, nullptr);
+			audio_mask = std::exchange(other.audio_mask, 0);
+			audio_written = std::exchange(other.audio_written, 0);
+			back_buffer = std::exchange(other.back_buffer, 0);
+			drawing = std::exchange(other.drawing, false);
+		}
+
+		return *this;
+	}
+
+	void NesSharedOutput::set_palette(std::span<const U32, palette_size> colors) noexcept
+	{
+		if (core)
+			std::ranges::copy(colors, core->palette.begin());
+	}
+
+	void NesSharedOutput::begin_frame() noexcept
+	{
+		// never the buffer readers were last pointed at, so they get a whole frame to copy it
+		back_buffer = (layout->latest.load(std::memory_order_relaxed) + 1) % NesSharedLayout::buffer_count;
+
+		auto &sequence = layout->sequence[back_buffer];
+		sequence.store(sequence.load(std::memory_order_relaxed) | 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		auto *pixels = core->memory->data() + layout->frames_offset + back_buffer * layout->frame_size;
+
+		if (layout->pixel_format == NesSharedPixelFormat::rgba)
+			rgba_pixels = std::bit_cast<U32 *>(pixels);
+		else
+			indexed_pixels = std::bit_cast<U16 *>(pixels);
+
+		drawing = true;
+	}
+
+	void NesSharedOutput::frame_complete() noexcept
+	{
+		if (!drawing)
+			return;
+
+		auto frame = layout->frame_count.load(std::memory_order_relaxed);
+
+		layout->sequence[back_buffer].store(2 * (frame + 1), std::memory_order_release);
+		layout->latest.store(back_buffer, std::memory_order_release);
+		layout->frame_count.store(frame + 1, std::memory_order_release);
+
+		drawing = false;
+	}
+
+	struct NesSharedOutputReader::Core
+	{
+		std::unique_ptr<SharedMemory> memory;
+
+		[[nodiscard]] const NesSharedLayout &layout() const noexcept
+		{
+			return *std::bit_cast<const NesSharedLayout *>(memory->data());
+		}
+	};
+
+	NesSharedOutputReader NesSharedOutputReader::open(std::string_view name) noexcept
+	{
+		auto memory = SharedMemory::open(segment_name(name));
+		if (!memory)
+			return NesSharedOutputReader();
+
+		auto core = std::make_unique<Core>(Core{.memory = std::move(memory)});
+		auto size = core->memory->bytes();
+
+		if (size < sizeof(NesSharedLayout))
+		{
+			LOG_WARN("Shared memory {} is too small to be shared output", segment_name(name));
+			return NesSharedOutputReader();
+		}
+
+		// the writer may be another build entirely, so check everything before trusting any offsets
+		const auto &layout = core->layout();
+		bool valid = layout.magic == NesSharedLayout::magic_value &&
+			layout.version == NesSharedLayout::version_value &&
+			layout.frame_size == U64{NesSharedLayout::width} * NesSharedLayout::height * layout.bytes_per_pixel &&
+			layout.frames_offset >= sizeof(NesSharedLayout) &&
+			layout.frames_offset + NesSharedLayout::buffer_count * layout.frame_size <= layout.audio_offset &&
+			std::has_single_bit(layout.audio_capacity) &&
+			layout.audio_offset + U64{layout.audio_capacity} * sizeof(float) <= size;
+
+		if (!valid)
+		{
+			LOG_WARN("Shared memory {} isn't shared output this version understands", segment_name(name));
+			return NesSharedOutputReader();
+		}
+
+		return NesSharedOutputReader(std::move(core));
+	}
+
+	NesSharedOutputReader::NesSharedOutputReader() noexcept = default;
+
+	NesSharedOutputReader::NesSharedOutputReader(std::unique_ptr<Core> &&core) noexcept
+		: core(std::move(core))
+	{
+	}
+
+	NesSharedOutputReader::~NesSharedOutputReader() = default;
+	NesSharedOutputReader::NesSharedOutputReader(NesSharedOutputReader &&other) noexcept = default;
+	NesSharedOutputReader &NesSharedOutputReader::operator=(NesSharedOutputReader &&other) noexcept = default;
+
+	const NesSharedLayout &NesSharedOutputReader::layout() const noexcept
+	{
+		CHECK(core != nullptr, "no layout in an empty reader");
+		return core->layout();
+	}
+
+	std::optional<U64> NesSharedOutputReader::read_frame(std::span<std::byte> pixels) const noexcept
+	{
+		if (!core)
+			return std::nullopt;
+
+		const auto &shared = core->layout();
+		if (pixels.size() < shared.frame_size)
+		{
+			LOG_WARN("Buffer of {} bytes is too small for a frame of {} bytes", pixels.size(), shared.frame_size);
+			return std::nullopt;
+		}
+
+		// a torn copy means the emulator drew over the buffer mid copy, so trying again gets a newer frame
+		for (int attempt = 0; attempt < 4; ++attempt)
+		{
+			if (shared.frame_count.load(std::memory_order_acquire) == 0)
+				return std::nullopt;
+
+			auto buffer = shared.latest.load(std::memory_order_acquire) % NesSharedLayout::buffer_count;
+			auto before = shared.sequence[buffer].load(std::memory_order_acquire);
+
+			if (before == 0 || (before & 1) != 0)
+				continue;
+
+			std::memcpy(pixels.data(), core->memory->data() + shared.frames_offset + buffer * shared.frame_size, shared.frame_size);
+			std::atomic_thread_fence(std::memory_order_acquire);
+
+			if (shared.sequence[buffer].load(std::memory_order_relaxed) == before)
+				return before / 2 - 1;
+		}
+
+		return std::nullopt;
+	}
+
+	size_t NesSharedOutputReader::read_audio(U64 &position, std::span<float> samples) const noexcept
+	{
+		if (!core)
+			return 0;
+
+		const auto &shared = core->layout();
+		const auto *ring = std::bit_cast<const float *>(core->memory->data() + shared.audio_offset);
+		const U64 capacity = shared.audio_capacity;
+		const U64 mask = capacity - 1;
+
+		auto written = shared.audio_written.load(std::memory_order_acquire);
+		position = std::clamp(position, written > capacity ? written - capacity : 0, written);
+
+		auto count = size_t(std::min<U64>(written - position, samples.size()));
+		for (size_t i = 0; i < count; ++i)
+			samples[i] = ring[(position + i) & mask];
+
+		// samples the emulator wrote over while we copied them are lost
+		std::atomic_thread_fence(std::memory_order_acquire);
+		auto now = shared.audio_written.load(std::memory_order_relaxed);
+
+		if (now - position > capacity)
+		{
+			auto lost = size_t(std::min<U64>(now - capacity - position, count));
+			std::copy(samples.begin() + ptrdiff_t(lost), samples.begin() + ptrdiff_t(count), samples.begin());
+
+			count -= lost;
+			position += lost;
+		}
+
+		position += count;
+		return count;
+	}
+}
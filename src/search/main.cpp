@@ -0,0 +1,520 @@
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <expected>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fmt/format.h>
+#include <fmt/ranges.h>
+#include <fmt/std.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+
+#include <nes.hpp>
+#include <nes_movie.hpp>
+#include <nes_search.hpp>
+
+namespace io
+{
+	using fmt::format;
+	using fmt::print;
+	using fmt::println;
+}
+
+enum class Compare
+{
+	equal,
+	not_equal,
+	less,
+	less_equal,
+	greater,
+	greater_equal,
+};
+
+// a byte of work ram compared against a value
+struct Condition
+{
+	size_t addr = 0;
+	Compare compare = Compare::equal;
+	nesem::U8 value = 0;
+
+	bool operator()(std::span<const nesem::U8> ram) const noexcept
+	{
+		auto byte = ram[addr];
+
+		switch (compare)
+		{
+		case Compare::equal:
+			return byte == value;
+		case Compare::not_equal:
+			return byte != value;
+		case Compare::less:
+			return byte < value;
+		case Compare::less_equal:
+			return byte <= value;
+		case Compare::greater:
+			return byte > value;
+		case Compare::greater_equal:
+			return byte >= value;
+		}
+
+		return false;
+	}
+};
+
+// a little endian value in work ram to maximize
+struct Score
+{
+	size_t addr = 0;
+	size_t bytes = 1;
+
+	double operator()(std::span<const nesem::U8> ram) const noexcept
+	{
+		double result = 0.0;
+		for (size_t i = bytes; i > 0; --i)
+			result = result * 256.0 + ram[addr + i - 1];
+
+		return result;
+	}
+};
+
+struct Options
+{
+	std::string exe{};
+	std::filesystem::path rom_filename{};
+	std::optional<std::filesystem::path> movie_filename{};
+	std::vector<Condition> goal{};
+	std::optional<Score> score{};
+	nesem::NesSearchSettings search{};
+	std::filesystem::path output_dir{"."};
+	bool verbose{};
+	bool show_help{};
+};
+
+constexpr size_t ram_size = 0x800;
+
+// decimal, or hex with a leading $ or 0x
+template <typename T>
+std::optional<T> parse_number(std::string_view text)
+{
+	int base = 10;
+
+	if (text.starts_with('$'))
+	{
+		text.remove_prefix(1);
+		base = 16;
+	}
+	else if (text.starts_with("0x") || text.starts_with("0X"))
+	{
+		text.remove_prefix(2);
+		base = 16;
+	}
+
+	T value{};
+	auto [ptr, ec] = std::from_chars(text.data(), text.data() + text.size(), value, base);
+	if (text.empty() || ec != std::errc{} || ptr != text.data() + text.size())
+		return std::nullopt;
+
+	return value;
+}
+
+std::optional<size_t> parse_addr(std::string_view text)
+{
+	auto addr = parse_number<size_t>(text);
+	if (!addr || *addr >= ram_size)
+		return std::nullopt;
+
+	return addr;
+}
+
+std::expected<Condition, std::string> parse_condition(std::string_view text)
+{
+	struct Operator
+	{
+		std::string_view text;
+		Compare compare;
+	};
+
+	// longest first so '>=' isn't taken for '>'
+	constexpr Operator operators[] = {
+		{"!=", Compare::not_equal},
+		{"<=", Compare::less_equal},
+		{">=", Compare::greater_equal},
+		{"=", Compare::equal},
+		{"<", Compare::less},
+		{">", Compare::greater},
+	};
+
+	for (const auto &op : operators)
+	{
+		auto pos = text.find(op.text);
+		if (pos == std::string_view::npos)
+			continue;
+
+		auto addr = parse_addr(text.substr(0, pos));
+		auto value = parse_number<nesem::U8>(text.substr(pos + op.text.size()));
+
+		if (!addr || !value)
+			break;
+
+		return Condition{.addr = *addr, .compare = op.compare, .value = *value};
+	}
+
+	return std::unexpected(io::format("'{}' is not a goal, expected <addr><op><value> with op one of = != < <= > >=", text));
+}
+
+std::expected<Score, std::string> parse_score(std::string_view text)
+{
+	auto colon = text.find(':');
+	auto addr = parse_addr(text.substr(0, colon));
+	auto bytes = colon == std::string_view::npos ? std::optional<size_t>(1) : parse_number<size_t>(text.substr(colon + 1));
+
+	if (!addr || !bytes || *bytes == 0 || *bytes > 8 || *addr + *bytes > ram_size)
+		return std::unexpected(io::format("'{}' is not a score, expected <addr>[:<bytes>]", text));
+
+	return Score{.addr = *addr, .bytes = *bytes};
+}
+
+std::expected<Options, std::string> parse_command_line(std::span<char *> args)
+{
+	auto it = args.begin();
+	const auto end = args.end();
+
+	Options result;
+
+	auto next_arg = [&](std::string_view arg) -> std::expected<std::string_view, std::string> {
+		if (++it == end)
+			return std::unexpected(io::format("'{}' specified, but no argument given", arg));
+
+		return std::string_view{*it};
+	};
+
+	auto next_number = [&]<typename T>(std::string_view arg, T &out) -> std::expected<void, std::string> {
+		auto value = next_arg(arg);
+		if (!value)
+			return std::unexpected(value.error());
+
+		auto number = parse_number<T>(*value);
+		if (!number)
+			return std::unexpected(io::format("'{}' is not a number for '{}'", *value, arg));
+
+		out = *number;
+		return {};
+	};
+
+	// skip the first argument (should be the program name)
+	while (++it != end)
+	{
+		auto arg = std::string_view{*it};
+
+		if (!arg.starts_with('-'))
+		{
+			if (result.rom_filename.empty())
+				result.rom_filename = arg;
+			else
+				return std::unexpected(io::format("rom '{}', but was already set to '{}'", arg, result.rom_filename));
+		}
+		else if (arg == "--help" || arg == "-h" || arg == "-?")
+		{
+			result.show_help = true;
+		}
+		else if (arg == "--movie" || arg == "-m")
+		{
+			auto value = next_arg(arg);
+			if (!value)
+				return std::unexpected(value.error());
+
+			result.movie_filename = *value;
+		}
+		else if (arg == "--goal" || arg == "-g")
+		{
+			auto value = next_arg(arg);
+			if (!value)
+				return std::unexpected(value.error());
+
+			auto condition = parse_condition(*value);
+			if (!condition)
+				return std::unexpected(condition.error());
+
+			result.goal.push_back(*condition);
+		}
+		else if (arg == "--score" || arg == "-s")
+		{
+			auto value = next_arg(arg);
+			if (!value)
+				return std::unexpected(value.error());
+
+			auto score = parse_score(*value);
+			if (!score)
+				return std::unexpected(score.error());
+
+			result.score = *score;
+		}
+		else if (arg == "--depth" || arg == "-d")
+		{
+			if (auto ok = next_number(arg, result.search.max_depth); !ok)
+				return std::unexpected(ok.error());
+		}
+		else if (arg == "--beam" || arg == "-b")
+		{
+			if (auto ok = next_number(arg, result.search.beam_width); !ok)
+				return std::unexpected(ok.error());
+		}
+		else if (arg == "--hold" || arg == "-k")
+		{
+			if (auto ok = next_number(arg, result.search.frames_per_action); !ok)
+				return std::unexpected(ok.error());
+		}
+		else if (arg == "--best" || arg == "-n")
+		{
+			if (auto ok = next_number(arg, result.search.best_count); !ok)
+				return std::unexpected(ok.error());
+		}
+		else if (arg == "--threads" || arg == "-t")
+		{
+			if (auto ok = next_number(arg, result.search.threads); !ok)
+				return std::unexpected(ok.error());
+		}
+		else if (arg == "--out" || arg == "-o")
+		{
+			auto value = next_arg(arg);
+			if (!value)
+				return std::unexpected(value.error());
+
+			result.output_dir = *value;
+		}
+		else if (arg == "--verbose" || arg == "-v")
+		{
+			result.verbose = true;
+		}
+		else
+			return std::unexpected(io::format("unknown option '{}'", arg));
+	}
+
+	return result;
+}
+
+void print_help(std::string_view app)
+{
+	io::println("USAGE: {} [ops] <rom filename>", app);
+	io::println("Searches for controller input that reaches a goal in ram, saves the best sequences as movies and prints a json report");
+	io::println("Addresses and values are decimal, or hex with a leading $ or 0x");
+	io::println("OPTIONS:");
+	io::println("--help,-h,-?          - print this help");
+	io::println("--movie,-m   <file>   - search from the end of a movie recorded for the rom, default right after power on");
+	io::println("--goal,-g    <cond>   - <addr><op><value> that must hold, with op one of = != < <= > >=. May be repeated");
+	io::println("--score,-s   <addr>   - <addr>[:<bytes>] little endian value in ram to maximize, keeping the best states");
+	io::println("--depth,-d   <count>  - most actions in a sequence, default 60");
+	io::println("--beam,-b    <count>  - states kept at each depth, default 256");
+	io::println("--hold,-k    <frames> - frames each action is held for, default 8");
+	io::println("--best,-n    <count>  - sequences to save, default 4");
+	io::println("--threads,-t <count>  - threads to search with, default one per core");
+	io::println("--out,-o     <dir>    - directory for the movies and report, default current directory");
+	io::println("--verbose,-v          - log to stderr while running");
+}
+
+void print_error(std::string_view msg)
+{
+	io::println(stderr, "{}", msg);
+}
+
+// quote and escape a path for a json string
+std::string json_path(const std::filesystem::path &path)
+{
+	std::string result = "\"";
+
+	for (char c : path.generic_string())
+	{
+		if (c == '"' || c == '\\')
+			result += '\\';
+
+		if (static_cast<unsigned char>(c) < 0x20)
+			result += io::format("\\u{:04x}", static_cast<unsigned char>(c));
+		else
+			result += c;
+	}
+
+	result += '"';
+	return result;
+}
+
+// play a movie to its end to get the state to search from
+std::optional<std::vector<std::byte>> movie_end_state(const Options &options)
+{
+	using namespace nesem;
+
+	auto movie = NesMovie::load(*options.movie_filename);
+	if (!movie)
+		return std::nullopt;
+
+	auto player = NesMoviePlayer(std::move(*movie));
+
+	auto nes = std::make_unique<Nes>(NesSettings{
+		.error = [](std::string_view) {},
+		.player1 = std::make_unique<NesController>([&] { return player.poll(0); }),
+		.player2 = std::make_unique<NesController>([&] { return player.poll(1); }),
+		.nes20db_filename = options.search.nes20db_filename,
+	});
+
+	nes->enable_video(false);
+	nes->enable_audio(false);
+
+	if (!nes->load_rom(options.rom_filename) || !player.start(*nes))
+		return std::nullopt;
+
+	while (player.run_frame())
+		;
+
+	auto state = std::vector<std::byte>(nes->state_size());
+	if (nes->save_state(state) == 0)
+		return std::nullopt;
+
+	return state;
+}
+
+int run(Options &options)
+{
+	namespace fs = std::filesystem;
+	using namespace nesem;
+
+	std::error_code ec;
+	fs::create_directories(options.output_dir, ec);
+	if (ec)
+	{
+		print_error(io::format("could not create output directory: {}", ec.message()));
+		return EXIT_FAILURE;
+	}
+
+	options.search.rom = options.rom_filename;
+
+	if (options.movie_filename)
+	{
+		auto state = movie_end_state(options);
+		if (!state)
+		{
+			print_error(io::format("could not play movie {} on {}", *options.movie_filename, options.rom_filename));
+			return EXIT_FAILURE;
+		}
+
+		options.search.start_state = std::move(*state);
+	}
+
+	NesSearchGoalFn goal;
+	if (!options.goal.empty())
+	{
+		goal = [&conditions = options.goal](std::span<const U8> ram) {
+			for (const auto &condition : conditions)
+			{
+				if (!condition(ram))
+					return false;
+			}
+
+			return true;
+		};
+	}
+
+	NesSearchScoreFn score;
+	if (options.score)
+		score = *options.score;
+
+	auto result = search_inputs(options.search, std::move(goal), std::move(score));
+	if (result.best.empty())
+	{
+		print_error(io::format("could not search {}", options.rom_filename));
+		return EXIT_FAILURE;
+	}
+
+	bool reached_goal = result.best.front().reached_goal;
+	std::vector<std::string> solutions;
+
+	for (size_t i = 0; i < result.best.size(); ++i)
+	{
+		const auto &solution = result.best[i];
+
+		auto filename = options.output_dir / options.rom_filename.stem().concat(io::format("-search-{}.nesm", i));
+		if (!solution.movie.save(filename))
+		{
+			print_error(io::format("could not write {}", filename));
+			return EXIT_FAILURE;
+		}
+
+		solutions.push_back(io::format("\t\t{{\"movie\": {}, \"frames\": {}, \"score\": {}, \"actions\": [{}]}}", json_path(filename), solution.frames, solution.score, fmt::join(solution.actions, ", ")));
+	}
+
+	const auto &stats = result.stats;
+	auto seconds = std::chrono::duration<double>(stats.elapsed).count();
+
+	std::string json = "{\n";
+	json += io::format("\t\"rom\": {},\n", json_path(options.rom_filename));
+	json += io::format("\t\"reached_goal\": {},\n", reached_goal);
+	json += io::format("\t\"solutions\": [\n{}\n\t],\n", fmt::join(solutions, ",\n"));
+	json += io::format("\t\"stats\": {{\"nodes\": {}, \"duplicates\": {}, \"depth\": {}, \"frames\": {}, \"threads\": {}, \"steals\": {}, \"utilization\": {:.3f}, \"wall_seconds\": {:.6f}, \"fps\": {:.2f}}}\n",
+		stats.nodes, stats.duplicates, stats.depth, stats.frames, stats.pool.threads, stats.pool.steals, stats.pool.utilization(), seconds, stats.frames_per_second());
+	json += "}";
+
+	io::println("{}", json);
+
+	auto report_file = std::ofstream(options.output_dir / options.rom_filename.stem().concat("-search.json"), std::ios::trunc);
+	report_file << json << '\n';
+
+	// finding the best scores without a goal is a success, as that is all that was asked for
+	return reached_goal || options.goal.empty() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc == 0)
+	{
+		// This "should" never happen. Technically possible, but windows and unix-likes always provide at least 1 argument
+		print_error("Commandline empty?!?!");
+		return EXIT_FAILURE;
+	}
+
+	auto exe = std::filesystem::path(argv[0]).filename().string();
+
+	auto options = parse_command_line({argv, argv + argc});
+
+	if (!options.has_value())
+	{
+		print_error(options.error());
+		print_help(exe);
+		return EXIT_FAILURE;
+	}
+
+	options->exe = exe;
+
+	if (options->show_help)
+	{
+		print_help(exe);
+		return EXIT_SUCCESS;
+	}
+
+	if (options->rom_filename.empty())
+	{
+		print_error("No rom specified");
+		print_help(exe);
+		return EXIT_FAILURE;
+	}
+
+	if (options->goal.empty() && !options->score)
+	{
+		print_error("Nothing to search for, give a goal or a score");
+		print_help(exe);
+		return EXIT_FAILURE;
+	}
+
+	// stdout is for the report, so anything logged goes to stderr, and only when asked for
+	auto logger = spdlog::stderr_color_mt("nesem-search");
+	logger->set_level(options->verbose ? spdlog::level::info : spdlog::level::off);
+	spdlog::set_default_logger(std::move(logger));
+
+	return run(*options);
+}
@@ -225,6 +225,7 @@ struct Options
 	std::optional<std::string> symbol_name{};
 	std::optional<std::string> namespace_name{};
 	CompressType compression{};
+	bool view{};
 	bool show_help{};
 	bool test_mode{};
 };
@@ -236,6 +237,7 @@ void print_options(const Options &options)
 	io::println("output_file_name: {}", options.output_file_name);
 	io::println("symbol_name: {}", options.symbol_name);
 	io::println("compression: {}", to_string(options.compression));
+	io::println("view: {}", options.view);
 	io::println("show_help: {}", options.show_help);
 }
 
@@ -296,12 +298,19 @@ std::expected<Options, std::string> parse_command_line(std::span<char *> args)
 			else
 				return std::unexpected(io::format("'{}' specified, but no argument given", arg));
 		}
+		else if (arg == "--view")
+		{
+			result.view = true;
+		}
 		else if (arg == "--test")
 		{
 			result.test_mode = true;
 		}
 	}
 
+	if (result.view && result.compression != CompressType::None)
+		return std::unexpected("'--view' can't be used with compression");
+
 	return result;
 }
 
@@ -314,6 +323,7 @@ void print_help(std::string_view app)
 	io::println("--symbol,-s    <name> - name of getter function, defaults to <input filename> (invalid characters converted to '_')");
 	io::println("--compress,-c  <type> - compress using algorithm <type>: one of none, deflate, gzip, zlib, default none");
 	io::println("--namespace,-n <name> - wrap function in namespace <name>");
+	io::println("--view                - getter returns a span of the embedded data instead of a copy, needs no compression");
 	io::println("--test                - test input file against each compression type and print results");
 }
 
@@ -359,14 +369,28 @@ void write(const Options &options, size_t uncompressed_size, std::span<unsigned
 		if (!header_file)
 			on_error(options, io::format("error opening {} for write", header_path));
 
-		io::print(header_file,
-			R"(#pragma once
+		if (options.view)
+		{
+			io::print(header_file,
+				R"(#pragma once
+
+#include <span>
+
+{1}std::span<const unsigned char> {0}();
+{2})",
+				fn_name, ns_start, ns_end);
+		}
+		else
+		{
+			io::print(header_file,
+				R"(#pragma once
 
 #include <vector>
 
 {1}std::vector<unsigned char> {0}();
 {2})",
-			fn_name, ns_start, ns_end);
+				fn_name, ns_start, ns_end);
+		}
 	}
 
 	{
@@ -395,8 +419,24 @@ namespace
 
 		auto data_name = io::format("{0}_data", fn_name);
 
-		io::println(source_file,
-			R"(	// clang-format on
+		if (options.view)
+		{
+			io::println(source_file,
+				R"(	// clang-format on
+	}};
+}}
+
+{1}std::span<const unsigned char> {0}()
+{{
+	return {3};
+}}
+{2})",
+				fn_name, ns_start, ns_end, data_name);
+		}
+		else
+		{
+			io::println(source_file,
+				R"(	// clang-format on
 	}};
 
 	{3}
@@ -407,7 +447,8 @@ namespace
 	{4}
 }}
 {2})",
-			fn_name, ns_start, ns_end, get_decompressor_text(options.compression, uncompressed_size), call_decompressor_text(options.compression, data_name));
+				fn_name, ns_start, ns_end, get_decompressor_text(options.compression, uncompressed_size), call_decompressor_text(options.compression, data_name));
+		}
 	}
 }
 
@@ -0,0 +1,152 @@
+#include <cstdio>
+#include <cstdlib>
+#include <expected>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+#include <fmt/format.h>
+#include <fmt/std.h>
+
+#include "nes_20db.hpp"
+
+namespace io
+{
+	using fmt::format;
+	using fmt::print;
+	using fmt::println;
+}
+
+struct Options
+{
+	std::string exe{};
+	std::filesystem::path input_filename{};
+	std::optional<std::filesystem::path> output_filename{};
+	bool show_help{};
+};
+
+std::expected<Options, std::string> parse_command_line(std::span<char *> args)
+{
+	auto it = args.begin();
+	const auto end = args.end();
+
+	Options result;
+
+	// skip the first argument (should be the program name)
+	while (++it != end)
+	{
+		auto arg = std::string_view{*it};
+
+		if (!arg.starts_with('-'))
+		{
+			if (result.input_filename.empty())
+				result.input_filename = arg;
+			else
+				return std::unexpected(io::format("input file '{}', but was already set to '{}'", arg, result.input_filename));
+		}
+		else if (arg == "--help" || arg == "-h" || arg == "-?")
+		{
+			result.show_help = true;
+		}
+		else if (arg == "--out" || arg == "-o")
+		{
+			if (++it != end)
+				result.output_filename = *it;
+			else
+				return std::unexpected(io::format("'{}' specified, but no argument given", arg));
+		}
+		else
+			return std::unexpected(io::format("unknown option '{}'", arg));
+	}
+
+	return result;
+}
+
+void print_help(std::string_view app)
+{
+	io::println("USAGE: {} [ops] <nes20db.xml>", app);
+	io::println("Converts nes20db.xml to the binary index nesem looks roms up in, to embed or pass in place of the xml");
+	io::println("OPTIONS:");
+	io::println("--help,-h,-?    - print this help");
+	io::println("--out,-o <file> - file to write, defaults to the input with the extension .bin");
+}
+
+void print_error(std::string_view msg)
+{
+	io::println(stderr, "{}", msg);
+}
+
+int run(const Options &options)
+{
+	auto roms = nesem::load_nes20db_xml(options.input_filename);
+	if (roms.empty())
+	{
+		print_error(io::format("no roms loaded from {}", options.input_filename));
+		return EXIT_FAILURE;
+	}
+
+	auto index = nesem::build_nes20db_index(roms);
+
+	// check it reads back before anything relies on it
+	auto check = nesem::Nes20dbIndex::open(index);
+	if (!check || !check->find(roms.front().rom.sha1))
+	{
+		print_error("built index does not read back");
+		return EXIT_FAILURE;
+	}
+
+	auto output_filename = options.output_filename.value_or(std::filesystem::path(options.input_filename).replace_extension(".bin"));
+
+	auto file = std::ofstream(output_filename, std::ios::binary | std::ios::trunc);
+	file.write(reinterpret_cast<const char *>(index.data()), static_cast<std::streamsize>(index.size()));
+
+	if (!file)
+	{
+		print_error(io::format("error writing {}", output_filename));
+		return EXIT_FAILURE;
+	}
+
+	io::println("{} roms, {} indexed in {} bytes, digest {:016X}", roms.size(), check->size(), index.size(), check->fingerprint());
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc == 0)
+	{
+		// This "should" never happen. Technically possible, but windows and unix-likes always provide at least 1 argument
+		print_error("Commandline empty?!?!");
+		return EXIT_FAILURE;
+	}
+
+	auto exe = std::filesystem::path(argv[0]).filename().string();
+
+	auto options = parse_command_line({argv, argv + argc});
+
+	if (!options.has_value())
+	{
+		print_error(options.error());
+		print_help(exe);
+		return EXIT_FAILURE;
+	}
+
+	options->exe = exe;
+
+	if (options->show_help)
+	{
+		print_help(exe);
+		return EXIT_SUCCESS;
+	}
+
+	if (options->input_filename.empty())
+	{
+		print_error("No filename specified");
+		print_help(exe);
+		return EXIT_FAILURE;
+	}
+
+	return run(*options);
+}
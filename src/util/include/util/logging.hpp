@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <filesystem>
 #include <span>
 #include <utility>
@@ -112,14 +113,14 @@ namespace util::detail::sinks
 #define LOG_ERROR SPDLOG_ERROR
 #define LOG_CRITICAL SPDLOG_CRITICAL
 
-#define LOG_ONCE(DO_LOG, ...)                            \
-	do                                                   \
-	{                                                    \
-		static bool PP_UNIQUE_VAR(already_ran_) = false; \
-		if (PP_UNIQUE_VAR(already_ran_))                 \
-			break;                                       \
-		PP_UNIQUE_VAR(already_ran_) = true;              \
-		DO_LOG(__VA_ARGS__);                             \
+// the flag is shared by every instance running on every thread, so it is atomic to keep it from being a data race
+#define LOG_ONCE(DO_LOG, ...)                                                      \
+	do                                                                             \
+	{                                                                              \
+		static std::atomic<bool> PP_UNIQUE_VAR(already_ran_) = false;              \
+		if (PP_UNIQUE_VAR(already_ran_).exchange(true, std::memory_order_relaxed)) \
+			break;                                                                 \
+		DO_LOG(__VA_ARGS__);                                                       \
 	} while (false)
 
 #define LOG_TRACE_ONCE(...) LOG_ONCE(LOG_TRACE, __VA_ARGS__)
@@ -1,5 +1,10 @@
+#include <algorithm>
+#include <vector>
+
 #include <catch2/catch_test_macros.hpp>
+#include <nes.hpp>
 #include <nes_apu.hpp>
+#include <nes_clock.hpp>
 
 TEST_CASE("Channel", "[nes_apu]")
 {
@@ -171,3 +176,49 @@ TEST_CASE("Channel", "[nes_apu]")
 		CHECK(c.length() == 0x15);
 	}
 }
+
+TEST_CASE("Pulse 1 plays at the frequency its timer is set to", "[nes_apu]")
+{
+	using nesem::Addr;
+
+	auto samples = std::vector<float>();
+	auto nes = nesem::Nes{nesem::NesSettings{
+		.audio = [&](float sample) { samples.push_back(sample); },
+	}};
+
+	constexpr nesem::U32 sample_rate = 44100;
+	constexpr auto apu_frequency = nesem::apu_frequency(nesem::ntsc());
+
+	// a second of ntsc apu cycles is a little under 900,000
+	CHECK(apu_frequency > 890000);
+	CHECK(apu_frequency < 900000);
+
+	auto apu = nesem::NesApu(&nes);
+	apu.set_output_rate(apu_frequency, sample_rate);
+
+	// enable pulse 1 at constant full volume with a 50% duty and the length counter halted, then a timer period of
+	// 253, which is CPU / (16 * 254), about 440 Hz
+	apu.write(Addr{0x4015}, 0x01);
+	apu.write(Addr{0x4000}, 0xBF);
+	apu.write(Addr{0x4002}, 0xFD);
+	apu.write(Addr{0x4003}, 0x08);
+
+	for (nesem::U64 i = 0; i < apu_frequency; ++i)
+		apu.clock();
+
+	REQUIRE(samples.size() >= sample_rate - 1);
+	REQUIRE(samples.size() <= sample_rate + 1);
+
+	auto peak = *std::ranges::max_element(samples);
+	REQUIRE(peak > 0.0f);
+
+	int rising_edges = 0;
+	for (size_t i = 1; i < samples.size(); ++i)
+	{
+		if (samples[i - 1] < peak / 2 && samples[i] >= peak / 2)
+			++rising_edges;
+	}
+
+	CHECK(rising_edges >= 435);
+	CHECK(rising_edges <= 446);
+}
@@ -0,0 +1,77 @@
+#include <array>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+#include <nes_audio_capture.hpp>
+
+namespace
+{
+	std::vector<char> read_file(const std::filesystem::path &path)
+	{
+		auto file = std::ifstream(path, std::ios::binary);
+		return {std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+	}
+
+	nesem::U32 read_u32(const std::vector<char> &data, size_t offset)
+	{
+		nesem::U32 result = 0;
+		std::memcpy(&result, data.data() + offset, sizeof(result));
+		return result;
+	}
+}
+
+TEST_CASE("Audio capture", "[nes_audio_capture]")
+{
+	auto path = std::filesystem::temp_directory_path() / "nesem_test_audio_capture.wav";
+
+	// use a small buffer so several buffers pass through the writer thread
+	constexpr size_t sample_count = 10'000;
+
+	SECTION("WAV pcm16")
+	{
+		{
+			auto capture = nesem::NesAudioCapture::create(path, 44100, nesem::NesAudioFormat::wav_pcm16, 1000);
+			REQUIRE(capture);
+
+			for (size_t i = 0; i < sample_count; ++i)
+				capture.push(0.5f);
+
+			REQUIRE(capture.sample_count() == sample_count);
+		}
+
+		auto data = read_file(path);
+		REQUIRE(data.size() == 44 + sample_count * 2);
+		CHECK(std::memcmp(data.data(), "RIFF", 4) == 0);
+		CHECK(std::memcmp(data.data() + 8, "WAVE", 4) == 0);
+		CHECK(read_u32(data, 24) == 44100);
+		CHECK(read_u32(data, 40) == sample_count * 2);
+	}
+
+	SECTION("raw float keeps every sample in order")
+	{
+		{
+			auto capture = nesem::NesAudioCapture::create(path, 48000, nesem::NesAudioFormat::raw_float, 333);
+			REQUIRE(capture);
+
+			for (size_t i = 0; i < sample_count; ++i)
+				capture.push(float(i));
+
+			capture.close();
+		}
+
+		auto data = read_file(path);
+		REQUIRE(data.size() == sample_count * sizeof(float));
+
+		std::vector<float> samples(sample_count);
+		std::memcpy(samples.data(), data.data(), data.size());
+
+		for (size_t i = 0; i < sample_count; ++i)
+			REQUIRE(samples[i] == float(i));
+	}
+
+	std::filesystem::remove(path);
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+#include <nes.hpp>
+
+// searches the working directory and every directory above it, defined in run_nestest.cpp
+std::filesystem::path find_path(const std::filesystem::path &path);
+
+// the whole state of a system, failing the test if it can't be saved
+inline std::vector<std::byte> save(const nesem::Nes &nes)
+{
+	auto state = std::vector<std::byte>(nes.state_size());
+	REQUIRE(nes.save_state(state) == state.size());
+	return state;
+}
+
+// a system that fails the test on any error, with a controller on port 1 reading its buttons from player1
+inline nesem::Nes make_nes(nesem::PollInputFn player1)
+{
+	return nesem::Nes{nesem::NesSettings{
+		.error = [](const auto &msg) { FAIL(msg); },
+		.player1 = std::make_unique<nesem::NesController>(std::move(player1)),
+	}};
+}
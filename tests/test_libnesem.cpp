@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+#include <nes.hpp>
+#include <nesem.h>
+
+std::filesystem::path find_path(const std::filesystem::path &path);
+
+namespace
+{
+	std::vector<char> read_file(const std::filesystem::path &path)
+	{
+		auto file = std::ifstream(path, std::ios::binary);
+		return {std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+	}
+
+	struct Destroy
+	{
+		void operator()(nesem_instance *instance) const
+		{
+			nesem_destroy(instance);
+		}
+	};
+
+	using Instance = std::unique_ptr<nesem_instance, Destroy>;
+}
+
+TEST_CASE("The C interface runs like the C++ one", "[libnesem][.skip][nestest.nes]")
+{
+	auto rom = find_path("data/nestest.nes");
+
+	CHECK(nesem_abi_version() == NESEM_ABI_VERSION);
+
+	auto settings = nesem_settings{.audio_ring_size = 1000};
+	auto instance = Instance(nesem_create(&settings));
+	REQUIRE(instance);
+
+	auto data = read_file(rom);
+	REQUIRE(nesem_load_rom(instance.get(), data.data(), data.size()));
+
+	// the rom was copied, so the buffer can go
+	data = {};
+
+	auto screen = std::vector<nesem::U16>(NESEM_SCREEN_WIDTH * NESEM_SCREEN_HEIGHT);
+	size_t samples = 0;
+	nesem::U8 buttons = 0;
+
+	auto nes = nesem::Nes{nesem::NesSettings{
+		.error = [](const auto &) {},
+		.draw = [&](int x, int y, nesem::U8 color_index, util::Flags<nesem::NesColorEmphasis> emphasis) {
+			screen[size_t(y * NESEM_SCREEN_WIDTH + x)] = nesem::U16((color_index & 0x3F) | (emphasis.raw_value() << 6));
+		},
+		.audio = [&](float) { ++samples; },
+		.player1 = std::make_unique<nesem::NesController>([&] { return buttons; }),
+	}};
+	REQUIRE(nes.load_rom(rom));
+
+	for (int i = 0; i < 30; ++i)
+	{
+		buttons = i % 7 == 0 ? NESEM_BUTTON_START : (i % 3 == 0 ? NESEM_BUTTON_SELECT | NESEM_BUTTON_DOWN : 0);
+		nesem_set_input(instance.get(), 0, buttons);
+
+		auto frame = nesem_step_frames(instance.get(), 1);
+		nes.step(nesem::NesClockStep::OneFrame);
+
+		REQUIRE(frame == nes.ppu().current_frame());
+	}
+
+	CHECK(nesem_state_hash(instance.get()) == nes.state_hash());
+	CHECK(std::equal(screen.begin(), screen.end(), nesem_framebuffer(instance.get())));
+
+	auto ram = nes.bus().work_ram();
+	CHECK(std::equal(ram.begin(), ram.end(), nesem_ram(instance.get())));
+
+	uint32_t capacity = 0;
+	CHECK(nesem_audio_ring(instance.get(), &capacity) != nullptr);
+	CHECK(capacity == 1024);
+	CHECK(nesem_audio_written(instance.get()) == samples);
+}
+
+TEST_CASE("The C interface saves and loads states", "[libnesem][.skip][nestest.nes]")
+{
+	auto rom = find_path("data/nestest.nes");
+
+	auto instance = Instance(nesem_create(nullptr));
+	REQUIRE(instance);
+	CHECK(nesem_state_size(instance.get()) == 0);
+
+	auto data = read_file(rom);
+	REQUIRE(nesem_load_rom(instance.get(), data.data(), data.size()));
+	nesem_step_frames(instance.get(), 10);
+
+	auto state = std::vector<std::byte>(nesem_state_size(instance.get()));
+	REQUIRE(!state.empty());
+	REQUIRE(nesem_save_state(instance.get(), state.data(), state.size()) == state.size());
+	CHECK(nesem_save_state(instance.get(), state.data(), state.size() - 1) == 0);
+
+	auto hash = nesem_state_hash(instance.get());
+	nesem_step_frames(instance.get(), 10);
+	CHECK(nesem_state_hash(instance.get()) != hash);
+
+	REQUIRE(nesem_load_state(instance.get(), state.data(), state.size()));
+	CHECK(nesem_state_hash(instance.get()) == hash);
+	CHECK(!nesem_load_state(instance.get(), state.data(), 3));
+}
+
+TEST_CASE("The C interface rejects bad roms", "[libnesem][.skip][nestest.nes]")
+{
+	auto rom = find_path("data/nestest.nes");
+
+	auto instance = Instance(nesem_create(nullptr));
+	REQUIRE(instance);
+
+	auto data = read_file(rom);
+	CHECK(!nesem_load_rom(instance.get(), data.data(), 10));
+	CHECK(!nesem_load_rom(instance.get(), data.data(), data.size() / 2));
+	CHECK(!nesem_load_rom(instance.get(), nullptr, 0));
+	CHECK(!nesem_load_rom(nullptr, data.data(), data.size()));
+
+	data[0] = 'X';
+	CHECK(!nesem_load_rom(instance.get(), data.data(), data.size()));
+	CHECK(nesem_state_size(instance.get()) == 0);
+}
@@ -0,0 +1,276 @@
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__)
+
+#	include <chrono>
+#	include <cstddef>
+#	include <cstring>
+#	include <filesystem>
+#	include <vector>
+
+#	include <poll.h>
+#	include <sys/socket.h>
+#	include <sys/un.h>
+#	include <unistd.h>
+
+#	include <catch2/catch_test_macros.hpp>
+#	include <nes.hpp>
+#	include <nes_debug_server.hpp>
+
+std::filesystem::path find_path(const std::filesystem::path &path);
+
+namespace
+{
+	using nesem::NesDebugCommand;
+	using nesem::U16;
+	using nesem::U32;
+	using nesem::U64;
+	using nesem::U8;
+
+	class Client final
+	{
+	public:
+		explicit Client(const std::filesystem::path &path)
+		{
+			fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+			REQUIRE(fd >= 0);
+
+			auto address = sockaddr_un{.sun_family = AF_UNIX, .sun_path = {}};
+			std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+			REQUIRE(::connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) == 0);
+		}
+
+		~Client()
+		{
+			::close(fd);
+		}
+
+		Client(const Client &) = delete;
+		Client &operator=(const Client &) = delete;
+
+		void send(NesDebugCommand command, std::vector<U8> payload = {})
+		{
+			auto size = U32(payload.size() + 1);
+			auto packet = std::vector<U8>{U8(size), U8(size >> 8), U8(size >> 16), U8(size >> 24), U8(command)};
+			packet.insert(packet.end(), payload.begin(), payload.end());
+
+			REQUIRE(::send(fd, packet.data(), packet.size(), 0) == ssize_t(packet.size()));
+		}
+
+		// keep the system running until a whole packet has arrived, returning its command and payload
+		std::vector<U8> receive(nesem::NesDebugServer &server, nesem::Nes &nes)
+		{
+			while (true)
+			{
+				if (received.size() >= 4)
+				{
+					auto size = size_t(received[0] | received[1] << 8 | received[2] << 16 | received[3] << 24);
+					if (received.size() >= size + 4)
+					{
+						auto packet = std::vector<U8>(received.begin() + 4, received.begin() + ptrdiff_t(size + 4));
+						received.erase(received.begin(), received.begin() + ptrdiff_t(size + 4));
+						return packet;
+					}
+				}
+
+				server.run_frame(nes);
+
+				auto fds = pollfd{.fd = fd, .events = POLLIN, .revents = 0};
+				if (::poll(&fds, 1, 10) > 0)
+				{
+					U8 chunk[256];
+					auto count = ::recv(fd, chunk, sizeof(chunk), 0);
+					REQUIRE(count > 0);
+					received.insert(received.end(), chunk, chunk + count);
+				}
+			}
+		}
+
+	private:
+		int fd = -1;
+		std::vector<U8> received;
+	};
+
+	U16 get_u16(const std::vector<U8> &bytes, size_t offset)
+	{
+		return U16(bytes[offset] | bytes[offset + 1] << 8);
+	}
+
+	U64 get_u64(const std::vector<U8> &bytes, size_t offset)
+	{
+		U64 value = 0;
+		for (size_t i = 0; i < 8; ++i)
+			value |= U64(bytes[offset + i]) << (i * 8);
+
+		return value;
+	}
+
+	// offsets of the registers within a response, after the command byte
+	constexpr size_t pc_offset = 1;
+	constexpr size_t frame_offset = 15;
+	constexpr size_t halted_offset = 23;
+	constexpr size_t registers_size = 24;
+
+	U8 response(NesDebugCommand command)
+	{
+		return U8(U8(command) | 0x80);
+	}
+
+	void wait_for_attach(nesem::NesDebugServer &server)
+	{
+		for (int i = 0; i < 100 && !server.attached(); ++i)
+			server.wait(std::chrono::milliseconds(10));
+
+		REQUIRE(server.attached());
+	}
+}
+
+TEST_CASE("Debug server reads memory and steps a halted system", "[nes_debug_server][nestest.nes]")
+{
+	auto path = std::filesystem::temp_directory_path() / "nesem-test-debug.sock";
+
+	auto server = nesem::NesDebugServer::create(path, true);
+	if (!server)
+		SKIP("Unix sockets not available");
+
+	auto nes = nesem::Nes{nesem::NesSettings{.error = [](const auto &msg) { FAIL(msg); }}};
+	if (!nes.load_rom(find_path("data/nestest.nes")))
+		SKIP("Could not load nestest.nes");
+
+	auto client = Client(path);
+	wait_for_attach(server);
+
+	client.send(NesDebugCommand::registers);
+	auto registers = client.receive(server, nes);
+	REQUIRE(registers.size() == registers_size);
+	CHECK(registers[0] == response(NesDebugCommand::registers));
+	CHECK(registers[halted_offset] == 1);
+
+	// nothing runs while halted
+	auto cycle = nes.cpu().current_cycle();
+	CHECK(!server.run_frame(nes));
+	CHECK(nes.cpu().current_cycle() == cycle);
+
+	// the reset vector, read twice in one request
+	client.send(NesDebugCommand::read_cpu, {2, 0, 0xFC, 0xFF, 2, 0, 0xFC, 0xFF, 2, 0});
+	auto memory = client.receive(server, nes);
+	REQUIRE(memory.size() == 5);
+	CHECK(memory[0] == response(NesDebugCommand::read_cpu));
+	CHECK(memory[1] == nes.bus().peek(nesem::Addr{0xFFFC}));
+	CHECK(memory[2] == nes.bus().peek(nesem::Addr{0xFFFD}));
+	CHECK(get_u16(memory, 3) == get_u16(memory, 1));
+
+	client.send(NesDebugCommand::step, {U8(nesem::NesClockStep::OneFrame), 3, 0, 0, 0});
+	auto stepped = client.receive(server, nes);
+	REQUIRE(stepped.size() == registers_size);
+	CHECK(get_u64(stepped, frame_offset) == get_u64(registers, frame_offset) + 3);
+	CHECK(stepped[halted_offset] == 1);
+
+	// a byte too many
+	client.send(NesDebugCommand::read_cpu, {1, 0, 0, 0, 1, 0, 0});
+	auto bad = client.receive(server, nes);
+	CHECK(bad == std::vector<U8>{U8(NesDebugCommand::error), U8(NesDebugCommand::read_cpu), U8(nesem::NesDebugError::bad_request)});
+
+	// 17 whole address spaces, more than one request may read
+	auto ranges = std::vector<U8>{17, 0};
+	for (int i = 0; i < 17; ++i)
+		ranges.insert(ranges.end(), {0, 0, 0xFF, 0xFF});
+
+	client.send(NesDebugCommand::read_cpu, ranges);
+	auto too_large = client.receive(server, nes);
+	CHECK(too_large == std::vector<U8>{U8(NesDebugCommand::error), U8(NesDebugCommand::read_cpu), U8(nesem::NesDebugError::too_large)});
+
+	// more frames than one request may step, which leaves the system where it was
+	client.send(NesDebugCommand::step, {U8(nesem::NesClockStep::OneFrame), 61, 0, 0, 0});
+	auto too_many_steps = client.receive(server, nes);
+	CHECK(too_many_steps == std::vector<U8>{U8(NesDebugCommand::error), U8(NesDebugCommand::step), U8(nesem::NesDebugError::too_large)});
+	CHECK(nes.ppu().current_frame() == get_u64(stepped, frame_offset));
+
+	client.send(NesDebugCommand(0x33));
+	auto unknown = client.receive(server, nes);
+	CHECK(unknown == std::vector<U8>{U8(NesDebugCommand::error), 0x33, U8(nesem::NesDebugError::unknown_command)});
+}
+
+TEST_CASE("Debug server halts on breakpoints", "[nes_debug_server][nestest.nes]")
+{
+	auto path = std::filesystem::temp_directory_path() / "nesem-test-breakpoint.sock";
+
+	auto server = nesem::NesDebugServer::create(path);
+	if (!server)
+		SKIP("Unix sockets not available");
+
+	auto nes = nesem::Nes{nesem::NesSettings{.error = [](const auto &msg) { FAIL(msg); }}};
+	if (!nes.load_rom(find_path("data/nestest.nes")))
+		SKIP("Could not load nestest.nes");
+
+	// without a client, frames run as usual
+	CHECK(server.run_frame(nes));
+
+	auto client = Client(path);
+	wait_for_attach(server);
+
+	for (int i = 0; i < 30; ++i)
+		CHECK(server.run_frame(nes));
+
+	client.send(NesDebugCommand::halt);
+	CHECK(client.receive(server, nes).size() == registers_size);
+
+	// a frame can end partway through an instruction, so finish it first. nestest sits in a loop waiting for input by
+	// now, so the instruction after that will come round again
+	client.send(NesDebugCommand::step, {U8(nesem::NesClockStep::OneCpuInstruction), 1, 0, 0, 0});
+	auto halted = client.receive(server, nes);
+	REQUIRE(halted.size() == registers_size);
+	auto pc = get_u16(halted, pc_offset);
+
+	client.send(NesDebugCommand::add_breakpoint, {U8(pc), U8(pc >> 8)});
+	CHECK(client.receive(server, nes) == std::vector<U8>{response(NesDebugCommand::add_breakpoint)});
+
+	client.send(NesDebugCommand::step, {U8(nesem::NesClockStep::OneCpuInstruction), 1, 0, 0, 0});
+	CHECK(client.receive(server, nes).size() == registers_size);
+
+	client.send(NesDebugCommand::resume);
+	CHECK(client.receive(server, nes) == std::vector<U8>{response(NesDebugCommand::resume)});
+
+	auto stopped = client.receive(server, nes);
+	REQUIRE(stopped.size() == registers_size + 2);
+	CHECK(stopped[0] == U8(NesDebugCommand::stopped));
+	CHECK(get_u16(stopped, 1) == pc);
+	CHECK(get_u16(stopped, 3) == pc);
+	CHECK(stopped[halted_offset + 2] == 1);
+	CHECK(nes.cpu().state().PC == nesem::Addr(pc));
+
+	client.send(NesDebugCommand::clear_breakpoints);
+	CHECK(client.receive(server, nes) == std::vector<U8>{response(NesDebugCommand::clear_breakpoints)});
+
+	client.send(NesDebugCommand::resume);
+	CHECK(client.receive(server, nes) == std::vector<U8>{response(NesDebugCommand::resume)});
+	CHECK(server.run_frame(nes));
+}
+
+TEST_CASE("Debug server resumes a halted system when its client detaches", "[nes_debug_server][nestest.nes]")
+{
+	auto path = std::filesystem::temp_directory_path() / "nesem-test-debug-detach.sock";
+
+	auto server = nesem::NesDebugServer::create(path, true);
+	if (!server)
+		SKIP("Unix sockets not available");
+
+	auto nes = nesem::Nes{nesem::NesSettings{.error = [](const auto &msg) { FAIL(msg); }}};
+	if (!nes.load_rom(find_path("data/nestest.nes")))
+		SKIP("Could not load nestest.nes");
+
+	{
+		auto client = Client(path);
+		wait_for_attach(server);
+
+		client.send(NesDebugCommand::registers);
+		CHECK(client.receive(server, nes)[halted_offset] == 1);
+		CHECK(!server.run_frame(nes));
+	}
+
+	for (int i = 0; i < 100 && server.attached(); ++i)
+		server.wait(std::chrono::milliseconds(10));
+
+	REQUIRE(!server.attached());
+	CHECK(server.run_frame(nes));
+}
+
+#endif
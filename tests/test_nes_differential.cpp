@@ -0,0 +1,480 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+#include <fmt/format.h>
+#include <nes.hpp>
+#include <nes_movie.hpp>
+#include <nes_state_hash.hpp>
+
+std::filesystem::path find_path(const std::filesystem::path &path);
+
+// Runs the same rom or movie through two systems set up differently and holds them in lockstep, comparing the cpu
+// registers, ppu position, framebuffer and state hash as they go. Any way of running the system that is supposed to be
+// invisible to the game, like stepping at a finer grain or saving and loading states along the way, can be added as a
+// Variant and is checked against plain frame stepping over the whole corpus.
+//
+// The corpus is nestest.nes, plus every .nes rom and .nesm movie in the directory named by NESEM_DIFF_CORPUS. A movie
+// is played on the rom with the same name next to it.
+
+namespace
+{
+	// how often the two systems are compared
+	enum class Lockstep
+	{
+		frame,
+		instruction,
+	};
+
+	struct Variant
+	{
+		std::string_view name;
+
+		// how the system gets to the end of a frame when comparing every frame. Anything but OneFrame is repeated until
+		// the frame ends, so it must be able to stop exactly where OneFrame does. Movies always play a frame at a time
+		nesem::NesClockStep step = nesem::NesClockStep::OneFrame;
+
+		bool video = true;
+
+		// done after every step, and must not change the outcome
+		void (*after_step)(nesem::Nes &nes) = nullptr;
+	};
+
+	struct CorpusEntry
+	{
+		std::filesystem::path rom;
+		std::optional<nesem::NesMovie> movie;
+		int frames = 0;
+	};
+
+	struct Snapshot
+	{
+		nesem::NesCpuState cpu;
+		nesem::U64 cpu_cycle;
+		nesem::U64 ppu_frame;
+		int scanline;
+		int cycle;
+		nesem::U64 framebuffer;
+
+		// the state hash is only taken at the end of a frame or on a load, so it's only comparable at the end of a frame
+		bool frame_end;
+		nesem::U64 state;
+
+		std::string_view error;
+	};
+
+	// the name of the first thing that differs, or an empty string if the snapshots agree
+	std::string_view compare(const Snapshot &a, const Snapshot &b, bool compare_framebuffer)
+	{
+		if (a.cpu.PC != b.cpu.PC)
+			return "PC";
+		if (a.cpu.A != b.cpu.A || a.cpu.X != b.cpu.X || a.cpu.Y != b.cpu.Y)
+			return "cpu registers";
+		if (a.cpu.S != b.cpu.S)
+			return "stack pointer";
+		if (a.cpu.P.raw_value() != b.cpu.P.raw_value())
+			return "cpu flags";
+		if (a.cpu_cycle != b.cpu_cycle)
+			return "cpu cycle";
+		if (a.ppu_frame != b.ppu_frame || a.scanline != b.scanline || a.cycle != b.cycle)
+			return "ppu position";
+		if (compare_framebuffer && a.framebuffer != b.framebuffer)
+			return "framebuffer";
+		if (a.frame_end && b.frame_end && a.state != b.state)
+			return "state hash";
+		if (a.error != b.error)
+			return "error";
+
+		return {};
+	}
+
+	// the ppu signals a finished frame at the start of vblank, leaving it just past that point
+	bool at_frame_end(const nesem::Nes &nes)
+	{
+		return nes.ppu().current_scanline() == 241 && nes.ppu().current_cycle() == 2;
+	}
+
+	// One system of a pair, running an entry of the corpus
+	class Lane final
+	{
+	public:
+		Lane(const Variant &variant, const CorpusEntry &entry)
+			: variant(variant),
+			  entry(entry),
+			  nes(nesem::NesSettings{
+				  .error = [this](std::string_view msg) { error = msg; },
+				  .draw = [this](int x, int y, nesem::U8 color_index, auto) { framebuffer[size_t(y * 256 + x)] = color_index; },
+				  .frame_ready = [this] { framebuffer_hash = nesem::state_hash::hash_bytes(std::as_bytes(std::span(framebuffer))); },
+				  .player1 = std::make_unique<nesem::NesController>([this] { return poll(0); }),
+				  .player2 = std::make_unique<nesem::NesController>([this] { return poll(1); }),
+			  })
+		{
+		}
+
+		// returns an error message if the lane couldn't be started
+		std::optional<std::string> start()
+		{
+			if (!nes.load_rom(entry.rom))
+				return fmt::format("could not load {}: {}", entry.rom.string(), error);
+
+			if (entry.movie)
+			{
+				movie.emplace(*entry.movie);
+				if (!movie->start(nes))
+					return fmt::format("could not play the movie for {}", entry.rom.string());
+			}
+
+			nes.enable_video(variant.video);
+			return std::nullopt;
+		}
+
+		void run_frame()
+		{
+			if (movie)
+				movie->run_frame();
+			else if (variant.step == nesem::NesClockStep::OneFrame)
+				nes.step(nesem::NesClockStep::OneFrame);
+			else
+			{
+				for (;;)
+				{
+					auto ppu_tick = nes.ppu().current_tick();
+					nes.step(variant.step);
+
+					if (nes.ppu().current_tick() != ppu_tick && at_frame_end(nes))
+						break;
+
+					after_step();
+				}
+			}
+
+			after_step();
+		}
+
+		void run_instruction()
+		{
+			history[instructions % history.size()] = nes.cpu().state().PC;
+			++instructions;
+
+			nes.step(nesem::NesClockStep::OneCpuInstruction);
+			after_step();
+		}
+
+		[[nodiscard]] Snapshot snapshot() const
+		{
+			return {
+				.cpu = nes.cpu().state(),
+				.cpu_cycle = nes.cpu().current_cycle(),
+				.ppu_frame = nes.ppu().current_frame(),
+				.scanline = nes.ppu().current_scanline(),
+				.cycle = nes.ppu().current_cycle(),
+				.framebuffer = framebuffer_hash,
+				.frame_end = at_frame_end(nes),
+				.state = nes.state_hash(),
+				.error = error,
+			};
+		}
+
+		// the instructions leading up to the current one, if the lane was stepped an instruction at a time, and a few
+		// after it
+		[[nodiscard]] std::string disassembly() const
+		{
+			std::string text;
+
+			auto line = [&](nesem::Addr addr, std::string_view marker) {
+				auto instruction = nesem::disassemble(nes.bus(), addr);
+				text += fmt::format("  {:2}${:04X}: {}\n", marker, nesem::to_integer(addr), instruction.text);
+				return instruction.size;
+			};
+
+			for (auto i = instructions - std::min<size_t>(instructions, history.size()); i < instructions; ++i)
+				line(history[i % history.size()], "");
+
+			auto pc = nes.cpu().state().PC;
+			pc = pc + line(pc, ">");
+
+			for (int i = 0; i < 4; ++i)
+				pc = pc + line(pc, "");
+
+			return text;
+		}
+
+		[[nodiscard]] bool video() const noexcept
+		{
+			return variant.video;
+		}
+
+		[[nodiscard]] const Variant &settings() const noexcept
+		{
+			return variant;
+		}
+
+	private:
+		const Variant &variant;
+		const CorpusEntry &entry;
+
+		std::array<nesem::U8, 256 * 240> framebuffer{};
+		nesem::U64 framebuffer_hash = 0;
+
+		// the last error reported, errors are part of the outcome and have to match as well
+		std::string error;
+
+		std::optional<nesem::NesMoviePlayer> movie;
+
+		std::array<nesem::Addr, 8> history{};
+		size_t instructions = 0;
+
+		nesem::Nes nes;
+
+		nesem::U8 poll(int port) const
+		{
+			if (movie)
+				return movie->poll(port);
+
+			// without a movie, press each button in turn now and then so the game has something to react to
+			auto frame = nes.ppu().current_frame();
+			if (port != 0 || (frame / 4) % 3 != 0)
+				return 0;
+
+			return nesem::U8(1u << (frame / 12 % 8));
+		}
+
+		void after_step()
+		{
+			if (variant.after_step)
+				variant.after_step(nes);
+		}
+	};
+
+	std::string describe(const Lane &lane, const Snapshot &snapshot)
+	{
+		const auto &cpu = snapshot.cpu;
+
+		return fmt::format("{}: PC:{:04X} A:{:02X} X:{:02X} Y:{:02X} P:{:02X} SP:{:02X} CYC:{} PPU:{},{},{} FB:{:016X} STATE:{:016X} {}\n{}",
+			lane.settings().name, nesem::to_integer(cpu.PC), cpu.A, cpu.X, cpu.Y, cpu.P.raw_value(), cpu.S, snapshot.cpu_cycle,
+			snapshot.ppu_frame, snapshot.scanline, snapshot.cycle, snapshot.framebuffer, snapshot.state, snapshot.error, lane.disassembly());
+	}
+
+	struct Job
+	{
+		const CorpusEntry *entry;
+		const Variant *variant;
+		Lockstep lockstep;
+	};
+
+	constexpr Variant reference{.name = "frame stepping"};
+
+	// where two systems first disagreed, or why they couldn't be started, in which case field is empty
+	struct Divergence
+	{
+		// frames or instructions run before the difference was seen
+		nesem::U64 step = 0;
+		std::string_view field;
+		std::string report;
+	};
+
+	// run a job to the end, returning the first divergence or nothing if the systems agreed throughout
+	std::optional<Divergence> run(const Job &job)
+	{
+		const auto &entry = *job.entry;
+
+		// the systems are large and hold pointers to themselves, so they live on the heap and stay put
+		auto expected = std::make_unique<Lane>(reference, entry);
+		auto actual = std::make_unique<Lane>(*job.variant, entry);
+
+		if (auto error = expected->start())
+			return Divergence{.report = std::move(*error)};
+		if (auto error = actual->start())
+			return Divergence{.report = std::move(*error)};
+
+		bool compare_framebuffer = expected->video() && actual->video();
+		auto frame_end = expected->snapshot().ppu_frame + nesem::U64(entry.frames);
+
+		for (nesem::U64 step = 0;; ++step)
+		{
+			auto a = expected->snapshot();
+			auto b = actual->snapshot();
+
+			if (auto field = compare(a, b, compare_framebuffer); !field.empty())
+			{
+				return Divergence{
+					.step = step,
+					.field = field,
+					.report = fmt::format("{}: '{}' diverged after {} {}, {} differs\n{}{}",
+						entry.rom.filename().string(), job.variant->name, step, job.lockstep == Lockstep::frame ? "frames" : "instructions",
+						field, describe(*expected, a), describe(*actual, b)),
+				};
+			}
+
+			if (a.ppu_frame >= frame_end)
+				return std::nullopt;
+
+			if (job.lockstep == Lockstep::frame)
+			{
+				expected->run_frame();
+				actual->run_frame();
+			}
+			else
+			{
+				expected->run_instruction();
+				actual->run_instruction();
+			}
+		}
+	}
+
+	// run every job, spread over all cores. The results line up with the jobs
+	std::vector<std::optional<Divergence>> run_parallel(std::span<const Job> jobs)
+	{
+		auto results = std::vector<std::optional<Divergence>>(jobs.size());
+		if (jobs.empty())
+			return results;
+
+		auto next = std::atomic<size_t>{0};
+
+		auto worker = [&] {
+			for (auto i = next++; i < jobs.size(); i = next++)
+				results[i] = run(jobs[i]);
+		};
+
+		auto thread_count = std::clamp<size_t>(std::thread::hardware_concurrency(), 1, jobs.size());
+
+		auto threads = std::vector<std::jthread>();
+		for (size_t i = 1; i < thread_count; ++i)
+			threads.emplace_back(worker);
+
+		worker();
+		return results;
+	}
+
+	std::vector<CorpusEntry> load_corpus(int frames)
+	{
+		auto corpus = std::vector<CorpusEntry>{{.rom = find_path("data/nestest.nes"), .frames = frames}};
+
+		const char *dir = std::getenv("NESEM_DIFF_CORPUS");
+		if (!dir || !std::filesystem::is_directory(dir))
+			return corpus;
+
+		for (const auto &file : std::filesystem::directory_iterator(dir))
+		{
+			auto ext = file.path().extension();
+
+			if (ext == ".nes")
+				corpus.push_back({.rom = file.path(), .frames = frames});
+			else if (ext == ".nesm")
+			{
+				auto movie = nesem::NesMovie::load(file.path());
+				auto rom = std::filesystem::path(file.path()).replace_extension(".nes");
+
+				if (movie && std::filesystem::exists(rom))
+				{
+					int length = int(movie->frame_count());
+					corpus.push_back({.rom = rom, .movie = std::move(movie), .frames = length});
+				}
+			}
+		}
+
+		return corpus;
+	}
+
+	void check_variants(std::span<const Variant> variants, Lockstep lockstep, int frames)
+	{
+		auto corpus = load_corpus(frames);
+
+		auto jobs = std::vector<Job>();
+		for (const auto &entry : corpus)
+		{
+			// movies can't be stepped an instruction at a time without losing track of their frames
+			if (lockstep == Lockstep::instruction && entry.movie)
+				continue;
+
+			for (const auto &variant : variants)
+				jobs.push_back({.entry = &entry, .variant = &variant, .lockstep = lockstep});
+		}
+
+		auto results = run_parallel(jobs);
+
+		for (const auto &result : results)
+		{
+			if (result)
+				FAIL_CHECK(result->report);
+		}
+	}
+
+	void save_and_load(nesem::Nes &nes)
+	{
+		auto state = std::vector<std::byte>(nes.state_size());
+		nes.save_state(state);
+		nes.load_state(state);
+	}
+
+	void fork_and_restore(nesem::Nes &nes)
+	{
+		auto fork = nes.fork();
+		nes.restore(fork);
+	}
+}
+
+TEST_CASE("Finer steps stop exactly where frames end", "[nes_differential][.skip][nestest.nes]")
+{
+	constexpr auto variants = std::array{
+		Variant{.name = "clock cycle stepping", .step = nesem::NesClockStep::OneClockCycle},
+		Variant{.name = "ppu cycle stepping", .step = nesem::NesClockStep::OnePpuCycle},
+	};
+
+	check_variants(variants, Lockstep::frame, 30);
+}
+
+TEST_CASE("Saving, forking and skipping video don't change the outcome", "[nes_differential][.skip][nestest.nes]")
+{
+	constexpr auto variants = std::array{
+		Variant{.name = "video disabled", .video = false},
+		Variant{.name = "save and load every frame", .after_step = save_and_load},
+		Variant{.name = "fork and restore every frame", .after_step = fork_and_restore},
+	};
+
+	check_variants(variants, Lockstep::frame, 120);
+}
+
+TEST_CASE("Saving and forking every instruction doesn't change the outcome", "[nes_differential][.skip][nestest.nes]")
+{
+	constexpr auto variants = std::array{
+		Variant{.name = "save and load every instruction", .after_step = save_and_load},
+		Variant{.name = "fork and restore every instruction", .after_step = fork_and_restore},
+	};
+
+	check_variants(variants, Lockstep::instruction, 10);
+}
+
+TEST_CASE("Divergences are reported with where they happened", "[nes_differential][.skip][nestest.nes]")
+{
+	auto entry = CorpusEntry{.rom = find_path("data/nestest.nes"), .frames = 30};
+
+	// a stray write to the stack page, as a buggy fast path might make
+	constexpr auto variant = Variant{
+		.name = "stray write",
+		.after_step = [](nesem::Nes &nes) {
+			if (nes.ppu().current_frame() == 20)
+				nes.bus().write(nesem::Addr{0x01A0}, nesem::U8(nes.bus().peek(nesem::Addr{0x01A0}) + 1), nesem::NesBusOp::ready);
+		},
+	};
+
+	auto result = run({.entry = &entry, .variant = &variant, .lockstep = Lockstep::frame});
+
+	REQUIRE(result);
+	INFO(result->report);
+	// written once frame 20 is done and caught in the hash at the end of the next
+	CHECK(result->step == 22);
+	CHECK(result->field == "state hash");
+	CHECK(result->report.find("> $") != std::string::npos);
+}
@@ -0,0 +1,200 @@
+#include <algorithm>
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+#include <nes.hpp>
+#include <nes_env.hpp>
+
+std::filesystem::path find_path(const std::filesystem::path &path);
+
+namespace
+{
+	nesem::U8 action_for(size_t step, size_t env)
+	{
+		using enum nesem::Buttons;
+
+		if ((step + env) % 5 == 0)
+			return util::Flags(Start).raw_value();
+
+		return (step + env) % 3 == 0 ? util::Flags(Select, Down).raw_value() : 0;
+	}
+
+	// the same thing as a step, done by hand
+	struct Reference
+	{
+		std::vector<nesem::U16> screen = std::vector<nesem::U16>(nesem::NesEnvObservation::width * nesem::NesEnvObservation::height);
+		nesem::U8 buttons = 0;
+		std::unique_ptr<nesem::Nes> nes;
+
+		explicit Reference(const std::filesystem::path &rom)
+			: nes(std::make_unique<nesem::Nes>(nesem::NesSettings{
+				  .error = [](const auto &) {},
+				  .draw = [this](int x, int y, nesem::U8 color_index, util::Flags<nesem::NesColorEmphasis> emphasis) {
+					  screen[size_t(y * nesem::NesEnvObservation::width + x)] = nesem::U16((color_index & 0x3F) | (emphasis.raw_value() << 6));
+				  },
+				  .player1 = std::make_unique<nesem::NesController>([this] { return buttons; }),
+			  }))
+		{
+			REQUIRE(nes->load_rom(rom));
+		}
+
+		void step(nesem::U8 action, int frames)
+		{
+			buttons = action;
+			for (int i = 0; i < frames; ++i)
+				nes->step(nesem::NesClockStep::OneFrame);
+		}
+	};
+}
+
+TEST_CASE("Grayscale downsampling averages each 2x2 block", "[nes_env]")
+{
+	using nesem::NesEnvObservation;
+
+	// colors 0x20 and 0x0F are the brightest white and black, and 0x10 is in between
+	auto screen = std::vector<nesem::U16>(NesEnvObservation::width * NesEnvObservation::height);
+	for (size_t i = 0; i < screen.size(); ++i)
+		screen[i] = nesem::U16((i * 7 + i / NesEnvObservation::width) % 4 == 0 ? 0x20 : (i % 3 == 0 ? 0x10 : 0x0F));
+
+	auto gray = std::vector<nesem::U8>(NesEnvObservation::grayscale_width * NesEnvObservation::grayscale_height);
+	nesem::downsample_grayscale(screen, gray);
+
+	auto luma = [&](size_t x, size_t y) {
+		switch (screen[y * NesEnvObservation::width + x])
+		{
+		case 0x20: return 255u;
+		case 0x10: return 156u;
+		default: return 0u;
+		}
+	};
+
+	auto average = [](unsigned int a, unsigned int b) { return (a + b + 1) / 2; };
+
+	for (size_t y = 0; y < NesEnvObservation::grayscale_height; ++y)
+	{
+		for (size_t x = 0; x < NesEnvObservation::grayscale_width; ++x)
+		{
+			auto expected = average(average(luma(x * 2, y * 2), luma(x * 2, y * 2 + 1)), average(luma(x * 2 + 1, y * 2), luma(x * 2 + 1, y * 2 + 1)));
+			REQUIRE(gray[y * NesEnvObservation::grayscale_width + x] == expected);
+		}
+	}
+}
+
+TEST_CASE("Environment steps match stepping the system by hand", "[nes_env][.skip][nestest.nes]")
+{
+	auto rom = find_path("data/nestest.nes");
+
+	auto env = nesem::NesEnv::create({.rom = rom, .grayscale = true});
+	REQUIRE(env);
+
+	auto reference = Reference(rom);
+
+	auto start = env.reset();
+	CHECK(start.info.frames == 0);
+	CHECK(start.info.state_hash == reference.nes->state_hash());
+
+	constexpr int frameskip = 4;
+
+	for (size_t i = 0; i < 20; ++i)
+	{
+		INFO("step " << i);
+
+		auto result = env.step(action_for(i, 0), frameskip);
+		reference.step(action_for(i, 0), frameskip);
+
+		CHECK(result.info.frames == frameskip);
+		CHECK(result.info.frame == reference.nes->ppu().current_frame());
+		CHECK(result.info.state_hash == reference.nes->state_hash());
+
+		REQUIRE(result.observation.screen.size() == reference.screen.size());
+		CHECK(std::equal(result.observation.screen.begin(), result.observation.screen.end(), reference.screen.begin()));
+
+		REQUIRE(result.observation.ram.size() == 0x800);
+		for (nesem::U16 addr = 0; addr < 0x800; addr += 0x41)
+			CHECK(result.observation.ram[addr] == reference.nes->bus().peek(nesem::Addr{addr}));
+
+		CHECK(result.observation.grayscale.size() == size_t(nesem::NesEnvObservation::grayscale_width * nesem::NesEnvObservation::grayscale_height));
+		CHECK(result.observation.audio.empty());
+	}
+}
+
+TEST_CASE("Environments reset to a save state", "[nes_env][.skip][nestest.nes]")
+{
+	auto rom = find_path("data/nestest.nes");
+
+	auto env = nesem::NesEnv::create({.rom = rom});
+	REQUIRE(env);
+
+	for (size_t i = 0; i < 10; ++i)
+		env.step(action_for(i, 0));
+
+	auto state = std::vector<std::byte>(env.nes().state_size());
+	REQUIRE(env.nes().save_state(state) != 0);
+	auto saved = env.step(0).info;
+
+	for (size_t i = 0; i < 10; ++i)
+		env.step(action_for(i, 1), 3);
+
+	env.reset(state);
+	auto again = env.step(0).info;
+
+	CHECK(again.frame == saved.frame);
+	CHECK(again.state_hash == saved.state_hash);
+
+	// garbage resets to the start instead
+	auto initial = nesem::NesEnv::create({.rom = rom}).reset().info;
+	auto garbage = std::vector<std::byte>(16);
+	CHECK(env.reset(garbage).info.state_hash == initial.state_hash);
+}
+
+TEST_CASE("Vectorized environments step like separate ones", "[nes_env][.skip][nestest.nes]")
+{
+	auto rom = find_path("data/nestest.nes");
+
+	constexpr size_t count = 5;
+	constexpr int frameskip = 2;
+
+	auto envs = nesem::NesVectorEnv::create({.rom = rom, .grayscale = true}, count, 2);
+	REQUIRE(envs);
+	REQUIRE(envs.size() == count);
+
+	auto singles = std::vector<nesem::NesEnv>();
+	for (size_t i = 0; i < count; ++i)
+	{
+		singles.push_back(nesem::NesEnv::create({.rom = rom, .grayscale = true}));
+		singles.back().reset();
+	}
+
+	REQUIRE(envs.reset().size() == count);
+
+	for (size_t step = 0; step < 15; ++step)
+	{
+		auto actions = std::vector<nesem::U8>(count);
+		for (size_t i = 0; i < count; ++i)
+			actions[i] = action_for(step, i);
+
+		auto results = envs.step(actions, frameskip);
+		REQUIRE(results.size() == count);
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			INFO("step " << step << ", environment " << i);
+
+			auto expected = singles[i].step(actions[i], frameskip);
+
+			CHECK(results[i].info.frame == expected.info.frame);
+			CHECK(results[i].info.state_hash == expected.info.state_hash);
+			CHECK(std::ranges::equal(results[i].observation.screen, expected.observation.screen));
+			CHECK(std::ranges::equal(results[i].observation.grayscale, expected.observation.grayscale));
+			CHECK(std::ranges::equal(results[i].observation.ram, expected.observation.ram));
+		}
+	}
+
+	auto metrics = envs.metrics();
+	REQUIRE(metrics.instances.size() == count);
+	for (const auto &instance : metrics.instances)
+		CHECK(instance.frames == 15 * frameskip);
+}
@@ -0,0 +1,110 @@
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+#include <nes.hpp>
+#include <nes_fork.hpp>
+
+#include "test_helpers.hpp"
+
+namespace
+{
+	// press select and down now and then, so nestest moves around its menu and writes to ram
+	nesem::PollInputFn wander(const int &frame)
+	{
+		return [&frame]() -> nesem::U8 {
+			using enum nesem::Buttons;
+
+			if ((frame / 5) % 2 == 0)
+				return util::Flags(Select, Down).raw_value();
+
+			return 0;
+		};
+	}
+}
+
+TEST_CASE("Forks restore the system exactly", "[nes_fork][nestest.nes]")
+{
+	int frame = 0;
+	auto nes = make_nes(wander(frame));
+
+	int child_frame = 0;
+	auto child = make_nes(wander(child_frame));
+
+	if (!nes.load_rom(find_path("data/nestest.nes")) || !child.load_rom(find_path("data/nestest.nes")))
+		SKIP("Could not load nestest.nes");
+
+	for (; frame < 10; ++frame)
+		nes.step(nesem::NesClockStep::OneFrame);
+
+	auto fork = nes.fork();
+	REQUIRE(fork);
+
+	auto run = [](nesem::Nes &system, int &counter) {
+		for (int i = 0; i < 30; ++i, ++counter)
+			system.step(nesem::NesClockStep::OneFrame);
+
+		return save(system);
+	};
+
+	auto expected = run(nes, frame);
+
+	SECTION("Restoring goes back to the fork")
+	{
+		frame = 10;
+		REQUIRE(nes.restore(fork));
+		CHECK(run(nes, frame) == expected);
+
+		// and again, now that most pages are shared with the fork
+		frame = 10;
+		REQUIRE(nes.restore(fork));
+		CHECK(run(nes, frame) == expected);
+	}
+
+	SECTION("Another instance can continue from the fork")
+	{
+		child_frame = 10;
+		REQUIRE(child.restore(fork));
+		CHECK(run(child, child_frame) == expected);
+	}
+
+	SECTION("Empty forks are rejected")
+	{
+		auto state = save(nes);
+		CHECK(!nes.restore(nesem::NesFork{}));
+		CHECK(save(nes) == state);
+	}
+}
+
+TEST_CASE("Forks only copy pages written since the last fork", "[nes_fork][nestest.nes]")
+{
+	int frame = 0;
+	auto nes = make_nes(wander(frame));
+
+	if (!nes.load_rom(find_path("data/nestest.nes")))
+		SKIP("Could not load nestest.nes");
+
+	nes.step(nesem::NesClockStep::OneFrame);
+
+	auto first = nes.fork();
+	auto second = nes.fork();
+
+	REQUIRE(first);
+	REQUIRE(second);
+
+	// the first fork copies all of work ram, the second has nothing new to copy
+	CHECK(second.size() + 0x800 == first.size());
+
+	for (int i = 0; i < 10; ++i, ++frame)
+		nes.step(nesem::NesClockStep::OneFrame);
+
+	auto third = nes.fork();
+	CHECK(third.size() > second.size());
+	CHECK(third.size() < first.size());
+
+	// forks of forks share everything
+	auto copies = std::vector<nesem::NesFork>(1000, third);
+	CHECK(nes.restore(copies.back()));
+}
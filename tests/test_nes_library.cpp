@@ -0,0 +1,54 @@
+#include <filesystem>
+#include <fstream>
+
+#include <catch2/catch_test_macros.hpp>
+#include <nes_library.hpp>
+
+std::filesystem::path find_path(const std::filesystem::path &path);
+
+TEST_CASE("Library scan finds roms below its directories", "[nes_library][nestest.nes]")
+{
+	auto dir = std::filesystem::temp_directory_path() / "nesem_test_library";
+	std::filesystem::remove_all(dir);
+	std::filesystem::create_directories(dir / "nested");
+
+	std::error_code ec;
+	std::filesystem::copy_file(find_path("data/nestest.nes"), dir / "nested" / "NesTest.NES", ec);
+	if (ec)
+		SKIP("Could not copy nestest.nes");
+
+	// neither of these is a rom, one by its name and one by its contents
+	std::ofstream(dir / "notes.txt") << "not a rom";
+	std::ofstream(dir / "broken.nes") << "not a rom either";
+
+	auto library = nesem::NesLibrary::scan({.directories = {dir}, .threads = 4});
+	REQUIRE(library.entries.size() == 1);
+
+	const auto &entry = library.entries[0];
+	CHECK(entry.title == "NesTest");
+	CHECK(entry.sha1.size() == 40);
+	CHECK(entry.mapper == 0);
+	CHECK(entry.prg_rom_size == 16384);
+	CHECK(entry.chr_rom_size == 8192);
+	CHECK(entry.file_size == std::filesystem::file_size(entry.path));
+
+	CHECK(library.find({.mapper = 0}).size() == 1);
+	CHECK(library.find({.mapper = 4}).empty());
+	CHECK(library.find({.title = "nestest"}).size() == 1);
+	CHECK(library.find({.title = "mario"}).empty());
+
+	auto filename = dir / "library.bin";
+	REQUIRE(library.save(filename));
+
+	auto loaded = nesem::NesLibrary::load(filename);
+	REQUIRE(loaded);
+	REQUIRE(loaded->entries.size() == 1);
+	CHECK(loaded->entries[0].path == entry.path);
+	CHECK(loaded->entries[0].title == entry.title);
+	CHECK(loaded->entries[0].sha1 == entry.sha1);
+	CHECK(loaded->entries[0].modified == entry.modified);
+	CHECK(loaded->entries[0].prg_rom_size == entry.prg_rom_size);
+	CHECK(loaded->entries[0].in_db == entry.in_db);
+
+	std::filesystem::remove_all(dir);
+}
@@ -0,0 +1,94 @@
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+#include <nes.hpp>
+#include <nes_movie.hpp>
+
+#include "test_helpers.hpp"
+
+namespace
+{
+	// press start after a bit, then walk down the menu with select
+	nesem::U8 scripted_input(nesem::U64 frame)
+	{
+		using enum nesem::Buttons;
+
+		if (frame >= 20 && frame < 22)
+			return util::Flags(Start).raw_value();
+
+		if (frame % 16 == 0)
+			return util::Flags(Select, Down).raw_value();
+
+		return 0;
+	}
+}
+
+TEST_CASE("Movies play back exactly what was recorded", "[nes_movie][nestest.nes]")
+{
+	nesem::NesMovieRecorder recorder;
+	nesem::Nes *recording_nes = nullptr;
+
+	auto nes = nesem::Nes{nesem::NesSettings{
+		.error = [](const auto &msg) { FAIL(msg); },
+		.player1 = std::make_unique<nesem::NesController>([&] { return recorder.poll(0, scripted_input(recording_nes->ppu().current_frame())); }),
+	}};
+	recording_nes = &nes;
+
+	if (!nes.load_rom(find_path("data/nestest.nes")))
+		SKIP("Could not load nestest.nes");
+
+	REQUIRE(recorder.start(nes));
+
+	for (int i = 0; i < 100; ++i)
+		nes.step(nesem::NesClockStep::OneFrame);
+
+	// land the reset in the middle of a frame so playback has to find the exact tick
+	for (int i = 0; i < 50; ++i)
+		nes.step(nesem::NesClockStep::OnePpuScanline);
+
+	recorder.reset(nes);
+
+	for (int i = 0; i < 40; ++i)
+		nes.step(nesem::NesClockStep::OneFrame);
+
+	auto expected = save(nes);
+	auto movie = recorder.stop();
+
+	CHECK(!recorder.recording());
+	REQUIRE(movie.events.size() == 1);
+	CHECK(movie.frame_count() > 100);
+
+	auto filename = std::filesystem::temp_directory_path() / "nesem_test_movie.nesm";
+	REQUIRE(movie.save(filename));
+
+	auto loaded = nesem::NesMovie::load(filename);
+	std::filesystem::remove(filename);
+
+	REQUIRE(loaded);
+	CHECK(loaded->sha1 == movie.sha1);
+	CHECK(loaded->input == movie.input);
+	CHECK(loaded->start_state == movie.start_state);
+	REQUIRE(loaded->events.size() == 1);
+	CHECK(loaded->events[0].tick == movie.events[0].tick);
+
+	auto player = std::make_unique<nesem::NesMoviePlayer>(std::move(*loaded));
+
+	auto playback = nesem::Nes{nesem::NesSettings{
+		.error = [](const auto &msg) { FAIL(msg); },
+		.player1 = std::make_unique<nesem::NesController>([&] { return player->poll(0); }),
+	}};
+
+	REQUIRE(playback.load_rom(find_path("data/nestest.nes")));
+	REQUIRE(player->start(playback));
+
+	int frames = 0;
+	while (player->run_frame())
+		++frames;
+
+	CHECK(player->finished());
+	CHECK(frames == 140);
+	CHECK(save(playback) == expected);
+}
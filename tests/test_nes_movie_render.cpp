@@ -0,0 +1,151 @@
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+#include <nes.hpp>
+#include <nes_movie.hpp>
+#include <nes_movie_render.hpp>
+
+std::filesystem::path find_path(const std::filesystem::path &path);
+
+namespace
+{
+	struct Frame
+	{
+		std::vector<nesem::U16> pixels;
+		std::vector<float> audio;
+	};
+
+	// press start after a bit, then walk down the menu with select
+	nesem::U8 scripted_input(nesem::U64 frame)
+	{
+		using enum nesem::Buttons;
+
+		if (frame >= 20 && frame < 22)
+			return util::Flags(Start).raw_value();
+
+		if (frame % 16 == 0)
+			return util::Flags(Select, Down).raw_value();
+
+		return 0;
+	}
+
+	nesem::NesMovie record_movie(const std::filesystem::path &rom)
+	{
+		nesem::NesMovieRecorder recorder;
+		nesem::Nes *recording_nes = nullptr;
+
+		auto nes = nesem::Nes{nesem::NesSettings{
+			.error = [](const auto &msg) { FAIL(msg); },
+			.player1 = std::make_unique<nesem::NesController>([&] { return recorder.poll(0, scripted_input(recording_nes->ppu().current_frame())); }),
+		}};
+		recording_nes = &nes;
+
+		REQUIRE(nes.load_rom(rom));
+		REQUIRE(recorder.start(nes));
+
+		for (int i = 0; i < 60; ++i)
+			nes.step(nesem::NesClockStep::OneFrame);
+
+		// a reset part way through a frame, so some segment starts with a picture left over from before it
+		for (int i = 0; i < 50; ++i)
+			nes.step(nesem::NesClockStep::OnePpuScanline);
+
+		recorder.reset(nes);
+
+		for (int i = 0; i < 40; ++i)
+			nes.step(nesem::NesClockStep::OneFrame);
+
+		return recorder.stop();
+	}
+
+	// play the movie one frame after the other, the slow way
+	std::vector<Frame> play_serially(const std::filesystem::path &rom, const nesem::NesMovie &movie)
+	{
+		auto frames = std::vector<Frame>();
+		auto screen = std::vector<nesem::U16>(nesem::NesRenderedFrame::width * nesem::NesRenderedFrame::height);
+		auto audio = std::vector<float>();
+
+		auto player = std::make_unique<nesem::NesMoviePlayer>(movie);
+
+		auto nes = nesem::Nes{nesem::NesSettings{
+			.error = [](const auto &msg) { FAIL(msg); },
+			.draw = [&](int x, int y, nesem::U8 color_index, util::Flags<nesem::NesColorEmphasis> emphasis) {
+				screen[size_t(y * nesem::NesRenderedFrame::width + x)] = nesem::U16((color_index & 0x3F) | (emphasis.raw_value() << 6));
+			},
+			.audio = [&](float sample) { audio.push_back(sample); },
+			.player1 = std::make_unique<nesem::NesController>([&] { return player->poll(0); }),
+		}};
+
+		REQUIRE(nes.load_rom(rom));
+		REQUIRE(player->start(nes));
+
+		while (player->run_frame())
+			frames.push_back({.pixels = screen, .audio = std::exchange(audio, {})});
+
+		return frames;
+	}
+}
+
+TEST_CASE("Movies render the same in parallel as one frame at a time", "[nes_movie_render][.skip][nestest.nes]")
+{
+	auto rom = find_path("data/nestest.nes");
+
+	auto movie = record_movie(rom);
+	auto expected = play_serially(rom, movie);
+	REQUIRE(expected.size() == movie.frame_count());
+
+	// segments that don't divide the movie evenly, on more threads than they can keep busy
+	auto settings = nesem::NesMovieRenderSettings{
+		.rom = rom,
+		.keyframe_interval = 7,
+		.threads = 3,
+	};
+
+	// with memory for every thread, then too little for more than one segment at a time
+	for (auto memory_limit : {settings.memory_limit, size_t{1}})
+	{
+		INFO("memory limit " << memory_limit);
+		settings.memory_limit = memory_limit;
+
+		auto frames = std::vector<Frame>();
+		auto frame_numbers_in_order = true;
+
+		auto result = nesem::render_movie(movie, settings, [&](const nesem::NesRenderedFrame &frame) {
+			frame_numbers_in_order = frame_numbers_in_order && frame.frame == frames.size();
+			frames.push_back({
+				.pixels = {frame.pixels.begin(), frame.pixels.end()},
+				.audio = {frame.audio.begin(), frame.audio.end()},
+			});
+		});
+
+		CHECK(frame_numbers_in_order);
+		CHECK(result.success);
+		CHECK(result.frames == expected.size());
+		REQUIRE(frames.size() == expected.size());
+
+		for (size_t i = 0; i < frames.size(); ++i)
+		{
+			INFO("frame " << i);
+			CHECK(frames[i].pixels == expected[i].pixels);
+			CHECK(frames[i].audio == expected[i].audio);
+		}
+	}
+}
+
+TEST_CASE("Movies for a different rom aren't rendered", "[nes_movie_render][.skip][nestest.nes]")
+{
+	auto rom = find_path("data/nestest.nes");
+
+	auto movie = record_movie(rom);
+	movie.sha1 = "0000000000000000000000000000000000000000";
+
+	auto called = false;
+	auto result = nesem::render_movie(movie, {.rom = rom}, [&](const auto &) { called = true; });
+	CHECK(!result.success);
+	CHECK(result.frames == 0);
+	CHECK(!called);
+}
@@ -0,0 +1,91 @@
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+#include <nes.hpp>
+#include <nes_netplay.hpp>
+
+#include "test_helpers.hpp"
+
+namespace
+{
+	struct Player
+	{
+		std::unique_ptr<nesem::NesNetplaySession> session;
+		nesem::Nes nes;
+
+		Player()
+			: nes(nesem::NesSettings{
+				  .error = [](const auto &msg) { FAIL(msg); },
+				  .player1 = std::make_unique<nesem::NesController>([this] { return session->poll(0); }),
+				  .player2 = std::make_unique<nesem::NesController>([this] { return session->poll(1); }),
+			  })
+		{
+		}
+	};
+
+	nesem::U8 input_for(int player, nesem::U32 frame)
+	{
+		using enum nesem::Buttons;
+
+		// change often enough that predictions keep missing
+		if ((frame / 7 + nesem::U32(player)) % 3 == 0)
+			return util::Flags(Select, Down).raw_value();
+
+		if (frame > 60 && frame < 63)
+			return util::Flags(Start).raw_value();
+
+		return 0;
+	}
+}
+
+TEST_CASE("Rollback netplay stays in sync over loopback", "[nes_netplay][nestest.nes]")
+{
+	auto socket_a = nesem::NesNetplaySocket::create(0);
+	auto socket_b = nesem::NesNetplaySocket::create(0);
+
+	if (!socket_a || !socket_b)
+		SKIP("Netplay sockets are not available");
+
+	REQUIRE(socket_a.connect("127.0.0.1", socket_b.local_port()));
+	REQUIRE(socket_b.connect("127.0.0.1", socket_a.local_port()));
+
+	Player a;
+	Player b;
+
+	if (!a.nes.load_rom(find_path("data/nestest.nes")) || !b.nes.load_rom(find_path("data/nestest.nes")))
+		SKIP("Could not load nestest.nes");
+
+	a.session = std::make_unique<nesem::NesNetplaySession>(a.nes, std::move(socket_a), 0, 8);
+	b.session = std::make_unique<nesem::NesNetplaySession>(b.nes, std::move(socket_b), 1, 8);
+
+	constexpr nesem::U32 frames = 200;
+
+	// b starts late and runs unevenly, so a keeps running on predictions
+	for (int i = 0; a.session->current_frame() < frames || b.session->current_frame() < frames; ++i)
+	{
+		if (a.session->current_frame() < frames)
+			a.session->run_frame(input_for(0, a.session->current_frame()));
+
+		if (i > 5 && i % 4 != 0 && b.session->current_frame() < frames)
+			b.session->run_frame(input_for(1, b.session->current_frame()));
+
+		REQUIRE(i < 10 * int(frames));
+	}
+
+	for (int i = 0; i < 10 && (a.session->confirmed_frame() < frames || b.session->confirmed_frame() < frames); ++i)
+	{
+		a.session->sync();
+		b.session->sync();
+	}
+
+	CHECK(a.session->confirmed_frame() == frames);
+	CHECK(b.session->confirmed_frame() == frames);
+	CHECK(a.session->stats().stalls > 0);
+	CHECK(a.session->stats().rollbacks > 0);
+	CHECK(a.session->stats().max_rollback_frames <= 8);
+	CHECK(a.session->stats().frames_per_host_frame() > 0.0);
+	CHECK(save(a.nes) == save(b.nes));
+}
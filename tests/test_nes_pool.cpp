@@ -0,0 +1,131 @@
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+#include <nes.hpp>
+#include <nes_pool.hpp>
+
+std::filesystem::path find_path(const std::filesystem::path &path);
+
+namespace
+{
+	struct Result
+	{
+		std::vector<nesem::U16> screen;
+		nesem::U64 frame = 0;
+		nesem::U64 state_hash = 0;
+	};
+
+	// each instance gets different input, so their states drift apart
+	nesem::U8 input_for(size_t index)
+	{
+		return nesem::U8(index % 3 == 0 ? 0 : 1 << (index % 8));
+	}
+
+	Result run_serially(const std::filesystem::path &rom, size_t index, nesem::U64 frames)
+	{
+		auto result = Result{.screen = std::vector<nesem::U16>(nesem::NesPoolOutput::width * nesem::NesPoolOutput::height)};
+
+		auto nes = nesem::Nes{nesem::NesSettings{
+			.error = [](const auto &) {},
+			.draw = [&](int x, int y, nesem::U8 color_index, util::Flags<nesem::NesColorEmphasis> emphasis) {
+				result.screen[size_t(y * nesem::NesPoolOutput::width + x)] = nesem::U16((color_index & 0x3F) | (emphasis.raw_value() << 6));
+			},
+			.player1 = std::make_unique<nesem::NesController>([&] { return input_for(index); }),
+		}};
+
+		REQUIRE(nes.load_rom(rom));
+
+		for (nesem::U64 i = 0; i < frames; ++i)
+			nes.step(nesem::NesClockStep::OneFrame);
+
+		result.frame = nes.ppu().current_frame();
+		result.state_hash = nes.state_hash();
+		return result;
+	}
+}
+
+TEST_CASE("Pooled instances run the same as serial ones", "[nes_pool][.skip][nestest.nes]")
+{
+	auto rom = find_path("data/nestest.nes");
+
+	constexpr size_t instances = 7;
+	constexpr nesem::U64 frames = 30;
+
+	auto pool = nesem::NesPool::create({.instances = instances, .threads = 3, .audio = false});
+	REQUIRE(pool);
+	REQUIRE(pool.size() == instances);
+	REQUIRE(pool.load_rom(rom));
+
+	for (size_t i = 0; i < instances; ++i)
+		pool.set_input(i, 0, input_for(i));
+
+	// split into several jobs per instance, which must still run in order
+	pool.run_frames(10);
+	pool.run_frames(5);
+	for (size_t i = 0; i < instances; ++i)
+		pool.run_frames(i, frames - 15);
+
+	pool.wait();
+
+	for (size_t i = 0; i < instances; ++i)
+	{
+		INFO("instance " << i);
+		auto expected = run_serially(rom, i, frames);
+
+		CHECK(pool.instance(i).ppu().current_frame() == expected.frame);
+		CHECK(pool.instance(i).state_hash() == expected.state_hash);
+		CHECK(pool.output(i).screen == expected.screen);
+		CHECK(pool.output(i).audio.empty());
+	}
+}
+
+TEST_CASE("Pool metrics add up", "[nes_pool][.skip][nestest.nes]")
+{
+	auto rom = find_path("data/nestest.nes");
+
+	auto pool = nesem::NesPool::create({.instances = 4, .threads = 2, .video = false});
+	REQUIRE(pool.load_rom(rom));
+	pool.reset_metrics();
+
+	pool.run_frames(12);
+	pool.submit(1, [](nesem::Nes &nes) {
+		nes.step(nesem::NesClockStep::OneFrame);
+		return nesem::U64{1};
+	});
+	pool.wait();
+
+	auto metrics = pool.metrics();
+	REQUIRE(metrics.instances.size() == 4);
+	CHECK(metrics.threads == 2);
+
+	for (size_t i = 0; i < metrics.instances.size(); ++i)
+	{
+		INFO("instance " << i);
+		CHECK(metrics.instances[i].jobs == (i == 1 ? 2 : 1));
+		CHECK(metrics.instances[i].frames == (i == 1 ? 13 : 12));
+		CHECK(metrics.instances[i].frames_per_second() > 0.0);
+	}
+
+	// the last job's audio, and nothing else
+	CHECK(!pool.output(0).audio.empty());
+
+	CHECK(metrics.busy > std::chrono::nanoseconds{0});
+	CHECK(metrics.utilization() > 0.0);
+
+	pool.reset_metrics();
+	CHECK(pool.metrics().instances[0].frames == 0);
+	CHECK(pool.metrics().steals == 0);
+}
+
+TEST_CASE("Empty pools do nothing", "[nes_pool]")
+{
+	auto pool = nesem::NesPool::create({.instances = 0});
+	CHECK(!pool);
+	CHECK(pool.size() == 0);
+	CHECK(!pool.load_rom("nothing.nes"));
+	pool.wait();
+	CHECK(pool.metrics().instances.empty());
+}
@@ -0,0 +1,76 @@
+#include <array>
+#include <cstddef>
+#include <filesystem>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+#include <nes.hpp>
+#include <nes_rewind.hpp>
+
+std::filesystem::path find_path(const std::filesystem::path &path);
+
+TEST_CASE("Rewind delta encoding", "[nes_rewind]")
+{
+	auto base = std::vector<std::byte>(300, std::byte{0x11});
+	auto state = base;
+	state[0] = std::byte{0x22};
+	state[150] = std::byte{0x33};
+	state[151] = std::byte{0x44};
+	state[299] = std::byte{0x55};
+
+	auto encoded = std::vector<std::byte>(state.size());
+	auto size = nesem::rewind::encode_delta(state, base, encoded);
+
+	REQUIRE(size > 0);
+	CHECK(size < 20);
+
+	auto decoded = base;
+	REQUIRE(nesem::rewind::decode_delta(std::span(encoded).first(size), decoded));
+	CHECK(decoded == state);
+
+	SECTION("Identical states encode to almost nothing")
+	{
+		CHECK(nesem::rewind::encode_delta(base, base, encoded) <= 4);
+	}
+
+	SECTION("Encoding fails if the output is too small")
+	{
+		CHECK(nesem::rewind::encode_delta(state, base, std::span(encoded).first(4)) == 0);
+	}
+}
+
+TEST_CASE("Rewind steps back through history", "[nes_rewind][nestest.nes]")
+{
+	auto nes = nesem::Nes{nesem::NesSettings{.error = [](const auto &msg) { FAIL(msg); }}};
+
+	if (!nes.load_rom(find_path("data/nestest.nes")))
+		SKIP("Could not load nestest.nes");
+
+	constexpr size_t frames = 100;
+
+	// small budget with a short keyframe interval so old groups get evicted
+	auto rewind = nesem::NesRewind(nes.state_size() * 8, 10);
+	auto ticks = std::vector<nesem::U64>{};
+
+	for (size_t i = 0; i < frames; ++i)
+	{
+		nes.step(nesem::NesClockStep::OneFrame);
+		rewind.push(nes);
+		ticks.push_back(nes.ppu().current_tick());
+	}
+
+	REQUIRE(rewind.frame_count() > 0);
+	REQUIRE(rewind.frame_count() < frames);
+	CHECK(rewind.memory_used() <= rewind.budget());
+	CHECK(rewind.seconds_per_mib() > 0.0);
+
+	auto history = rewind.frame_count();
+
+	for (size_t i = 0; i < history; ++i)
+	{
+		REQUIRE(rewind.step_back(nes));
+		CHECK(nes.ppu().current_tick() == ticks[frames - 1 - i]);
+	}
+
+	CHECK(!rewind.step_back(nes));
+}
@@ -0,0 +1,456 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+#include <nes_rom_loader.hpp>
+
+std::filesystem::path find_path(const std::filesystem::path &path);
+
+namespace
+{
+	using namespace nesem::mappers::ines_2;
+
+	void put_u16(std::vector<nesem::U8> &out, unsigned int value)
+	{
+		out.push_back(nesem::U8(value));
+		out.push_back(nesem::U8(value >> 8));
+	}
+
+	void put_u32(std::vector<nesem::U8> &out, nesem::U32 value)
+	{
+		put_u16(out, value & 0xFFFF);
+		put_u16(out, value >> 16);
+	}
+
+	nesem::U32 crc32(const std::vector<nesem::U8> &data)
+	{
+		nesem::U32 crc = 0xFFFFFFFF;
+
+		for (auto byte : data)
+		{
+			crc ^= byte;
+			for (int bit = 0; bit < 8; ++bit)
+				crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+		}
+
+		return ~crc;
+	}
+
+	// deflate using only stored blocks, which every inflater has to understand
+	std::vector<nesem::U8> deflate_stored(const std::vector<nesem::U8> &data)
+	{
+		std::vector<nesem::U8> out;
+
+		for (size_t offset = 0; offset < data.size(); offset += 0xFFFF)
+		{
+			auto size = std::min<size_t>(0xFFFF, data.size() - offset);
+
+			out.push_back(offset + size == data.size() ? 1 : 0);
+			put_u16(out, unsigned(size));
+			put_u16(out, unsigned(~size & 0xFFFF));
+			out.insert(out.end(), data.begin() + std::ptrdiff_t(offset), data.begin() + std::ptrdiff_t(offset + size));
+		}
+
+		return out;
+	}
+
+	std::vector<nesem::U8> make_gzip(const std::vector<nesem::U8> &data)
+	{
+		auto out = std::vector<nesem::U8>{0x1F, 0x8B, 8, 0, 0, 0, 0, 0, 0, 0xFF};
+
+		auto deflated = deflate_stored(data);
+		out.insert(out.end(), deflated.begin(), deflated.end());
+
+		put_u32(out, crc32(data));
+		put_u32(out, nesem::U32(data.size()));
+		return out;
+	}
+
+	// a zip holding a text file before the rom, with the rom deflated or stored
+	std::vector<nesem::U8> make_zip(const std::vector<nesem::U8> &data, bool deflate)
+	{
+		struct File
+		{
+			std::string name;
+			std::vector<nesem::U8> data;
+			std::vector<nesem::U8> compressed;
+			unsigned int method;
+			nesem::U32 offset = 0;
+		};
+
+		auto readme = std::string("not a rom");
+		auto files = std::vector<File>{
+			{"readme.txt", {readme.begin(), readme.end()}, {readme.begin(), readme.end()}, 0},
+			{"roms/game.NES", data, deflate ? deflate_stored(data) : data, deflate ? 8u : 0u},
+		};
+
+		std::vector<nesem::U8> out;
+
+		for (auto &file : files)
+		{
+			file.offset = nesem::U32(out.size());
+			put_u32(out, 0x04034B50);
+			put_u16(out, 20);
+			put_u16(out, 0);
+			put_u16(out, file.method);
+			put_u32(out, 0);
+			put_u32(out, crc32(file.data));
+			put_u32(out, nesem::U32(file.compressed.size()));
+			put_u32(out, nesem::U32(file.data.size()));
+			put_u16(out, unsigned(file.name.size()));
+			put_u16(out, 0);
+			out.insert(out.end(), file.name.begin(), file.name.end());
+			out.insert(out.end(), file.compressed.begin(), file.compressed.end());
+		}
+
+		auto directory = nesem::U32(out.size());
+
+		for (const auto &file : files)
+		{
+			put_u32(out, 0x02014B50);
+			put_u16(out, 20);
+			put_u16(out, 20);
+			put_u16(out, 0);
+			put_u16(out, file.method);
+			put_u32(out, 0);
+			put_u32(out, crc32(file.data));
+			put_u32(out, nesem::U32(file.compressed.size()));
+			put_u32(out, nesem::U32(file.data.size()));
+			put_u16(out, unsigned(file.name.size()));
+			put_u16(out, 0);
+			put_u16(out, 0);
+			put_u16(out, 0);
+			put_u16(out, 0);
+			put_u32(out, 0);
+			put_u32(out, file.offset);
+			out.insert(out.end(), file.name.begin(), file.name.end());
+		}
+
+		auto directory_size = nesem::U32(out.size()) - directory;
+
+		put_u32(out, 0x06054B50);
+		put_u16(out, 0);
+		put_u16(out, 0);
+		put_u16(out, unsigned(files.size()));
+		put_u16(out, unsigned(files.size()));
+		put_u32(out, directory_size);
+		put_u32(out, directory);
+		put_u16(out, 0);
+		return out;
+	}
+
+	RomData make_rom(const std::string &sha1, int mapper)
+	{
+		return RomData{
+			.prgrom = {.size = 32768, .crc32 = "1A2B3C4D", .sha1 = sha1, .sum16 = "BEEF"},
+			.rom = {.size = 40960, .crc32 = "0F0F0F0F", .sha1 = sha1},
+			.pcb = {.mapper = mapper, .submapper = 0, .mirroring = nesem::mappers::MirroringMode::vertical, .battery = false},
+			.console = {.type = 0, .region = 1},
+			.expansion = Expansion::standard_controller,
+		};
+	}
+}
+
+TEST_CASE("Rom loader finds entries in its nes20db index", "[nes_rom_loader]")
+{
+	auto full = make_rom("F0E1D2C3B4A5968778695A4B3C2D1E0F00112233", 4);
+	full.chrrom = ChrRom{.size = 8192, .crc32 = "DEADBEEF", .sha1 = "0123456789ABCDEF0123456789ABCDEF01234567", .sum16 = "1234"};
+	full.prgnvram = 8192;
+	full.miscrom = MiscRom{.size = 256, .crc32 = "not hex", .sha1 = "", .number = 2};
+	full.prgrom.sum16 = std::string(300, 'A');
+	full.rom.crc32 = std::string(300, 'z');
+	full.vs = Vs{.hardware = 3, .ppu = 7};
+	full.trainer = Trainer{.size = 512, .crc32 = "00000000", .sha1 = "FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFF"};
+
+	auto loader = nesem::NesRomLoader({
+		make_rom("00112233445566778899AABBCCDDEEFF00112233", 0),
+		full,
+		make_rom("00112233445566778899AABBCCDDEEFF00112233", 1),
+		make_rom("not a sha1", 2),
+		make_rom("FFEEDDCCBBAA99887766554433221100FFEEDDCC", 66),
+	});
+
+	auto found = loader.find_rom_data(full.rom.sha1);
+	REQUIRE(found);
+	CHECK(found->prgrom.size == full.prgrom.size);
+	CHECK(found->prgrom.crc32 == full.prgrom.crc32);
+	CHECK(found->prgrom.sha1 == full.prgrom.sha1);
+	CHECK(found->prgrom.sum16 == full.prgrom.sum16);
+	CHECK(found->rom.sha1 == full.rom.sha1);
+	CHECK(found->pcb.mapper == 4);
+	CHECK(found->pcb.mirroring == nesem::mappers::MirroringMode::vertical);
+	CHECK(found->console.region == 1);
+	CHECK(found->expansion == Expansion::standard_controller);
+
+	REQUIRE(found->chrrom);
+	CHECK(found->chrrom->sha1 == full.chrrom->sha1);
+	CHECK(found->chrrom->sum16 == full.chrrom->sum16);
+	CHECK(!found->chrram);
+	CHECK(found->prgnvram == full.prgnvram);
+	CHECK(!found->prgram);
+
+	// text that isn't hex comes back as it went in
+	REQUIRE(found->miscrom);
+	CHECK(found->miscrom->crc32 == "not hex");
+	CHECK(found->miscrom->sha1.empty());
+	CHECK(found->miscrom->number == 2);
+
+	// long text isn't cut short, packed or not
+	CHECK(found->prgrom.sum16 == full.prgrom.sum16);
+	CHECK(found->rom.crc32 == full.rom.crc32);
+
+	REQUIRE(found->vs);
+	CHECK(found->vs->ppu == 7);
+	REQUIRE(found->trainer);
+	CHECK(found->trainer->sha1 == full.trainer->sha1);
+
+	// the first of entries sharing a sha1 wins
+	auto first = loader.find_rom_data("00112233445566778899AABBCCDDEEFF00112233");
+	REQUIRE(first);
+	CHECK(first->pcb.mapper == 0);
+
+	auto last = loader.find_rom_data("FFEEDDCCBBAA99887766554433221100FFEEDDCC");
+	REQUIRE(last);
+	CHECK(last->pcb.mapper == 66);
+
+	CHECK(!loader.find_rom_data("00112233445566778899AABBCCDDEEFF00112234"));
+	CHECK(!loader.find_rom_data("not a sha1"));
+	CHECK(!loader.find_rom_data(""));
+}
+
+TEST_CASE("Rom loader without a nes20db finds nothing", "[nes_rom_loader]")
+{
+	auto loader = nesem::NesRomLoader();
+	CHECK(!loader.find_rom_data("00112233445566778899AABBCCDDEEFF00112233"));
+}
+
+TEST_CASE("Rom loader keeps the rom's storage alive", "[nes_rom_loader][nestest.nes]")
+{
+	auto filename = find_path("data/nestest.nes");
+
+	auto file = std::ifstream(filename, std::ios::binary);
+	if (!file)
+		SKIP("Could not open nestest.nes");
+
+	auto contents = std::vector<nesem::U8>(std::istreambuf_iterator<char>(file), {});
+
+	auto loader = nesem::NesRomLoader();
+
+	auto from_file = loader.load_rom(filename);
+	REQUIRE(from_file);
+	CHECK(from_file->storage);
+
+	// the rom is still in use, so loading it again gives the same image
+	auto copied = loader.load_rom(contents);
+	REQUIRE(copied);
+	CHECK(copied == from_file);
+	CHECK(copied->prg_rom.data() != contents.data() + 16);
+
+	// the copy doesn't depend on the buffer it was loaded from
+	auto header = std::vector<nesem::U8>(contents.begin(), contents.begin() + 16);
+	auto expected_prg = std::vector<nesem::U8>(contents.begin() + 16, contents.begin() + 16 + 16384);
+	contents.assign(contents.size(), 0);
+
+	CHECK(copied->sha1 == from_file->sha1);
+	CHECK(std::ranges::equal(copied->prg_rom, expected_prg));
+	CHECK(std::ranges::equal(from_file->prg_rom, expected_prg));
+	CHECK(std::ranges::equal(copied->chr_rom, from_file->chr_rom));
+
+	// copies of a rom share its contents, which last as long as any copy does
+	auto prg_rom = from_file->prg_rom.data();
+	auto rom = *from_file;
+	from_file.reset();
+	copied.reset();
+	CHECK(rom.prg_rom.data() == prg_rom);
+	CHECK(std::ranges::equal(rom.prg_rom, expected_prg));
+
+	// once nothing uses the image, loading it again makes a new one, a copy aligned to cache lines
+	contents.assign(expected_prg.begin(), expected_prg.end());
+	contents.insert(contents.begin(), header.begin(), header.end());
+	contents.resize(16 + 16384 + 8192);
+
+	auto reloaded = loader.load_rom(contents);
+	REQUIRE(reloaded);
+	CHECK(reinterpret_cast<std::uintptr_t>(reloaded->prg_rom.data()) % 64 == 0);
+	CHECK(reinterpret_cast<std::uintptr_t>(reloaded->chr_rom.data()) % 64 == 0);
+	CHECK(std::ranges::equal(reloaded->prg_rom, expected_prg));
+}
+
+TEST_CASE("Rom loader copies roms so their file can be rebuilt while they run", "[nes_rom_loader][nestest.nes]")
+{
+	auto dir = std::filesystem::temp_directory_path() / "nesem_test_rom_rebuild";
+	std::filesystem::remove_all(dir);
+	std::filesystem::create_directories(dir);
+
+	auto filename = dir / "nestest.nes";
+	std::error_code ec;
+	std::filesystem::copy_file(find_path("data/nestest.nes"), filename, ec);
+	if (ec)
+		SKIP("Could not copy nestest.nes");
+
+	auto loader = nesem::NesRomLoader();
+	auto rom = loader.load_rom(filename);
+	REQUIRE(rom);
+
+	auto expected_prg = std::vector<nesem::U8>(rom->prg_rom.begin(), rom->prg_rom.end());
+
+	// a build writing the file again truncates it first, which would pull the pages out from under a mapping
+	std::ofstream(filename, std::ios::binary | std::ios::trunc) << "NES";
+
+	CHECK(std::ranges::equal(rom->prg_rom, expected_prg));
+
+	rom.reset();
+	std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("Rom loader gives a rom with a changed header an image of its own", "[nes_rom_loader][nestest.nes]")
+{
+	auto filename = find_path("data/nestest.nes");
+
+	auto file = std::ifstream(filename, std::ios::binary);
+	if (!file)
+		SKIP("Could not open nestest.nes");
+
+	auto contents = std::vector<nesem::U8>(std::istreambuf_iterator<char>(file), {});
+
+	auto loader = nesem::NesRomLoader();
+
+	auto original = loader.load_rom(contents);
+	REQUIRE(original);
+
+	// same contents, but now the header says there's a battery
+	contents[6] ^= 0x02;
+
+	auto fixed = loader.load_rom(contents);
+	REQUIRE(fixed);
+	CHECK(fixed != original);
+	CHECK(fixed->sha1 == original->sha1);
+	CHECK(fixed->v1.has_battery != original->v1.has_battery);
+
+	// while loading the original header again still shares the first image
+	contents[6] ^= 0x02;
+	CHECK(loader.load_rom(contents) == original);
+}
+
+TEST_CASE("Rom loader remembers rom hashes between loaders", "[nes_rom_loader][nestest.nes]")
+{
+	auto source = find_path("data/nestest.nes");
+
+	auto dir = std::filesystem::temp_directory_path() / "nesem_test_rom_hash_cache";
+	std::filesystem::remove_all(dir);
+	std::filesystem::create_directories(dir);
+
+	auto filename = dir / "nestest.nes";
+	std::error_code ec;
+	std::filesystem::copy_file(source, filename, ec);
+	if (ec)
+		SKIP("Could not copy nestest.nes");
+
+	std::string sha1;
+	{
+		auto loader = nesem::NesRomLoader::create("", dir);
+		auto rom = loader.load_rom(filename);
+		REQUIRE(rom);
+		sha1 = rom->sha1;
+	}
+
+	CHECK(std::filesystem::exists(dir / "rom_hashes.bin"));
+	CHECK(!std::filesystem::exists(dir / "rom_hashes.bin.tmp"));
+
+	// change the contents but not the size or modification time, which the cache can't tell apart from no change
+	auto modified = std::filesystem::last_write_time(filename);
+	{
+		auto file = std::fstream(filename, std::ios::binary | std::ios::in | std::ios::out);
+		file.seekp(16);
+		file.put('\x55');
+	}
+	std::filesystem::last_write_time(filename, modified);
+
+	{
+		auto loader = nesem::NesRomLoader::create("", dir);
+		auto rom = loader.load_rom(filename);
+		REQUIRE(rom);
+		CHECK(rom->sha1 == sha1);
+	}
+
+	// once the file looks changed it's hashed again
+	std::filesystem::last_write_time(filename, modified + std::chrono::seconds(10));
+
+	{
+		auto loader = nesem::NesRomLoader::create("", dir);
+		auto rom = loader.load_rom(filename);
+		REQUIRE(rom);
+		CHECK(rom->sha1 != sha1);
+	}
+
+	std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("Rom loader inflates roms from gzip and zip files", "[nes_rom_loader][nestest.nes]")
+{
+	auto file = std::ifstream(find_path("data/nestest.nes"), std::ios::binary);
+	if (!file)
+		SKIP("Could not open nestest.nes");
+
+	auto contents = std::vector<nesem::U8>(std::istreambuf_iterator<char>(file), {});
+
+	auto dir = std::filesystem::temp_directory_path() / "nesem_test_rom_archives";
+	std::filesystem::remove_all(dir);
+	std::filesystem::create_directories(dir);
+
+	auto write = [&](const std::string &name, const std::vector<nesem::U8> &data) {
+		auto filename = dir / name;
+		std::ofstream(filename, std::ios::binary).write(reinterpret_cast<const char *>(data.data()), std::streamsize(data.size()));
+		return filename;
+	};
+
+	auto loader = nesem::NesRomLoader();
+	auto expected = loader.load_rom(contents);
+	REQUIRE(expected);
+
+	auto sha1 = expected->sha1;
+	auto expected_prg = std::vector<nesem::U8>(expected->prg_rom.begin(), expected->prg_rom.end());
+	auto expected_chr = std::vector<nesem::U8>(expected->chr_rom.begin(), expected->chr_rom.end());
+	expected.reset();
+
+	auto archives = std::vector{
+		write("nestest.nes.gz", make_gzip(contents)),
+		write("deflated.zip", make_zip(contents, true)),
+		write("stored.zip", make_zip(contents, false)),
+	};
+
+	for (const auto &archive : archives)
+	{
+		INFO(archive);
+
+		auto rom = loader.load_rom(archive);
+		REQUIRE(rom);
+		CHECK(rom->sha1 == sha1);
+		CHECK(std::ranges::equal(rom->prg_rom, expected_prg));
+		CHECK(std::ranges::equal(rom->chr_rom, expected_chr));
+		CHECK(reinterpret_cast<std::uintptr_t>(rom->prg_rom.data()) % 64 == 0);
+
+		// and looked up without loading, as a library scan does
+		auto identified = loader.identify_rom(archive);
+		REQUIRE(identified);
+		CHECK(identified->sha1 == sha1);
+		CHECK(identified->v1.prg_rom_size == rom->v1.prg_rom_size);
+	}
+
+	// damaged archives are turned away rather than loaded
+	auto damaged = make_gzip(contents);
+	damaged[20] ^= 0xFF;
+	CHECK(!loader.load_rom(write("damaged.gz", damaged)));
+
+	auto truncated = make_zip(contents, true);
+	truncated.resize(truncated.size() / 2);
+	CHECK(!loader.load_rom(write("truncated.zip", truncated)));
+
+	std::filesystem::remove_all(dir);
+}
@@ -0,0 +1,87 @@
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+#include <nes.hpp>
+#include <nes_run_ahead.hpp>
+
+#include "test_helpers.hpp"
+
+TEST_CASE("Run ahead shows the future without changing the present", "[nes_run_ahead][nestest.nes]")
+{
+	int frames_shown = 0;
+	size_t samples = 0;
+	size_t reference_samples = 0;
+
+	auto nes = nesem::Nes{nesem::NesSettings{
+		.error = [](const auto &msg) { FAIL(msg); },
+		.frame_ready = [&] { ++frames_shown; },
+		.audio = [&](float) { ++samples; },
+	}};
+
+	auto reference = nesem::Nes{nesem::NesSettings{
+		.error = [](const auto &msg) { FAIL(msg); },
+		.audio = [&](float) { ++reference_samples; },
+	}};
+
+	if (!nes.load_rom(find_path("data/nestest.nes")) || !reference.load_rom(find_path("data/nestest.nes")))
+		SKIP("Could not load nestest.nes");
+
+	// start both from the exact same power on state
+	REQUIRE(reference.load_state(save(nes)));
+
+	auto run_ahead = nesem::NesRunAhead(2);
+
+	for (int i = 0; i < 10; ++i)
+	{
+		run_ahead.run_frame(nes);
+		reference.step(nesem::NesClockStep::OneFrame);
+	}
+
+	CHECK(frames_shown == 10);
+	CHECK(samples == reference_samples);
+	CHECK(nes.ppu().current_tick() == reference.ppu().current_tick());
+	CHECK(save(nes) == save(reference));
+
+	SECTION("No frames ahead is the same as stepping")
+	{
+		run_ahead.set_frames(0);
+		run_ahead.run_frame(nes);
+		reference.step(nesem::NesClockStep::OneFrame);
+
+		CHECK(frames_shown == 11);
+		CHECK(save(nes) == save(reference));
+	}
+}
+
+TEST_CASE("Run ahead on a second instance", "[nes_run_ahead][nestest.nes]")
+{
+	int frames_shown = 0;
+	int primary_frames_shown = 0;
+
+	auto nes = nesem::Nes{nesem::NesSettings{
+		.error = [](const auto &msg) { FAIL(msg); },
+		.frame_ready = [&] { ++primary_frames_shown; },
+	}};
+
+	auto ahead = std::make_unique<nesem::Nes>(nesem::NesSettings{
+		.frame_ready = [&] { ++frames_shown; },
+	});
+
+	if (!nes.load_rom(find_path("data/nestest.nes")) || !ahead->load_rom(find_path("data/nestest.nes")))
+		SKIP("Could not load nestest.nes");
+
+	auto run_ahead = nesem::NesRunAheadThread(std::move(ahead));
+	REQUIRE(run_ahead);
+
+	for (int i = 0; i < 10; ++i)
+		run_ahead.run_frame(nes);
+
+	run_ahead.wait();
+
+	CHECK(primary_frames_shown == 0);
+	CHECK(frames_shown == 10);
+	CHECK(run_ahead.ahead().ppu().current_frame() == nes.ppu().current_frame() + 1);
+}
@@ -0,0 +1,161 @@
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+#include <nes.hpp>
+#include <nes_movie.hpp>
+#include <nes_search.hpp>
+
+std::filesystem::path find_path(const std::filesystem::path &path);
+
+namespace
+{
+	const auto menu_down = util::Flags(nesem::Buttons::Select, nesem::Buttons::Down).raw_value();
+
+	std::vector<nesem::U8> run_ram(const std::filesystem::path &rom, nesem::U8 buttons, int frames)
+	{
+		auto nes = nesem::Nes{nesem::NesSettings{
+			.error = [](const auto &) {},
+			.player1 = std::make_unique<nesem::NesController>([&] { return buttons; }),
+		}};
+
+		REQUIRE(nes.load_rom(rom));
+
+		for (int i = 0; i < frames; ++i)
+			nes.step(nesem::NesClockStep::OneFrame);
+
+		auto ram = nes.bus().work_ram();
+		return {ram.begin(), ram.end()};
+	}
+
+	struct Goal
+	{
+		size_t addr = 0;
+		nesem::U8 value = 0;
+
+		bool operator()(std::span<const nesem::U8> ram) const
+		{
+			return ram[addr] == value;
+		}
+	};
+
+	// a byte of ram that walking down the menu changes and doing nothing doesn't
+	std::optional<Goal> find_goal(const std::filesystem::path &rom)
+	{
+		auto idle = run_ram(rom, 0, 40);
+		auto pressed = run_ram(rom, menu_down, 40);
+
+		for (size_t i = 0; i < idle.size(); ++i)
+		{
+			if (idle[i] != pressed[i])
+				return Goal{.addr = i, .value = pressed[i]};
+		}
+
+		return std::nullopt;
+	}
+
+	nesem::NesSearchSettings search_settings(const std::filesystem::path &rom, unsigned int threads)
+	{
+		return nesem::NesSearchSettings{
+			.rom = rom,
+			.actions = {0, menu_down},
+			.frames_per_action = 4,
+			.max_depth = 12,
+			.beam_width = 32,
+			.best_count = 2,
+			.threads = threads,
+		};
+	}
+}
+
+TEST_CASE("Searches find inputs that reach the goal and play back to it", "[nes_search][.skip][nestest.nes]")
+{
+	auto rom = find_path("data/nestest.nes");
+
+	auto goal = find_goal(rom);
+	REQUIRE(goal);
+
+	auto result = nesem::search_inputs(search_settings(rom, 2), *goal, {});
+
+	REQUIRE(!result.best.empty());
+	CHECK(result.stats.nodes > 0);
+	CHECK(result.stats.frames > 0);
+
+	for (const auto &solution : result.best)
+	{
+		CHECK(solution.reached_goal);
+		CHECK(solution.movie.frame_count() == solution.frames);
+
+		auto player = nesem::NesMoviePlayer(solution.movie);
+
+		auto nes = nesem::Nes{nesem::NesSettings{
+			.error = [](const auto &) {},
+			.player1 = std::make_unique<nesem::NesController>([&] { return player.poll(0); }),
+		}};
+
+		REQUIRE(nes.load_rom(rom));
+		REQUIRE(player.start(nes));
+
+		while (player.run_frame())
+			;
+
+		CHECK((*goal)(nes.bus().work_ram()));
+	}
+
+	// shortest first
+	for (size_t i = 1; i < result.best.size(); ++i)
+		CHECK(result.best[i - 1].frames <= result.best[i].frames);
+}
+
+TEST_CASE("Searches don't depend on the number of threads", "[nes_search][.skip][nestest.nes]")
+{
+	auto rom = find_path("data/nestest.nes");
+
+	auto goal = find_goal(rom);
+	REQUIRE(goal);
+
+	auto serial = nesem::search_inputs(search_settings(rom, 1), *goal, {});
+	auto parallel = nesem::search_inputs(search_settings(rom, 3), *goal, {});
+
+	REQUIRE(serial.best.size() == parallel.best.size());
+	CHECK(serial.stats.nodes == parallel.stats.nodes);
+	CHECK(serial.stats.duplicates == parallel.stats.duplicates);
+
+	for (size_t i = 0; i < serial.best.size(); ++i)
+		CHECK(serial.best[i].actions == parallel.best[i].actions);
+}
+
+TEST_CASE("Searches drop states whose ram was already seen", "[nes_search][.skip][nestest.nes]")
+{
+	auto rom = find_path("data/nestest.nes");
+
+	auto settings = nesem::NesSearchSettings{
+		.rom = rom,
+		.actions = {0, 0},
+		.max_depth = 5,
+		.best_count = 3,
+		.threads = 2,
+	};
+
+	auto result = nesem::search_inputs(settings, {}, [](std::span<const nesem::U8>) { return 1.0; });
+
+	// the second action always lands where the first did, so there is only ever one state to expand
+	CHECK(result.stats.depth <= 5);
+	CHECK(result.stats.nodes == 2 * result.stats.depth);
+	CHECK(result.stats.duplicates >= result.stats.depth);
+
+	REQUIRE(!result.best.empty());
+	CHECK(!result.best.front().reached_goal);
+}
+
+TEST_CASE("Searches without a rom find nothing", "[nes_search]")
+{
+	auto result = nesem::search_inputs(nesem::NesSearchSettings{.rom = "does not exist.nes", .threads = 1}, {}, {});
+
+	CHECK(result.best.empty());
+	CHECK(result.stats.nodes == 0);
+}
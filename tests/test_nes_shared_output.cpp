@@ -0,0 +1,119 @@
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+#include <nes.hpp>
+#include <nes_shared_output.hpp>
+
+std::filesystem::path find_path(const std::filesystem::path &path);
+
+namespace
+{
+	constexpr size_t screen_size = nesem::NesSharedLayout::width * nesem::NesSharedLayout::height;
+}
+
+TEST_CASE("Shared output publishes what the system draws", "[nes_shared_output][nestest.nes]")
+{
+	auto output = nesem::NesSharedOutput::create("nesem-test-indexed", nesem::NesSharedPixelFormat::indexed, 44100, 1000);
+	if (!output)
+		SKIP("Shared memory not available");
+
+	auto reader = nesem::NesSharedOutputReader::open("nesem-test-indexed");
+	REQUIRE(reader);
+	CHECK(reader.layout().audio_capacity == 1024);
+	CHECK(reader.layout().frame_size == screen_size * sizeof(nesem::U16));
+
+	auto pixels = std::vector<std::byte>(reader.layout().frame_size);
+	CHECK(!reader.read_frame(pixels));
+
+	auto screen = std::vector<nesem::U16>(screen_size);
+	size_t samples = 0;
+
+	auto nes = nesem::Nes{nesem::NesSettings{
+		.error = [](const auto &) {},
+		.draw = [&](int x, int y, nesem::U8 color_index, util::Flags<nesem::NesColorEmphasis> emphasis) {
+			screen[size_t(y * 256 + x)] = nesem::U16((color_index & 0x3F) | (emphasis.raw_value() << 6));
+			output.draw(x, y, color_index, emphasis);
+		},
+		.frame_ready = [&] { output.frame_complete(); },
+		.audio = [&](float sample) {
+			++samples;
+			output.push(sample);
+		},
+	}};
+
+	if (!nes.load_rom(find_path("data/nestest.nes")))
+		SKIP("Could not load nestest.nes");
+
+	for (int i = 0; i < 5; ++i)
+		nes.step(nesem::NesClockStep::OneFrame);
+
+	// frames the reader didn't look at show up as a jump in the frame number
+	auto frame = reader.read_frame(pixels);
+	REQUIRE(frame);
+	CHECK(*frame + 1 == reader.layout().frame_count.load());
+	CHECK(std::memcmp(pixels.data(), screen.data(), pixels.size()) == 0);
+
+	nes.step(nesem::NesClockStep::OneFrame);
+	auto next = reader.read_frame(pixels);
+	REQUIRE(next);
+	CHECK(*next == *frame + 1);
+	CHECK(std::memcmp(pixels.data(), screen.data(), pixels.size()) == 0);
+
+	// the reader has fallen more than a ring behind by now, so it only gets the newest ring's worth
+	REQUIRE(samples > 1024);
+
+	nesem::U64 position = 0;
+	auto audio = std::vector<float>(4096);
+	CHECK(reader.read_audio(position, audio) == 1024);
+	CHECK(position == samples);
+	CHECK(reader.read_audio(position, audio) == 0);
+}
+
+TEST_CASE("Shared output maps rgba frames through the palette", "[nes_shared_output]")
+{
+	auto output = nesem::NesSharedOutput::create("nesem-test-rgba", nesem::NesSharedPixelFormat::rgba, 44100);
+	if (!output)
+		SKIP("Shared memory not available");
+
+	auto palette = std::vector<nesem::U32>(nesem::NesSharedOutput::palette_size);
+	for (size_t i = 0; i < palette.size(); ++i)
+		palette[i] = nesem::NesSharedOutput::rgba(nesem::U8(i), nesem::U8(i >> 8), 0x80);
+
+	output.set_palette(std::span<const nesem::U32, nesem::NesSharedOutput::palette_size>(palette));
+
+	auto emphasis = util::Flags(nesem::NesColorEmphasis::red);
+	output.draw(0, 0, 0x21, emphasis);
+	output.draw(255, 239, 0x0F, util::Flags(nesem::NesColorEmphasis::none));
+	output.frame_complete();
+
+	auto reader = nesem::NesSharedOutputReader::open("/nesem-test-rgba");
+	REQUIRE(reader);
+	CHECK(reader.layout().pixel_format == nesem::NesSharedPixelFormat::rgba);
+
+	auto pixels = std::vector<std::byte>(reader.layout().frame_size);
+	REQUIRE(reader.read_frame(pixels) == 0);
+
+	CHECK(pixels[0] == std::byte{0x61});
+	CHECK(pixels[1] == std::byte{0x00});
+	CHECK(pixels[2] == std::byte{0x80});
+	CHECK(pixels[3] == std::byte{0xFF});
+	CHECK(pixels[pixels.size() - 4] == std::byte{0x0F});
+}
+
+TEST_CASE("Shared output readers need a segment to read", "[nes_shared_output]")
+{
+	CHECK(!nesem::NesSharedOutputReader::open("nesem-test-missing"));
+
+	{
+		auto output = nesem::NesSharedOutput::create("nesem-test-gone", nesem::NesSharedPixelFormat::indexed, 44100);
+		if (!output)
+			SKIP("Shared memory not available");
+	}
+
+	// the segment goes away with its output
+	CHECK(!nesem::NesSharedOutputReader::open("nesem-test-gone"));
+}
@@ -0,0 +1,112 @@
+#include <array>
+#include <cstddef>
+#include <filesystem>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+#include <nes.hpp>
+#include <nes_state.hpp>
+
+std::filesystem::path find_path(const std::filesystem::path &path);
+
+TEST_CASE("State writer and reader", "[nes_state]")
+{
+	std::array<std::byte, 16> buffer{};
+
+	SECTION("Values round trip")
+	{
+		auto writer = nesem::NesStateWriter(buffer);
+		writer.write(nesem::U8(0x12), nesem::U32{0xDEADBEEF}, nesem::Addr{0xC000});
+
+		REQUIRE(writer.ok());
+		REQUIRE(writer.size() == 7);
+
+		nesem::U8 a = 0;
+		nesem::U32 b = 0;
+		nesem::Addr c{0};
+
+		auto reader = nesem::NesStateReader(std::span(buffer).first(writer.size()));
+		reader.read(a, b, c);
+
+		REQUIRE(reader.ok());
+		CHECK(reader.remaining() == 0);
+		CHECK(a == 0x12);
+		CHECK(b == 0xDEADBEEF);
+		CHECK(c == nesem::Addr{0xC000});
+	}
+
+	SECTION("Writing past the end is counted but dropped")
+	{
+		auto writer = nesem::NesStateWriter(std::span(buffer).first(4));
+		writer.write(nesem::U64(1));
+
+		CHECK(!writer.ok());
+		CHECK(writer.size() == 8);
+	}
+
+	SECTION("Reading past the end fails")
+	{
+		auto reader = nesem::NesStateReader(std::span(buffer).first(2));
+		nesem::U32 value = 42;
+		reader.read(value);
+
+		CHECK(!reader.ok());
+		CHECK(value == 42);
+	}
+}
+
+TEST_CASE("Save states restore the system exactly", "[nes_state][nestest.nes]")
+{
+	nesem::U64 pixel_hash = 0;
+
+	auto nes = nesem::Nes{nesem::NesSettings{
+		.error = [](const auto &msg) { FAIL(msg); },
+		.draw = [&pixel_hash](int x, int y, nesem::U8 color_index, auto) {
+			pixel_hash = (pixel_hash ^ nesem::U64(x + y * 256 + color_index * 65536)) * 0x100000001B3;
+		},
+	}};
+
+	if (!nes.load_rom(find_path("data/nestest.nes")))
+		SKIP("Could not load nestest.nes");
+
+	REQUIRE(nes.state_size() > 0);
+
+	for (int i = 0; i < 10; ++i)
+		nes.step(nesem::NesClockStep::OneFrame);
+
+	auto state = std::vector<std::byte>(nes.state_size());
+	REQUIRE(nes.save_state(state) == state.size());
+
+	auto run = [&] {
+		pixel_hash = 0;
+		for (int i = 0; i < 30; ++i)
+			nes.step(nesem::NesClockStep::OneFrame);
+
+		return std::array{
+			pixel_hash,
+			nes.cpu().current_cycle(),
+			nes.ppu().current_tick(),
+			nesem::U64(to_integer(nes.cpu().state().PC)),
+		};
+	};
+
+	auto expected = run();
+
+	REQUIRE(nes.load_state(state));
+	CHECK(run() == expected);
+
+	SECTION("Saving into a buffer that is too small fails")
+	{
+		auto small = std::vector<std::byte>(nes.state_size() - 1);
+		CHECK(nes.save_state(small) == 0);
+	}
+
+	SECTION("Loading garbage fails and leaves the system alone")
+	{
+		auto garbage = std::vector<std::byte>(nes.state_size(), std::byte{0xAB});
+		auto before = nes.cpu().current_cycle();
+
+		CHECK(!nes.load_state(garbage));
+		CHECK(nes.cpu().current_cycle() == before);
+	}
+}
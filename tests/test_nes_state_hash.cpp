@@ -0,0 +1,104 @@
+#include <cstddef>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+#include <nes.hpp>
+#include <nes_state_hash.hpp>
+
+#include "test_helpers.hpp"
+
+TEST_CASE("Memory hash follows writes", "[nes_state_hash]")
+{
+	auto memory = std::vector<nesem::U8>(64);
+	auto hash = nesem::NesMemoryHash(nesem::NesHashedMemory::ram);
+	hash.rehash(memory);
+
+	auto empty = hash.value();
+
+	hash.update(10, memory[10], 0x42);
+	memory[10] = 0x42;
+	CHECK(hash.value() != empty);
+
+	auto full = nesem::NesMemoryHash(nesem::NesHashedMemory::ram);
+	full.rehash(memory);
+	CHECK(full.value() == hash.value());
+
+	hash.update(10, memory[10], 0);
+	memory[10] = 0;
+	CHECK(hash.value() == empty);
+
+	SECTION("The same bytes in different memory hash differently")
+	{
+		auto other = nesem::NesMemoryHash(nesem::NesHashedMemory::prg_ram);
+		other.rehash(memory);
+		CHECK(other.value() != empty);
+	}
+}
+
+TEST_CASE("State hash tracks the whole system", "[nes_state_hash][nestest.nes]")
+{
+	auto input = nesem::U8{0};
+	auto nes = make_nes([&input] { return input; });
+	auto other = make_nes([&input] { return input; });
+
+	if (!nes.load_rom(find_path("data/nestest.nes")) || !other.load_rom(find_path("data/nestest.nes")))
+		SKIP("Could not load nestest.nes");
+
+	CHECK(nes.state_hash() != 0);
+	CHECK(nes.state_hash() == other.state_hash());
+
+	auto last_hash = nes.state_hash();
+	for (int i = 0; i < 60; ++i)
+	{
+		// move around the menu so ram and the nametables change
+		input = (i / 5) % 2 == 0 ? nesem::U8{0x24} : nesem::U8{0};
+
+		nes.step(nesem::NesClockStep::OneFrame);
+		other.step(nesem::NesClockStep::OneFrame);
+
+		CHECK(nes.state_hash() != last_hash);
+		last_hash = nes.state_hash();
+	}
+
+	CHECK(nes.state_hash() == other.state_hash());
+
+	SECTION("The hash kept up to date as memory is written matches hashing everything from scratch")
+	{
+		auto fresh = make_nes([&input] { return input; });
+		REQUIRE(fresh.load_rom(find_path("data/nestest.nes")));
+		REQUIRE(fresh.load_state(save(nes)));
+
+		CHECK(fresh.state_hash() == nes.state_hash());
+	}
+
+	SECTION("Different input gives a different hash")
+	{
+		for (int i = 0; i < 20; ++i)
+		{
+			input = (i / 5) % 2 == 0 ? nesem::U8{0x24} : nesem::U8{0};
+			nes.step(nesem::NesClockStep::OneFrame);
+
+			input = 0;
+			other.step(nesem::NesClockStep::OneFrame);
+		}
+
+		CHECK(nes.state_hash() != other.state_hash());
+	}
+
+	SECTION("Restoring a fork restores its hash")
+	{
+		auto fork = nes.fork();
+		auto hash = nes.state_hash();
+
+		for (int i = 0; i < 10; ++i)
+			nes.step(nesem::NesClockStep::OneFrame);
+
+		REQUIRE(nes.restore(fork));
+		CHECK(nes.state_hash() == hash);
+
+		REQUIRE(other.restore(fork));
+		CHECK(other.state_hash() == hash);
+	}
+}